@@ -62,8 +62,36 @@ typedef enum {
     NN_TRAIN_BPM = 1,   /*back-propagation with momentum*/
     NN_TRAIN_CG  = 2,   /*conjugate gradients*/
     NN_TRAIN_SPLX =3,   /*simplex optimization*/
+    NN_TRAIN_ADAM =4,   /*back-propagation with ADAM update*/
+    NN_TRAIN_RMSPROP=5, /*back-propagation with RMSPROP update*/
+    NN_TRAIN_LM  = 6,   /*Levenberg-Marquardt*/
     NN_TRAIN_UKN =-1,   /*unknown*/
 } nn_train;
+typedef enum {
+    NN_ORDER_SHUFFLE = 0,   /*random order (reproducible for seed/epoch)*/
+    NN_ORDER_INODE   = 1,   /*inode order (file system locality)*/
+} nn_order;
+typedef enum {
+    NN_PRUNE_NORM     = 0,  /*outgoing weight norm*/
+    NN_PRUNE_VARIANCE = 1,  /*activation variance over training samples*/
+} nn_prune;
+typedef enum {
+    NN_PAR_LAYER   = 0, /*layers are split over threads/tasks (default)*/
+    NN_PAR_HOGWILD = 1, /*threads train different samples, lock-free (BP)*/
+    NN_PAR_LOCAL   = 2, /*threads and tasks train replicas, averaged (BP)*/
+} nn_par;
+typedef enum {
+    NN_COMP_NONE = 0,   /*MPI tasks exchange their DOUBLE weights (default)*/
+    NN_COMP_FP32 = 1,   /*MPI tasks exchange updates, as float*/
+    NN_COMP_FP16 = 2,   /*MPI tasks exchange updates, as scaled half*/
+    NN_COMP_TOPK = 3,   /*MPI tasks exchange only their largest updates*/
+} nn_comp;
+typedef enum {
+    NN_STOP_NONE  = 0,  /*sample converged*/
+    NN_STOP_ITER  = 1,  /*iteration budget exhausted*/
+    NN_STOP_TIME  = 2,  /*wall-time budget exhausted*/
+    NN_STOP_STALL = 3,  /*error no longer improves (patience)*/
+} nn_stop;
 #define BP_LEARN_RATE 0.001
 #define MIN_BP_ITER 31
 #define MAX_BP_ITER 102399
@@ -72,6 +100,83 @@ typedef enum {
 #define MIN_BPM_ITER 15
 #define MAX_BPM_ITER 102399
 #define DELTA_BPM 1E-6
+#define ADAM_LEARN_RATE 0.001
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define RMSPROP_LEARN_RATE 0.001
+#define RMSPROP_RHO 0.9
+#define ADAPT_EPSILON 1E-8
+#define MIN_ADAPT_ITER 15
+#define MAX_ADAPT_ITER 102399
+#define DELTA_ADAPT 1E-6
+#define MIN_CG_ITER 3
+#define MAX_CG_ITER 1023
+#define DELTA_CG 1E-6
+#define MIN_LM_ITER 3
+#define MAX_LM_ITER 255
+#define DELTA_LM 1E-6
+#define MAX_SPLX_ITER 1023
+#define NN_LOADERS 1
+#define NN_PREFETCH 8
+#define NN_HOGWILD_BATCH 16 /*default hogwild samples per thread and batch*/
+#define NN_COMP_RATIO 0.01  /*default fraction of updates sent by topk*/
+#define NN_CONV_MIN_REL 1E-3 /*default relative improvement (patience)*/
+/*-------------------------------------*/
+/*+++ per-sample convergence policy +++*/
+/*-------------------------------------*/
+typedef struct {
+    UINT  max_iter;     /*iterations per sample (0: MAX_BP(M)_ITER)*/
+    DOUBLE max_time;    /*wall-time per sample in seconds (0: none)*/
+    UINT  patience;     /*iterations without improvement (0: none)*/
+    DOUBLE min_rel;     /*relative error decrease counted as improvement*/
+    BOOL     defer;     /*retrain stopped samples at the end of the pass*/
+    UINT   n_check;     /*error checked every n_check iterations (0,1: all)*/
+} nn_conv;
+typedef struct {
+    UINT n_samples;     /*number of samples trained (retries excluded)*/
+    UINT n_stop[NN_STOP_STALL+1];/*number of samples per stop reason*/
+    UINT n_deferred;    /*number of samples deferred*/
+    UINT n_recovered;   /*number of deferred samples that converged*/
+    UINT64  n_iter;     /*total number of iterations*/
+    DOUBLE t_train;     /*total wall-time, retries included (s)*/
+    DOUBLE  t_stop;     /*wall-time spent on stopped samples (s)*/
+    nn_stop   last;     /*stop reason of the last sample*/
+} nn_conv_stats;
+/*--------------------------------*/
+/*+++ predictor/corrector data +++*/
+/*--------------------------------*/
+typedef struct {
+    UINT n_in;          /*prediction input size*/
+    UINT n_out;         /*prediction output size*/
+    DOUBLE *in;         /*last prediction input*/
+    DOUBLE *out;        /*last prediction output*/
+    UINT n_samples;     /*number of samples in training queue*/
+    UINT max_samples;   /*training queue capacity*/
+    DOUBLE **q_in;      /*training queue inputs*/
+    DOUBLE **q_out;     /*training queue (corrected) outputs*/
+} nn_pc;
+/*--------------------------------*/
+/*+++ binary (IDX/raw) dataset +++*/
+/*--------------------------------*/
+typedef enum {
+    NN_DATA_U8  = 0,    /*unsigned char*/
+    NN_DATA_F32 = 1,    /*float*/
+    NN_DATA_F64 = 2,    /*double*/
+} nn_data_type;
+typedef struct {
+    nn_data_type type;  /*element type*/
+    UINT    n_rows;     /*number of samples*/
+    UINT    n_cols;     /*number of elements per sample*/
+    void     *data;     /*elements (in host byte order)*/
+} nn_matrix;
+typedef struct {
+    CHAR     *f_in;     /*input filename*/
+    CHAR    *f_out;     /*output (or label) filename*/
+    nn_matrix   in;     /*inputs*/
+    nn_matrix  out;     /*outputs, or labels when n_classes>0*/
+    UINT n_classes;     /*number of classes (labels are one-hot encoded)*/
+    DOUBLE   scale;     /*input normalization factor*/
+} nn_dataset;
 /*-----------------------------*/
 /*+++ NN definition handler +++*/
 /*-----------------------------*/
@@ -86,6 +191,28 @@ typedef struct {
     nn_train train;     /*training type*/
     CHAR  *samples;     /*samples directory (for training)*/
     CHAR    *tests;     /*tests directory (for validation)*/
+    nn_dataset *samples_ds; /*samples dataset (replaces samples directory)*/
+    nn_dataset   *tests_ds; /*tests dataset (replaces tests directory)*/
+    nn_pc       pc;     /*predictor/corrector data*/
+    CHAR  *f_chkpt;     /*checkpoint filename (for training)*/
+    UINT   n_chkpt;     /*checkpoint every n_chkpt samples (0: never)*/
+    UINT   t_chkpt;     /*checkpoint every t_chkpt seconds (0: never)*/
+    UINT n_loaders;     /*number of sample loader threads (0: none)*/
+    UINT n_prefetch;    /*number of samples prefetched by loaders*/
+    nn_order order;     /*order in which samples are processed*/
+    UINT     epoch;     /*number of training passes done (for shuffle)*/
+    CHAR *f_teacher;    /*teacher kernel filename (distillation)*/
+    DOUBLE  t_temp;     /*teacher softmax temperature (SNN)*/
+    DOUBLE  *t_out;     /*cached teacher outputs (per sample)*/
+    UINT       t_n;     /*number of cached teacher outputs*/
+    UINT   n_batch;     /*samples per CG/LM/SPLX/hogwild batch (0,1: default)*/
+    nn_par     par;     /*how training is parallelized*/
+    UINT   n_local;     /*local SGD samples between averages (0: adaptive)*/
+    UINT   k_local;     /*current local SGD period*/
+    nn_comp   comp;     /*compression of the MPI weight sync*/
+    DOUBLE comp_ratio;  /*fraction of updates sent (topk)*/
+    nn_conv   conv;     /*per-sample convergence policy (BP/BPM)*/
+    nn_conv_stats conv_stats;/*convergence statistics of the last pass*/
 } nn_def;
 /*------------------*/
 /*+++ NN methods +++*/
@@ -120,6 +247,10 @@ typedef struct {
     _OUT((_file), __VA_ARGS__);\
 }while(0)
 #define NN_WRITE _OUT
+/*fast version of GET_DOUBLE (see _NN(parse,double))*/
+#define NN_GET_DOUBLE(d,in,out) do{\
+    d=_NN(parse,double)(in,&(out));\
+}while(0)
 /*--------------------------*/
 /*+++ initialize library +++*/
 /*--------------------------*/
@@ -188,6 +319,29 @@ char *_NN(return,samples_directory)(nn_def *conf);
 void _NN(set,tests_directory)(nn_def *conf,CHAR *tests);
 void _NN(get,tests_directory)(nn_def *conf,CHAR **tests);
 char *_NN(return,tests_directory)(nn_def *conf);
+void _NN(set,checkpoint)(nn_def *conf,const CHAR *f_chkpt,
+                         UINT n_samples,UINT n_seconds);
+void _NN(get,checkpoint)(nn_def *conf,CHAR **f_chkpt,
+                         UINT *n_samples,UINT *n_seconds);
+void _NN(set,loader)(nn_def *conf,UINT n_loaders,UINT n_prefetch);
+void _NN(get,loader)(nn_def *conf,UINT *n_loaders,UINT *n_prefetch);
+void _NN(set,order)(nn_def *conf,nn_order order);
+void _NN(get,order)(nn_def *conf,nn_order *order);
+void _NN(set,epoch)(nn_def *conf,UINT epoch);
+void _NN(get,epoch)(nn_def *conf,UINT *epoch);
+void _NN(set,teacher)(nn_def *conf,const CHAR *f_teacher,DOUBLE temperature);
+void _NN(get,teacher)(nn_def *conf,CHAR **f_teacher,DOUBLE *temperature);
+void _NN(set,batch)(nn_def *conf,UINT n_batch);
+void _NN(get,batch)(nn_def *conf,UINT *n_batch);
+void _NN(set,parallel)(nn_def *conf,nn_par par);
+void _NN(get,parallel)(nn_def *conf,nn_par *par);
+void _NN(set,local)(nn_def *conf,UINT n_local);
+void _NN(get,local)(nn_def *conf,UINT *n_local);
+void _NN(set,compress)(nn_def *conf,nn_comp comp,DOUBLE ratio);
+void _NN(get,compress)(nn_def *conf,nn_comp *comp,DOUBLE *ratio);
+void _NN(set,conv)(nn_def *conf,const nn_conv *conv);
+void _NN(get,conv)(nn_def *conf,nn_conv *conv);
+void _NN(get,conv_stats)(nn_def *conf,nn_conv_stats *stats);
 nn_def *_NN(load,conf)(const CHAR *filename);
 void _NN(dump,conf)(nn_def *conf,FILE *fp);
 /*----------------------------*/
@@ -204,15 +358,47 @@ UINT _NN(get,n_inputs)(nn_def *conf);
 UINT _NN(get,n_hiddens)(nn_def *conf);
 UINT _NN(get,n_outputs)(nn_def *conf);
 UINT _NN(get,h_neurons)(nn_def *conf,UINT layer);
+BOOL _NN(set,activation)(nn_def *conf,UINT layer,const CHAR *name);
+const CHAR *_NN(get,activation)(nn_def *conf,UINT layer);
+BOOL _NN(set,bias)(nn_def *conf,BOOL is_bias);
+BOOL _NN(get,bias)(nn_def *conf);
 /*------------------*/
 /*+++ sample I/O +++*/
 /*------------------*/
+DOUBLE _NN(parse,double)(const CHAR *in,CHAR **out);
 BOOL _NN(read,sample)(CHAR *filename,DOUBLE **in,DOUBLE **out);
+BOOL _NN(read,idx)(const CHAR *filename,nn_matrix *m);
+BOOL _NN(read,raw)(const CHAR *filename,nn_data_type type,UINT n_cols,
+                   nn_matrix *m);
+void _NN(free,matrix)(nn_matrix *m);
+nn_dataset *_NN(open,idx)(const CHAR *f_in,const CHAR *f_out,
+                          UINT n_classes,DOUBLE scale);
+nn_dataset *_NN(open,raw)(const CHAR *f_in,nn_data_type t_in,UINT n_in,
+                          const CHAR *f_out,nn_data_type t_out,UINT n_out,
+                          UINT n_classes,DOUBLE scale);
+void _NN(close,dataset)(nn_dataset *ds);
+UINT _NN(get,dataset_size)(nn_dataset *ds);
+BOOL _NN(get,dataset_sample)(nn_dataset *ds,UINT index,DOUBLE *in,DOUBLE *out);
+void _NN(set,samples_dataset)(nn_def *conf,nn_dataset *ds);
+void _NN(set,tests_dataset)(nn_def *conf,nn_dataset *ds);
+UINT _NN(read,tests)(nn_def *conf,DOUBLE **in,DOUBLE **out);
 /*---------------------*/
 /*+++ execute NN OP +++*/
 /*---------------------*/
 BOOL _NN(train,kernel)(nn_def *conf);
 void _NN(run,kernel)(nn_def *conf);
+BOOL _NN(prune,kernel)(nn_def *conf,nn_prune criterion,
+                       UINT layer,UINT n_remove);
+UINT _NN(lowrank,kernel)(nn_def *conf,UINT layer,DOUBLE energy,
+                         UINT max_rank,DOUBLE *kept);
+/*-----------------------------*/
+/*+++ predictor / corrector +++*/
+/*-----------------------------*/
+DOUBLE _NN(predict,kernel)(nn_def *conf,const DOUBLE *in,DOUBLE *out);
+DOUBLE _NN(correct,kernel)(nn_def *conf,const DOUBLE *result,DOUBLE threshold);
+UINT _NN(get,n_queued)(nn_def *conf);
+DOUBLE _NN(train,queue)(nn_def *conf);
+void _NN(flush,queue)(nn_def *conf);
 
 
 #endif/*LIBHPNN_H*/
@@ -26,17 +26,101 @@
 #define ANN_UNROLL 4
 #endif /*ANN_UNROLL*/
 
+#ifndef ANN_INC_REFRESH
+#define ANN_INC_REFRESH 256 /*full recalculation period (incremental run)*/
+#endif /*ANN_INC_REFRESH*/
+
+#ifndef ANN_SPARSE_RATIO
+#define ANN_SPARSE_RATIO 8 /*sparse 1st layer if nonzero inputs <= 1/ratio*/
+#endif /*ANN_SPARSE_RATIO*/
+#define ANN_IS_SPARSE(n_nz,M) \
+    ((ANN_SPARSE_RATIO>0)&&(((n_nz)*ANN_SPARSE_RATIO)<=(M)))
+
+#ifndef ANN_LOWRANK_ITER
+#define ANN_LOWRANK_ITER 64 /*max QL iterations per eigenvalue (low-rank)*/
+#endif /*ANN_LOWRANK_ITER*/
+
+#ifndef ANN_CG_STEP
+#define ANN_CG_STEP 0.01 /*length of the first CG line search step*/
+#endif /*ANN_CG_STEP*/
+#ifndef ANN_CG_MAX
+#define ANN_CG_MAX 0.2 /*max length of a CG step*/
+#endif /*ANN_CG_MAX*/
+#ifndef ANN_CG_LS
+#define ANN_CG_LS 16 /*max step halvings in a CG line search*/
+#endif /*ANN_CG_LS*/
+
+#ifndef ANN_LM_LAMBDA
+#define ANN_LM_LAMBDA 1E-3 /*initial LM damping (x max diag of J^T.J)*/
+#endif /*ANN_LM_LAMBDA*/
+#ifndef ANN_LM_ADAPT
+#define ANN_LM_ADAPT 10. /*LM damping decrease/increase factor*/
+#endif /*ANN_LM_ADAPT*/
+#ifndef ANN_LM_STEP
+#define ANN_LM_STEP 0.2 /*max length of a LM step (m<n_par)*/
+#endif /*ANN_LM_STEP*/
+#ifndef ANN_LM_FAIL
+#define ANN_LM_FAIL 10 /*max rejected LM steps in a row*/
+#endif /*ANN_LM_FAIL*/
+#ifndef ANN_LM_MAX
+#define ANN_LM_MAX 4096 /*max parameters for LM (J^T.J is n^2)*/
+#endif /*ANN_LM_MAX*/
+#ifndef ANN_SPLX_STEP
+#define ANN_SPLX_STEP 0.05 /*edge length of a new SPLX simplex*/
+#endif /*ANN_SPLX_STEP*/
+#ifndef ANN_SPLX_TOL
+#define ANN_SPLX_TOL 1E-4 /*SPLX simplex is converged below that edge*/
+#endif /*ANN_SPLX_TOL*/
+#ifndef ANN_SPLX_START
+#define ANN_SPLX_START 4 /*max SPLX (re)starts*/
+#endif /*ANN_SPLX_START*/
+#ifndef ANN_SPLX_MAX
+#define ANN_SPLX_MAX 4096 /*max parameters for SPLX (simplex is n^2)*/
+#endif /*ANN_SPLX_MAX*/
+#ifndef ANN_LOCAL_KMAX
+#define ANN_LOCAL_KMAX 64 /*max adaptive local SGD period (samples)*/
+#endif /*ANN_LOCAL_KMAX*/
+#ifndef ANN_LOCAL_DIV_LO
+#define ANN_LOCAL_DIV_LO 0.01 /*replicas spread to double the period*/
+#endif /*ANN_LOCAL_DIV_LO*/
+#ifndef ANN_LOCAL_DIV_HI
+#define ANN_LOCAL_DIV_HI 0.05 /*replicas spread to halve the period*/
+#endif /*ANN_LOCAL_DIV_HI*/
+
+#ifndef ANN_LRELU_SLOPE
+#define ANN_LRELU_SLOPE 0.01 /*slope of leaky ReLU for x<0*/
+#endif /*ANN_LRELU_SLOPE*/
+
+/*bias of neuron ix of a layer (0 when the layer has no bias): the initial
+ *value of the mv accumulator, so that the bias costs no extra pass*/
+#define ANN_BIAS(lay,ix) (((lay)->bias==NULL)?0.:(lay)->bias[ix])
+
 #define DBG_TRACE(array,N) do{\
     acc=0.;\
     for(rdx=0;rdx<(N);rdx++) acc+=(array)[rdx];\
     fprintf(stdout,"#DBG: acc=%.15f\n",acc);\
 }while(0)
 
+typedef enum {
+    ANN_ACT_SIGMOID = 0,    /*bipolar sigmoid 2/(1+exp(-x))-1 (default)*/
+    ANN_ACT_RELU = 1,       /*max(0,x)*/
+    ANN_ACT_LRELU = 2,      /*x or ANN_LRELU_SLOPE*x for x<0*/
+    ANN_ACT_HTANH = 3,      /*min(1,max(-1,x))*/
+    ANN_ACT_UKN = -1,
+} ann_act_type;
+
 typedef struct {
     UINT n_neurons;     /*number of neurons*/
     UINT n_inputs;      /*number of inputs*/
     DOUBLE *weights;    /*weights for this layer*/
     DOUBLE *vec;        /*output of this layer*/
+    ann_act_type act;   /*activation of this layer*/
+    DOUBLE *bias;       /*bias of each neuron (NULL: no bias)*/
+    DOUBLE *dbias;      /*bias momentum (when relevant)*/
+    UINT rank;          /*rank of the U.V factorization (0: dense)*/
+    DOUBLE *u;          /*U factor (n_neurons x rank)*/
+    DOUBLE *v;          /*V factor (rank x n_inputs)*/
+    DOUBLE *uv_tmp;     /*V.input (rank)*/
 } layer_ann;
 
 typedef struct kann{
@@ -48,12 +132,33 @@ typedef struct kann{
     UINT n_outputs;     /*number of outputs*/
     layer_ann output;   /*output layer*/
     DOUBLE **dw;        /*weight momentum (when relevant)*/
+    DOUBLE **dv;        /*2nd moment of weights (ADAM, RMSPROP)*/
+    UINT n_step;        /*number of updates (ADAM bias correction)*/
     UINT max_index;     /*maximum array index*/
     DOUBLE *tmp_cpu;    /*temporary array (CPU)*/
     DOUBLE *tmp_gpu;    /*temporary array (GPU))*/
     struct kann **kerns;/*multiple allocation (when relevant)*/
+    DOUBLE *inc_sum;    /*1st layer sums (incremental run)*/
+    DOUBLE *inc_in;     /*input used for inc_sum (incremental run)*/
+    UINT inc_count;     /*incremental runs since last full one*/
+    UINT *nz_idx;       /*nonzero input indices (sparse input)*/
+    DOUBLE **dc;        /*compressed update residual (MPI weight sync)*/
 } kernel_ann;
 
+/*forward, error and delta routines used by CG and LM (ANN or SNN)*/
+typedef struct {
+    void (*run)(kernel_ann *kernel);
+    DOUBLE (*error)(kernel_ann *kernel,const DOUBLE *train);
+    void (*delta)(kernel_ann *kernel,const DOUBLE *train,DOUBLE **delta_ptr);
+} ann_cg_ops;
+
+/*per-sample convergence state (see nn_conv)*/
+typedef struct {
+    DOUBLE t_start;     /*wall-time at which the sample started*/
+    DOUBLE    best;     /*best error so far*/
+    UINT    i_best;     /*iteration of the last improvement*/
+} ann_conv;
+
 /*functions*/
 BOOL ann_kernel_free(kernel_ann *kernel);
 BOOL ann_kernel_allocate(kernel_ann *kernel,UINT n_inputs,UINT n_hiddens,
@@ -62,18 +167,95 @@ kernel_ann *ann_load(CHAR *f_kernel);
 kernel_ann *ann_generate(UINT *seed,UINT n_inputs,UINT n_hiddens,
                          UINT n_outputs,UINT *hiddens);
 void ann_dump(kernel_ann *kernel,FILE *out);
+kernel_ann *ann_kernel_stage(kernel_ann *kernel,kernel_ann *stage);
+void ann_stage_free(kernel_ann *stage);
+BOOL ann_dump_file(kernel_ann *stage,const CHAR *filename);
+void ann_neuron_norm(kernel_ann *kernel,UINT layer,DOUBLE *score);
+kernel_ann *ann_prune(kernel_ann *kernel,UINT layer,UINT n_remove,
+                      const DOUBLE *score);
+UINT ann_lowrank(kernel_ann *kernel,UINT layer,DOUBLE energy,UINT max_rank,
+                 DOUBLE *kept);
+void ann_lowrank_drop(kernel_ann *kernel);
 BOOL ann_validate_kernel(kernel_ann *kernel);
 DOUBLE ann_act(DOUBLE x);
 DOUBLE ann_dact(DOUBLE y);
+ann_act_type ann_act_parse(const CHAR *str);
+const CHAR *ann_act_name(ann_act_type act);
+void ann_act_vec(ann_act_type act,DOUBLE *v,UINT n);
+void ann_act_range(layer_ann *layer,UINT from,UINT n);
+void ann_dact_range(layer_ann *layer,DOUBLE *delta,UINT from,UINT n);
+void ann_bias_alloc(kernel_ann *kernel);
+void ann_bias_free(kernel_ann *kernel);
+DOUBLE ann_bias_load(const layer_ann *layer,DOUBLE *vec,UINT from,UINT n);
+void ann_bias_train(layer_ann *layer,const DOUBLE *delta,DOUBLE rate);
+void ann_bias_momentum(layer_ann *layer,const DOUBLE *delta,
+                       DOUBLE rate,DOUBLE alpha);
+void ann_lowrank_run(layer_ann *layer,const DOUBLE *in);
+void ann_kernel_run_hiddens(kernel_ann *kernel);
+void ann_kernel_run_output(kernel_ann *kernel);
 void ann_kernel_run(kernel_ann *kernel);
-DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train);
+void ann_kernel_inc_reset(kernel_ann *kernel);
+BOOL ann_kernel_inc_input(kernel_ann *kernel,UINT n_changed,const UINT *changed);
+void ann_kernel_run_inc(kernel_ann *kernel,UINT n_changed,const UINT *changed);
+DOUBLE ann_kernel_train_error(kernel_ann *kernel,const DOUBLE *train);
+void ann_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train,
+                            DOUBLE **delta_ptr);
+void ann_comp_set(nn_comp mode,DOUBLE ratio);
+void ann_comp_stats(UINT64 *sent,UINT64 *raw);
+void ann_comp_free(kernel_ann *kernel);
+#ifdef _MPI
+void ann_comp_save(kernel_ann *kernel,UINT layer,const DOUBLE *w,UINT n);
+void ann_comp_sync(kernel_ann *kernel,UINT layer,DOUBLE *weights,UINT n);
+void ann_comp_wait();
+#endif /*_MPI*/
+DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train,DOUBLE *err);
 void ann_momentum_init(kernel_ann *kernel);
 void ann_raz_momentum(kernel_ann *kernel);
 void ann_momentum_free(kernel_ann *kernel);
 DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,
-    const DOUBLE *train,DOUBLE alpha);
-DOUBLE ann_train_BP(kernel_ann *kernel,
-    DOUBLE *train_in,DOUBLE *train_out,DOUBLE delta);
-DOUBLE ann_train_BPM(kernel_ann *kernel,
-    DOUBLE *train_in,DOUBLE *train_out,DOUBLE alpha,DOUBLE delta);
+    const DOUBLE *train,DOUBLE alpha,DOUBLE *err);
+DOUBLE ann_wtime();
+void ann_conv_init(ann_conv *cv,DOUBLE Ep);
+nn_stop ann_conv_stop(const nn_conv *conv,ann_conv *cv,
+                      UINT iter,UINT max_iter,DOUBLE Ep);
+void ann_conv_done(nn_conv_stats *stats,const ann_conv *cv,
+                   UINT iter,nn_stop stop);
+DOUBLE ann_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+    DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats);
+DOUBLE ann_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+    DOUBLE alpha,DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats);
+#ifndef _CUDA
+void ann_adapt_init(kernel_ann *kernel);
+void ann_adapt_free(kernel_ann *kernel);
+void ann_adapt_update(kernel_ann *kernel,DOUBLE **delta_ptr,nn_train rule);
+DOUBLE ann_kernel_train_adapt(kernel_ann *kernel,
+    const DOUBLE *train,nn_train rule);
+DOUBLE ann_train_adapt(kernel_ann *kernel,
+    DOUBLE *train_in,DOUBLE *train_out,nn_train rule,DOUBLE delta);
+DOUBLE ann_cg_minimize(kernel_ann *kernel,const ann_cg_ops *ops,
+                       UINT n,DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                       UINT *n_iter,UINT *n_grad);
+DOUBLE ann_train_CG(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta);
+DOUBLE ann_lm_minimize(kernel_ann *kernel,const ann_cg_ops *ops,
+                       UINT n,DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                       UINT *n_iter,UINT *n_jac);
+DOUBLE ann_train_LM(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta);
+DOUBLE ann_splx_minimize(kernel_ann *kernel,BOOL is_snn,UINT n,
+                         DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                         DOUBLE *f_init,UINT *n_iter,UINT *n_eval);
+DOUBLE ann_train_SPLX(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                      DOUBLE **train_out,DOUBLE delta);
+DOUBLE ann_hogwild_train(kernel_ann *kernel,BOOL is_snn,DOUBLE rate,UINT n,
+                         DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                         UINT *n_iter,UINT *n_ok);
+DOUBLE ann_train_hogwild(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                         DOUBLE **train_out,DOUBLE delta);
+DOUBLE ann_local_train(kernel_ann *kernel,BOOL is_snn,DOUBLE rate,UINT n,
+                       DOUBLE **in,DOUBLE **out,DOUBLE delta,UINT *k,
+                       BOOL adapt,UINT *n_iter,UINT *n_ok,UINT *n_avg);
+DOUBLE ann_train_local(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                       DOUBLE **train_out,DOUBLE delta,UINT *k,BOOL adapt);
+#endif /*_CUDA*/
 #endif /*ANN_H*/
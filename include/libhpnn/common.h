@@ -24,6 +24,7 @@
 #include <glib/gstdio.h>
 #else
 #include <unistd.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <sys/types.h>
@@ -23,14 +23,32 @@
 /*SNN (= ANN + SOFTMAX) uses the same _kernel type as ANN*/
 
 /*functions*/
+void snn_kernel_run_output(kernel_ann *kernel);
 void snn_kernel_run(kernel_ann *kernel);
-DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train);
+void snn_kernel_run_inc(kernel_ann *kernel,UINT n_changed,const UINT *changed);
+DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train,DOUBLE *err);
 DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,
-    const DOUBLE *train,DOUBLE alpha);
-DOUBLE snn_train_BP(kernel_ann *kernel,
-    DOUBLE *train_in,DOUBLE *train_out,DOUBLE delta);
-DOUBLE snn_train_BPM(kernel_ann *kernel,
-    DOUBLE *train_in,DOUBLE *train_out,DOUBLE alpha,DOUBLE delta);
+    const DOUBLE *train,DOUBLE alpha,DOUBLE *err);
+DOUBLE snn_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+    DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats);
+DOUBLE snn_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+    DOUBLE alpha,DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats);
+#ifndef _CUDA
+DOUBLE snn_kernel_train_adapt(kernel_ann *kernel,
+    const DOUBLE *train,nn_train rule);
+DOUBLE snn_train_adapt(kernel_ann *kernel,
+    DOUBLE *train_in,DOUBLE *train_out,nn_train rule,DOUBLE delta);
+DOUBLE snn_train_CG(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta);
+DOUBLE snn_train_LM(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta);
+DOUBLE snn_train_SPLX(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                      DOUBLE **train_out,DOUBLE delta);
+DOUBLE snn_train_hogwild(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                         DOUBLE **train_out,DOUBLE delta);
+DOUBLE snn_train_local(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                       DOUBLE **train_out,DOUBLE delta,UINT *k,BOOL adapt);
+#endif /*_CUDA*/
 
 
 
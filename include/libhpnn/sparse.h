@@ -0,0 +1,66 @@
+/*
++++ libhpnn - High Performance Neural Network library - file: sparse.h +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This file is part of libhpnn.
+
+    libhpnn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libhpnn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef SPARSE_H
+#define SPARSE_H
+
+/*sparse (pruned) kernels: inference only, on CPU*/
+
+#define SPARSE_MAGIC "HPNNSPK1"     /*binary kernel file signature*/
+#define SPARSE_ENDIAN 0x01020304    /*binary kernel endianness check*/
+
+/* Each row of a layer is stored as a list of blocks of 'block' consecutive
+ * weights, starting at column col_idx[k] (a multiple of block), values in
+ * val[k*block] to val[k*block+block-1], for k=row_ptr[row]..row_ptr[row+1]-1.
+ * block=1 is the plain CSR format, larger blocks trade some stored zeros
+ * for a SIMD friendly inner loop.  Layer inputs and outputs (vec) are
+ * padded with zeros to a multiple of block.*/
+typedef struct {
+    UINT n_neurons;     /*number of neurons*/
+    UINT n_inputs;      /*number of inputs*/
+    UINT n_blk;         /*number of stored blocks*/
+    UINT *row_ptr;      /*1st block of each row (n_neurons+1)*/
+    UINT *col_idx;      /*1st column of each block*/
+    DOUBLE *val;        /*block values (n_blk*block)*/
+    DOUBLE *vec;        /*output of this layer (padded)*/
+    ann_act_type act;   /*activation of this layer*/
+    DOUBLE *bias;       /*bias of each neuron (NULL: none)*/
+} layer_sparse;
+
+typedef struct {
+    CHAR *name;         /*ANN name*/
+    UINT block;         /*block size (1 for CSR)*/
+    UINT n_inputs;      /*number of inputs*/
+    DOUBLE *in;         /*input array (padded)*/
+    UINT n_hiddens;     /*number of hidden layers*/
+    layer_sparse *hiddens; /*hidden layers*/
+    UINT n_outputs;     /*number of outputs*/
+    layer_sparse output;/*output layer*/
+} kernel_sparse;
+
+/*functions*/
+kernel_sparse *sparse_convert(kernel_ann *kernel,DOUBLE threshold,UINT block);
+void sparse_free(kernel_sparse *sparse);
+BOOL sparse_dump(kernel_sparse *sparse,const CHAR *filename);
+kernel_sparse *sparse_load(const CHAR *filename);
+DOUBLE sparse_density(kernel_sparse *sparse);
+void sparse_ann_run(kernel_sparse *sparse);
+void sparse_snn_run(kernel_sparse *sparse);
+
+#endif /*SPARSE_H*/
@@ -19,6 +19,8 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <math.h>
@@ -79,6 +81,9 @@ BOOL ann_kernel_free(kernel_ann *kernel){
     if(kernel==NULL) return FALSE;
 #ifdef   _CUDA
     scuda_ann_deallocate(kernel,_NN(return,cudas)());
+    if(KERN.hiddens!=NULL)
+        for(idx=0;idx<KERN.n_hiddens;idx++) FREE(KERN.hiddens[idx].bias);
+    FREE(KERN.output.bias);
     FREE(KERN.hiddens);
     FREE(KERN.kerns);
     scuda_ann_free_momentum(kernel,_NN(return,cudas)());
@@ -86,12 +91,17 @@ BOOL ann_kernel_free(kernel_ann *kernel){
 #else  /*_CUDA*/
     FREE(KERN.name);
     FREE(KERN.in);
+    ann_lowrank_drop(kernel);
     FREE(KERN.output.weights);
     FREE(KERN.output.vec);
+    FREE(KERN.output.bias);
+    FREE(KERN.output.dbias);
     if(KERN.hiddens!=NULL){
         for(idx=0;idx<KERN.n_hiddens;idx++){
             FREE(KERN.hiddens[idx].weights);
             FREE(KERN.hiddens[idx].vec);
+            FREE(KERN.hiddens[idx].bias);
+            FREE(KERN.hiddens[idx].dbias);
         }
         FREE(KERN.hiddens);
     }
@@ -100,6 +110,10 @@ BOOL ann_kernel_free(kernel_ann *kernel){
         FREE(KERN.dw);
     }
     FREE(KERN.tmp_cpu);
+    FREE(KERN.inc_sum);
+    FREE(KERN.inc_in);
+    FREE(KERN.nz_idx);
+    ann_comp_free(kernel);
 #endif /*_CUDA*/
     KERN.n_inputs=0;
     KERN.n_hiddens=0;
@@ -140,6 +154,9 @@ BOOL ann_kernel_allocate(kernel_ann *kernel,UINT n_inputs,UINT n_hiddens,
         KERN.hiddens[idx].n_inputs=h_neurons[idx-1];
         KERN.hiddens[idx].n_neurons=h_neurons[idx];
     }
+    /*default activation is sigmoid*/
+    for(idx=0;idx<n_hiddens;idx++) KERN.hiddens[idx].act=ANN_ACT_SIGMOID;
+    KERN.output.act=ANN_ACT_SIGMOID;
     /*allocate temporary CPU array*/
     ALLOC_REPORT(KERN.tmp_cpu,KERN.max_index,DOUBLE,allocate);
 #ifndef  _CUDA
@@ -203,6 +220,127 @@ if(n_gpu>1){
 /*---------------------------------*/
 /*+++ load ANN kernel from file +++*/
 /*---------------------------------*/
+/*^^^ private: read n_rows neurons of n_cols weights each into w*/
+static BOOL ann_load_rows(FILE *fp,UINT n_rows,UINT n_cols,DOUBLE *w){
+#define FAIL load_rows_fail
+    PREP_READLINE();
+    CHAR *line=NULL;
+    CHAR *ptr,*ptr2;
+    UINT jdx,kdx,n_par;
+    for(jdx=0;jdx<n_rows;jdx++){
+        READLINE(fp,line);
+        ptr=STRFIND("[neuron",line);
+        if(ptr==NULL) goto FAIL;
+        while(!(ISDIGIT(*ptr))&&(*ptr!='\n')&&(*ptr!='\0')) ptr++;
+        if(!ISDIGIT(*ptr)) goto FAIL;
+        GET_UINT(n_par,ptr,ptr2);/*this is neuron number*/
+        ptr=ptr2+1;SKIP_BLANK(ptr);
+        if(!ISDIGIT(*ptr)) goto FAIL;
+        GET_UINT(n_par,ptr,ptr2);/*this is number of inputs*/
+        if(n_par!=n_cols) goto FAIL;
+        READLINE(fp,line);/*weights line*/
+        ptr=&(line[0]);SKIP_BLANK(ptr);
+        for(kdx=0;kdx<n_cols;kdx++){
+            NN_GET_DOUBLE(w[_2D_IDX(n_cols,jdx,kdx)],ptr,ptr2);
+            if((ptr2==NULL)||(ptr2==ptr)) goto FAIL;
+            ptr=ptr2;SKIP_BLANK(ptr);
+        }
+    }
+    FREE(line);
+    return TRUE;
+load_rows_fail:
+    FREE(line);
+    return FALSE;
+#undef FAIL
+}
+#ifndef _CUDA
+/*^^^ private: read the (optional) low-rank factors of each [lowrank X] R
+ * section, X being the layer (n_hiddens+1 is the output), of rank R: its
+ * n_neurons rows of U, then the R rows of V, written as neurons.*/
+static BOOL ann_load_lowrank(FILE *fp,kernel_ann *kernel){
+#define FAIL load_lowrank_fail
+    PREP_READLINE();
+    CHAR *line=NULL;
+    CHAR *ptr,*ptr2;
+    layer_ann *lay;
+    UINT idx,rank;
+    rewind(fp);
+    READLINE(fp,line);
+    while(!feof(fp)){
+        ptr=STRFIND("[lowrank",line);
+        if(ptr!=NULL){
+            while(!(ISDIGIT(*ptr))&&(*ptr!='\n')&&(*ptr!='\0')) ptr++;
+            if(!ISDIGIT(*ptr)) goto FAIL;
+            GET_UINT(idx,ptr,ptr2);/*this is the layer*/
+            ptr=ptr2;
+            while(!(ISDIGIT(*ptr))&&(*ptr!='\n')&&(*ptr!='\0')) ptr++;
+            if(!ISDIGIT(*ptr)) goto FAIL;
+            GET_UINT(rank,ptr,ptr2);
+            if((idx<1)||(idx>KERN.n_hiddens+1)) goto FAIL;
+            if(idx<=KERN.n_hiddens) lay=&(KERN.hiddens[idx-1]);
+            else lay=&(KERN.output);
+            if((rank<1)||(rank>lay->n_neurons)||(rank>lay->n_inputs))
+                goto FAIL;
+            FREE(lay->u);
+            FREE(lay->v);
+            FREE(lay->uv_tmp);
+            ALLOC(lay->u,lay->n_neurons*rank,DOUBLE);
+            ALLOC(lay->v,rank*lay->n_inputs,DOUBLE);
+            ALLOC(lay->uv_tmp,rank,DOUBLE);
+            lay->rank=rank;
+            if(!ann_load_rows(fp,lay->n_neurons,rank,lay->u)) goto FAIL;
+            if(!ann_load_rows(fp,rank,lay->n_inputs,lay->v)) goto FAIL;
+        }
+        READLINE(fp,line);
+    }
+    FREE(line);
+    return TRUE;
+load_lowrank_fail:
+    NN_ERROR(stderr,"kernel read: malformed low-rank layer definition!\n");
+    ann_lowrank_drop(kernel);
+    FREE(line);
+    return FALSE;
+#undef FAIL
+}
+#endif /*_CUDA*/
+/*^^^ private: read the (optional) [bias X] N sections, X being the layer
+ * (n_hiddens+1 is the output), written as a single neuron of N inputs.*/
+static BOOL ann_load_bias(FILE *fp,kernel_ann *kernel){
+#define FAIL load_bias_fail
+    PREP_READLINE();
+    CHAR *line=NULL;
+    CHAR *ptr,*ptr2;
+    layer_ann *lay;
+    UINT idx,n_par;
+    rewind(fp);
+    READLINE(fp,line);
+    while(!feof(fp)){
+        ptr=STRFIND("[bias",line);
+        if(ptr!=NULL){
+            while(!(ISDIGIT(*ptr))&&(*ptr!='\n')&&(*ptr!='\0')) ptr++;
+            if(!ISDIGIT(*ptr)) goto FAIL;
+            GET_UINT(idx,ptr,ptr2);/*this is the layer*/
+            ptr=ptr2;
+            while(!(ISDIGIT(*ptr))&&(*ptr!='\n')&&(*ptr!='\0')) ptr++;
+            if(!ISDIGIT(*ptr)) goto FAIL;
+            GET_UINT(n_par,ptr,ptr2);
+            if((idx<1)||(idx>KERN.n_hiddens+1)) goto FAIL;
+            if(idx<=KERN.n_hiddens) lay=&(KERN.hiddens[idx-1]);
+            else lay=&(KERN.output);
+            if(n_par!=lay->n_neurons) goto FAIL;
+            if(lay->bias==NULL) ALLOC(lay->bias,lay->n_neurons,DOUBLE);
+            if(!ann_load_rows(fp,1,n_par,lay->bias)) goto FAIL;
+        }
+        READLINE(fp,line);
+    }
+    FREE(line);
+    return TRUE;
+load_bias_fail:
+    NN_ERROR(stderr,"kernel read: malformed bias definition!\n");
+    FREE(line);
+    return FALSE;
+#undef FAIL
+}
 kernel_ann *ann_load(CHAR *f_kernel){
 #define FAIL load_kernel_fail
     PREP_READLINE();
@@ -380,6 +518,13 @@ if(stream==0) {
                     idx+1,jdx,KERN.hiddens[idx].n_neurons);
                 goto FAIL;
             }
+            /*optional activation keyword*/
+            KERN.hiddens[idx].act=ann_act_parse(ptr2);
+            if(KERN.hiddens[idx].act==ANN_ACT_UKN){
+                NN_ERROR(stderr,"kernel read: unknown activation!\n");
+                NN_ERROR(stderr,"-> hidden layer %i\n",idx+1);
+                goto FAIL;
+            }
 /*now let's fetch neurons*/
 READLINE(fp,line);
 jdx=0;
@@ -438,7 +583,7 @@ do{
     ptr=&(line[0]);SKIP_BLANK(ptr);
     for(kdx=0;kdx<n_par;kdx++){
         /*read weights*/
-        GET_DOUBLE(w_ptr[_2D_IDX(n_par,jdx,kdx)],ptr,ptr2);
+        NN_GET_DOUBLE(w_ptr[_2D_IDX(n_par,jdx,kdx)],ptr,ptr2);
         ASSERT_GOTO(ptr2,FAIL);
         ptr=ptr2+1;SKIP_BLANK(ptr);
     }
@@ -475,6 +620,12 @@ do{
                     idx,KERN.output.n_neurons);
                 goto FAIL;
             }
+            /*optional activation keyword*/
+            KERN.output.act=ann_act_parse(ptr2);
+            if(KERN.output.act==ANN_ACT_UKN){
+                NN_ERROR(stderr,"kernel read: unknown output activation!\n");
+                goto FAIL;
+            }
 /*now let's fetch neurons*/
 READLINE(fp,line);
 jdx=0;
@@ -525,7 +676,7 @@ do{
     ptr=&(line[0]);SKIP_BLANK(ptr);
     for(kdx=0;kdx<n_par;kdx++){
         /*read weights*/
-        GET_DOUBLE(w_ptr[_2D_IDX(n_par,jdx,kdx)],ptr,ptr2);
+        NN_GET_DOUBLE(w_ptr[_2D_IDX(n_par,jdx,kdx)],ptr,ptr2);
         ASSERT_GOTO(ptr2,FAIL);
         ptr=ptr2+1;SKIP_BLANK(ptr);
     }
@@ -543,6 +694,25 @@ do{
         }
         READLINE(fp,line);
     }while(!feof(fp));
+    /*biases, if any*/
+    if(!ann_load_bias(fp,kernel)) goto FAIL;
+#ifndef  _CUDA
+    /*low-rank factors, if any*/
+    if(!ann_load_lowrank(fp,kernel)) goto FAIL;
+#else  /*_CUDA*/
+    /*GPU kernels only implement the sigmoid, without bias*/
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        layer_ann *lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        if(lay->bias!=NULL){
+            NN_ERROR(stderr,"kernel read: biases unsupported on GPU!\n");
+            goto FAIL;
+        }
+        if(lay->act==ANN_ACT_SIGMOID) continue;
+        NN_ERROR(stderr,"kernel read: %s activation unsupported on GPU!\n",
+            ann_act_name(lay->act));
+        goto FAIL;
+    }
+#endif /*_CUDA*/
     /*end*/
     FREE(line);
     fclose(fp);
@@ -612,6 +782,33 @@ MPI_Bcast(KERN.output.weights,N*M,MPI_DOUBLE,0,MPI_COMM_WORLD);
     }
     if(cudas->mem_model!=CUDA_MEM_CMM) FREE(w_ptr);
 #endif /*_CUDA*/
+/*broadcast activations and biases*/
+for(idx=0;idx<=n_hid;idx++){
+    layer_ann *lay=(idx<n_hid)?&(KERN.hiddens[idx]):&(KERN.output);
+    MPI_Bcast(&(lay->act),1,MPI_INT,0,MPI_COMM_WORLD);
+    jdx=(lay->bias!=NULL);
+    MPI_Bcast(&jdx,1,MPI_INT,0,MPI_COMM_WORLD);
+    if(jdx==0) continue;
+    if(lay->bias==NULL) ALLOC(lay->bias,lay->n_neurons,DOUBLE);
+    MPI_Bcast(lay->bias,lay->n_neurons,MPI_DOUBLE,0,MPI_COMM_WORLD);
+}
+#ifndef  _CUDA
+/*broadcast low-rank factors*/
+for(idx=0;idx<=n_hid;idx++){
+    layer_ann *lay=(idx<n_hid)?&(KERN.hiddens[idx]):&(KERN.output);
+    MPI_Bcast(&(lay->rank),1,MPI_INT,0,MPI_COMM_WORLD);
+    if(lay->rank==0) continue;
+    N=lay->n_neurons;
+    M=lay->n_inputs;
+    if(stream!=0){
+        ALLOC(lay->u,N*lay->rank,DOUBLE);
+        ALLOC(lay->v,lay->rank*M,DOUBLE);
+        ALLOC(lay->uv_tmp,lay->rank,DOUBLE);
+    }
+    MPI_Bcast(lay->u,N*lay->rank,MPI_DOUBLE,0,MPI_COMM_WORLD);
+    MPI_Bcast(lay->v,lay->rank*M,MPI_DOUBLE,0,MPI_COMM_WORLD);
+}
+#endif /*_CUDA*/
 #endif /*_MPI*/
     return kernel;
 load_kernel_fail:
@@ -764,17 +961,143 @@ MPI_Bcast(KERN.output.weights,N*M,MPI_DOUBLE,0,MPI_COMM_WORLD);
 #endif /*_MPI*/
     return kernel;
 }
+/*----------------------------*/
+/*+++ fast kernel dump I/O +++*/
+/*----------------------------*/
+/*^^^ write x in buf, exactly as printf("%17.15f",x) would, and return the
+ * number of written chars (no '\0'). For |x|<2^13, x=m*2^e is turned into
+ * q=round(m*10^15*2^e) using integer arithmetic only (round half to even
+ * on the exact value, as glibc does), so no precision is lost.*/
+static UINT ann_dump_double(CHAR *buf,DOUBLE x){
+#ifdef __SIZEOF_INT128__
+    union {DOUBLE d;UINT64 u;} bits;
+    unsigned __int128 p,rem,half;
+    UINT64 m,q,i_part,f_part;
+    CHAR digits[24];
+    UINT len=0,n_dig,sh;
+    int ex;
+    bits.d=x;
+    m=bits.u&((1ULL<<52)-1);
+    ex=(int)((bits.u>>52)&0x7FF);
+    if(ex==0) ex=1;/*subnormal*/
+    else m|=(1ULL<<52);
+    ex-=1075;/*x=m*2^ex*/
+    if((ex>-40)||(((bits.u>>52)&0x7FF)==0x7FF))
+        return (UINT)sprintf(buf,"%17.15f",x);
+    sh=(UINT)(-ex);
+    if(sh>=104){
+        q=0;/*|x|*10^15 < 1/2*/
+    }else{
+        p=(unsigned __int128)m*1000000000000000ULL;
+        q=(UINT64)(p>>sh);
+        rem=p-(((unsigned __int128)q)<<sh);
+        half=((unsigned __int128)1)<<(sh-1);
+        if((rem>half)||((rem==half)&&(q&1))) q++;
+    }
+    if(bits.u>>63) buf[len++]='-';
+    i_part=q/1000000000000000ULL;
+    f_part=q%1000000000000000ULL;
+    n_dig=0;
+    do{
+        digits[n_dig++]='0'+(CHAR)(i_part%10);
+        i_part/=10;
+    }while(i_part>0);
+    while(n_dig>0) buf[len++]=digits[--n_dig];
+    buf[len++]='.';
+    for(n_dig=15;n_dig>0;n_dig--){
+        buf[len+n_dig-1]='0'+(CHAR)(f_part%10);
+        f_part/=10;
+    }
+    return len+15;
+#else  /*__SIZEOF_INT128__*/
+    return (UINT)sprintf(buf,"%17.15f",x);
+#endif /*__SIZEOF_INT128__*/
+}
+/*^^^ write one neuron (header + weights line) in buf, return its length*/
+static UINT64 ann_dump_neuron(CHAR *buf,UINT jdx,UINT M,const DOUBLE *w){
+    UINT64 len;
+    UINT kdx;
+    len=(UINT64)sprintf(buf,"[neuron %i] %i\n",jdx+1,M);
+    len+=ann_dump_double(buf+len,w[0]);
+    for(kdx=1;kdx<M;kdx++){
+        buf[len++]=' ';
+        len+=ann_dump_double(buf+len,w[kdx]);
+    }
+    buf[len++]='\n';
+    return len;
+}
+/*^^^ write all N neurons of a layer with a single write. Each neuron is
+ * formatted (in parallel) in its own slot, the slots are then packed.*/
+#define ANN_DUMP_HEAD 64    /*max size of a neuron header*/
+#define ANN_DUMP_SMALL 24   /*max size of a weight |w|<2^13*/
+#define ANN_DUMP_LARGE 340  /*max size of any other weight*/
+static void ann_dump_layer(FILE *out,UINT N,UINT M,const DOUBLE *w){
+    UINT64 n_big=0,slot,len,kdx;
+    UINT64 *r_len;
+    CHAR *buf;
+    UINT jdx;
+    for(kdx=0;kdx<(UINT64)N*M;kdx++) if(!(fabs(w[kdx])<8192.)) n_big++;
+    slot=ANN_DUMP_HEAD+ANN_DUMP_SMALL*M+ANN_DUMP_LARGE*n_big;
+    ALLOC(buf,slot*N,CHAR);
+    ALLOC(r_len,N,UINT64);
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<N;jdx++)
+        r_len[jdx]=ann_dump_neuron(buf+slot*jdx,jdx,M,w+_2D_IDX(M,jdx,0));
+    len=r_len[0];
+    for(jdx=1;jdx<N;jdx++){
+        memmove(buf+len,buf+slot*jdx,r_len[jdx]);
+        len+=r_len[jdx];
+    }
+    fwrite(buf,sizeof(CHAR),len,out);
+    FREE(r_len);
+    FREE(buf);
+}
+#undef ANN_DUMP_HEAD
+#undef ANN_DUMP_SMALL
+#undef ANN_DUMP_LARGE
 /*---------------------*/
 /*+++ OUTPUT KERNEL +++*/
 /*---------------------*/
-void ann_dump(kernel_ann *kernel,FILE *out){
+/*^^^ private: write a kernel whose weights are on CPU.  Used by ann_dump
+ * and by the checkpoint thread (ann_dump_file), so no MPI call is made.*/
+static void ann_dump_cpu(const kernel_ann *kernel,FILE *out){
+    const layer_ann *lay;
     UINT idx;
-    UINT jdx;
-    UINT kdx;
-    UINT N,M;
-    DOUBLE *w_ptr=NULL;
+    if(KERN.name!=NULL) fprintf(out,"[name] %s\n",KERN.name);
+    else fprintf(out,"[name] kernel\n");
+    fprintf(out,"[param] %i",KERN.n_inputs);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        fprintf(out," %i",KERN.hiddens[idx].n_neurons);
+    fprintf(out," %i\n",KERN.output.n_neurons);
+    fprintf(out,"[input] %i\n",KERN.n_inputs);
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        if(idx<KERN.n_hiddens) fprintf(out,"[hidden %i] %i",idx+1,lay->n_neurons);
+        else fprintf(out,"[output] %i",lay->n_neurons);
+        if(lay->act!=ANN_ACT_SIGMOID) fprintf(out," %s",ann_act_name(lay->act));
+        fprintf(out,"\n");
+        ann_dump_layer(out,lay->n_neurons,lay->n_inputs,lay->weights);
+    }
+    /*biases*/
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        if(lay->bias==NULL) continue;
+        fprintf(out,"[bias %i] %i\n",idx+1,lay->n_neurons);
+        ann_dump_layer(out,1,lay->n_neurons,lay->bias);
+    }
+    /*low-rank factors (weights are U.V already)*/
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        if(lay->rank==0) continue;
+        fprintf(out,"[lowrank %i] %i\n",idx+1,lay->rank);
+        ann_dump_layer(out,lay->n_neurons,lay->rank,lay->u);
+        ann_dump_layer(out,lay->rank,lay->n_inputs,lay->v);
+    }
+}
+void ann_dump(kernel_ann *kernel,FILE *out){
 #ifdef _CUDA
     cudastreams *cudas=_NN(return,cudas)();
+    kernel_ann *cpu;
 #endif
 #ifdef _MPI
     UINT n_streams,stream;
@@ -791,69 +1114,585 @@ if(stream==0){/*only master writes*/
         return;
     }
 #endif /*_MPI*/
-/*before dumping, we need to sync*/
-    NN_WRITE(out,"[name] %s\n",KERN.name);
-    NN_WRITE(out,"[param] %i",KERN.n_inputs);
-    for(idx=0;idx<KERN.n_hiddens;idx++) 
-        NN_WRITE(out," %i",KERN.hiddens[idx].n_neurons);
-    NN_WRITE(out," %i\n",KERN.output.n_neurons);
-    NN_WRITE(out,"[input] %i\n",KERN.n_inputs);
-    for(idx=0;idx<KERN.n_hiddens;idx++) {
+#ifdef   _CUDA
+    if(cudas->mem_model!=CUDA_MEM_CMM){
+        /*before dumping, we need to sync*/
+        cpu=ann_kernel_stage(kernel,NULL);
+        ann_dump_cpu(cpu,out);
+        ann_stage_free(cpu);
+    }else{
+        /*CMM memory can be access by CPU directly*/
+        ann_dump_cpu(kernel,out);
+    }
+#else  /*_CUDA*/
+    ann_dump_cpu(kernel,out);
+#endif /*_CUDA*/
+#ifdef _MPI
+    /*end of master*/
+    }
+    MPI_Barrier(MPI_COMM_WORLD);/*everyone WAIT for master*/
+#endif /*_MPI*/
+}
+/*-----------------------------*/
+/*+++ stage (copy) a kernel +++*/
+/*-----------------------------*/
+/*^^^ private: copy the low-rank factors of layer src into dst, the rank can
+ * change (or drop to 0) between two stage calls during training.*/
+static void ann_stage_lowrank(const layer_ann *src,layer_ann *dst){
+    if(dst->rank!=src->rank){
+        FREE(dst->u);
+        FREE(dst->v);
+        dst->rank=src->rank;
+        if(dst->rank==0) return;
+        ALLOC(dst->u,dst->n_neurons*dst->rank,DOUBLE);
+        ALLOC(dst->v,dst->rank*dst->n_inputs,DOUBLE);
+    }
+    if(dst->rank==0) return;
+    memcpy(dst->u,src->u,dst->n_neurons*dst->rank*sizeof(DOUBLE));
+    memcpy(dst->v,src->v,dst->rank*dst->n_inputs*sizeof(DOUBLE));
+}
+/*^^^ copy all weights of kernel into stage, a CPU only kernel which is
+ * allocated on first call (stage==NULL).  It is only a copy per layer, which
+ * can be done during training, so that the stage can then be written by a
+ * separate thread (see ann_dump_file) while training goes on.*/
+kernel_ann *ann_kernel_stage(kernel_ann *kernel,kernel_ann *stage){
+    UINT idx,N,M;
+#ifdef _CUDA
+    cudastreams *cudas=_NN(return,cudas)();
+    DOUBLE *w_ptr;
+#endif /*_CUDA*/
+    if(kernel==NULL) return NULL;
+    if(stage==NULL){
+        ALLOC(stage,1,kernel_ann);
+        if(KERN.name!=NULL) STRDUP(KERN.name,stage->name);
+        stage->n_inputs=KERN.n_inputs;
+        stage->n_hiddens=KERN.n_hiddens;
+        stage->n_outputs=KERN.n_outputs;
+        stage->max_index=KERN.max_index;
+        ALLOC(stage->hiddens,KERN.n_hiddens,layer_ann);
+        for(idx=0;idx<KERN.n_hiddens;idx++){
+            stage->hiddens[idx].n_neurons=KERN.hiddens[idx].n_neurons;
+            stage->hiddens[idx].n_inputs=KERN.hiddens[idx].n_inputs;
+            stage->hiddens[idx].act=KERN.hiddens[idx].act;
+            ALLOC(stage->hiddens[idx].weights,
+                KERN.hiddens[idx].n_neurons*KERN.hiddens[idx].n_inputs,DOUBLE);
+            if(KERN.hiddens[idx].bias!=NULL)
+                ALLOC(stage->hiddens[idx].bias,
+                    KERN.hiddens[idx].n_neurons,DOUBLE);
+        }
+        stage->output.n_neurons=KERN.output.n_neurons;
+        stage->output.n_inputs=KERN.output.n_inputs;
+        stage->output.act=KERN.output.act;
+        ALLOC(stage->output.weights,
+            KERN.output.n_neurons*KERN.output.n_inputs,DOUBLE);
+        if(KERN.output.bias!=NULL)
+            ALLOC(stage->output.bias,KERN.output.n_neurons,DOUBLE);
+    }
+    /*biases (never on GPU)*/
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        if((KERN.hiddens[idx].bias!=NULL)&&(stage->hiddens[idx].bias!=NULL))
+            memcpy(stage->hiddens[idx].bias,KERN.hiddens[idx].bias,
+                KERN.hiddens[idx].n_neurons*sizeof(DOUBLE));
+    if((KERN.output.bias!=NULL)&&(stage->output.bias!=NULL))
+        memcpy(stage->output.bias,KERN.output.bias,
+            KERN.output.n_neurons*sizeof(DOUBLE));
+    /*low-rank factors (never on GPU)*/
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        ann_stage_lowrank(&(KERN.hiddens[idx]),&(stage->hiddens[idx]));
+    ann_stage_lowrank(&(KERN.output),&(stage->output));
+    for(idx=0;idx<KERN.n_hiddens;idx++){
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
-        /*prepare array*/
 #ifdef   _CUDA
         if(cudas->mem_model!=CUDA_MEM_CMM){
-            ALLOC(w_ptr,N*M,DOUBLE);
+            w_ptr=stage->hiddens[idx].weights;
             scuda_ann_weight_transfer_G2C(kernel,idx,&w_ptr,cudas);
-        }else{
-            /*CMM memory can be access by CPU directly*/
-            /*TODO: should we prefetch?*/
-            w_ptr=KERN.hiddens[idx].weights;
+            continue;
         }
-#else  /*_CUDA*/
-        w_ptr=KERN.hiddens[idx].weights;
 #endif /*_CUDA*/
-        NN_WRITE(out,"[hidden %i] %i\n",idx+1,N);
-        for(jdx=0;jdx<N;jdx++){
-            NN_WRITE(out,"[neuron %i] %i\n",jdx+1,M);
-            NN_WRITE(out,"%17.15f",w_ptr[_2D_IDX(M,jdx,0)]);
-            for(kdx=1;kdx<M;kdx++)
-                NN_WRITE(out," %17.15f",w_ptr[_2D_IDX(M,jdx,kdx)]);
-            NN_WRITE(out,"\n");
-        }
+        memcpy(stage->hiddens[idx].weights,KERN.hiddens[idx].weights,
+            N*M*sizeof(DOUBLE));
     }
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
 #ifdef   _CUDA
     if(cudas->mem_model!=CUDA_MEM_CMM){
-        FREE(w_ptr);
-        ALLOC(w_ptr,N*M,DOUBLE);
+        w_ptr=stage->output.weights;
         scuda_ann_weight_transfer_G2C(kernel,KERN.n_hiddens,&w_ptr,cudas);
-    }else{
-        /*CMM memory can be access by CPU directly*/
-        /*TODO: should we prefetch?*/
-        w_ptr=KERN.output.weights;
+        return stage;
+    }
+#endif /*_CUDA*/
+    memcpy(stage->output.weights,KERN.output.weights,N*M*sizeof(DOUBLE));
+    return stage;
+}
+void ann_stage_free(kernel_ann *stage){
+    UINT idx;
+    if(stage==NULL) return;
+    FREE(stage->name);
+    if(stage->hiddens!=NULL){
+        for(idx=0;idx<stage->n_hiddens;idx++){
+            FREE(stage->hiddens[idx].weights);
+            FREE(stage->hiddens[idx].bias);
+            FREE(stage->hiddens[idx].u);
+            FREE(stage->hiddens[idx].v);
+        }
+        FREE(stage->hiddens);
+    }
+    FREE(stage->output.weights);
+    FREE(stage->output.bias);
+    FREE(stage->output.u);
+    FREE(stage->output.v);
+    FREE(stage);
+}
+/*^^^ write a staged kernel to filename.tmp, which is then renamed to
+ * filename, so that filename is always a complete kernel (if any).  As it
+ * is meant to run in a separate thread, no MPI (or output) call is made.*/
+BOOL ann_dump_file(kernel_ann *stage,const CHAR *filename){
+    CHAR *tmp=NULL;
+    FILE *out;
+    if((stage==NULL)||(filename==NULL)) return FALSE;
+    STRCAT(tmp,filename,".tmp");
+    if(tmp==NULL) return FALSE;
+    out=fopen(tmp,"w");
+    if(out==NULL){
+        FREE(tmp);
+        return FALSE;
     }
+    ann_dump_cpu(stage,out);
+    /*make sure data reached the disk before renaming*/
+    if((fflush(out)!=0)||(fsync(fileno(out))!=0)){
+        fclose(out);
+        FREE(tmp);
+        return FALSE;
+    }
+    fclose(out);
+    if(rename(tmp,filename)!=0){
+        FREE(tmp);
+        return FALSE;
+    }
+    FREE(tmp);
+    return TRUE;
+}
+/*--------------------------*/
+/*+++ structured pruning +++*/
+/*--------------------------*/
+/*^^^ importance of each neuron of hidden layer 'layer': L2 norm of its
+ * outgoing weights (ie. its column in the next layer).*/
+void ann_neuron_norm(kernel_ann *kernel,UINT layer,DOUBLE *score){
+    kernel_ann *cpu;
+    layer_ann *next;
+    UINT idx,jdx,N,M;
+    if((kernel==NULL)||(score==NULL)||(layer>=KERN.n_hiddens)) return;
+#ifdef   _CUDA
+    /*weights may only be available on GPU*/
+    cpu=ann_kernel_stage(kernel,NULL);
+    if(cpu==NULL) return;
 #else  /*_CUDA*/
-    w_ptr=KERN.output.weights;
+    cpu=kernel;
 #endif /*_CUDA*/
-    NN_WRITE(out,"[output] %i\n",N);
-    for(jdx=0;jdx<N;jdx++){
-        NN_WRITE(out,"[neuron %i] %i\n",jdx+1,M);
-        NN_WRITE(out,"%17.15f",w_ptr[_2D_IDX(M,jdx,0)]);
-        for(kdx=1;kdx<M;kdx++)
-            NN_WRITE(out," %17.15f",w_ptr[_2D_IDX(M,jdx,kdx)]);
-        NN_WRITE(out,"\n");
+    if(layer+1<cpu->n_hiddens) next=&(cpu->hiddens[layer+1]);
+    else next=&(cpu->output);
+    N=next->n_neurons;
+    M=next->n_inputs;
+    for(jdx=0;jdx<M;jdx++) score[jdx]=0.;
+    for(idx=0;idx<N;idx++)
+        for(jdx=0;jdx<M;jdx++)
+            score[jdx]+=next->weights[_2D_IDX(M,idx,jdx)]*
+                        next->weights[_2D_IDX(M,idx,jdx)];
+    for(jdx=0;jdx<M;jdx++) score[jdx]=sqrt(score[jdx]);
+#ifdef   _CUDA
+    ann_stage_free(cpu);
+#endif /*_CUDA*/
+}
+/*^^^ private: copy the kept rows and columns of a layer weights*/
+static void ann_prune_copy(const layer_ann *src,const BOOL *row_keep,
+                           const BOOL *col_keep,DOUBLE *dst){
+    UINT idx,jdx,kdx=0;
+    for(idx=0;idx<src->n_neurons;idx++){
+        if((row_keep!=NULL)&&(!row_keep[idx])) continue;
+        for(jdx=0;jdx<src->n_inputs;jdx++){
+            if((col_keep!=NULL)&&(!col_keep[jdx])) continue;
+            dst[kdx++]=src->weights[_2D_IDX(src->n_inputs,idx,jdx)];
+        }
     }
-#ifdef _CUDA
-    if(cudas->mem_model!=CUDA_MEM_CMM) FREE(w_ptr);
-#endif
-#ifdef _MPI
-    /*end of master*/
+}
+/*^^^ remove the n_remove neurons of hidden layer 'layer' with the lowest
+ * score: their weight rows, and the matching columns of the next layer.
+ * A new (smaller) kernel is returned, kernel itself is left untouched.*/
+kernel_ann *ann_prune(kernel_ann *kernel,UINT layer,UINT n_remove,
+                      const DOUBLE *score){
+    kernel_ann *cpu,*pruned;
+    layer_ann *src,*dst;
+    UINT *h_neurons;
+    BOOL *keep;
+    UINT idx,jdx,low,N;
+#ifdef   _CUDA
+    cudastreams *cudas=_NN(return,cudas)();
+    DOUBLE *w_ptr;
+#endif /*_CUDA*/
+    if((kernel==NULL)||(score==NULL)||(layer>=KERN.n_hiddens)) return NULL;
+    N=KERN.hiddens[layer].n_neurons;
+    if(n_remove>=N){
+        NN_ERROR(stderr,"can't remove %i out of %i neurons!\n",n_remove,N);
+        return NULL;
     }
-    MPI_Barrier(MPI_COMM_WORLD);/*everyone WAIT for master*/
-#endif /*_MPI*/
+    /*select the n_remove lowest scores (first index on ties)*/
+    ALLOC(keep,N,BOOL);
+    for(idx=0;idx<N;idx++) keep[idx]=TRUE;
+    for(jdx=0;jdx<n_remove;jdx++){
+        low=N;
+        for(idx=0;idx<N;idx++){
+            if(!keep[idx]) continue;
+            if((low==N)||(score[idx]<score[low])) low=idx;
+        }
+        keep[low]=FALSE;
+    }
+    ALLOC(h_neurons,KERN.n_hiddens,UINT);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        h_neurons[idx]=KERN.hiddens[idx].n_neurons;
+    h_neurons[layer]-=n_remove;
+#ifdef   _CUDA
+    cpu=ann_kernel_stage(kernel,NULL);
+#else  /*_CUDA*/
+    cpu=kernel;
+#endif /*_CUDA*/
+    ALLOC(pruned,1,kernel_ann);
+    if(KERN.name!=NULL) STRDUP(KERN.name,pruned->name);
+    ann_kernel_allocate(pruned,KERN.n_inputs,KERN.n_hiddens,
+                        h_neurons,KERN.n_outputs);
+    FREE(h_neurons);
+    /*idx==n_hiddens is the output layer*/
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        if(idx<KERN.n_hiddens){
+            src=&(cpu->hiddens[idx]);
+            dst=&(pruned->hiddens[idx]);
+        }else{
+            src=&(cpu->output);
+            dst=&(pruned->output);
+        }
+        dst->act=src->act;
+        if(src->bias!=NULL){
+            ALLOC(dst->bias,dst->n_neurons,DOUBLE);
+            for(N=0,jdx=0;jdx<src->n_neurons;jdx++){
+                if((idx==layer)&&(!keep[jdx])) continue;
+                dst->bias[N++]=src->bias[jdx];
+            }
+        }
+#ifdef   _CUDA
+        if(cudas->mem_model!=CUDA_MEM_CMM){
+            ALLOC(w_ptr,dst->n_neurons*dst->n_inputs,DOUBLE);
+            ann_prune_copy(src,(idx==layer)?keep:NULL,
+                (idx==layer+1)?keep:NULL,w_ptr);
+            scuda_ann_weight_transfer_C2G(pruned,idx,w_ptr,cudas);
+            FREE(w_ptr);
+            continue;
+        }
+#endif /*_CUDA*/
+        ann_prune_copy(src,(idx==layer)?keep:NULL,
+            (idx==layer+1)?keep:NULL,dst->weights);
+    }
+#ifdef   _CUDA
+    ann_stage_free(cpu);
+#endif /*_CUDA*/
+    FREE(keep);
+    return pruned;
+}
+/*------------------------------*/
+/*+++ low-rank factorization +++*/
+/*------------------------------*/
+#ifdef _LAPACK
+/*Fortran LAPACK (column major: eigenvectors in columns are our rows)*/
+extern void dsyevd_(const char *jobz,const char *uplo,const int *n,double *a,
+                    const int *lda,double *w,double *work,const int *lwork,
+                    int *iwork,const int *liwork,int *info);
+#endif /*_LAPACK*/
+/*^^^ private: eigen decomposition of the n x n symmetric matrix a (which is
+ * destroyed) by Householder reduction to a tridiagonal form, then implicit
+ * QL iterations.  On return, d[k] is the k-th eigenvalue and row k of z the
+ * matching eigenvector (unsorted).  Rows of z are updated instead of its
+ * columns, so that all inner loops are contiguous.*/
+static BOOL ann_sym_eigen_ql(UINT n,DOUBLE *a,DOUBLE *d,DOUBLE *z){
+    DOUBLE *v,*p,*e;
+    DOUBLE alpha,norm,vv,K,b,c,f,g,r,s,dd,pp;
+    UINT idx,jdx,kdx,m,iter;
+    int ldx,mdx,rdx;
+    ALLOC(e,n,DOUBLE);
+    ALLOC(v,n,DOUBLE);
+    ALLOC(p,n,DOUBLE);
+    for(idx=0;idx<n*n;idx++) z[idx]=0.;
+    for(idx=0;idx<n;idx++) z[_2D_IDX(n,idx,idx)]=1.;
+    /*Householder: a=Q.T.Q^t, with z=Q^t*/
+    for(kdx=0;kdx+2<n;kdx++){
+        m=n-kdx-1;
+        norm=0.;
+        for(idx=0;idx<m;idx++){
+            v[idx]=a[_2D_IDX(n,kdx,kdx+1+idx)];
+            norm+=v[idx]*v[idx];
+        }
+        norm=sqrt(norm);
+        e[kdx]=0.;
+        if(norm==0.) continue;
+        alpha=(v[0]>0.)?-norm:norm;
+        v[0]-=alpha;
+        vv=norm*(norm+fabs(a[_2D_IDX(n,kdx,kdx+1)]));/*v.v/2*/
+        e[kdx]=alpha;
+        /*p=S.v/(v.v/2), w=p-K.v*/
+        K=0.;
+        for(idx=0;idx<m;idx++){
+            p[idx]=0.;
+            for(jdx=0;jdx<m;jdx++)
+                p[idx]+=a[_2D_IDX(n,kdx+1+idx,kdx+1+jdx)]*v[jdx];
+            p[idx]/=vv;
+            K+=v[idx]*p[idx];
+        }
+        K/=2.*vv;
+        for(idx=0;idx<m;idx++) p[idx]-=K*v[idx];
+        /*S=S-v.w^t-w.v^t*/
+        for(idx=0;idx<m;idx++)
+            for(jdx=0;jdx<m;jdx++)
+                a[_2D_IDX(n,kdx+1+idx,kdx+1+jdx)]-=v[idx]*p[jdx]+p[idx]*v[jdx];
+        /*z=H.z, one row of z at a time*/
+        for(jdx=0;jdx<n;jdx++) p[jdx]=0.;
+        for(idx=0;idx<m;idx++)
+            for(jdx=0;jdx<n;jdx++) p[jdx]+=v[idx]*z[_2D_IDX(n,kdx+1+idx,jdx)];
+        for(idx=0;idx<m;idx++)
+            for(jdx=0;jdx<n;jdx++)
+                z[_2D_IDX(n,kdx+1+idx,jdx)]-=v[idx]*p[jdx]/vv;
+    }
+    for(idx=0;idx<n;idx++) d[idx]=a[_2D_IDX(n,idx,idx)];
+    if(n>1) e[n-2]=a[_2D_IDX(n,n-2,n-1)];
+    e[n-1]=0.;
+    /*implicit QL on (d,e): e[i] couples d[i] and d[i+1]*/
+    for(ldx=0;ldx<(int)n;ldx++){
+        iter=0;
+        do{
+            for(mdx=ldx;mdx<(int)n-1;mdx++){
+                dd=fabs(d[mdx])+fabs(d[mdx+1]);
+                if(fabs(e[mdx])+dd==dd) break;
+            }
+            if(mdx==ldx) break;
+            if(iter++==ANN_LOWRANK_ITER){
+                FREE(e);
+                FREE(v);
+                FREE(p);
+                return FALSE;
+            }
+            g=(d[ldx+1]-d[ldx])/(2.*e[ldx]);
+            r=sqrt(g*g+1.);
+            g=d[mdx]-d[ldx]+e[ldx]/(g+((g>=0.)?r:-r));
+            s=1.;c=1.;pp=0.;
+            for(rdx=mdx-1;rdx>=ldx;rdx--){
+                f=s*e[rdx];
+                b=c*e[rdx];
+                r=sqrt(f*f+g*g);
+                e[rdx+1]=r;
+                if(r==0.){
+                    d[rdx+1]-=pp;
+                    e[mdx]=0.;
+                    break;
+                }
+                s=f/r;
+                c=g/r;
+                g=d[rdx+1]-pp;
+                r=(d[rdx]-g)*s+2.*c*b;
+                pp=s*r;
+                d[rdx+1]=g+pp;
+                g=c*r-b;
+                for(jdx=0;jdx<n;jdx++){
+                    f=z[_2D_IDX(n,rdx+1,jdx)];
+                    z[_2D_IDX(n,rdx+1,jdx)]=s*z[_2D_IDX(n,rdx,jdx)]+c*f;
+                    z[_2D_IDX(n,rdx,jdx)]=c*z[_2D_IDX(n,rdx,jdx)]-s*f;
+                }
+            }
+            if((r==0.)&&(rdx>=ldx)) continue;
+            d[ldx]-=pp;
+            e[ldx]=g;
+            e[mdx]=0.;
+        }while(1);
+    }
+    FREE(e);
+    FREE(v);
+    FREE(p);
+    return TRUE;
+}
+/*^^^ private: same as ann_sym_eigen_ql (same output layout), using the
+ * LAPACK divide and conquer dsyevd when available.  The internal solver is
+ * only a fallback, used when LAPACK is missing or fails.*/
+static BOOL ann_sym_eigen(UINT n,DOUBLE *a,DOUBLE *d,DOUBLE *z){
+#ifdef _LAPACK
+    DOUBLE *work,query;
+    int nn=(int)n,lwork=-1,liwork=-1,iquery,*iwork,info;
+    UINT idx;
+    /*a is symmetric: z=a is already in column major*/
+    for(idx=0;idx<n*n;idx++) z[idx]=a[idx];
+    dsyevd_("V","L",&nn,z,&nn,d,&query,&lwork,&iquery,&liwork,&info);
+    if(info==0){
+        lwork=(int)query;
+        liwork=iquery;
+        ALLOC(work,lwork,DOUBLE);
+        ALLOC(iwork,liwork,int);
+        dsyevd_("V","L",&nn,z,&nn,d,work,&lwork,iwork,&liwork,&info);
+        FREE(work);
+        FREE(iwork);
+        if(info==0) return TRUE;
+    }
+    NN_WARN(stdout,"low-rank: dsyevd failed (info=%i), using fallback.\n",
+        info);
+#endif /*_LAPACK*/
+    return ann_sym_eigen_ql(n,a,d,z);
+}
+/*^^^ replace the weights W (N x M) of layer 'layer' (n_hiddens for the
+ * output) by the rank-r product U.V (N x r).(r x M) of its truncated SVD.
+ * r is the smallest rank which keeps a fraction energy of the squared
+ * singular values (ie. of |W|^2), limited to max_rank (if not 0).  The
+ * SVD is obtained from the eigen decomposition of the smallest of W.W^t
+ * and W^t.W.  weights are set to U.V, so that training (which works on
+ * the dense weights, and drops U and V) and kernel files remain valid.
+ * Returns r, or 0 when the layer is kept dense: when U.V would not need
+ * fewer operations than W, or on error.  The kept energy is put in kept.*/
+UINT ann_lowrank(kernel_ann *kernel,UINT layer,DOUBLE energy,UINT max_rank,
+                 DOUBLE *kept){
+#ifdef   _CUDA
+    if(kept!=NULL) *kept=1.;
+    NN_ERROR(stderr,"low-rank layers are only available on CPU!\n");
+    return 0;
+#else  /*_CUDA*/
+    layer_ann *lay;
+    DOUBLE *g,*d,*z,*q,*u,*v,*w;
+    DOUBLE total,acc,tmp;
+    UINT *order;
+    UINT idx,jdx,kdx,N,M,n,rank;
+    BOOL by_row;
+    if(kept!=NULL) *kept=1.;
+    if((kernel==NULL)||(layer>KERN.n_hiddens)) return 0;
+    if((energy<=0.)||(energy>1.)) return 0;
+    if(layer<KERN.n_hiddens) lay=&(KERN.hiddens[layer]);
+    else lay=&(KERN.output);
+    N=lay->n_neurons;
+    M=lay->n_inputs;
+    w=lay->weights;
+    by_row=(N<=M);
+    n=by_row?N:M;
+    /*gram matrix: W.W^t (N<=M) or W^t.W*/
+    ALLOC(g,n*n,DOUBLE);
+    if(by_row){
+        for(idx=0;idx<N;idx++)
+            for(jdx=0;jdx<=idx;jdx++){
+                tmp=0.;
+                for(kdx=0;kdx<M;kdx++)
+                    tmp+=w[_2D_IDX(M,idx,kdx)]*w[_2D_IDX(M,jdx,kdx)];
+                g[_2D_IDX(n,idx,jdx)]=tmp;
+                g[_2D_IDX(n,jdx,idx)]=tmp;
+            }
+    }else{
+        for(kdx=0;kdx<N;kdx++)
+            for(idx=0;idx<M;idx++)
+                for(jdx=0;jdx<M;jdx++)
+                    g[_2D_IDX(n,idx,jdx)]+=
+                        w[_2D_IDX(M,kdx,idx)]*w[_2D_IDX(M,kdx,jdx)];
+    }
+    ALLOC(d,n,DOUBLE);
+    ALLOC(z,n*n,DOUBLE);
+    if(!ann_sym_eigen(n,g,d,z)){
+        NN_ERROR(stderr,"low-rank: no eigen decomposition for layer %i!\n",
+            layer+1);
+        FREE(g);
+        FREE(d);
+        FREE(z);
+        return 0;
+    }
+    FREE(g);
+    /*sort eigenvalues (squared singular values) by decreasing order*/
+    ALLOC(order,n,UINT);
+    total=0.;
+    for(idx=0;idx<n;idx++){
+        if(d[idx]<0.) d[idx]=0.;/*round-off*/
+        total+=d[idx];
+        order[idx]=idx;
+    }
+    for(idx=1;idx<n;idx++){
+        kdx=order[idx];
+        for(jdx=idx;(jdx>0)&&(d[order[jdx-1]]<d[kdx]);jdx--)
+            order[jdx]=order[jdx-1];
+        order[jdx]=kdx;
+    }
+    rank=0;
+    acc=0.;
+    while((rank<n)&&(acc<energy*total)){
+        acc+=d[order[rank]];
+        rank++;
+    }
+    if(rank==0) rank=1;/*null layer*/
+    if((max_rank>0)&&(rank>max_rank)){
+        rank=max_rank;
+        acc=0.;
+        for(idx=0;idx<rank;idx++) acc+=d[order[idx]];
+    }
+    if(kept!=NULL) *kept=(total>0.)?acc/total:1.;
+    if((UINT64)rank*(N+M)>=(UINT64)N*M){
+        FREE(order);
+        FREE(d);
+        FREE(z);
+        return 0;
+    }
+    /*W=Q.Q^t.W (N<=M) or W.P.P^t*/
+    ALLOC(u,N*rank,DOUBLE);
+    ALLOC(v,rank*M,DOUBLE);
+    for(kdx=0;kdx<rank;kdx++){
+        q=&(z[_2D_IDX(n,order[kdx],0)]);
+        if(by_row){
+            for(idx=0;idx<N;idx++){
+                u[_2D_IDX(rank,idx,kdx)]=q[idx];
+                for(jdx=0;jdx<M;jdx++)
+                    v[_2D_IDX(M,kdx,jdx)]+=q[idx]*w[_2D_IDX(M,idx,jdx)];
+            }
+        }else{
+            for(jdx=0;jdx<M;jdx++) v[_2D_IDX(M,kdx,jdx)]=q[jdx];
+            for(idx=0;idx<N;idx++){
+                tmp=0.;
+                for(jdx=0;jdx<M;jdx++) tmp+=w[_2D_IDX(M,idx,jdx)]*q[jdx];
+                u[_2D_IDX(rank,idx,kdx)]=tmp;
+            }
+        }
+    }
+    FREE(order);
+    FREE(d);
+    FREE(z);
+    /*dense weights are now U.V*/
+    for(idx=0;idx<N;idx++)
+        for(jdx=0;jdx<M;jdx++){
+            tmp=0.;
+            for(kdx=0;kdx<rank;kdx++)
+                tmp+=u[_2D_IDX(rank,idx,kdx)]*v[_2D_IDX(M,kdx,jdx)];
+            w[_2D_IDX(M,idx,jdx)]=tmp;
+        }
+    FREE(lay->u);
+    FREE(lay->v);
+    FREE(lay->uv_tmp);
+    lay->rank=rank;
+    lay->u=u;
+    lay->v=v;
+    ALLOC(lay->uv_tmp,rank,DOUBLE);
+    return rank;
+#endif /*_CUDA*/
+}
+/*^^^ back to dense layers (U and V are dropped, weights are kept).  This is
+ * done before any weight update, as U.V would no longer match weights.*/
+void ann_lowrank_drop(kernel_ann *kernel){
+    UINT idx;
+    if(kernel==NULL) return;
+    if(KERN.hiddens!=NULL){
+        for(idx=0;idx<KERN.n_hiddens;idx++){
+            FREE(KERN.hiddens[idx].u);
+            FREE(KERN.hiddens[idx].v);
+            FREE(KERN.hiddens[idx].uv_tmp);
+            KERN.hiddens[idx].rank=0;
+        }
+    }
+    FREE(KERN.output.u);
+    FREE(KERN.output.v);
+    FREE(KERN.output.uv_tmp);
+    KERN.output.rank=0;
 }
 /*-------------------------------------*/
 /*+++ validate parameters of kernel +++*/
@@ -886,135 +1725,229 @@ DOUBLE ann_act(DOUBLE x){
 DOUBLE ann_dact(DOUBLE y){
     return -0.5*(y*y-1.0);
 }
-/*------------------------*/
-/*+++ feed-forward run +++*/
-/*------------------------*/
-void ann_kernel_run(kernel_ann *kernel){
-#ifdef   _CUDA
-    /*the _NN(run,kernel) is now in charge of transfer(s)*/
-    scuda_ann_forward(kernel,_NN(return,cudas)());
-#else  /*_CUDA*/
-    /*simple, one pass kernel*/
-    UINT idx,jdx,M,N;
-#if !defined (PBLAS) && !defined (SBLAS)
-    UINT kdx;
-#endif
-#ifdef _MPI
-    UINT n_streams,stream;
-    UINT red,rem;
-    _NN(get,mpi_tasks)(&n_streams);
-    _NN(get,curr_mpi_task)(&stream);
-#endif /*_MPI*/
-    /*simple, one pass kernel*/
-/*+++ I - input +++*/
-    N=KERN.hiddens[0].n_neurons;
-    M=KERN.hiddens[0].n_inputs;
-#ifdef _MPI
-    red=N/n_streams;
-    rem=N%n_streams;
-#endif /*_MPI*/
-#ifdef PBLAS
-#ifdef _MPI
-    cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
-        1.0,KERN.hiddens[0].weights+stream*M*red,
-        M,KERN.in,1,0.,KERN.hiddens[0].vec+stream*red,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix+stream*red]=\
-    ann_act(KERN.hiddens[0].vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,ACT,jdx);
+/*^^^ activation keyword (kernel file) <-> type*/
+ann_act_type ann_act_parse(const CHAR *str){
+    if(str==NULL) return ANN_ACT_SIGMOID;
+    SKIP_BLANK(str);
+    if(STRFIND("lrelu",str)==str) return ANN_ACT_LRELU;
+    if(STRFIND("relu",str)==str) return ANN_ACT_RELU;
+    if(STRFIND("htanh",str)==str) return ANN_ACT_HTANH;
+    if(STRFIND("sigmoid",str)==str) return ANN_ACT_SIGMOID;
+    if(!ISGRAPH(*str)||(*str=='#')) return ANN_ACT_SIGMOID;/*default*/
+    return ANN_ACT_UKN;
+}
+const CHAR *ann_act_name(ann_act_type act){
+    switch(act){
+    case ANN_ACT_RELU:
+        return "relu";
+    case ANN_ACT_LRELU:
+        return "lrelu";
+    case ANN_ACT_HTANH:
+        return "htanh";
+    case ANN_ACT_SIGMOID:
+    default:
+        return "sigmoid";
+    }
+}
+/*^^^ v[0..n[=act(v[...]), with one specialized loop per activation type:
+ * only the sigmoid needs exp.  Biases are already in v, the mv accumulators
+ * starting from them (see ANN_BIAS and ann_bias_load).*/
+void ann_act_vec(ann_act_type act,DOUBLE *v,UINT n){
+    UINT jdx;
+    switch(act){
+    case ANN_ACT_RELU:
+#define OP_ACT(ix) v[ix]=(v[ix]>0.)?v[ix]:0.
+        UNROLL_FOR(0,n,ANN_UNROLL,ACT,jdx);
 #undef OP_ACT
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
-                  KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-    /*do the remaining ops without MPI*/
-    if(rem>0){
-        cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
-            1.0,KERN.hiddens[0].weights+n_streams*M*red,
-            M,KERN.in,1,0.,KERN.hiddens[0].vec+n_streams*red,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix+n_streams*red]=\
-        ann_act(KERN.hiddens[0].vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,ACT,jdx);
+        break;
+    case ANN_ACT_LRELU:
+#define OP_ACT(ix) v[ix]=(v[ix]>0.)?v[ix]:ANN_LRELU_SLOPE*v[ix]
+        UNROLL_FOR(0,n,ANN_UNROLL,ACT,jdx);
 #undef OP_ACT
-    }
-#else /*_MPI*/
-    cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
-                1.0,KERN.hiddens[0].weights,
-                M,KERN.in,1,0.,KERN.hiddens[0].vec,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix]=ann_act(KERN.hiddens[0].vec[ix])
-    UNROLL_OMP_FOR(0,N,ANN_UNROLL,ACT,jdx);
+        break;
+    case ANN_ACT_HTANH:
+#define OP_ACT(ix) v[ix]=(v[ix]>1.)?1.:((v[ix]<-1.)?-1.:v[ix])
+        UNROLL_FOR(0,n,ANN_UNROLL,ACT,jdx);
+#undef OP_ACT
+        break;
+    case ANN_ACT_SIGMOID:
+    default:
+#define OP_ACT(ix) v[ix]=ann_act(v[ix])
+        UNROLL_OMP_FOR(0,n,ANN_UNROLL,ACT,jdx);
 #undef OP_ACT
-//DMP_DBG(KERN.hiddens[0].vec,N);
-#endif /*_MPI*/
-#elif defined(SBLAS)
-    /*move the parallel mv into a series of vv*/
-#ifdef _MPI
-#pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<red;jdx++){
-_HT;
-        KERN.hiddens[0].vec[jdx+stream*red]=cblas_ddot(
-            M,&(KERN.hiddens[0].weights[M*(jdx+stream*red)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx+stream*red]=ann_act(
-            KERN.hiddens[0].vec[jdx+stream*red]);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
-                  KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-if(rem>0){
+}
+/*^^^ layer->vec[from..from+n[=act(layer->vec[...])*/
+void ann_act_range(layer_ann *layer,UINT from,UINT n){
+    ann_act_vec(layer->act,layer->vec+from,n);
+}
+/*^^^ delta[from..from+n[*=dact(layer->vec[...]), the derivative being
+ * expressed from the layer output y=act(x).*/
+void ann_dact_range(layer_ann *layer,DOUBLE *delta,UINT from,UINT n){
+    DOUBLE *v=layer->vec+from;
+    DOUBLE *d=delta+from;
+    UINT jdx;
+    switch(layer->act){
+    case ANN_ACT_RELU:
+#define OP_DACT(ix) d[ix]=(v[ix]>0.)?d[ix]:0.
+        UNROLL_FOR(0,n,ANN_UNROLL,DACT,jdx);
+#undef OP_DACT
+        break;
+    case ANN_ACT_LRELU:
+#define OP_DACT(ix) d[ix]=(v[ix]>0.)?d[ix]:ANN_LRELU_SLOPE*d[ix]
+        UNROLL_FOR(0,n,ANN_UNROLL,DACT,jdx);
+#undef OP_DACT
+        break;
+    case ANN_ACT_HTANH:
+#define OP_DACT(ix) d[ix]=((v[ix]<1.)&&(v[ix]>-1.))?d[ix]:0.
+        UNROLL_FOR(0,n,ANN_UNROLL,DACT,jdx);
+#undef OP_DACT
+        break;
+    case ANN_ACT_SIGMOID:
+    default:
+#define OP_DACT(ix) d[ix]*=ann_dact(v[ix])
+        UNROLL_OMP_FOR(0,n,ANN_UNROLL,DACT,jdx);
+#undef OP_DACT
+    }
+}
+/*-----------------------*/
+/*+++ bias of neurons +++*/
+/*-----------------------*/
+/*^^^ add (zero) biases to all layers that have none*/
+void ann_bias_alloc(kernel_ann *kernel){
+    UINT idx;
+    layer_ann *lay;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        if(lay->bias==NULL) ALLOC(lay->bias,lay->n_neurons,DOUBLE);
+    }
+}
+/*^^^ remove the biases of all layers*/
+void ann_bias_free(kernel_ann *kernel){
+    UINT idx;
+    layer_ann *lay;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        FREE(lay->bias);
+        FREE(lay->dbias);
+    }
+}
+/*^^^ vec[from..from+n[=bias[...] and return the beta of the dgemv that
+ * accumulates w.in on top of it: 1 or, when there is no bias, 0.*/
+DOUBLE ann_bias_load(const layer_ann *layer,DOUBLE *vec,UINT from,UINT n){
+    if(layer->bias==NULL) return 0.;
+    memcpy(vec+from,layer->bias+from,n*sizeof(DOUBLE));
+    return 1.;
+}
+/*^^^ bias+=rate*delta, ie. the column of the rank-1 (ger) weight update
+ * that corresponds to a constant input of 1.  delta being known to all MPI
+ * tasks, each one does the (cheap) update of the whole column.*/
+void ann_bias_train(layer_ann *layer,const DOUBLE *delta,DOUBLE rate){
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT jdx;
+#endif
+    if(layer->bias==NULL) return;
+#if defined (PBLAS) || defined (SBLAS)
+    cblas_daxpy(layer->n_neurons,rate,delta,1,layer->bias,1);
+#else /*no PBLAS no SBLAS*/
+#define OP_DB(ix) layer->bias[ix]+=rate*delta[ix]
+    UNROLL_FOR(0,layer->n_neurons,ANN_UNROLL,DB,jdx);
+#undef OP_DB
+#endif /*PBLAS*/
+}
+/*^^^ same with momentum: dbias+=rate*delta; bias+=dbias; dbias*=alpha*/
+void ann_bias_momentum(layer_ann *layer,const DOUBLE *delta,
+                       DOUBLE rate,DOUBLE alpha){
+    UINT jdx;
+    if(layer->bias==NULL) return;
+    if(layer->dbias==NULL) ALLOC(layer->dbias,layer->n_neurons,DOUBLE);
+#define OP_DB(ix) do{\
+    layer->dbias[ix]+=rate*delta[ix];\
+    layer->bias[ix]+=layer->dbias[ix];\
+    layer->dbias[ix]*=alpha;\
+}while(0)
+    UNROLL_FOR(0,layer->n_neurons,ANN_UNROLL,DB,jdx);
+#undef OP_DB
+}
+#ifndef _CUDA
+/*-----------------------------*/
+/*+++ feed-forward low-rank +++*/
+/*-----------------------------*/
+/*^^^ run a low-rank layer: vec=act(U.(V.in)) ie. two thin mv, (N+M)*rank
+ * operations instead of N*M.  It is cheap enough to be done by every MPI
+ * task, which saves the Allgather.*/
+void ann_lowrank_run(layer_ann *layer,const DOUBLE *in){
+    UINT M,N,R;
+#ifndef PBLAS
+    UINT jdx;
+#endif /*PBLAS*/
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT kdx;
+#endif
+    N=layer->n_neurons;
+    M=layer->n_inputs;
+    R=layer->rank;
+#ifdef PBLAS
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,R,M,
+        1.0,layer->v,M,in,1,0.,layer->uv_tmp,1);
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,N,R,
+        1.0,layer->u,R,layer->uv_tmp,1,
+        ann_bias_load(layer,layer->vec,0,N),layer->vec,1);
+    ann_act_range(layer,0,N);
+#elif defined(SBLAS)
 #pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<rem;jdx++){
+    for(jdx=0;jdx<R;jdx++){
 _HT;
-        KERN.hiddens[0].vec[jdx+n_streams*red]=cblas_ddot(
-        M,&(KERN.hiddens[0].weights[M*(jdx+n_streams*red)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx+n_streams*red]=ann_act(
-            KERN.hiddens[0].vec[jdx+n_streams*red]);
+        layer->uv_tmp[jdx]=cblas_ddot(M,&(layer->v[_2D_IDX(M,jdx,0)]),1,in,1);
     }
-}
-#else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
     for(jdx=0;jdx<N;jdx++){
 _HT;
-        KERN.hiddens[0].vec[jdx]=cblas_ddot(
-        M,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx]=ann_act(KERN.hiddens[0].vec[jdx]);
+        layer->vec[jdx]=ANN_BIAS(layer,jdx)+cblas_ddot(
+            R,&(layer->u[_2D_IDX(R,jdx,0)]),1,layer->uv_tmp,1);
     }
-#endif /*_MPI*/
+    ann_act_range(layer,0,N);
 #else /*no PBLAS no SBLAS*/
-#ifdef _MPI
 #pragma omp parallel for private(jdx,kdx) _NT
-    for(jdx=0;jdx<red;jdx++){
-        KERN.hiddens[0].vec[jdx+stream*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx+stream*red]+=\
-        KERN.hiddens[0].weights[M*(jdx+stream*red)+ix]*KERN.in[ix]
+    for(jdx=0;jdx<R;jdx++){
+        layer->uv_tmp[jdx]=0.;/*TRAP*/
+#define OP_WI(ix) layer->uv_tmp[jdx]+=layer->v[_2D_IDX(M,jdx,ix)]*in[ix]
         UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-        KERN.hiddens[0].vec[jdx+stream*red]=ann_act(
-            KERN.hiddens[0].vec[jdx+stream*red]);
-    }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
-            KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-    if(rem>0){
-#pragma omp parallel for private(jdx,kdx) _NT
-        for(jdx=0;jdx<rem;jdx++){
-            KERN.hiddens[0].vec[jdx+n_streams*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx+n_streams*red]+=\
-            KERN.hiddens[0].weights[M*(jdx+n_streams*red)+ix]*KERN.in[ix]
-            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-            KERN.hiddens[0].vec[jdx+n_streams*red]=ann_act(
-                KERN.hiddens[0].vec[jdx+n_streams*red]);
-        }
     }
-#else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
     for(jdx=0;jdx<N;jdx++){
-        KERN.hiddens[0].vec[jdx]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx]+=\
-        KERN.hiddens[0].weights[_2D_IDX(M,jdx,ix)]*KERN.in[ix]
-        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+        layer->vec[jdx]=ANN_BIAS(layer,jdx);/*TRAP*/
+#define OP_WI(ix) layer->vec[jdx]+=layer->u[_2D_IDX(R,jdx,ix)]*layer->uv_tmp[ix]
+        UNROLL_FOR(0,R,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-        KERN.hiddens[0].vec[jdx]=ann_act(KERN.hiddens[0].vec[jdx]);
     }
-#endif /*_MPI*/
+    ann_act_range(layer,0,N);
 #endif /*PBLAS*/
-/*+++ II - hiddens +++*/
+}
+/*-------------------------------*/
+/*+++ feed-forward hidden(s) +++*/
+/*-------------------------------*/
+/* run all hidden layers but the first one, which has to be done already.*/
+void ann_kernel_run_hiddens(kernel_ann *kernel){
+    UINT idx,M,N;
+#ifndef PBLAS
+    UINT jdx;
+#endif /*PBLAS*/
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT kdx;
+#endif
+#ifdef _MPI
+    UINT n_streams,stream;
+    UINT red,rem;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
     for(idx=1;idx<KERN.n_hiddens;idx++){
+        if(KERN.hiddens[idx].rank>0){
+            ann_lowrank_run(&(KERN.hiddens[idx]),KERN.hiddens[idx-1].vec);
+            continue;
+        }
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
 #ifdef _MPI
@@ -1024,28 +1957,26 @@ _HT;
 #ifdef PBLAS
 #ifdef _MPI
         cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
-        1.0,KERN.hiddens[idx].weights+stream*M*red,M,KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec+stream*red,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix+stream*red]=\
-        ann_act(KERN.hiddens[idx].vec[ix+stream*red])
-        UNROLL_OMP_FOR(0,red,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+        1.0,KERN.hiddens[idx].weights+stream*M*red,M,KERN.hiddens[idx-1].vec,1,
+        ann_bias_load(&(KERN.hiddens[idx]),KERN.hiddens[idx].vec,stream*red,red),
+        KERN.hiddens[idx].vec+stream*red,1);
+        ann_act_range(&(KERN.hiddens[idx]),stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
             KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
             cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
-            1.0,KERN.hiddens[idx].weights+n_streams*M*red,M,KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec+n_streams*red,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix+n_streams*red]=\
-            ann_act(KERN.hiddens[idx].vec[ix+n_streams*red])
-            UNROLL_OMP_FOR(0,rem,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+            1.0,KERN.hiddens[idx].weights+n_streams*M*red,M,KERN.hiddens[idx-1].vec,1,
+            ann_bias_load(&(KERN.hiddens[idx]),KERN.hiddens[idx].vec,n_streams*red,rem),
+            KERN.hiddens[idx].vec+n_streams*red,1);
+            ann_act_range(&(KERN.hiddens[idx]),n_streams*red,rem);
         }
 #else /*_MPI*/
         cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
             1.0,KERN.hiddens[idx].weights,M,
-            KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix]=ann_act(KERN.hiddens[idx].vec[ix])
-        UNROLL_OMP_FOR(0,N,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+            KERN.hiddens[idx-1].vec,1,
+            ann_bias_load(&(KERN.hiddens[idx]),KERN.hiddens[idx].vec,0,N),
+            KERN.hiddens[idx].vec,1);
+        ann_act_range(&(KERN.hiddens[idx]),0,N);
 #endif /*_MPI*/
 #elif defined(SBLAS)
         /*move the parallel mv into a series of vv*/
@@ -1053,75 +1984,93 @@ _HT;
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<red;jdx++){
 _HT;
-            KERN.hiddens[idx].vec[jdx+stream*red]=cblas_ddot(
+            KERN.hiddens[idx].vec[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[idx]),jdx+stream*red)+cblas_ddot(
                 M,&(KERN.hiddens[idx].weights[M*(jdx+stream*red)]),1,
                 KERN.hiddens[idx-1].vec,1);
-            KERN.hiddens[idx].vec[jdx+stream*red]=ann_act(
-                KERN.hiddens[idx].vec[jdx+stream*red]);
         }
+        ann_act_range(&(KERN.hiddens[idx]),stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
             KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
             for(jdx=0;jdx<rem;jdx++){
 _HT;
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=cblas_ddot(
+                KERN.hiddens[idx].vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[idx]),jdx+n_streams*red)+cblas_ddot(
                     M,&(KERN.hiddens[idx].weights[M*(jdx+n_streams*red)]),1,
                     KERN.hiddens[idx-1].vec,1);
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=ann_act(
-                    KERN.hiddens[idx].vec[jdx+n_streams*red]);
             }
+            ann_act_range(&(KERN.hiddens[idx]),n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<N;jdx++){
 _HT;
-            KERN.hiddens[idx].vec[jdx]=cblas_ddot(
+            KERN.hiddens[idx].vec[jdx]=ANN_BIAS(&(KERN.hiddens[idx]),jdx)+cblas_ddot(
                 M,&(KERN.hiddens[idx].weights[_2D_IDX(M,jdx,0)]),1,
                 KERN.hiddens[idx-1].vec,1);
-            KERN.hiddens[idx].vec[jdx]=ann_act(KERN.hiddens[idx].vec[jdx]);
         }
+        ann_act_range(&(KERN.hiddens[idx]),0,N);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
         #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<red;jdx++){
-            KERN.hiddens[idx].vec[jdx+stream*red]=0.;/*TRAP*/
+            KERN.hiddens[idx].vec[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[idx]),jdx+stream*red);/*TRAP*/
 #define OP_WI(ix) KERN.hiddens[idx].vec[jdx+stream*red]+=\
     KERN.hiddens[idx].weights[M*(jdx+stream*red)+ix]*KERN.hiddens[idx-1].vec[ix]
             UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-            KERN.hiddens[idx].vec[jdx+stream*red]=ann_act(
-                KERN.hiddens[idx].vec[jdx+stream*red]);
         }
+        ann_act_range(&(KERN.hiddens[idx]),stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
                       KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
             for(jdx=0;jdx<rem;jdx++){
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=0.;/*TRAP*/
+                KERN.hiddens[idx].vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[idx]),jdx+n_streams*red);/*TRAP*/
 #define OP_WI(ix) KERN.hiddens[idx].vec[jdx+n_streams*red]+=\
  KERN.hiddens[idx].weights[M*(jdx+n_streams*red)+ix]*KERN.hiddens[idx-1].vec[ix]
                 UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=ann_act(
-                    KERN.hiddens[idx].vec[jdx+n_streams*red]);
             }
+            ann_act_range(&(KERN.hiddens[idx]),n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<N;jdx++){
-            KERN.hiddens[idx].vec[jdx]=0.;/*TRAP*/
+            KERN.hiddens[idx].vec[jdx]=ANN_BIAS(&(KERN.hiddens[idx]),jdx);/*TRAP*/
 #define OP_WI(ix) KERN.hiddens[idx].vec[jdx]+=\
     KERN.hiddens[idx].weights[_2D_IDX(M,jdx,ix)]*KERN.hiddens[idx-1].vec[ix]
             UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-            KERN.hiddens[idx].vec[jdx]=ann_act(KERN.hiddens[idx].vec[jdx]);
         }
+        ann_act_range(&(KERN.hiddens[idx]),0,N);
 #endif /*_MPI*/
 #endif /*PBLAS*/
     }
-/*+++ III - output +++*/
+}
+/*-------------------------------*/
+/*+++ feed-forward output(s) +++*/
+/*-------------------------------*/
+/* run the output layer, last hidden layer has to be done already.*/
+void ann_kernel_run_output(kernel_ann *kernel){
+    UINT M,N;
+#ifndef PBLAS
+    UINT jdx;
+#endif /*PBLAS*/
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT kdx;
+#endif
+#ifdef _MPI
+    UINT n_streams,stream;
+    UINT red,rem;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
+    if(KERN.output.rank>0){
+        ann_lowrank_run(&(KERN.output),KERN.hiddens[KERN.n_hiddens-1].vec);
+        return;
+    }
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
 #ifdef _MPI
@@ -1132,32 +2081,28 @@ _HT;
 #ifdef _MPI
     cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
         1.0,KERN.output.weights+stream*M*red,M,
-        KERN.hiddens[KERN.n_hiddens-1].vec,1,0.,KERN.output.vec+stream*red,1);
-#define OP_ACT(ix) KERN.output.vec[ix+stream*red]=\
-    ann_act(KERN.output.vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+        KERN.hiddens[KERN.n_hiddens-1].vec,1,
+        ann_bias_load(&(KERN.output),KERN.output.vec,stream*red,red),
+        KERN.output.vec+stream*red,1);
+    ann_act_range(&(KERN.output),stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
                   KERN.output.vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
         cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
             1.0,KERN.output.weights+n_streams*M*red,M,
             KERN.hiddens[KERN.n_hiddens-1].vec,1,
-            0.,KERN.output.vec+n_streams*red,1);
-#define OP_ACT(ix) KERN.output.vec[ix+n_streams*red]=\
-        ann_act(KERN.output.vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+            ann_bias_load(&(KERN.output),KERN.output.vec,n_streams*red,rem),
+            KERN.output.vec+n_streams*red,1);
+        ann_act_range(&(KERN.output),n_streams*red,rem);
     }
 #else /*_MPI*/
     /*serial dgemv (no thread support here)*/
     cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
         1.0,KERN.output.weights,M,
         KERN.hiddens[KERN.n_hiddens-1].vec,1,
-        0.,KERN.output.vec,1);
-#define OP_ACT(ix) KERN.output.vec[ix]=ann_act(KERN.output.vec[ix])
-    UNROLL_OMP_FOR(0,N,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
+        ann_bias_load(&(KERN.output),KERN.output.vec,0,N),
+        KERN.output.vec,1);
+    ann_act_range(&(KERN.output),0,N);
 #endif /*_MPI*/
 #elif defined(SBLAS)
     /*move the mv into a series of vv*/
@@ -1165,241 +2110,537 @@ _HT;
 #pragma omp parallel for private(jdx) _NT
     for(jdx=0;jdx<red;jdx++){
 _HT;
-        KERN.output.vec[jdx+stream*red]=cblas_ddot(
+        KERN.output.vec[jdx+stream*red]=ANN_BIAS(&(KERN.output),jdx+stream*red)+cblas_ddot(
             M,&(KERN.output.weights[M*(jdx+stream*red)]),1,
             KERN.hiddens[KERN.n_hiddens-1].vec,1);
-        KERN.output.vec[jdx+stream*red]=ann_act(
-            KERN.output.vec[jdx+stream*red]);
     }
+    ann_act_range(&(KERN.output),stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
                   KERN.output.vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
 _HT;
-            KERN.output.vec[jdx+n_streams*red]=cblas_ddot(
+            KERN.output.vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.output),jdx+n_streams*red)+cblas_ddot(
                 M,&(KERN.output.weights[M*(jdx+n_streams*red)]),1,
                 KERN.hiddens[KERN.n_hiddens-1].vec,1);
-            KERN.output.vec[jdx+n_streams*red]=ann_act(
-                KERN.output.vec[jdx+n_streams*red]);
         }
+        ann_act_range(&(KERN.output),n_streams*red,rem);
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
     for(jdx=0;jdx<N;jdx++){
 _HT;
-        KERN.output.vec[jdx]=cblas_ddot(
+        KERN.output.vec[jdx]=ANN_BIAS(&(KERN.output),jdx)+cblas_ddot(
             M,&(KERN.output.weights[_2D_IDX(M,jdx,0)]),1,
             KERN.hiddens[KERN.n_hiddens-1].vec,1);
-        KERN.output.vec[jdx]=ann_act(KERN.output.vec[jdx]);
     }
+    ann_act_range(&(KERN.output),0,N);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
 #pragma omp parallel for private(jdx,kdx) _NT
     for(jdx=0;jdx<red;jdx++){
-        KERN.output.vec[jdx+stream*red]=0.;/*TRAP*/
+        KERN.output.vec[jdx+stream*red]=ANN_BIAS(&(KERN.output),jdx+stream*red);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx+stream*red]+=\
                     KERN.output.weights[M*(jdx+stream*red)+ix]*\
                     KERN.hiddens[KERN.n_hiddens-1].vec[ix]
         UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-        KERN.output.vec[jdx+stream*red]=ann_act(
-            KERN.output.vec[jdx+stream*red]);
     }
+    ann_act_range(&(KERN.output),stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
                   KERN.output.vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
-            KERN.output.vec[jdx+n_streams*red]=0.;/*TRAP*/
+            KERN.output.vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.output),jdx+n_streams*red);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx+n_streams*red]+=\
                     KERN.output.weights[M*(jdx+n_streams*red)+ix]*\
                     KERN.hiddens[KERN.n_hiddens-1].vec[ix]
             UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-            KERN.output.vec[jdx+n_streams*red]=ann_act(
-                KERN.output.vec[jdx+n_streams*red]);
         }
+        ann_act_range(&(KERN.output),n_streams*red,rem);
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
     for(jdx=0;jdx<N;jdx++){
-        KERN.output.vec[jdx]=0.;/*TRAP*/
+        KERN.output.vec[jdx]=ANN_BIAS(&(KERN.output),jdx);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx]+=\
    KERN.output.weights[_2D_IDX(M,jdx,ix)]*KERN.hiddens[KERN.n_hiddens-1].vec[ix]
         UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
-        KERN.output.vec[jdx]=ann_act(KERN.output.vec[jdx]);
     }
+    ann_act_range(&(KERN.output),0,N);
 #endif /*_MPI*/
 #endif /*PBLAS*/
-#ifdef _MPI
-//  MPI_Barrier(MPI_COMM_WORLD);/*WAIT FOR ALL TASKS BEFORE LEAVING*/
-#endif
-    /*done*/
+}
 #endif /*_CUDA*/
+/*--------------------------------*/
+/*+++ sparse input (1st layer) +++*/
+/*--------------------------------*/
+/* Inputs that are mostly zero (one-hot, bag-of-words, thresholded pixels)
+ * are scanned once per pass: the indices of nonzero inputs are kept in
+ * nz_idx and, when at most 1/ANN_SPARSE_RATIO of the inputs are nonzero,
+ * the 1st layer mv (and ger, see ann_kernel_train) only visit these columns.*/
+static UINT ann_kernel_sparse_scan(kernel_ann *kernel){
+    UINT idx,M,n_nz=0;
+    M=KERN.hiddens[0].n_inputs;
+    if(KERN.nz_idx==NULL) ALLOC(KERN.nz_idx,M,UINT);
+    for(idx=0;idx<M;idx++) if(KERN.in[idx]!=0.) KERN.nz_idx[n_nz++]=idx;
+    return n_nz;
 }
-/*-------------------------------*/
-/*+++ Train Error Calculation +++*/
-/*-------------------------------*/
-DOUBLE ann_kernel_train_error(kernel_ann *kernel, const DOUBLE *train){
-    DOUBLE Ep=0.;
-    UINT idx,N;
+#ifndef _CUDA
+static DOUBLE ann_sparse_dot(const DOUBLE *w,const DOUBLE *in,
+                             const UINT *nz_idx,UINT n_nz){
+    DOUBLE acc=0.;
+    UINT idx;
+    for(idx=0;idx<n_nz;idx++) acc+=w[nz_idx[idx]]*in[nz_idx[idx]];
+    return acc;
+}
+static void ann_kernel_run_sparse(kernel_ann *kernel,UINT n_nz){
+    UINT jdx,M,N;
 #ifdef _MPI
-    UINT red,rem;
     UINT n_streams,stream;
+    UINT red,rem;
     _NN(get,mpi_tasks)(&n_streams);
     _NN(get,curr_mpi_task)(&stream);
 #endif /*_MPI*/
-    N=KERN.n_outputs;
+    N=KERN.hiddens[0].n_neurons;
+    M=KERN.hiddens[0].n_inputs;
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
-#pragma omp parallel for private(idx) reduction(+:Ep) _NT
-    for(idx=0;idx<red;idx++)
-            Ep+=(train[idx+stream*red]-KERN.output.vec[idx+stream*red])
-               *(train[idx+stream*red]-KERN.output.vec[idx+stream*red]);
-    MPI_Allreduce(MPI_IN_PLACE,&Ep,1,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    if(rem>0) {
-        for(idx=0;idx<rem;idx++) 
-            Ep+=(train[idx+n_streams*red]-KERN.output.vec[idx+n_streams*red])
-               *(train[idx+n_streams*red]-KERN.output.vec[idx+n_streams*red]);
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<red;jdx++){
+        KERN.hiddens[0].vec[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+stream*red)+ann_sparse_dot(
+            &(KERN.hiddens[0].weights[_2D_IDX(M,jdx+stream*red,0)]),
+            KERN.in,KERN.nz_idx,n_nz);
+    }
+    ann_act_range(&(KERN.hiddens[0]),stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
+                  KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+#pragma omp parallel for private(jdx) _NT
+        for(jdx=0;jdx<rem;jdx++){
+            KERN.hiddens[0].vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+n_streams*red)+ann_sparse_dot(
+                &(KERN.hiddens[0].weights[_2D_IDX(M,jdx+n_streams*red,0)]),
+                KERN.in,KERN.nz_idx,n_nz);
+        }
+        ann_act_range(&(KERN.hiddens[0]),n_streams*red,rem);
     }
 #else /*_MPI*/
-#pragma omp parallel for private(idx) reduction(+:Ep) _NT
-    for(idx=0;idx<N;idx++) Ep+=(train[idx]-KERN.output.vec[idx])*(train[idx]-KERN.output.vec[idx]);
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<N;jdx++){
+        KERN.hiddens[0].vec[jdx]=ANN_BIAS(&(KERN.hiddens[0]),jdx)+ann_sparse_dot(
+            &(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]),
+            KERN.in,KERN.nz_idx,n_nz);
+    }
+    ann_act_range(&(KERN.hiddens[0]),0,N);
 #endif /*_MPI*/
-    Ep*=0.5;
-    return Ep;
 }
-/*------------------------*/
-/*+++ Calculate deltas +++*/
-/*------------------------*/
-void ann_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train, DOUBLE **delta_ptr){
+/*--------------------------*/
+/*+++ feed-forward input +++*/
+/*--------------------------*/
+/*^^^ sum[0..N[ = bias + weights.in for the 1st hidden layer, before its
+ * activation (gathered on all MPI tasks). It is used by both the one pass
+ * run (sum=hiddens[0].vec) and the incremental run refresh (sum=inc_sum).*/
+static void ann_kernel_run_sum(kernel_ann *kernel,DOUBLE *sum){
+    UINT M,N;
+#ifndef PBLAS
+    UINT jdx;
+#endif
 #if !defined (PBLAS) && !defined (SBLAS)
-        UINT kdx;
+    UINT kdx;
 #endif
-    UINT N,M;
-        UINT idx, jdx;
 #ifdef _MPI
-    UINT red, rem;
     UINT n_streams,stream;
+    UINT red,rem;
     _NN(get,mpi_tasks)(&n_streams);
     _NN(get,curr_mpi_task)(&stream);
 #endif /*_MPI*/
-/*^^^ output*/
-    N=KERN.output.n_neurons;
+    N=KERN.hiddens[0].n_neurons;
+    M=KERN.hiddens[0].n_inputs;
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
-#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix+stream*red]=\
-    (train[ix+stream*red]-KERN.output.vec[ix+stream*red])*ann_dact(KERN.output.vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,DELTA,idx);
-#undef OP_DELTA
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens],red,MPI_DOUBLE,MPI_COMM_WORLD);
-    if(rem>0){
-#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix+n_streams*red]=\
-    (train[ix+n_streams*red]-KERN.output.vec[ix+n_streams*red])*ann_dact(KERN.output.vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DELTA,idx);
-#undef OP_DELTA
-    }
-#else /*_MPI*/
-#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix]=(train[ix]-KERN.output.vec[ix])*ann_dact(KERN.output.vec[ix])
-    UNROLL_OMP_FOR(0,N,ANN_UNROLL,DELTA,idx);
-#undef OP_DELTA
-#endif /*_MPI*/
-/*^^^ output to hidden*/
-    N=KERN.output.n_neurons;
-    M=KERN.output.n_inputs;
-#ifdef _MPI
-    red=M/n_streams;
-    rem=M%n_streams;
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
-    cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
-        1.0,KERN.output.weights+stream*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
+        1.0,KERN.hiddens[0].weights+stream*M*red,
+        M,KERN.in,1,
+        ann_bias_load(&(KERN.hiddens[0]),sum,stream*red,red),
+        sum+stream*red,1);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
+                  sum,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
-        cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
-            1.0,KERN.output.weights+n_streams*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
+            1.0,KERN.hiddens[0].weights+n_streams*M*red,
+            M,KERN.in,1,
+            ann_bias_load(&(KERN.hiddens[0]),sum,n_streams*red,rem),
+            sum+n_streams*red,1);
     }
 #else /*_MPI*/
-    /*! transposed*/
-    cblas_dgemv(CblasRowMajor,CblasTrans,N,M,1.0,KERN.output.weights,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1],1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix])
-    UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
+                1.0,KERN.hiddens[0].weights,
+                M,KERN.in,1,
+                ann_bias_load(&(KERN.hiddens[0]),sum,0,N),
+                sum,1);
 #endif /*_MPI*/
 #elif defined(SBLAS)
-    /*move the mv into a series of vv*/
+    /*move the parallel mv into a series of vv*/
 #ifdef _MPI
 #pragma omp parallel for private(jdx) _NT
     for(jdx=0;jdx<red;jdx++){
 _HT;
-        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]=cblas_ddot(
-            N,&(KERN.output.weights[jdx+stream*red]),M,delta_ptr[KERN.n_hiddens],1);
-        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+stream*red]);
+        sum[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+stream*red)+cblas_ddot(
+            M,&(KERN.hiddens[0].weights[M*(jdx+stream*red)]),1,KERN.in,1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
+                  sum,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
 _HT;
-            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]=cblas_ddot(
-                N,&(KERN.output.weights[jdx+n_streams*red]),M,delta_ptr[KERN.n_hiddens],1);
-            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+n_streams*red]);
+            sum[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+n_streams*red)+cblas_ddot(
+            M,&(KERN.hiddens[0].weights[M*(jdx+n_streams*red)]),1,KERN.in,1);
         }
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<M;jdx++){
+    for(jdx=0;jdx<N;jdx++){
 _HT;
-        /*since the matrix is transposed incX is the matrix stride!*/
-        delta_ptr[KERN.n_hiddens-1][jdx]=cblas_ddot(
-        N,&(KERN.output.weights[jdx]),M,&(delta_ptr[KERN.n_hiddens][0]),1);
-        delta_ptr[KERN.n_hiddens-1][jdx]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx]);
+        sum[jdx]=ANN_BIAS(&(KERN.hiddens[0]),jdx)+cblas_ddot(
+        M,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]),1,KERN.in,1);
     }
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
 #pragma omp parallel for private(jdx,kdx) _NT
     for(jdx=0;jdx<red;jdx++){
-#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx+stream*red]+=\
-    KERN.output.weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[KERN.n_hiddens][ix]
-        UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
-#undef OP_WD
-        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+stream*red]);
+        sum[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+stream*red);/*TRAP*/
+#define OP_WI(ix) sum[jdx+stream*red]+=\
+        KERN.hiddens[0].weights[M*(jdx+stream*red)+ix]*KERN.in[ix]
+        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
+            sum,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
-#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]+=\
-    KERN.output.weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[KERN.n_hiddens][ix]
-            UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
-#undef OP_WD
-            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+n_streams*red]);
+            sum[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+n_streams*red);/*TRAP*/
+#define OP_WI(ix) sum[jdx+n_streams*red]+=\
+            KERN.hiddens[0].weights[M*(jdx+n_streams*red)+ix]*KERN.in[ix]
+            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
         }
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
-    for(jdx=0;jdx<M;jdx++){
-#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx]+=KERN.output.weights[_2D_IDX(M,ix,jdx)]*delta_ptr[KERN.n_hiddens][ix]
-        UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
-#undef OP_WD
-        delta_ptr[KERN.n_hiddens-1][jdx]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx]);
+    for(jdx=0;jdx<N;jdx++){
+        sum[jdx]=ANN_BIAS(&(KERN.hiddens[0]),jdx);/*TRAP*/
+#define OP_WI(ix) sum[jdx]+=\
+        KERN.hiddens[0].weights[_2D_IDX(M,jdx,ix)]*KERN.in[ix]
+        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
     }
 #endif /*_MPI*/
 #endif /*PBLAS*/
-#ifdef _MPI
+}
+static void ann_kernel_run_input(kernel_ann *kernel){
+    ann_kernel_run_sum(kernel,KERN.hiddens[0].vec);
+    ann_act_range(&(KERN.hiddens[0]),0,KERN.hiddens[0].n_neurons);
+}
+#endif /*_CUDA*/
+/*------------------------*/
+/*+++ feed-forward run +++*/
+/*------------------------*/
+void ann_kernel_run(kernel_ann *kernel){
+#ifdef   _CUDA
+    /*the _NN(run,kernel) is now in charge of transfer(s)*/
+    scuda_ann_forward(kernel,_NN(return,cudas)());
+#else  /*_CUDA*/
+    UINT n_nz;
+    /*simple, one pass kernel*/
+    /*incremental run data are not kept here*/
+    ann_kernel_inc_reset(kernel);
+/*+++ I - input +++*/
+    if(KERN.hiddens[0].rank>0){
+        ann_lowrank_run(&(KERN.hiddens[0]),KERN.in);
+    }else{
+        n_nz=ann_kernel_sparse_scan(kernel);
+        if(ANN_IS_SPARSE(n_nz,KERN.hiddens[0].n_inputs))
+            ann_kernel_run_sparse(kernel,n_nz);
+        else
+            ann_kernel_run_input(kernel);
+    }
+/*+++ II - hiddens +++*/
+    ann_kernel_run_hiddens(kernel);
+/*+++ III - output +++*/
+    ann_kernel_run_output(kernel);
+#ifdef _MPI
+//  MPI_Barrier(MPI_COMM_WORLD);/*WAIT FOR ALL TASKS BEFORE LEAVING*/
+#endif
+    /*done*/
+#endif /*_CUDA*/
+}
+/*------------------------------------*/
+/*+++ incremental feed-forward run +++*/
+/*------------------------------------*/
+/* The 1st hidden layer sums (before activation) are kept in inc_sum, along
+ * with the input they were calculated from (inc_in). When only a few inputs
+ * change between two runs, each changed input k only requires a correction
+ * inc_sum += (in[k]-inc_in[k]) * weights[:,k] ie. a column axpy, instead of
+ * the full (N x M) mv.  A full calculation is performed every
+ * ANN_INC_REFRESH incremental pass, to bound the numerical drift, or
+ * whenever the weights have changed (see ann_kernel_inc_reset).*/
+void ann_kernel_inc_reset(kernel_ann *kernel){
+    if(kernel==NULL) return;
+    KERN.inc_count=ANN_INC_REFRESH;
+}
+#ifndef _CUDA
+static void ann_kernel_inc_refresh(kernel_ann *kernel){
+    UINT M=KERN.hiddens[0].n_inputs;
+    ann_kernel_run_sum(kernel,KERN.inc_sum);
+    /*keep the reference input*/
+    ARRAY_CP(KERN.in,KERN.inc_in,M);
+    KERN.inc_count=0;
+}
+#endif /*_CUDA*/
+/* update the 1st hidden layer from a list of n_changed indices of changed
+ * input (changed==NULL means compare all inputs to the reference ones).
+ * Each MPI task performs the (cheap) axpy corrections on the whole layer.
+ * Return TRUE if the 1st layer output was modified.*/
+BOOL ann_kernel_inc_input(kernel_ann *kernel,UINT n_changed,const UINT *changed){
+#ifdef   _CUDA
+    /*no incremental run on GPU: caller should use ann_kernel_run*/
+    return TRUE;
+#else  /*_CUDA*/
+    UINT idx,kdx,M,N;
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT jdx;
+#endif
+    BOOL is_mod=FALSE;
+    DOUBLE dx;
+    N=KERN.hiddens[0].n_neurons;
+    M=KERN.hiddens[0].n_inputs;
+    if(KERN.inc_sum==NULL){
+        ALLOC(KERN.inc_sum,N,DOUBLE);
+        ALLOC(KERN.inc_in,M,DOUBLE);
+        KERN.inc_count=ANN_INC_REFRESH;
+    }
+    if(changed==NULL){
+        /*count changed inputs*/
+        n_changed=0;
+        for(idx=0;idx<M;idx++) if(KERN.in[idx]!=KERN.inc_in[idx]) n_changed++;
+    }
+    /*too many changes: a full mv is cheaper*/
+    if(4*n_changed>M) KERN.inc_count=ANN_INC_REFRESH;
+    if(changed==NULL) n_changed=M;
+    if(KERN.inc_count>=ANN_INC_REFRESH){
+        ann_kernel_inc_refresh(kernel);
+        is_mod=TRUE;
+    }else{
+        for(idx=0;idx<n_changed;idx++){
+            kdx=(changed==NULL) ? idx : changed[idx];
+            if(kdx>=M) continue;
+            dx=KERN.in[kdx]-KERN.inc_in[kdx];
+            if(dx==0.) continue;
+#if defined (PBLAS) || defined (SBLAS)
+_HT;
+            cblas_daxpy(N,dx,KERN.hiddens[0].weights+kdx,M,KERN.inc_sum,1);
+#else /*no PBLAS no SBLAS*/
+#define OP_AX(ix) KERN.inc_sum[ix]+=dx*KERN.hiddens[0].weights[_2D_IDX(M,ix,kdx)]
+            UNROLL_OMP_FOR(0,N,ANN_UNROLL,AX,jdx);
+#undef OP_AX
+#endif /*PBLAS*/
+            KERN.inc_in[kdx]=KERN.in[kdx];
+            is_mod=TRUE;
+        }
+        if(is_mod) KERN.inc_count++;
+    }
+    if(!is_mod) return FALSE;
+    ARRAY_CP(KERN.inc_sum,KERN.hiddens[0].vec,N);
+    ann_act_range(&(KERN.hiddens[0]),0,N);
+    return TRUE;
+#endif /*_CUDA*/
+}
+/* incremental version of ann_kernel_run: KERN.in is modified by the caller,
+ * which passes the list of modified indices.  The downstream layers are only
+ * recalculated when the 1st layer output has changed.*/
+void ann_kernel_run_inc(kernel_ann *kernel,UINT n_changed,const UINT *changed){
+#ifdef   _CUDA
+    ann_kernel_run(kernel);
+#else  /*_CUDA*/
+    if(!ann_kernel_inc_input(kernel,n_changed,changed)) return;
+    ann_kernel_run_hiddens(kernel);
+    ann_kernel_run_output(kernel);
+#endif /*_CUDA*/
+}
+/*-------------------------------*/
+/*+++ Train Error Calculation +++*/
+/*-------------------------------*/
+DOUBLE ann_kernel_train_error(kernel_ann *kernel, const DOUBLE *train){
+    DOUBLE Ep=0.;
+    UINT idx,N;
+#ifdef _MPI
+    UINT red,rem;
+    UINT n_streams,stream;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
+    N=KERN.n_outputs;
+#ifdef _MPI
+    red=N/n_streams;
+    rem=N%n_streams;
+#pragma omp parallel for private(idx) reduction(+:Ep) _NT
+    for(idx=0;idx<red;idx++)
+            Ep+=(train[idx+stream*red]-KERN.output.vec[idx+stream*red])
+               *(train[idx+stream*red]-KERN.output.vec[idx+stream*red]);
+    MPI_Allreduce(MPI_IN_PLACE,&Ep,1,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    if(rem>0) {
+        for(idx=0;idx<rem;idx++) 
+            Ep+=(train[idx+n_streams*red]-KERN.output.vec[idx+n_streams*red])
+               *(train[idx+n_streams*red]-KERN.output.vec[idx+n_streams*red]);
+    }
+#else /*_MPI*/
+#pragma omp parallel for private(idx) reduction(+:Ep) _NT
+    for(idx=0;idx<N;idx++) Ep+=(train[idx]-KERN.output.vec[idx])*(train[idx]-KERN.output.vec[idx]);
+#endif /*_MPI*/
+    Ep*=0.5;
+    return Ep;
+}
+/*------------------------*/
+/*+++ Calculate deltas +++*/
+/*------------------------*/
+void ann_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train, DOUBLE **delta_ptr){
+#if !defined (PBLAS) && !defined (SBLAS)
+        UINT kdx;
+#endif
+    UINT N,M;
+        UINT idx;
+#ifndef PBLAS
+        UINT jdx;
+#endif /*PBLAS*/
+#ifdef _MPI
+    UINT red, rem;
+    UINT n_streams,stream;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
+/*^^^ output*/
+    N=KERN.output.n_neurons;
+#ifdef _MPI
+    red=N/n_streams;
+    rem=N%n_streams;
+#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix+stream*red]=\
+    (train[ix+stream*red]-KERN.output.vec[ix+stream*red])
+    UNROLL_OMP_FOR(0,red,ANN_UNROLL,DELTA,idx);
+#undef OP_DELTA
+    ann_dact_range(&(KERN.output),delta_ptr[KERN.n_hiddens],stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix+n_streams*red]=\
+    (train[ix+n_streams*red]-KERN.output.vec[ix+n_streams*red])
+        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DELTA,idx);
+#undef OP_DELTA
+        ann_dact_range(&(KERN.output),delta_ptr[KERN.n_hiddens],
+            n_streams*red,rem);
+    }
+#else /*_MPI*/
+#define OP_DELTA(ix) delta_ptr[KERN.n_hiddens][ix]=(train[ix]-KERN.output.vec[ix])
+    UNROLL_OMP_FOR(0,N,ANN_UNROLL,DELTA,idx);
+#undef OP_DELTA
+    ann_dact_range(&(KERN.output),delta_ptr[KERN.n_hiddens],0,N);
+#endif /*_MPI*/
+/*^^^ output to hidden*/
+    N=KERN.output.n_neurons;
+    M=KERN.output.n_inputs;
+#ifdef _MPI
+    red=M/n_streams;
+    rem=M%n_streams;
+#endif /*_MPI*/
+#ifdef PBLAS
+#ifdef _MPI
+    cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
+        1.0,KERN.output.weights+stream*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+stream*red,1);
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+        cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
+            1.0,KERN.output.weights+n_streams*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+n_streams*red,1);
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
+    }
+#else /*_MPI*/
+    /*! transposed*/
+    cblas_dgemv(CblasRowMajor,CblasTrans,N,M,1.0,KERN.output.weights,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1],1);
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
+#endif /*_MPI*/
+#elif defined(SBLAS)
+    /*move the mv into a series of vv*/
+#ifdef _MPI
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<red;jdx++){
+_HT;
+        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]=cblas_ddot(
+            N,&(KERN.output.weights[jdx+stream*red]),M,delta_ptr[KERN.n_hiddens],1);
+    }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+#pragma omp parallel for private(jdx) _NT
+        for(jdx=0;jdx<rem;jdx++){
+_HT;
+            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]=cblas_ddot(
+                N,&(KERN.output.weights[jdx+n_streams*red]),M,delta_ptr[KERN.n_hiddens],1);
+        }
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
+    }
+#else /*_MPI*/
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<M;jdx++){
+_HT;
+        /*since the matrix is transposed incX is the matrix stride!*/
+        delta_ptr[KERN.n_hiddens-1][jdx]=cblas_ddot(
+        N,&(KERN.output.weights[jdx]),M,&(delta_ptr[KERN.n_hiddens][0]),1);
+    }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
+#endif /*_MPI*/
+#else /*no PBLAS no SBLAS*/
+#ifdef _MPI
+#pragma omp parallel for private(jdx,kdx) _NT
+    for(jdx=0;jdx<red;jdx++){
+#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx+stream*red]+=\
+    KERN.output.weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[KERN.n_hiddens][ix]
+        UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
+#undef OP_WD
+    }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+#pragma omp parallel for private(jdx,kdx) _NT
+        for(jdx=0;jdx<rem;jdx++){
+#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]+=\
+    KERN.output.weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[KERN.n_hiddens][ix]
+            UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
+#undef OP_WD
+        }
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
+    }
+#else /*_MPI*/
+#pragma omp parallel for private(jdx,kdx) _NT
+    for(jdx=0;jdx<M;jdx++){
+#define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx]+=KERN.output.weights[_2D_IDX(M,ix,jdx)]*delta_ptr[KERN.n_hiddens][ix]
+        UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
+#undef OP_WD
+    }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
+#endif /*_MPI*/
+#endif /*PBLAS*/
+#ifdef _MPI
 #endif /*_MPI*/
 /*^^^ hidden to hidden (if any)*/
     if(KERN.n_hiddens>1){
@@ -1414,23 +2655,17 @@ _HT;
 #ifdef _MPI
             cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
                  1.0,KERN.hiddens[idx+1].weights+stream*red,M,delta_ptr[idx+1],1,0.,delta_ptr[idx]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[idx][ix+stream*red]*=ann_dact(KERN.hiddens[idx].vec[ix+stream*red])
-            UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
                 cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
                     1.0,KERN.hiddens[idx+1].weights+n_streams*red,M,delta_ptr[idx+1],1,0.,delta_ptr[idx]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[idx][ix+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[ix+n_streams*red])
-                UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
             /*! transposed*/
             cblas_dgemv(CblasRowMajor,CblasTrans,N,M,1.0,KERN.hiddens[idx+1].weights,M,delta_ptr[idx+1],1,0.,delta_ptr[idx],1);
-#define OP_DACT(ix) delta_ptr[idx][ix]*=ann_dact(KERN.hiddens[idx].vec[ix])
-            UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #elif defined(SBLAS)
             /*move the mv into a series of vv*/
@@ -1441,8 +2676,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[idx][jdx+stream*red]=cblas_ddot(
                 N,&(KERN.hiddens[idx+1].weights[jdx+stream*red]),M,delta_ptr[idx+1],1);
-                delta_ptr[idx][jdx+stream*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+stream*red]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
 #pragma omp parallel for private(jdx) _NT
@@ -1451,8 +2686,8 @@ _HT;
                     /*since the matrix is transposed incX is the matrix stride!*/
                     delta_ptr[idx][jdx+n_streams*red]=cblas_ddot(
                     N,&(KERN.hiddens[idx+1].weights[jdx+n_streams*red]),M,delta_ptr[idx+1],1);
-                    delta_ptr[idx][jdx+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+n_streams*red]);
                 }
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
@@ -1461,8 +2696,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[idx][jdx]=cblas_ddot(
                 N,&(KERN.hiddens[idx+1].weights[_2D_IDX(M,0,jdx)]),M,delta_ptr[idx+1],1);
-                delta_ptr[idx][jdx]*=ann_dact(KERN.hiddens[idx].vec[jdx]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
@@ -1471,8 +2706,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx+stream*red]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[idx+1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[idx][jdx+stream*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+stream*red]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -1480,8 +2715,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx+n_streams*red]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[idx+1][ix]
                     UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                    delta_ptr[idx][jdx+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+n_streams*red]);
                 }
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -1489,8 +2724,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx)]*delta_ptr[idx+1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[idx][jdx]*=ann_dact(KERN.hiddens[idx].vec[jdx]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #endif /*PBLAS*/
 #ifdef _MPI
@@ -1508,23 +2743,17 @@ _HT;
 #ifdef _MPI
         cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
             1.0,KERN.hiddens[1].weights+stream*red,M,delta_ptr[1],1,0.,delta_ptr[0]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[0][ix+stream*red]*=ann_dact(KERN.hiddens[0].vec[ix+stream*red])
-        UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
             cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
             1.0,KERN.hiddens[1].weights+n_streams*red,M,delta_ptr[1],1,0.,delta_ptr[0]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[0][ix+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[ix+n_streams*red])
-            UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
         cblas_dgemv(CblasRowMajor,CblasTrans,N,M,
         1.0,KERN.hiddens[1].weights,M,delta_ptr[1],1,0.,delta_ptr[0],1);
-#define OP_DACT(ix) delta_ptr[0][ix]*=ann_dact(KERN.hiddens[0].vec[ix])
-        UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #elif defined(SBLAS)
 #ifdef _MPI
@@ -1534,8 +2763,8 @@ _HT;
             /*since the matrix is transposed incX is the matrix stride!*/
             delta_ptr[0][jdx+stream*red]=cblas_ddot(
             N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx+stream*red)]),N,&(delta_ptr[1][0]),1);
-            delta_ptr[0][jdx+stream*red]*=ann_dact(KERN.hiddens[0].vec[jdx+stream*red]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
@@ -1544,8 +2773,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[0][jdx+n_streams*red]=cblas_ddot(
                 N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx+n_streams*red)]),N,&(delta_ptr[1][0]),1);
-                delta_ptr[0][jdx+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[jdx+n_streams*red]);
             }
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
@@ -1554,8 +2783,8 @@ _HT;
             /*since the matrix is transposed incX is the matrix stride!*/
             delta_ptr[0][jdx]=cblas_ddot(
             N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx)]),M,&(delta_ptr[1][0]),1);
-            delta_ptr[0][jdx]*=ann_dact(KERN.hiddens[0].vec[jdx]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
@@ -1564,8 +2793,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx+stream*red]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[1][ix]
             UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-            delta_ptr[0][jdx+stream*red]*=ann_dact(KERN.hiddens[0].vec[jdx+stream*red]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -1573,8 +2802,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx+n_streams*red]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[0][jdx+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[jdx+n_streams*red]);
             }
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -1582,23 +2811,329 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx)]*delta_ptr[1][ix]
             UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-            delta_ptr[0][jdx]*=ann_dact(KERN.hiddens[0].vec[jdx]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #endif /*PBLAS*/
 #ifdef _MPI
 #endif /*_MPI*/
     }
 }
+/*^^^ 1st layer ger restricted to the nonzero input columns.  Both delta and
+ * input are known to all MPI tasks: each one updates all rows, which avoids
+ * the weights Allgather.*/
+static void ann_kernel_train_sparse(kernel_ann *kernel,const DOUBLE *delta,
+                                    DOUBLE rate,UINT n_nz){
+    UINT jdx,kdx,M,N;
+    DOUBLE *w;
+    DOUBLE d;
+    N=KERN.hiddens[0].n_neurons;
+    M=KERN.hiddens[0].n_inputs;
+#pragma omp parallel for private(jdx,kdx,w,d) _NT
+    for(jdx=0;jdx<N;jdx++){
+        w=&(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]);
+        d=rate*delta[jdx];
+        for(kdx=0;kdx<n_nz;kdx++) w[KERN.nz_idx[kdx]]+=d*KERN.in[KERN.nz_idx[kdx]];
+    }
+}
+/*------------------------------------*/
+/*+++ compressed weight sync (MPI) +++*/
+/*------------------------------------*/
+/* With layers split over MPI tasks, each task updates its own rows of the
+ * weights, which are then Allgathered.  With compression, tasks exchange
+ * the update of their rows (new-old weights) instead: down-cast to float
+ * (fp32), to half scaled by max|update| (fp16), or only the largest ratio*n
+ * of them as index/float pairs (topk, a sparse allgather).  The part of an
+ * update lost by the compression is kept in a residual, and added to the
+ * next one (error feedback).  The owner applies the decompressed update
+ * like any other task, so that all tasks keep identical weights.
+ * The exchange of a layer is only posted (MPI_Iallgather) once its rows are
+ * updated, so that it proceeds while the next layers are updated, and it is
+ * completed by ann_comp_wait when the weights are needed again.  Momentum
+ * (dw) is never exchanged: a task only ever reads its own rows of it.*/
+typedef struct {
+    UINT idx;
+    float val;
+} ann_comp_pair;
+static nn_comp ann_comp_mode=NN_COMP_NONE;
+static DOUBLE ann_comp_ratio=NN_COMP_RATIO;
+static UINT64 ann_comp_sent=0;  /*bytes sent by this task*/
+static UINT64 ann_comp_raw=0;   /*bytes sent without compression*/
+#ifdef _MPI
+typedef struct {
+    MPI_Request req;    /*pending exchange (MPI_REQUEST_NULL: none)*/
+    DOUBLE *weights;    /*weights of the layer*/
+    UINT n;             /*weights per task*/
+    UINT k;             /*pairs per task (topk)*/
+    UINT64 blk;         /*bytes per task (0: not compressed)*/
+    CHAR *buf;          /*compressed updates of all tasks*/
+    UINT64 len;         /*size of buf*/
+} ann_comp_req;
+static ann_comp_req *ann_comp_q=NULL;/*one per layer*/
+static UINT ann_comp_nq=0;
+static DOUBLE *ann_comp_sel=NULL;   /*topk selection*/
+static UINT64 ann_comp_nsel=0;
+#endif /*_MPI*/
+/*^^^ set the compression of the MPI weight sync, reset statistics*/
+void ann_comp_set(nn_comp mode,DOUBLE ratio){
+#ifdef _MPI
+    UINT idx;
+    ann_comp_wait();
+#endif /*_MPI*/
+    ann_comp_mode=mode;
+    ann_comp_ratio=((ratio>0.)&&(ratio<=1.))?ratio:NN_COMP_RATIO;
+    ann_comp_sent=0;
+    ann_comp_raw=0;
+#ifdef _MPI
+    if(mode==NN_COMP_NONE){
+        for(idx=0;idx<ann_comp_nq;idx++) FREE(ann_comp_q[idx].buf);
+        FREE(ann_comp_q);
+        ann_comp_nq=0;
+        FREE(ann_comp_sel);
+        ann_comp_nsel=0;
+    }
+#endif /*_MPI*/
+}
+/*^^^ bytes sent by this task for weight sync, with and without compression*/
+void ann_comp_stats(UINT64 *sent,UINT64 *raw){
+    *sent=ann_comp_sent;
+    *raw=ann_comp_raw;
+}
+void ann_comp_free(kernel_ann *kernel){
+    UINT idx;
+    if(KERN.dc==NULL) return;
+    for(idx=0;idx<KERN.n_hiddens+1;idx++) FREE(KERN.dc[idx]);
+    FREE(KERN.dc);
+}
+#ifdef _MPI
+static BOOL ann_comp_active(){
+    UINT n_tasks;
+    if(ann_comp_mode==NN_COMP_NONE) return FALSE;
+    _NN(get,mpi_tasks)(&n_tasks);
+    return (n_tasks>1);
+}
+/*^^^ half precision bits of x (|x|<=1), rounded to nearest even*/
+static unsigned short ann_comp_half(DOUBLE x){
+    union {float f; UINT u;} v;
+    unsigned short h;
+    v.f=(float)x;
+    h=(v.u>>16)&0x8000;
+    v.u&=0x7FFFFFFF;
+    /*subnormal (below 2^-14): x=m.2^-24*/
+    if(v.u<0x38800000) return h|(unsigned short)lrintf(v.f*16777216.f);
+    /*rebias exponent (127->15), round the 13 dropped mantissa bits*/
+    return h|(unsigned short)((v.u-0x38000000+0x0FFF+((v.u>>13)&1))>>13);
+}
+static DOUBLE ann_comp_single(unsigned short h){
+    union {float f; UINT u;} v;
+    if((h&0x7C00)==0) v.f=(float)(h&0x3FF)*5.9604644775390625E-8f;
+    else v.u=((UINT)(h&0x7FFF)<<13)+0x38000000;
+    return (h&0x8000)?-(DOUBLE)v.f:(DOUBLE)v.f;
+}
+/*^^^ k-th largest of a[0..n-1] (quickselect, a is reordered)*/
+static DOUBLE ann_comp_select(DOUBLE *a,UINT n,UINT k){
+    int lo=0,hi=(int)n-1,i,j;
+    DOUBLE p,t;
+    k--;
+    while(lo<hi){
+        p=a[(lo+hi)/2];
+        i=lo;j=hi;
+        while(i<=j){
+            while(a[i]>p) i++;
+            while(a[j]<p) j--;
+            if(i<=j){
+                t=a[i];a[i]=a[j];a[j]=t;
+                i++;j--;
+            }
+        }
+        if((int)k<=j) hi=j;
+        else if((int)k>=i) lo=i;
+        else break;
+    }
+    return a[k];
+}
+/*^^^ keep the n weights of this task before they are updated*/
+void ann_comp_save(kernel_ann *kernel,UINT layer,const DOUBLE *w,UINT n){
+    if(!ann_comp_active()) return;
+    if(KERN.dc==NULL) ALLOC(KERN.dc,KERN.n_hiddens+1,DOUBLE *);
+    /*residual, then saved weights*/
+    if(KERN.dc[layer]==NULL) ALLOC(KERN.dc[layer],2*n,DOUBLE);
+    memcpy(KERN.dc[layer]+n,w,n*sizeof(DOUBLE));
+}
+/*^^^ exchange slot of a layer*/
+static ann_comp_req *ann_comp_slot(UINT layer){
+    ann_comp_req *q;
+    UINT idx;
+    if(layer>=ann_comp_nq){
+        /*requests are handles: they can be moved while pending*/
+        ALLOC(q,layer+1,ann_comp_req);
+        if(ann_comp_nq>0) memcpy(q,ann_comp_q,ann_comp_nq*sizeof(ann_comp_req));
+        for(idx=ann_comp_nq;idx<=layer;idx++) q[idx].req=MPI_REQUEST_NULL;
+        FREE(ann_comp_q);
+        ann_comp_q=q;
+        ann_comp_nq=layer+1;
+    }
+    return &(ann_comp_q[layer]);
+}
+/*^^^ replaces the Allgather of weights, n per task, once each task has
+ * updated its rows (see ann_comp_save).  The exchange is only posted: the
+ * weights are not to be read before ann_comp_wait.*/
+void ann_comp_sync(kernel_ann *kernel,UINT layer,DOUBLE *weights,UINT n){
+    UINT n_tasks,task,idx,jdx,k=0,n_eq;
+    UINT64 blk,len;
+    DOUBLE *res,*w,s;
+    CHAR *buf;
+    float *f;
+    unsigned short *h;
+    ann_comp_pair *p;
+    ann_comp_req *q;
+    if(n==0) return;/*same n on all tasks*/
+    ann_comp_raw+=n*sizeof(DOUBLE);
+    q=ann_comp_slot(layer);
+    if(q->req!=MPI_REQUEST_NULL) ann_comp_wait();/*layer synced twice*/
+    q->weights=weights;
+    q->n=n;
+    q->blk=0;
+    if(!ann_comp_active()){
+        MPI_Iallgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,weights,n,
+            MPI_DOUBLE,MPI_COMM_WORLD,&(q->req));
+        ann_comp_sent+=n*sizeof(DOUBLE);
+        return;
+    }
+    _NN(get,mpi_tasks)(&n_tasks);
+    _NN(get,curr_mpi_task)(&task);
+    res=KERN.dc[layer];
+    w=weights+task*n;
+    /*res=update+residual, restore the weights*/
+    for(idx=0;idx<n;idx++){
+        res[idx]+=w[idx]-res[n+idx];
+        w[idx]=res[n+idx];
+    }
+    switch(ann_comp_mode){
+    case NN_COMP_FP16:
+        blk=sizeof(DOUBLE)+n*sizeof(unsigned short);/*scale, then values*/
+        break;
+    case NN_COMP_TOPK:
+        k=(UINT)(ann_comp_ratio*n);
+        if(k<1) k=1;
+        blk=k*sizeof(ann_comp_pair);
+        break;
+    case NN_COMP_FP32:
+    default:
+        blk=n*sizeof(float);
+    }
+    blk=(blk+sizeof(DOUBLE)-1)&~((UINT64)sizeof(DOUBLE)-1);
+    len=n_tasks*blk;
+    if(len>q->len){
+        FREE(q->buf);
+        ALLOC(q->buf,len,CHAR);
+        q->len=len;
+    }
+    q->k=k;
+    q->blk=blk;
+/*+++ I - compress in place, keep what is lost +++*/
+    buf=q->buf+task*blk;
+    switch(ann_comp_mode){
+    case NN_COMP_FP16:
+        s=0.;
+        for(idx=0;idx<n;idx++) if(fabs(res[idx])>s) s=fabs(res[idx]);
+        *((DOUBLE *)buf)=s;
+        h=(unsigned short *)(buf+sizeof(DOUBLE));
+        for(idx=0;idx<n;idx++){
+            h[idx]=(s>0.)?ann_comp_half(res[idx]/s):0;
+            res[idx]-=s*ann_comp_single(h[idx]);
+        }
+        break;
+    case NN_COMP_TOPK:
+        if(n>ann_comp_nsel){
+            FREE(ann_comp_sel);
+            ALLOC(ann_comp_sel,n,DOUBLE);
+            ann_comp_nsel=n;
+        }
+        for(idx=0;idx<n;idx++) ann_comp_sel[idx]=fabs(res[idx]);
+        s=ann_comp_select(ann_comp_sel,n,k);
+        /*all above s, and as many equal to s as needed*/
+        n_eq=k;
+        for(idx=0;idx<n;idx++) if(fabs(res[idx])>s) n_eq--;
+        p=(ann_comp_pair *)buf;
+        jdx=0;
+        for(idx=0;(idx<n)&&(jdx<k);idx++){
+            if(fabs(res[idx])<s) continue;
+            if(fabs(res[idx])==s){
+                if(n_eq==0) continue;
+                n_eq--;
+            }
+            p[jdx].idx=idx;
+            p[jdx].val=(float)res[idx];
+            res[idx]-=(DOUBLE)p[jdx].val;
+            jdx++;
+        }
+        for(;jdx<k;jdx++){
+            p[jdx].idx=0;
+            p[jdx].val=0.;
+        }
+        break;
+    case NN_COMP_FP32:
+    default:
+        f=(float *)buf;
+        for(idx=0;idx<n;idx++){
+            f[idx]=(float)res[idx];
+            res[idx]-=(DOUBLE)f[idx];
+        }
+    }
+/*+++ II - post the exchange +++*/
+    MPI_Iallgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,q->buf,(int)blk,
+        MPI_BYTE,MPI_COMM_WORLD,&(q->req));
+    ann_comp_sent+=blk;
+}
+/*^^^ complete all pending exchanges: every task then applies the updates
+ * of every task (compression).*/
+void ann_comp_wait(){
+    UINT n_tasks,task,layer,idx,jdx;
+    DOUBLE *w,s;
+    CHAR *buf;
+    float *f;
+    unsigned short *h;
+    ann_comp_pair *p;
+    ann_comp_req *q;
+    _NN(get,mpi_tasks)(&n_tasks);
+    for(layer=0;layer<ann_comp_nq;layer++){
+        q=&(ann_comp_q[layer]);
+        if(q->req==MPI_REQUEST_NULL) continue;
+        MPI_Wait(&(q->req),MPI_STATUS_IGNORE);
+        if(q->blk==0) continue;
+        for(task=0;task<n_tasks;task++){
+            buf=q->buf+task*q->blk;
+            w=q->weights+task*q->n;
+            switch(ann_comp_mode){
+            case NN_COMP_FP16:
+                s=*((DOUBLE *)buf);
+                h=(unsigned short *)(buf+sizeof(DOUBLE));
+                for(idx=0;idx<q->n;idx++) w[idx]+=s*ann_comp_single(h[idx]);
+                break;
+            case NN_COMP_TOPK:
+                p=(ann_comp_pair *)buf;
+                for(jdx=0;jdx<q->k;jdx++) w[p[jdx].idx]+=(DOUBLE)p[jdx].val;
+                break;
+            case NN_COMP_FP32:
+            default:
+                f=(float *)buf;
+                for(idx=0;idx<q->n;idx++) w[idx]+=(DOUBLE)f[idx];
+            }
+        }
+        q->blk=0;
+    }
+}
+#endif /*_MPI*/
 /*------------------------*/
 /*+++ back-propagation +++*/
 /*------------------------*/
-DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train){
+DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train,DOUBLE *err){
 #define LEARN_RATE 0.01
 #if !defined (PBLAS) && !defined (SBLAS)
     UINT kdx;
 #endif
-    UINT N,M;
+    UINT N,M,n_nz;
     DOUBLE **delta_ptr;
     UINT idx;
 #ifndef PBLAS
@@ -1618,8 +3153,15 @@ DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train){
     ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
     for(idx=0;idx<KERN.n_hiddens;idx++)
         ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
 /*+++ I - forward is _supposed_ to be done already +++*/
-    Ep=ann_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        /*the error is usually known from the previous step*/
+        if(*err<0.) Ep=ann_kernel_train_error(kernel,train);
+        else Ep=*err;
+    }
 //  NN_DBG(stdout,"TRAINING INITIAL ERROR: %.15f\n",Ep);
 /*+++ II - calculate deltas +++*/
     ann_kernel_train_delta(kernel,train,delta_ptr);
@@ -1627,15 +3169,18 @@ DOUBLE ann_kernel_train(kernel_ann *kernel,const DOUBLE *train){
 /*^^^ output*/
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
+    /*bias: the ger column of a constant input 1*/
+    ann_bias_train(&(KERN.output),delta_ptr[KERN.n_hiddens],BP_LEARN_RATE);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,KERN.n_hiddens,KERN.output.weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,BP_LEARN_RATE,delta_ptr[KERN.n_hiddens]+stream*red,
     1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.output.weights+stream*M*red,M);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,BP_LEARN_RATE,delta_ptr[KERN.n_hiddens]+n_streams*red,
         1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.output.weights+n_streams*M*red,M);
@@ -1653,7 +3198,7 @@ _HT;
         M,delta_ptr[KERN.n_hiddens][idx+stream*red]*BP_LEARN_RATE,
         &(KERN.hiddens[KERN.n_hiddens-1].vec[0]),1,&(KERN.output.weights[_2D_IDX(M,idx+stream*red,0)]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx) _NT
         for(idx=0;idx<rem;idx++){
@@ -1683,7 +3228,7 @@ _HT;
         UNROLL_FOR(0,M,ANN_UNROLL,DH,jdx);
 #undef OP_DH
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx,jdx) _NT
         for(idx=0;idx<rem;idx++){
@@ -1710,9 +3255,11 @@ _HT;
     for(idx=(KERN.n_hiddens-1);idx>0;idx--){
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
+        ann_bias_train(&(KERN.hiddens[idx]),delta_ptr[idx],BP_LEARN_RATE);
 #ifdef _MPI
         red=N/n_streams;
         rem=N%n_streams;
+        ann_comp_save(kernel,idx,KERN.hiddens[idx].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
@@ -1720,7 +3267,7 @@ _HT;
         delta_ptr[idx]+stream*red,1,
         KERN.hiddens[idx-1].vec,1,
         KERN.hiddens[idx].weights+stream*M*red,M);
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
             cblas_dger(CblasRowMajor,rem,M,BP_LEARN_RATE,
                 delta_ptr[idx]+n_streams*red,1,
@@ -1738,7 +3285,7 @@ _HT;
             cblas_daxpy(M,delta_ptr[idx][jdx+stream*red]*BP_LEARN_RATE,
                 &(KERN.hiddens[idx-1].vec[0]),1,&(KERN.hiddens[idx].weights[_2D_IDX(M,jdx+stream*red,0)]),1);
         }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
             for(jdx=0;jdx<rem;jdx++){
@@ -1765,7 +3312,7 @@ _HT;
             UNROLL_FOR(0,M,ANN_UNROLL,DH,kdx);
 #undef OP_DH
         }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
             for(jdx=0;jdx<rem;jdx++){
@@ -1792,14 +3339,22 @@ _HT;
     /*add zero*/
     N=KERN.hiddens[0].n_neurons;
     M=KERN.hiddens[0].n_inputs;
+    ann_bias_train(&(KERN.hiddens[0]),delta_ptr[0],BP_LEARN_RATE);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+#endif /*_MPI*/
+    n_nz=ann_kernel_sparse_scan(kernel);
+if(ANN_IS_SPARSE(n_nz,M)){
+    ann_kernel_train_sparse(kernel,delta_ptr[0],BP_LEARN_RATE,n_nz);
+}else{
+#ifdef _MPI
+    ann_comp_save(kernel,0,KERN.hiddens[0].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,BP_LEARN_RATE,delta_ptr[0]+stream*red,1,KERN.in,1,KERN.hiddens[0].weights+stream*M*red,M);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,
             BP_LEARN_RATE,delta_ptr[0]+n_streams*red,1,
@@ -1816,7 +3371,7 @@ _HT;
     for(jdx=0;jdx<red;jdx++){
         cblas_daxpy(M,BP_LEARN_RATE*delta_ptr[0][jdx+stream*red],KERN.in,1,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx+stream*red,0)]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         for(jdx=0;jdx<rem;jdx++){
             cblas_daxpy(M,BP_LEARN_RATE*delta_ptr[0][jdx+n_streams*red],
@@ -1837,7 +3392,7 @@ _HT;
         UNROLL_FOR(0,M,ANN_UNROLL,DI,kdx);
 #undef OP_DI
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -1855,12 +3410,19 @@ _HT;
     }
 #endif /*_MPI*/
 #endif /*PBLAS*/
+}
 #ifdef _MPI
 //  MPI_Barrier(MPI_COMM_WORLD);//WAIT FOR ALL TASKS
 #endif /*_MPI*/
+#ifdef _MPI
+    ann_comp_wait();/*weights are needed again*/
+#endif /*_MPI*/
 /*+++ IV - update error +++*/
     ann_kernel_run(kernel);
-    Epr=ann_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        Epr=ann_kernel_train_error(kernel,train);
+        *err=Epr;
+    }
 //  NN_DBG(stdout,"TRAINING UPDATED ERROR: %.15f\n",Epr);
 /*+++ V - cleanup +++*/
     for(idx=0;idx<(KERN.n_hiddens+1);idx++){
@@ -1918,6 +3480,11 @@ void ann_raz_momentum(kernel_ann *kernel){
     }
     memset(KERN.dw[KERN.n_hiddens],0,sizeof(DOUBLE)*
         (KERN.output.n_inputs*KERN.output.n_neurons));
+    for(idx=0;idx<KERN.n_hiddens;idx++) if(KERN.hiddens[idx].dbias!=NULL)
+        memset(KERN.hiddens[idx].dbias,0,sizeof(DOUBLE)*
+            KERN.hiddens[idx].n_neurons);
+    if(KERN.output.dbias!=NULL)
+        memset(KERN.output.dbias,0,sizeof(DOUBLE)*KERN.output.n_neurons);
 #else  /*_CUDA*/
     scuda_ann_raz_momentum(kernel,_NN(return,cudas)());
 #endif /*_CUDA*/
@@ -1929,8 +3496,12 @@ void ann_momentum_free(kernel_ann *kernel){
     UINT idx;
     /*FREE everything*/
 #ifndef  _CUDA
-    for(idx=0;idx<KERN.n_hiddens;idx++) FREE(KERN.dw[idx]);
+    for(idx=0;idx<KERN.n_hiddens;idx++){
+        FREE(KERN.dw[idx]);
+        FREE(KERN.hiddens[idx].dbias);
+    }
     FREE(KERN.dw[KERN.n_hiddens]);
+    FREE(KERN.output.dbias);
 #else  /*_CUDA*/
     /*allocate everything in CUDA*/
     scuda_ann_free_momentum(kernel,_NN(return,cudas)());
@@ -1940,7 +3511,7 @@ void ann_momentum_free(kernel_ann *kernel){
 /*---------------------------------*/
 /*+++ momentum back-propagation +++*/
 /*---------------------------------*/
-DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE alpha){
+DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE alpha,DOUBLE *err){
     UINT idx,N,M;
 #ifdef _MPI
     UINT red, rem;
@@ -1964,8 +3535,15 @@ DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
     ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
     for(idx=0;idx<KERN.n_hiddens;idx++)
         ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
 /*+++ I - forward is _supposed_ to be done already +++*/
-    Ep=ann_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        /*the error is usually known from the previous step*/
+        if(*err<0.) Ep=ann_kernel_train_error(kernel,train);
+        else Ep=*err;
+    }
 //  NN_DBG(stdout,"TRAINING INITIAL ERROR: %.15f\n",Ep);
 /*+++ II - calculate deltas +++*/
     ann_kernel_train_delta(kernel,train,delta_ptr);
@@ -1973,9 +3551,12 @@ DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
 /*^^^ output*/
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
+    /*bias: the ger column of a constant input 1*/
+    ann_bias_momentum(&(KERN.output),delta_ptr[KERN.n_hiddens],BPM_LEARN_RATE,alpha);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,KERN.n_hiddens,KERN.output.weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
@@ -1983,8 +3564,7 @@ DOUBLE ann_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
     1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.dw[KERN.n_hiddens]+stream*M*red,M);
     cblas_daxpy(red*M,1.0,KERN.dw[KERN.n_hiddens]+stream*M*red,1,KERN.output.weights+stream*M*red,1);
     cblas_dscal(red*M,alpha,KERN.dw[KERN.n_hiddens]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,BPM_LEARN_RATE,delta_ptr[KERN.n_hiddens]+n_streams*red,
         1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.dw[KERN.n_hiddens]+n_streams*M*red,M);
@@ -2012,8 +3592,7 @@ _HT;
         &(KERN.output.weights[_2D_IDX(M,idx+stream*red,0)]),1);
         cblas_dscal(M,alpha,&(KERN.dw[KERN.n_hiddens][(idx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx) _NT
         for(idx=0;idx<rem;idx++){
@@ -2054,8 +3633,7 @@ _HT;
             KERN.dw[KERN.n_hiddens][(idx+stream*red)*M+jdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx,jdx) _NT
         for(idx=0;idx<rem;idx++){
@@ -2082,23 +3660,24 @@ _HT;
     for(idx=(KERN.n_hiddens-1);idx>0;idx--){
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
+        ann_bias_momentum(&(KERN.hiddens[idx]),delta_ptr[idx],BPM_LEARN_RATE,alpha);
 #ifdef _MPI
         red=N/n_streams;
         rem=N%n_streams;
+        ann_comp_save(kernel,idx,KERN.hiddens[idx].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,BPM_LEARN_RATE,
         delta_ptr[idx]+stream*red,1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx]+stream*M*red,M);
-    cblas_daxpy(N*M,1.0,KERN.dw[idx]+stream*M*red,1,KERN.hiddens[idx].weights+stream*M*red,1);
-    cblas_dscal(N*M,alpha,KERN.dw[idx]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    cblas_daxpy(red*M,1.0,KERN.dw[idx]+stream*M*red,1,KERN.hiddens[idx].weights+stream*M*red,1);
+    cblas_dscal(red*M,alpha,KERN.dw[idx]+stream*M*red,1);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
-        cblas_dger(CblasRowMajor,red,M,BPM_LEARN_RATE,
+        cblas_dger(CblasRowMajor,rem,M,BPM_LEARN_RATE,
             delta_ptr[idx]+n_streams*red,1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx]+n_streams*M*red,M);
-        cblas_daxpy(N*M,1.0,KERN.dw[idx]+n_streams*M*red,1,KERN.hiddens[idx].weights+n_streams*M*red,1);
-        cblas_dscal(N*M,alpha,KERN.dw[idx]+n_streams*M*red,1);
+        cblas_daxpy(rem*M,1.0,KERN.dw[idx]+n_streams*M*red,1,KERN.hiddens[idx].weights+n_streams*M*red,1);
+        cblas_dscal(rem*M,alpha,KERN.dw[idx]+n_streams*M*red,1);
     }
 #else /*_MPI*/
     cblas_dger(CblasRowMajor,N,M,BPM_LEARN_RATE,delta_ptr[idx],1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx],M);
@@ -2115,8 +3694,7 @@ _HT;
         cblas_daxpy(M,1.0,&(KERN.dw[idx][(jdx+stream*red)*M]),1,&(KERN.hiddens[idx].weights[(jdx+stream*red)*M]),1);
         cblas_dscal(M,alpha,&(KERN.dw[idx][(jdx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -2150,8 +3728,7 @@ _HT;
             KERN.dw[idx][(jdx+stream*red)*M+kdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -2178,17 +3755,18 @@ _HT;
     /*add zero*/
     N=KERN.hiddens[0].n_neurons;
     M=KERN.hiddens[0].n_inputs;
+    ann_bias_momentum(&(KERN.hiddens[0]),delta_ptr[0],BPM_LEARN_RATE,alpha);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,0,KERN.hiddens[0].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,BPM_LEARN_RATE,delta_ptr[0]+stream*red,1,KERN.in,1,KERN.dw[0]+stream*M*red,M);
     cblas_daxpy(red*M,1.0,KERN.dw[0]+stream*M*red,1,KERN.hiddens[0].weights+stream*M*red,1);
     cblas_dscal(red*M,alpha,KERN.dw[0]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,BPM_LEARN_RATE,delta_ptr[0]+n_streams*red,1,KERN.in,1,KERN.dw[0]+n_streams*M*red,M);
         cblas_daxpy(rem*M,1.0,KERN.dw[0]+n_streams*M*red,1,KERN.hiddens[0].weights+n_streams*M*red,1);
@@ -2208,8 +3786,7 @@ _HT;
         cblas_daxpy(M,1.0,&(KERN.dw[0][(jdx+stream*red)*M]),1,&(KERN.hiddens[0].weights[(jdx+stream*red)*M]),1);
         cblas_dscal(M,alpha,&(KERN.dw[0][(jdx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         for(jdx=0;jdx<rem;jdx++){
 _HT;
@@ -2240,8 +3817,7 @@ _HT;
             KERN.dw[0][(jdx+stream*red)*M+kdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -2263,9 +3839,15 @@ _HT;
     }
 #endif /*_MPI*/
 #endif /*PBLAS*/
+#ifdef _MPI
+    ann_comp_wait();/*weights are needed again*/
+#endif /*_MPI*/
 /*+++ IV - update error +++*/
     ann_kernel_run(kernel);
-    Epr=ann_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        Epr=ann_kernel_train_error(kernel,train);
+        *err=Epr;
+    }
 //  NN_DBG(stdout,"TRAINING UPDATED ERROR: %.15f\n",Epr);
 /*+++ IV - cleanup +++*/
     for(idx=0;idx<(KERN.n_hiddens+1);idx++){
@@ -2275,19 +3857,83 @@ _HT;
     FREE(delta_ptr);
     return Ep-Epr;
 }
+/*-------------------------------------*/
+/*+++ per-sample convergence policy +++*/
+/*-------------------------------------*/
+/*^^^ monotonic wall-time (s)*/
+DOUBLE ann_wtime(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (DOUBLE)ts.tv_sec+1E-9*(DOUBLE)ts.tv_nsec;
+}
+/*^^^ start a sample with initial error Ep*/
+void ann_conv_init(ann_conv *cv,DOUBLE Ep){
+    cv->t_start=ann_wtime();
+    cv->best=Ep;
+    cv->i_best=0;
+}
+/*^^^ check the budgets of a sample which has not converged after iter
+ * iterations, Ep being its current error: returns NN_STOP_NONE if training
+ * should go on.  With conv==NULL only max_iter applies (original behavior).*/
+nn_stop ann_conv_stop(const nn_conv *conv,ann_conv *cv,
+                      UINT iter,UINT max_iter,DOUBLE Ep){
+    BOOL is_late;
+#ifdef _MPI
+    UINT n_tasks;
+#endif /*_MPI*/
+    if((conv!=NULL)&&(conv->max_iter>0)) max_iter=conv->max_iter;
+    if(iter>max_iter) return NN_STOP_ITER;
+    if(conv==NULL) return NN_STOP_NONE;
+    if(conv->patience>0){
+        if(Ep<cv->best*(1.-conv->min_rel)){
+            cv->best=Ep;
+            cv->i_best=iter;
+        }else if((iter-cv->i_best)>=conv->patience) return NN_STOP_STALL;
+    }
+    if(conv->max_time>0.){
+        is_late=((ann_wtime()-cv->t_start)>conv->max_time);
+#ifdef _MPI
+        /*all tasks have to stop at the same iteration*/
+        _NN(get,mpi_tasks)(&n_tasks);
+        if(n_tasks>1) MPI_Allreduce(MPI_IN_PLACE,&is_late,1,
+                                    MPI_INT,MPI_LOR,MPI_COMM_WORLD);
+#endif /*_MPI*/
+        if(is_late) return NN_STOP_TIME;
+    }
+    return NN_STOP_NONE;
+}
+/*^^^ account for a finished sample*/
+void ann_conv_done(nn_conv_stats *stats,const ann_conv *cv,
+                   UINT iter,nn_stop stop){
+    DOUBLE dt;
+    if(stats==NULL) return;
+    dt=ann_wtime()-cv->t_start;
+    stats->n_samples++;
+    stats->n_stop[stop]++;
+    stats->n_iter+=iter;
+    stats->t_train+=dt;
+    if(stop!=NN_STOP_NONE) stats->t_stop+=dt;
+    stats->last=stop;
+}
 /*--------------------------*/
 /* train ANN sample with BP */
 /*--------------------------*/
-DOUBLE ann_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,DOUBLE delta){
+DOUBLE ann_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                    DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats){
 /*typical values delta=0.000001*/
     BOOL is_ok;
     UINT   idx;
     UINT  iter;
     UINT max_p;
     UINT p_trg;
+    DOUBLE  Ep;
     DOUBLE dEp;
     DOUBLE *ptr;
     DOUBLE probe;
+    BOOL is_lazy;
+    UINT n_check;
+    nn_stop stop;
+    ann_conv cv;
 #ifdef _CUDA
     cudastreams *cudas=_NN(return,cudas)();
     DOUBLE *train_gpu;
@@ -2320,12 +3966,21 @@ if(cudas->mem_model==CUDA_MEM_CMM){
     dEp*=0.5;
 #endif /*_CUDA*/
     NN_COUT(stdout," init=%15.10f",dEp);
+    Ep=dEp;
+    ann_conv_init(&cv,Ep);
+    stop=NN_STOP_NONE;
+    n_check=((conv!=NULL)&&(conv->n_check>1))?conv->n_check:1;
+    is_ok=FALSE;
     iter=0;
     if(delta <= 0.) delta = DELTA_BP;/*default*/
     do{
         iter++;
+        /*error and answer are only checked every n_check iterations*/
+        is_lazy=(iter>1)&&((iter%n_check)!=0);
 #ifdef _CUDA
         dEp=(DOUBLE)scuda_ann_train(kernel,train_gpu,cudas);
+        Ep-=dEp;/*dEp is the error decrease of this iteration*/
+        if(is_lazy) continue;/*no output copy*/
 if(cudas->mem_model!=CUDA_MEM_CMM){
         /*we have to sync output.cuda_v -> out*/
         CUDA_SET_DEV(*cudas,0);/*make sure transfer happen from GPU[0]*/
@@ -2338,7 +3993,12 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
         ptr=kernel->output.vec;
 }
 #else /*_CUDA*/
-        dEp=ann_kernel_train(kernel,train_out);
+        if(is_lazy){
+            ann_kernel_train(kernel,train_out,NULL);
+            Ep=-1.;/*unknown*/
+            continue;
+        }
+        dEp=ann_kernel_train(kernel,train_out,&Ep);
         ptr=kernel->output.vec;
 #endif /*_CUDA*/
         /*1- determine max_p, p_trg*/
@@ -2348,7 +4008,7 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
                 probe=ptr[idx];
                 max_p=idx;
             }
-            if(train_out[idx]==1.0) p_trg=idx;
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
         }
         /*2- match*/
         is_ok=(max_p==p_trg);
@@ -2357,9 +4017,13 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
             if(is_ok==TRUE) NN_COUT(stdout," OK");
             else NN_COUT(stdout," NO");
         }
-        if(iter>MAX_BP_ITER) break;/*do at most MAX iterations*/
+        /*3- budgets (only while not converged)*/
+        if((dEp>delta)||(is_ok!=TRUE)||(iter<=MIN_BP_ITER))
+            stop=ann_conv_stop(conv,&cv,iter,MAX_BP_ITER,Ep);
+        if(stop!=NN_STOP_NONE) break;/*budget exhausted*/
         is_ok&=(iter>MIN_BP_ITER);/*do at least MIN iterations*/
     }while((dEp > delta)||(!(is_ok==TRUE)));
+    ann_conv_done(stats,&cv,iter,stop);
     NN_COUT(stdout," N_ITER=%8i",iter);
     NN_COUT(stdout," final=%15.10f",dEp);
     if(is_ok==TRUE) NN_COUT(stdout," SUCCESS!\n");
@@ -2373,16 +4037,23 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
 /*---------------------------*/
 /* train ANN sample with BPM */
 /*---------------------------*/
-DOUBLE ann_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,DOUBLE alpha,DOUBLE delta){
+DOUBLE ann_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                     DOUBLE alpha,DOUBLE delta,const nn_conv *conv,
+                     nn_conv_stats *stats){
 /*typical values alpha=0.2 delta=0.00001*/
     BOOL is_ok;
     UINT   idx;
     UINT  iter;
     UINT max_p;
     UINT p_trg;
+    DOUBLE  Ep;
     DOUBLE dEp;
     DOUBLE *ptr;
     DOUBLE probe;
+    BOOL is_lazy;
+    UINT n_check;
+    nn_stop stop;
+    ann_conv cv;
     ann_raz_momentum(kernel);
 #ifdef _CUDA
     cudastreams *cudas=_NN(return,cudas)();
@@ -2415,12 +4086,21 @@ if(cudas->mem_model==CUDA_MEM_CMM){
     dEp*=0.5;
 #endif /*_CUDA*/
     NN_COUT(stdout," init=%15.10f",dEp);
+    Ep=dEp;
+    ann_conv_init(&cv,Ep);
+    stop=NN_STOP_NONE;
+    n_check=((conv!=NULL)&&(conv->n_check>1))?conv->n_check:1;
+    is_ok=FALSE;
     iter=0;
     if(delta <= 0.) delta = DELTA_BPM;/*default*/
     do{
         iter++;
+        /*error and answer are only checked every n_check iterations*/
+        is_lazy=(iter>1)&&((iter%n_check)!=0);
 #ifdef _CUDA
         dEp=(DOUBLE)scuda_ann_train_momentum(kernel,train_gpu,alpha,cudas);
+        Ep-=dEp;/*dEp is the error decrease of this iteration*/
+        if(is_lazy) continue;/*no output copy*/
 if(cudas->mem_model!=CUDA_MEM_CMM){
         /*we have to sync output.cuda_v -> out*/
         CUDA_SET_DEV(*cudas,0);/*make sure transfer happen from GPU[0]*/
@@ -2433,7 +4113,12 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
         ptr=kernel->output.vec;
 }
 #else /*_CUDA*/
-        dEp=ann_kernel_train_momentum(kernel,train_out,alpha);
+        if(is_lazy){
+            ann_kernel_train_momentum(kernel,train_out,alpha,NULL);
+            Ep=-1.;/*unknown*/
+            continue;
+        }
+        dEp=ann_kernel_train_momentum(kernel,train_out,alpha,&Ep);
         ptr=kernel->output.vec;
 #endif /*_CUDA*/
         /*1- determine max_p, p_trg*/
@@ -2443,7 +4128,7 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
                 probe = ptr[idx];
                 max_p = idx;
             }
-            if(train_out[idx]==1.0) p_trg = idx;
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
         }
         /*2- match*/
         is_ok=(max_p == p_trg);
@@ -2452,9 +4137,13 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
             if(is_ok==TRUE) NN_COUT(stdout," OK");
             else NN_COUT(stdout," NO");
         }
-        if(iter>MAX_BPM_ITER) break;/*do at most MAX iterations*/
+        /*3- budgets (only while not converged)*/
+        if((dEp>delta)||(is_ok!=TRUE)||(iter<=MIN_BPM_ITER))
+            stop=ann_conv_stop(conv,&cv,iter,MAX_BPM_ITER,Ep);
+        if(stop!=NN_STOP_NONE) break;/*budget exhausted*/
         is_ok&=(iter>MIN_BPM_ITER);/*do at least MIN iterations*/
     }while((dEp > delta)||(!(is_ok==TRUE)));
+    ann_conv_done(stats,&cv,iter,stop);
     NN_COUT(stdout," N_ITER=%8i",iter);
     NN_COUT(stdout," final=%15.10f",dEp);
     if(is_ok==TRUE) NN_COUT(stdout," SUCCESS!\n");
@@ -2465,4 +4154,1453 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
 #endif /*_CUDA*/
     return dEp;
 }
+#ifndef _CUDA
+/*-----------------------------------*/
+/*+++ ADAM / RMSPROP moment arrays +++*/
+/*-----------------------------------*/
+/*^^^ dw (1st moment) and dv (2nd moment) of each layer hold n_neurons*
+ * (n_inputs+1) values: the weights, followed by one per bias.  Unlike BPM
+ * momentum, moments are kept from one sample to the next, over a whole
+ * training call: per-weight step sizes are then learned on all samples.*/
+void ann_adapt_init(kernel_ann *kernel){
+    UINT idx;
+    UINT64 allocate=0;
+    ALLOC_REPORT(KERN.dw,KERN.n_hiddens+1,DOUBLE *,allocate);
+    ALLOC_REPORT(KERN.dv,KERN.n_hiddens+1,DOUBLE *,allocate);
+    for(idx=0;idx<KERN.n_hiddens;idx++){
+        ALLOC_REPORT(KERN.dw[idx],
+            (KERN.hiddens[idx].n_inputs+1)*KERN.hiddens[idx].n_neurons,
+            DOUBLE,allocate);
+        ALLOC_REPORT(KERN.dv[idx],
+            (KERN.hiddens[idx].n_inputs+1)*KERN.hiddens[idx].n_neurons,
+            DOUBLE,allocate);
+    }
+    ALLOC_REPORT(KERN.dw[idx],
+        (KERN.output.n_inputs+1)*KERN.output.n_neurons,DOUBLE,allocate);
+    ALLOC_REPORT(KERN.dv[idx],
+        (KERN.output.n_inputs+1)*KERN.output.n_neurons,DOUBLE,allocate);
+    KERN.n_step=0;
+    NN_OUT(stdout,"[CPU] MOMENTS ALLOC: %lu (bytes)\n",allocate);
+}
+void ann_adapt_free(kernel_ann *kernel){
+    UINT idx;
+    if(KERN.dw!=NULL)
+        for(idx=0;idx<=KERN.n_hiddens;idx++) FREE(KERN.dw[idx]);
+    if(KERN.dv!=NULL)
+        for(idx=0;idx<=KERN.n_hiddens;idx++) FREE(KERN.dv[idx]);
+    FREE(KERN.dw);
+    FREE(KERN.dv);
+}
+/*---------------------------------*/
+/*+++ ADAM / RMSPROP row update +++*/
+/*---------------------------------*/
+/*^^^ private: update rows [from,from+n[ of layer, x being its input and m,v
+ * the moments.  Each weight is read, its gradient delta*x formed, both
+ * moments updated and the weight written in a single pass, which no BLAS
+ * call sequence can do.  ADAM: m=b1*m+(1-b1)*g; v=b2*v+(1-b2)*g^2;
+ * w+=step*m/(sqrt(v)+eps), step including the bias correction.  RMSPROP:
+ * v=rho*v+(1-rho)*g^2; w+=step*g/(sqrt(v)+eps) (m is unused).*/
+static void ann_adapt_rows(layer_ann *layer,const DOUBLE *x,
+                           const DOUBLE *delta,DOUBLE *m,DOUBLE *v,
+                           UINT from,UINT n,nn_train rule,DOUBLE step){
+    const UINT M=layer->n_inputs;
+    const UINT N=layer->n_neurons;
+    UINT jdx,kdx;
+    DOUBLE *w,*mw,*vw;
+    DOUBLE g,d;
+    if(rule==NN_TRAIN_ADAM){
+#pragma omp parallel for private(jdx,kdx,w,mw,vw,g,d) _NT
+        for(jdx=from;jdx<from+n;jdx++){
+            d=delta[jdx];
+            w=layer->weights+_2D_IDX(M,jdx,0);
+            mw=m+_2D_IDX(M,jdx,0);
+            vw=v+_2D_IDX(M,jdx,0);
+            for(kdx=0;kdx<M;kdx++){
+                g=d*x[kdx];
+                mw[kdx]=ADAM_BETA1*mw[kdx]+(1.-ADAM_BETA1)*g;
+                vw[kdx]=ADAM_BETA2*vw[kdx]+(1.-ADAM_BETA2)*g*g;
+                w[kdx]+=step*mw[kdx]/(sqrt(vw[kdx])+ADAPT_EPSILON);
+            }
+            if(layer->bias==NULL) continue;
+            /*bias moments follow the N*M weight ones*/
+            mw=m+N*M+jdx;
+            vw=v+N*M+jdx;
+            *mw=ADAM_BETA1*(*mw)+(1.-ADAM_BETA1)*d;
+            *vw=ADAM_BETA2*(*vw)+(1.-ADAM_BETA2)*d*d;
+            layer->bias[jdx]+=step*(*mw)/(sqrt(*vw)+ADAPT_EPSILON);
+        }
+    }else{
+#pragma omp parallel for private(jdx,kdx,w,vw,g,d) _NT
+        for(jdx=from;jdx<from+n;jdx++){
+            d=delta[jdx];
+            w=layer->weights+_2D_IDX(M,jdx,0);
+            vw=v+_2D_IDX(M,jdx,0);
+            for(kdx=0;kdx<M;kdx++){
+                g=d*x[kdx];
+                vw[kdx]=RMSPROP_RHO*vw[kdx]+(1.-RMSPROP_RHO)*g*g;
+                w[kdx]+=step*g/(sqrt(vw[kdx])+ADAPT_EPSILON);
+            }
+            if(layer->bias==NULL) continue;
+            vw=v+N*M+jdx;
+            *vw=RMSPROP_RHO*(*vw)+(1.-RMSPROP_RHO)*d*d;
+            layer->bias[jdx]+=step*d/(sqrt(*vw)+ADAPT_EPSILON);
+        }
+    }
+}
+/*^^^ update all layers from their deltas, common to ANN and SNN.  With MPI
+ * each task updates its own rows, which are then gathered: moments of a
+ * row are only ever used by the task owning it, so they are not sent.*/
+void ann_adapt_update(kernel_ann *kernel,DOUBLE **delta_ptr,nn_train rule){
+    layer_ann *lay;
+    const DOUBLE *x;
+    DOUBLE step;
+    UINT idx,N;
+#ifdef _MPI
+    UINT red, rem;
+    UINT n_streams,stream;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
+    KERN.n_step++;
+    if(rule==NN_TRAIN_ADAM){
+        step=ADAM_LEARN_RATE*sqrt(1.-pow(ADAM_BETA2,(DOUBLE)KERN.n_step))
+            /(1.-pow(ADAM_BETA1,(DOUBLE)KERN.n_step));
+    }else{
+        step=RMSPROP_LEARN_RATE;
+    }
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        x=(idx==0)?KERN.in:KERN.hiddens[idx-1].vec;
+        N=lay->n_neurons;
+#ifdef _MPI
+        red=N/n_streams;
+        rem=N%n_streams;
+        ann_adapt_rows(lay,x,delta_ptr[idx],KERN.dw[idx],KERN.dv[idx],
+            stream*red,red,rule,step);
+        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,lay->weights,
+            lay->n_inputs*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        if(lay->bias!=NULL) MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,
+            lay->bias,red,MPI_DOUBLE,MPI_COMM_WORLD);
+        if(rem>0) ann_adapt_rows(lay,x,delta_ptr[idx],KERN.dw[idx],
+            KERN.dv[idx],n_streams*red,rem,rule,step);
+#else  /*_MPI*/
+        ann_adapt_rows(lay,x,delta_ptr[idx],KERN.dw[idx],KERN.dv[idx],
+            0,N,rule,step);
+#endif /*_MPI*/
+    }
+}
+/*-------------------------------*/
+/*+++ ADAM / RMSPROP training +++*/
+/*-------------------------------*/
+DOUBLE ann_kernel_train_adapt(kernel_ann *kernel,const DOUBLE *train,
+                              nn_train rule){
+    DOUBLE **delta_ptr;
+    DOUBLE Ep,Epr;
+    UINT idx;
+    UINT64 allocate=0.;
+    if(!ann_validate_kernel(kernel)) return 0.;
+    ALLOC_REPORT(delta_ptr,KERN.n_hiddens+1,DOUBLE *,allocate);/*+1 for OUTPUT*/
+    ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+/*+++ I - forward is _supposed_ to be done already +++*/
+    Ep=ann_kernel_train_error(kernel,train);
+/*+++ II - calculate deltas +++*/
+    ann_kernel_train_delta(kernel,train,delta_ptr);
+/*+++ III - fused update +++*/
+    ann_adapt_update(kernel,delta_ptr,rule);
+/*+++ IV - update error +++*/
+    ann_kernel_run(kernel);
+    Epr=ann_kernel_train_error(kernel,train);
+/*+++ V - cleanup +++*/
+    for(idx=0;idx<(KERN.n_hiddens+1);idx++) FREE(delta_ptr[idx]);
+    FREE(delta_ptr);
+    return Ep-Epr;
+}
+/*---------------------------------------*/
+/* train ANN sample with ADAM or RMSPROP */
+/*---------------------------------------*/
+DOUBLE ann_train_adapt(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                       nn_train rule,DOUBLE delta){
+    BOOL is_ok;
+    UINT   idx;
+    UINT  iter;
+    UINT max_p;
+    UINT p_trg;
+    DOUBLE dEp;
+    DOUBLE probe;
+    ARRAY_CP(train_in,KERN.in,KERN.n_inputs);
+    dEp=0.;
+    ann_kernel_run(kernel);/*also FILL vec*/
+    for(idx=0;idx<kernel->n_outputs;idx++)
+        dEp+=(train_out[idx]-kernel->output.vec[idx])*(train_out[idx]-kernel->output.vec[idx]);
+    dEp*=0.5;
+    NN_COUT(stdout," init=%15.10f",dEp);
+    iter=0;
+    if(delta <= 0.) delta = DELTA_ADAPT;/*default*/
+    do{
+        iter++;
+        dEp=ann_kernel_train_adapt(kernel,train_out,rule);
+        /*1- determine max_p, p_trg*/
+        probe=-1.0;max_p=0;p_trg=0;
+        for(idx=0;idx<KERN.n_outputs;idx++){
+            if(probe < KERN.output.vec[idx]){
+                probe = KERN.output.vec[idx];
+                max_p = idx;
+            }
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
+        }
+        /*2- match*/
+        is_ok=(max_p == p_trg);
+        if(iter==1){
+            /*determine if we get a good answer at first try*/
+            if(is_ok==TRUE) NN_COUT(stdout," OK");
+            else NN_COUT(stdout," NO");
+        }
+        if(iter>MAX_ADAPT_ITER) break;/*do at most MAX iterations*/
+        is_ok&=(iter>MIN_ADAPT_ITER);/*do at least MIN iterations*/
+    }while((dEp > delta)||(!(is_ok==TRUE)));
+    NN_COUT(stdout," N_ITER=%8i",iter);
+    NN_COUT(stdout," final=%15.10f",dEp);
+    if(is_ok==TRUE) NN_COUT(stdout," SUCCESS!\n");
+    else NN_COUT(stdout," FAIL!\n");
+    fflush(stdout);
+    return dEp;
+}
+/*-------------------------------*/
+/*+++ conjugate gradient (CG) +++*/
+/*-------------------------------*/
+/* CG works on the flattened parameter vector: for each layer (hiddens then
+ * output) its n_neurons*n_inputs weights, followed by its biases if any.
+ * The vectors g (gradient) and d (direction) use that same layout.  g is
+ * the descent direction (sum of delta.x^T, as used by BP), so E decreases
+ * along g.  No reduction is done in parallel, so that every MPI task takes
+ * the very same decisions.*/
+/*^^^ private: number of parameters*/
+static UINT64 ann_cg_size(kernel_ann *kernel){
+    layer_ann *lay;
+    UINT64 n_par=0;
+    UINT idx;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        n_par+=(UINT64)lay->n_neurons*lay->n_inputs;
+        if(lay->bias!=NULL) n_par+=lay->n_neurons;
+    }
+    return n_par;
+}
+/*^^^ private: parameters+=a*d*/
+static void ann_cg_move(kernel_ann *kernel,const DOUBLE *d,DOUBLE a){
+    layer_ann *lay;
+    UINT64 jdx,n;
+    UINT idx;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        n=(UINT64)lay->n_neurons*lay->n_inputs;
+#pragma omp parallel for private(jdx) _NT
+        for(jdx=0;jdx<n;jdx++) lay->weights[jdx]+=a*d[jdx];
+        d+=n;
+        if(lay->bias==NULL) continue;
+        for(jdx=0;jdx<lay->n_neurons;jdx++) lay->bias[jdx]+=a*d[jdx];
+        d+=lay->n_neurons;
+    }
+}
+/*^^^ private: x=parameters (to_kernel=FALSE) or parameters=x (TRUE)*/
+static void ann_cg_copy(kernel_ann *kernel,DOUBLE *x,BOOL to_kernel){
+    layer_ann *lay;
+    UINT64 n;
+    UINT idx;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        n=(UINT64)lay->n_neurons*lay->n_inputs;
+        if(to_kernel) memcpy(lay->weights,x,n*sizeof(DOUBLE));
+        else memcpy(x,lay->weights,n*sizeof(DOUBLE));
+        x+=n;
+        if(lay->bias==NULL) continue;
+        if(to_kernel) memcpy(lay->bias,x,lay->n_neurons*sizeof(DOUBLE));
+        else memcpy(x,lay->bias,lay->n_neurons*sizeof(DOUBLE));
+        x+=lay->n_neurons;
+    }
+}
+/*^^^ private: serial dot product (same result on every MPI task)*/
+static DOUBLE ann_cg_dot(UINT64 n,const DOUBLE *a,const DOUBLE *b){
+    DOUBLE sum=0.;
+    UINT64 jdx;
+    for(jdx=0;jdx<n;jdx++) sum+=a[jdx]*b[jdx];
+    return sum;
+}
+/*^^^ private: error summed over the n samples*/
+static DOUBLE ann_cg_error(kernel_ann *kernel,const ann_cg_ops *ops,
+                           UINT n,DOUBLE **in,DOUBLE **out){
+    DOUBLE Ep=0.;
+    UINT sdx;
+    for(sdx=0;sdx<n;sdx++){
+        ARRAY_CP(in[sdx],KERN.in,KERN.n_inputs);
+        ops->run(kernel);
+        Ep+=ops->error(kernel,out[sdx]);
+    }
+    return Ep;
+}
+/*^^^ private: deltas of the current sample, for the given target*/
+static void ann_cg_delta(kernel_ann *kernel,const ann_cg_ops *ops,
+                         const DOUBLE *train,DOUBLE **delta_ptr){
+    UINT idx;
+    /*delta expects zeroed hidden deltas (no BLAS)*/
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        memset(delta_ptr[idx],0,KERN.hiddens[idx].n_neurons*sizeof(DOUBLE));
+    ops->delta(kernel,train,delta_ptr);
+}
+/*^^^ private: g+=delta.x^T (flattened layout)*/
+static void ann_cg_acc(kernel_ann *kernel,DOUBLE **delta_ptr,DOUBLE *g){
+    layer_ann *lay;
+    const DOUBLE *x;
+    UINT idx,N,M;
+#ifndef PBLAS
+    UINT jdx;
+#endif
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT kdx;
+#endif
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        x=(idx==0)?KERN.in:KERN.hiddens[idx-1].vec;
+        N=lay->n_neurons;
+        M=lay->n_inputs;
+#ifdef PBLAS
+        cblas_dger(CblasRowMajor,N,M,1.0,delta_ptr[idx],1,x,1,g,M);
+#elif defined(SBLAS)
+#pragma omp parallel for private(jdx) _NT
+        for(jdx=0;jdx<N;jdx++){
+_HT;
+            cblas_daxpy(M,delta_ptr[idx][jdx],x,1,g+_2D_IDX(M,jdx,0),1);
+        }
+#else /*no PBLAS no SBLAS*/
+#pragma omp parallel for private(jdx,kdx) _NT
+        for(jdx=0;jdx<N;jdx++)
+            for(kdx=0;kdx<M;kdx++)
+                g[_2D_IDX(M,jdx,kdx)]+=delta_ptr[idx][jdx]*x[kdx];
+#endif /*PBLAS*/
+        g+=(UINT64)N*M;
+        if(lay->bias==NULL) continue;
+#ifdef PBLAS
+        cblas_daxpy(N,1.0,delta_ptr[idx],1,g,1);
+#else  /*PBLAS*/
+        for(jdx=0;jdx<N;jdx++) g[jdx]+=delta_ptr[idx][jdx];
+#endif /*PBLAS*/
+        g+=N;
+    }
+}
+/*^^^ private: same as ann_cg_error, also accumulating the descent
+ * direction in g*/
+static DOUBLE ann_cg_grad(kernel_ann *kernel,const ann_cg_ops *ops,
+                          UINT n,DOUBLE **in,DOUBLE **out,
+                          DOUBLE **delta_ptr,UINT64 n_par,DOUBLE *g){
+    DOUBLE Ep=0.;
+    UINT sdx;
+    memset(g,0,n_par*sizeof(DOUBLE));
+    for(sdx=0;sdx<n;sdx++){
+        ARRAY_CP(in[sdx],KERN.in,KERN.n_inputs);
+        ops->run(kernel);
+        Ep+=ops->error(kernel,out[sdx]);
+        ann_cg_delta(kernel,ops,out[sdx],delta_ptr);
+        ann_cg_acc(kernel,delta_ptr,g);
+    }
+    return Ep;
+}
+/*^^^ Polak-Ribiere (PR+) nonlinear CG minimization of the error summed
+ * over n samples (n=1 being per-sample training).  The line search along
+ * d tries the step a, then the minimum of the parabola defined by E(0),
+ * E'(0) and E(a), halving the best step until sufficient decrease (Armijo)
+ * is obtained.  The direction restarts from the gradient every n_par
+ * iterations, when beta<0 or when it is not a descent direction.  Stops
+ * when E decreases by less than delta (after MIN_CG_ITER iterations) or
+ * when the line search fails.  Returns the final error, and the number of
+ * iterations (n_iter) and gradient evaluations (n_grad) if not NULL.*/
+DOUBLE ann_cg_minimize(kernel_ann *kernel,const ann_cg_ops *ops,
+                       UINT n,DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                       UINT *n_iter,UINT *n_grad){
+    DOUBLE **delta_ptr;
+    DOUBLE *g,*g_old,*d;
+    DOUBLE E0,E1,E2,gd,gd_old=0.,gg_old,beta,a,a2,a_max,a_old=0.,c;
+    UINT64 n_par,jdx;
+    UINT idx,iter,grad,tries;
+    BOOL is_ok;
+    if(n==0) return 0.;
+    if(delta<=0.) delta=DELTA_CG;
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+    n_par=ann_cg_size(kernel);
+    ALLOC(delta_ptr,KERN.n_hiddens+1,DOUBLE *);
+    ALLOC(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        ALLOC(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE);
+    ALLOC(g,n_par,DOUBLE);
+    ALLOC(g_old,n_par,DOUBLE);
+    ALLOC(d,n_par,DOUBLE);
+    E0=ann_cg_grad(kernel,ops,n,in,out,delta_ptr,n_par,g);
+    grad=1;
+    memcpy(d,g,n_par*sizeof(DOUBLE));
+    gd=ann_cg_dot(n_par,g,d);
+    for(iter=0;iter<MAX_CG_ITER;iter++){
+        if(gd<=0.) break;/*zero gradient*/
+        /*initial step: same decrease as the last iteration*/
+        if(iter==0) a=ANN_CG_STEP/sqrt(gd);
+        else a=a_old*gd_old/gd;
+        /*large steps only saturate the activations*/
+        a_max=ANN_CG_MAX/sqrt(ann_cg_dot(n_par,d,d));
+        if(a>a_max) a=a_max;
+        ann_cg_move(kernel,d,a);
+        E1=ann_cg_error(kernel,ops,n,in,out);
+        /*E(x)=E0-gd*x+c*x^2 through E(a)*/
+        c=(E1-E0+gd*a)/(a*a);
+        if(c>0.){
+            a2=gd/(2.*c);
+            if(a2>10.*a) a2=10.*a;
+            if(a2<0.1*a) a2=0.1*a;
+            if(a2>a_max) a2=a_max;
+            ann_cg_move(kernel,d,a2-a);
+            E2=ann_cg_error(kernel,ops,n,in,out);
+            if(E2<E1){
+                a=a2;
+                E1=E2;
+            }else ann_cg_move(kernel,d,a-a2);
+        }
+        tries=0;
+        while((E1>E0-1E-4*a*gd)&&(tries<ANN_CG_LS)){
+            ann_cg_move(kernel,d,-0.5*a);
+            a*=0.5;
+            E1=ann_cg_error(kernel,ops,n,in,out);
+            tries++;
+        }
+        if(E1>=E0){
+            /*no decrease at all: back to start and give up*/
+            ann_cg_move(kernel,d,-a);
+            break;
+        }
+        a_old=a;
+        gd_old=gd;
+        /*new gradient, PR+ update of the direction*/
+        gg_old=ann_cg_dot(n_par,g,g);
+        memcpy(g_old,g,n_par*sizeof(DOUBLE));
+        E1=ann_cg_grad(kernel,ops,n,in,out,delta_ptr,n_par,g);
+        grad++;
+        beta=(ann_cg_dot(n_par,g,g)-ann_cg_dot(n_par,g,g_old))/gg_old;
+        if((beta<0.)||(((iter+1)%n_par)==0)) beta=0.;
+        for(jdx=0;jdx<n_par;jdx++) d[jdx]=g[jdx]+beta*d[jdx];
+        gd=ann_cg_dot(n_par,g,d);
+        if(gd<=0.){
+            /*not a descent direction: restart*/
+            memcpy(d,g,n_par*sizeof(DOUBLE));
+            gd=ann_cg_dot(n_par,g,d);
+        }
+        is_ok=((E0-E1)<=delta)&&(iter+1>=MIN_CG_ITER);
+        E0=E1;
+        if(is_ok) break;
+    }
+    /*leave the kernel run on the last sample*/
+    ann_cg_error(kernel,ops,1,&(in[n-1]),&(out[n-1]));
+    for(idx=0;idx<=KERN.n_hiddens;idx++) FREE(delta_ptr[idx]);
+    FREE(delta_ptr);
+    FREE(g);
+    FREE(g_old);
+    FREE(d);
+    if(n_iter!=NULL) *n_iter=iter;
+    if(n_grad!=NULL) *n_grad=grad;
+    return E0;
+}
+/*^^^ train the kernel with CG on n samples (n=1: one sample)*/
+DOUBLE ann_train_CG(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta){
+    ann_cg_ops ops;
+    DOUBLE dEp;
+    UINT n_iter,n_grad;
+    ops.run=ann_kernel_run;
+    ops.error=ann_kernel_train_error;
+    ops.delta=ann_kernel_train_delta;
+    dEp=ann_cg_error(kernel,&ops,n,train_in,train_out);
+    NN_COUT(stdout," init=%15.10f",dEp);
+    dEp=ann_cg_minimize(kernel,&ops,n,train_in,train_out,delta,
+        &n_iter,&n_grad);
+    NN_COUT(stdout," N_ITER=%8i N_GRAD=%8i",n_iter,n_grad);
+    NN_COUT(stdout," final=%15.10f\n",dEp);
+    fflush(stdout);
+    return dEp;
+}
+/*--------------------------------*/
+/*+++ Levenberg-Marquardt (LM) +++*/
+/*--------------------------------*/
+/* LM solves (J^T.J + lambda.I).dw = J^T.e where e are the m residuals
+ * (target-output) of all outputs of all samples and J (m x n_par) is the
+ * jacobian of the outputs with respect to the flattened parameters (same
+ * layout as CG).  Each row of J is the back-propagation of a unit output
+ * delta, ie. the regular delta routine called with target=output+1 on that
+ * output.  For SNN, rows are the jacobian of the softmax inputs, which
+ * makes J^T.e the exact cross-entropy gradient (Gauss-Newton on logits).
+ * When m<n_par (few samples) the same step is obtained from the smaller
+ * system: (J.J^T + lambda.I).a = e then dw = J^T.a, so that per-sample LM
+ * only solves a n_outputs x n_outputs system.*/
+#ifdef _LAPACK
+/*Fortran LAPACK (column major: our upper part is their lower part)*/
+extern void dpotrf_(const char *uplo,const int *n,double *a,const int *lda,
+                    int *info);
+extern void dpotrs_(const char *uplo,const int *n,const int *nrhs,
+                    const double *a,const int *lda,double *b,const int *ldb,
+                    int *info);
+#endif /*_LAPACK*/
+/*^^^ private: S+=X^T.X (upper part) where X is (m x n)*/
+static void ann_lm_syrk(UINT64 m,UINT64 n,const DOUBLE *X,DOUBLE *S){
+#ifndef PBLAS
+    UINT64 idx,jdx;
+#endif
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT64 kdx;
+#endif
+#ifdef PBLAS
+    cblas_dsyrk(CblasRowMajor,CblasUpper,CblasTrans,n,m,1.0,X,n,1.0,S,n);
+#elif defined(SBLAS)
+#pragma omp parallel for private(idx,jdx) _NT
+    for(jdx=0;jdx<n;jdx++){
+_HT;
+        for(idx=0;idx<m;idx++){
+            if(X[_2D_IDX(n,idx,jdx)]==0.) continue;
+            cblas_daxpy(n-jdx,X[_2D_IDX(n,idx,jdx)],X+_2D_IDX(n,idx,jdx),1,
+                S+_2D_IDX(n,jdx,jdx),1);
+        }
+    }
+#else /*no PBLAS no SBLAS*/
+#pragma omp parallel for private(idx,jdx,kdx) _NT
+    for(jdx=0;jdx<n;jdx++){
+        for(idx=0;idx<m;idx++){
+            if(X[_2D_IDX(n,idx,jdx)]==0.) continue;
+            for(kdx=jdx;kdx<n;kdx++)
+                S[_2D_IDX(n,jdx,kdx)]+=
+                    X[_2D_IDX(n,idx,jdx)]*X[_2D_IDX(n,idx,kdx)];
+        }
+    }
+#endif /*PBLAS*/
+}
+/*^^^ private: error over the n samples, J rows (only for the last sample
+ * if is_dual is FALSE) and residuals e.  Then, the system matrix S (upper
+ * part) and right hand side r are: S=J.J^T, r=e if is_dual; S=J^T.J, r=J^T.e
+ * otherwise.*/
+static DOUBLE ann_lm_system(kernel_ann *kernel,const ann_cg_ops *ops,
+                            UINT n,DOUBLE **in,DOUBLE **out,
+                            DOUBLE **delta_ptr,UINT64 n_par,BOOL is_dual,
+                            DOUBLE *jac,DOUBLE *e,DOUBLE *tr,
+                            DOUBLE *S,DOUBLE *r){
+    DOUBLE Ep=0.,*row;
+    UINT64 m,n_sys;
+#ifndef PBLAS
+    UINT64 idx,jdx;
+#endif
+    UINT sdx,odx;
+    m=(UINT64)n*KERN.n_outputs;
+    n_sys=(is_dual)?m:n_par;
+    memset(S,0,n_sys*n_sys*sizeof(DOUBLE));
+    memset(r,0,n_sys*sizeof(DOUBLE));
+    for(sdx=0;sdx<n;sdx++){
+        ARRAY_CP(in[sdx],KERN.in,KERN.n_inputs);
+        ops->run(kernel);
+        Ep+=ops->error(kernel,out[sdx]);
+        for(odx=0;odx<KERN.n_outputs;odx++){
+            /*unit delta on output odx*/
+            ARRAY_CP(KERN.output.vec,tr,KERN.n_outputs);
+            tr[odx]+=1.0;
+            ann_cg_delta(kernel,ops,tr,delta_ptr);
+            if(is_dual) row=jac+((UINT64)sdx*KERN.n_outputs+odx)*n_par;
+            else row=jac+(UINT64)odx*n_par;
+            memset(row,0,n_par*sizeof(DOUBLE));
+            ann_cg_acc(kernel,delta_ptr,row);
+            e[(UINT64)sdx*KERN.n_outputs+odx]=out[sdx][odx]-KERN.output.vec[odx];
+        }
+        if(is_dual) continue;
+        /*J^T.J and J^T.e contributions of this sample*/
+        ann_lm_syrk(KERN.n_outputs,n_par,jac,S);
+#ifdef PBLAS
+        cblas_dgemv(CblasRowMajor,CblasTrans,KERN.n_outputs,n_par,1.0,jac,
+            n_par,e+(UINT64)sdx*KERN.n_outputs,1,1.0,r,1);
+#else  /*PBLAS*/
+        for(odx=0;odx<KERN.n_outputs;odx++){
+            row=jac+(UINT64)odx*n_par;
+            for(jdx=0;jdx<n_par;jdx++)
+                r[jdx]+=e[(UINT64)sdx*KERN.n_outputs+odx]*row[jdx];
+        }
+#endif /*PBLAS*/
+    }
+    if(!is_dual) return Ep;
+    /*J.J^T (upper part)*/
+#ifdef PBLAS
+    cblas_dsyrk(CblasRowMajor,CblasUpper,CblasNoTrans,m,n_par,1.0,jac,n_par,
+        0.0,S,m);
+#else  /*PBLAS*/
+#pragma omp parallel for private(idx,jdx) _NT
+    for(idx=0;idx<m;idx++)
+        for(jdx=idx;jdx<m;jdx++)
+            S[_2D_IDX(m,idx,jdx)]=ann_cg_dot(n_par,
+                jac+idx*n_par,jac+jdx*n_par);
+#endif /*PBLAS*/
+    memcpy(r,e,m*sizeof(DOUBLE));
+    return Ep;
+}
+/*^^^ private: dw=J^T.a with J (m x n_par)*/
+static void ann_lm_dual(UINT64 m,UINT64 n_par,const DOUBLE *jac,
+                        const DOUBLE *a,DOUBLE *dw){
+#ifdef PBLAS
+    cblas_dgemv(CblasRowMajor,CblasTrans,m,n_par,1.0,jac,n_par,a,1,0.0,dw,1);
+#else  /*PBLAS*/
+    UINT64 idx,jdx;
+    memset(dw,0,n_par*sizeof(DOUBLE));
+    for(idx=0;idx<m;idx++)
+        for(jdx=0;jdx<n_par;jdx++) dw[jdx]+=a[idx]*jac[_2D_IDX(n_par,idx,jdx)];
+#endif /*PBLAS*/
+}
+/*^^^ private: solve A.x=b in place (b<-x) for a symmetric positive
+ * definite A (upper part, destroyed) by a Cholesky factorization A=R^T.R.
+ * Returns FALSE if A is not positive definite.*/
+static BOOL ann_lm_solve(UINT64 n,DOUBLE *A,DOUBLE *b){
+#ifdef _LAPACK
+    int nn=(int)n,one=1,info;
+    dpotrf_("L",&nn,A,&nn,&info);
+    if(info!=0) return FALSE;
+    dpotrs_("L",&nn,&one,A,&nn,b,&nn,&info);
+    return (info==0);
+#else  /*_LAPACK*/
+    DOUBLE d,*r;
+    UINT64 idx,jdx,kdx;
+    /*R overwrites the upper part of A, row by row*/
+    for(idx=0;idx<n;idx++){
+        r=A+_2D_IDX(n,idx,0);
+        d=r[idx];
+        if(d<=0.) return FALSE;
+        d=sqrt(d);
+        for(jdx=idx;jdx<n;jdx++) r[jdx]/=d;
+#pragma omp parallel for private(jdx,kdx) _NT
+        for(kdx=idx+1;kdx<n;kdx++)
+            for(jdx=kdx;jdx<n;jdx++)
+                A[_2D_IDX(n,kdx,jdx)]-=r[kdx]*r[jdx];
+    }
+    /*R^T.y=b*/
+    for(idx=0;idx<n;idx++){
+        r=A+_2D_IDX(n,idx,0);
+        b[idx]/=r[idx];
+        for(jdx=idx+1;jdx<n;jdx++) b[jdx]-=r[jdx]*b[idx];
+    }
+    /*R.x=y*/
+    for(idx=n;idx>0;idx--){
+        r=A+_2D_IDX(n,idx-1,0);
+        d=b[idx-1];
+        for(jdx=idx;jdx<n;jdx++) d-=r[jdx]*b[jdx];
+        b[idx-1]=d/r[idx-1];
+    }
+    return TRUE;
+#endif /*_LAPACK*/
+}
+/*^^^ LM minimization of the error summed over n samples.  lambda starts
+ * at ANN_LM_LAMBDA times the largest diagonal element of the system, and
+ * is divided (resp. multiplied) by ANN_LM_ADAPT each time a step decreases
+ * (resp. does not decrease) the error.  Stops when E decreases by less
+ * than delta (after MIN_LM_ITER iterations) or after ANN_LM_FAIL rejected
+ * steps in a row.  When the system would be larger than ANN_LM_MAX, CG is
+ * used instead.  Returns the final error, and the number of iterations
+ * (n_iter) and jacobian evaluations (n_jac) if not NULL.*/
+DOUBLE ann_lm_minimize(kernel_ann *kernel,const ann_cg_ops *ops,
+                       UINT n,DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                       UINT *n_iter,UINT *n_jac){
+    DOUBLE **delta_ptr;
+    DOUBLE *jac,*e,*tr,*S,*A,*r,*dw;
+    DOUBLE E0,E1,lambda,step=1.0;
+    UINT64 n_par,m,n_sys,jdx;
+    UINT idx,iter,n_j,n_fail;
+    BOOL is_dual,is_ok,is_solved;
+    if(n==0) return 0.;
+    if(delta<=0.) delta=DELTA_LM;
+    n_par=ann_cg_size(kernel);
+    m=(UINT64)n*KERN.n_outputs;
+    is_dual=(m<n_par);
+    n_sys=(is_dual)?m:n_par;
+    if(n_sys>ANN_LM_MAX){
+        NN_ERROR(stderr,"LM: %i x %i system (>%i), using CG instead!\n",
+            (UINT)n_sys,(UINT)n_sys,ANN_LM_MAX);
+        if(n_jac!=NULL) *n_jac=0;
+        return ann_cg_minimize(kernel,ops,n,in,out,delta,n_iter,NULL);
+    }
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+    ALLOC(delta_ptr,KERN.n_hiddens+1,DOUBLE *);
+    ALLOC(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        ALLOC(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE);
+    if(is_dual) ALLOC(jac,m*n_par,DOUBLE);
+    else ALLOC(jac,(UINT64)KERN.n_outputs*n_par,DOUBLE);
+    ALLOC(e,m,DOUBLE);
+    ALLOC(tr,KERN.n_outputs,DOUBLE);
+    ALLOC(S,n_sys*n_sys,DOUBLE);
+    ALLOC(A,n_sys*n_sys,DOUBLE);
+    ALLOC(r,n_sys,DOUBLE);
+    ALLOC(dw,n_par,DOUBLE);
+    E0=ann_lm_system(kernel,ops,n,in,out,delta_ptr,n_par,is_dual,
+        jac,e,tr,S,r);
+    n_j=1;
+    lambda=0.;
+    for(jdx=0;jdx<n_sys;jdx++)
+        if(S[_2D_IDX(n_sys,jdx,jdx)]>lambda) lambda=S[_2D_IDX(n_sys,jdx,jdx)];
+    lambda*=ANN_LM_LAMBDA;
+    if(lambda<=0.) lambda=ANN_LM_LAMBDA;
+    n_fail=0;
+    for(iter=0;iter<MAX_LM_ITER;iter++){
+        memcpy(A,S,n_sys*n_sys*sizeof(DOUBLE));
+        for(jdx=0;jdx<n_sys;jdx++) A[_2D_IDX(n_sys,jdx,jdx)]+=lambda;
+        if(is_dual){
+            /*(J.J^T+lambda.I).a=e; dw=J^T.a*/
+            is_solved=ann_lm_solve(n_sys,A,r);
+            if(is_solved) ann_lm_dual(m,n_par,jac,r,dw);
+            memcpy(r,e,m*sizeof(DOUBLE));
+        }else{
+            memcpy(dw,r,n_par*sizeof(DOUBLE));
+            is_solved=ann_lm_solve(n_sys,A,dw);
+        }
+        if(is_solved){
+            /*underdetermined: samples can be fitted exactly by (large)
+             * steps that only saturate the activations*/
+            step=1.0;
+            if(is_dual){
+                step=sqrt(ann_cg_dot(n_par,dw,dw));
+                step=(step>ANN_LM_STEP)?ANN_LM_STEP/step:1.0;
+            }
+            ann_cg_move(kernel,dw,step);
+            E1=ann_cg_error(kernel,ops,n,in,out);
+        }else E1=E0;/*roundoff: only with a tiny lambda*/
+        if(E1<E0){
+            /*accept: closer to Gauss-Newton*/
+            lambda/=ANN_LM_ADAPT;
+            n_fail=0;
+            is_ok=((E0-E1)<=delta)&&(iter+1>=MIN_LM_ITER);
+            if(is_ok){
+                E0=E1;
+                break;
+            }
+            E0=ann_lm_system(kernel,ops,n,in,out,delta_ptr,n_par,is_dual,
+                jac,e,tr,S,r);
+            n_j++;
+        }else{
+            /*reject: closer to gradient descent*/
+            if(is_solved) ann_cg_move(kernel,dw,-step);
+            lambda*=ANN_LM_ADAPT;
+            n_fail++;
+            if(n_fail>=ANN_LM_FAIL) break;
+        }
+    }
+    /*leave the kernel run on the last sample*/
+    ann_cg_error(kernel,ops,1,&(in[n-1]),&(out[n-1]));
+    for(idx=0;idx<=KERN.n_hiddens;idx++) FREE(delta_ptr[idx]);
+    FREE(delta_ptr);
+    FREE(jac);
+    FREE(e);
+    FREE(tr);
+    FREE(S);
+    FREE(A);
+    FREE(r);
+    FREE(dw);
+    if(n_iter!=NULL) *n_iter=iter;
+    if(n_jac!=NULL) *n_jac=n_j;
+    return E0;
+}
+/*^^^ train the kernel with LM on n samples (n=1: one sample)*/
+DOUBLE ann_train_LM(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta){
+    ann_cg_ops ops;
+    DOUBLE dEp;
+    UINT n_iter,n_jac;
+    ops.run=ann_kernel_run;
+    ops.error=ann_kernel_train_error;
+    ops.delta=ann_kernel_train_delta;
+    dEp=ann_cg_error(kernel,&ops,n,train_in,train_out);
+    NN_COUT(stdout," init=%15.10f",dEp);
+    dEp=ann_lm_minimize(kernel,&ops,n,train_in,train_out,delta,
+        &n_iter,&n_jac);
+    NN_COUT(stdout," N_ITER=%8i N_JAC=%8i",n_iter,n_jac);
+    NN_COUT(stdout," final=%15.10f\n",dEp);
+    fflush(stdout);
+    return dEp;
+}
+/*-----------------------------------*/
+/*+++ thread-private feed-forward +++*/
+/*-----------------------------------*/
+/* Serial on purpose (no MPI, OpenMP or BLAS) since these run inside a
+ * parallel region: with ann_act_vec and cblas_dgemv, the nested OpenMP
+ * regions made an evaluation ~9x slower on small layers.*/
+/*^^^ out=act(w.in+b) for layer lay, with weights w and biases b (NULL:
+ * none) that do not have to be the layer's own; is_softmax computes the
+ * SNN output instead (see snn_kernel_run_output).*/
+static void ann_layer_private(layer_ann *lay,const DOUBLE *w,const DOUBLE *b,
+                              BOOL is_softmax,const DOUBLE *in,DOUBLE *out){
+    DOUBLE dv;
+    UINT jdx,kdx,N,M;
+    N=lay->n_neurons;
+    M=lay->n_inputs;
+    for(jdx=0;jdx<N;jdx++){
+        dv=(b==NULL)?0.:b[jdx];
+        for(kdx=0;kdx<M;kdx++) dv+=w[_2D_IDX(M,jdx,kdx)]*in[kdx];
+        out[jdx]=dv;
+    }
+    if(is_softmax){
+        dv=TINY;
+        for(jdx=0;jdx<N;jdx++){
+            out[jdx]=exp(out[jdx]-1.0);
+            dv+=out[jdx];
+        }
+        for(jdx=0;jdx<N;jdx++) out[jdx]/=dv;
+        return;
+    }
+    switch(lay->act){
+    case ANN_ACT_RELU:
+        for(jdx=0;jdx<N;jdx++) out[jdx]=(out[jdx]>0.)?out[jdx]:0.;
+        break;
+    case ANN_ACT_LRELU:
+        for(jdx=0;jdx<N;jdx++)
+            out[jdx]=(out[jdx]>0.)?out[jdx]:ANN_LRELU_SLOPE*out[jdx];
+        break;
+    case ANN_ACT_HTANH:
+        for(jdx=0;jdx<N;jdx++)
+            out[jdx]=(out[jdx]>1.)?1.:((out[jdx]<-1.)?-1.:out[jdx]);
+        break;
+    case ANN_ACT_SIGMOID:
+    default:
+        for(jdx=0;jdx<N;jdx++) out[jdx]=ann_act(out[jdx]);
+    }
+}
+/*^^^ private: n_ws workspaces, each with one vector per layer*/
+static DOUBLE ***ann_private_alloc(kernel_ann *kernel,UINT n_ws){
+    DOUBLE ***ws;
+    UINT tdx,idx;
+    ALLOC(ws,n_ws,DOUBLE **);
+    for(tdx=0;tdx<n_ws;tdx++){
+        ALLOC(ws[tdx],KERN.n_hiddens+1,DOUBLE *);
+        for(idx=0;idx<KERN.n_hiddens;idx++)
+            ALLOC(ws[tdx][idx],KERN.hiddens[idx].n_neurons,DOUBLE);
+        ALLOC(ws[tdx][KERN.n_hiddens],KERN.n_outputs,DOUBLE);
+    }
+    return ws;
+}
+static void ann_private_free(kernel_ann *kernel,DOUBLE ***ws,UINT n_ws){
+    UINT tdx,idx;
+    if(ws==NULL) return;
+    for(tdx=0;tdx<n_ws;tdx++){
+        for(idx=0;idx<=KERN.n_hiddens;idx++) FREE(ws[tdx][idx]);
+        FREE(ws[tdx]);
+    }
+    FREE(ws);
+}
+/*-----------------------------*/
+/*+++ simplex search (SPLX) +++*/
+/*-----------------------------*/
+/* Derivative free multi-directional search (Torczon) on the flattened
+ * parameters.  The simplex is kept as its best vertex x0 and its n_par
+ * edges D[i]=x[i]-x0.  Each iteration reflects all vertices through x0
+ * (x0-D[i]) then, if a reflected vertex is better than x0, tries to expand
+ * them (x0-2.D[i]), otherwise it contracts them (x0+D[i]/2).  The n_par
+ * trial vertices of a step are independent: they are spread over the MPI
+ * tasks and, within a task, over the OpenMP threads, each evaluation being
+ * a private (serial) forward pass over all the samples.  The objective is
+ * the number of misclassified samples plus E/(1+E), E being the averaged
+ * error, so that the error only breaks ties in accuracy.*/
+/*^^^ private: forward pass on in of the (flattened) parameters x, into
+ * the layer outputs vec (see ann_layer_private).*/
+static DOUBLE *ann_splx_run(kernel_ann *kernel,BOOL is_snn,const DOUBLE *x,
+                            const DOUBLE *in,DOUBLE **vec){
+    layer_ann *lay;
+    const DOUBLE *v_in=in;
+    const DOUBLE *b;
+    UINT idx,N,M;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        N=lay->n_neurons;
+        M=lay->n_inputs;
+        /*biases follow the weights (see ann_cg_copy)*/
+        b=(lay->bias!=NULL)?x+(UINT64)N*M:NULL;
+        ann_layer_private(lay,x,b,is_snn&&(idx==KERN.n_hiddens),v_in,vec[idx]);
+        x+=(UINT64)N*M+((b==NULL)?0:N);
+        v_in=vec[idx];
+    }
+    return vec[KERN.n_hiddens];
+}
+/*^^^ private: objective of the parameters x over the n samples*/
+static DOUBLE ann_splx_eval(kernel_ann *kernel,BOOL is_snn,const DOUBLE *x,
+                            UINT n,DOUBLE **in,DOUBLE **out,DOUBLE **vec){
+    DOUBLE *res;
+    DOUBLE Ep=0.,best;
+    UINT sdx,jdx,guess,is_ok,n_fail=0;
+    for(sdx=0;sdx<n;sdx++){
+        res=ann_splx_run(kernel,is_snn,x,in[sdx],vec);
+        guess=0;is_ok=0;best=res[0];
+        for(jdx=0;jdx<KERN.n_outputs;jdx++){
+            if(res[jdx]>best){
+                best=res[jdx];
+                guess=jdx;
+            }
+            /*same criterion as _NN(run,kernel)*/
+            if(out[sdx][jdx]>((is_snn)?0.1:0.5)) is_ok=jdx;
+            if(is_snn) Ep-=out[sdx][jdx]*log(res[jdx]+TINY)/KERN.n_outputs;
+            else Ep+=0.5*(out[sdx][jdx]-res[jdx])*(out[sdx][jdx]-res[jdx]);
+        }
+        if(guess!=is_ok) n_fail++;
+    }
+    Ep/=(DOUBLE)n;
+    if(Ep<0.) Ep=0.;/*SNN: log(p+TINY) with p~1*/
+    return (DOUBLE)n_fail+Ep/(1.+Ep);
+}
+/*^^^ private: ft[i]=objective of x0+c.D[i] for all vertices*/
+static void ann_splx_trial(kernel_ann *kernel,BOOL is_snn,UINT64 n_par,
+                           const DOUBLE *x0,const DOUBLE *D,DOUBLE c,
+                           UINT n,DOUBLE **in,DOUBLE **out,
+                           DOUBLE **ws_x,DOUBLE ***ws_vec,DOUBLE *ft){
+    UINT64 idx,jdx;
+    UINT tid=0;
+    UINT n_tasks=1,task=0;
+#ifdef _MPI
+    _NN(get,mpi_tasks)(&n_tasks);
+    _NN(get,curr_mpi_task)(&task);
+#endif /*_MPI*/
+    memset(ft,0,n_par*sizeof(DOUBLE));
+#pragma omp parallel for private(idx,jdx,tid) schedule(dynamic) _NT
+    for(idx=task;idx<n_par;idx+=n_tasks){
+#ifdef _OMP
+        tid=omp_get_thread_num();
+#endif /*_OMP*/
+        for(jdx=0;jdx<n_par;jdx++)
+            ws_x[tid][jdx]=x0[jdx]+c*D[_2D_IDX(n_par,idx,jdx)];
+        ft[idx]=ann_splx_eval(kernel,is_snn,ws_x[tid],n,in,out,ws_vec[tid]);
+    }
+#ifdef _MPI
+    /*each vertex was evaluated by one task (others have 0)*/
+    MPI_Allreduce(MPI_IN_PLACE,ft,(int)n_par,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif /*_MPI*/
+}
+/*^^^ private: D[i]*=c for all edges, then move x0 to the best vertex (if
+ * any is better) and return the objective of x0.*/
+static DOUBLE ann_splx_accept(UINT64 n_par,DOUBLE *x0,DOUBLE *D,DOUBLE c,
+                              const DOUBLE *ft,DOUBLE f0){
+    DOUBLE *Dk;
+    UINT64 idx,jdx,best=n_par;
+    for(idx=0;idx<n_par*n_par;idx++) D[idx]*=c;
+    for(idx=0;idx<n_par;idx++){
+        if(ft[idx]<f0){
+            f0=ft[idx];
+            best=idx;
+        }
+    }
+    if(best==n_par) return f0;
+    /*x0+D[k] becomes x0, and edges are taken from there*/
+    Dk=D+_2D_IDX(n_par,best,0);
+    for(jdx=0;jdx<n_par;jdx++) x0[jdx]+=Dk[jdx];
+#pragma omp parallel for private(idx,jdx) _NT
+    for(idx=0;idx<n_par;idx++){
+        if(idx==best) continue;
+        for(jdx=0;jdx<n_par;jdx++) D[_2D_IDX(n_par,idx,jdx)]-=Dk[jdx];
+    }
+    for(jdx=0;jdx<n_par;jdx++) Dk[jdx]=-Dk[jdx];
+    return f0;
+}
+/*^^^ multi-directional search of the kernel parameters over n samples
+ * (is_snn: softmax output and cross-entropy error).  Each start builds a
+ * new simplex of edges ANN_SPLX_STEP around the best point so far, which
+ * is searched until its edges are shorter than delta (<=0: ANN_SPLX_TOL).
+ * Stops after ANN_SPLX_START starts, a start without improvement, or
+ * MAX_SPLX_ITER iterations.  Returns the final objective; the initial one
+ * (f_init), the number of iterations (n_iter) and of evaluations (n_eval)
+ * are also returned when not NULL.*/
+DOUBLE ann_splx_minimize(kernel_ann *kernel,BOOL is_snn,UINT n,
+                         DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                         DOUBLE *f_init,UINT *n_iter,UINT *n_eval){
+    DOUBLE **ws_x;
+    DOUBLE ***ws_vec;
+    DOUBLE *x0,*D,*ft,*fr;
+    DOUBLE f0,f_start,f_min,size,len;
+    UINT64 n_par,idx,jdx;
+    UINT iter=0,n_ev=0,start,tdx,n_ws=1;
+    if(n==0){
+        if(f_init!=NULL) *f_init=0.;
+        if(n_iter!=NULL) *n_iter=0;
+        if(n_eval!=NULL) *n_eval=0;
+        return 0.;
+    }
+    n_par=ann_cg_size(kernel);
+    if(n_par>ANN_SPLX_MAX){
+        NN_ERROR(stderr,"SPLX: %i parameters (>%i), no training!\n",
+            (UINT)n_par,ANN_SPLX_MAX);
+        if(f_init!=NULL) *f_init=0.;
+        if(n_iter!=NULL) *n_iter=0;
+        if(n_eval!=NULL) *n_eval=0;
+        return 0.;
+    }
+    if(delta<=0.) delta=ANN_SPLX_TOL;
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+#ifdef _OMP
+    n_ws=_NN(return,omp_threads)();
+    if(n_ws<1) n_ws=1;
+#endif /*_OMP*/
+    /*one private workspace per thread*/
+    ALLOC(ws_x,n_ws,DOUBLE *);
+    for(tdx=0;tdx<n_ws;tdx++) ALLOC(ws_x[tdx],n_par,DOUBLE);
+    ws_vec=ann_private_alloc(kernel,n_ws);
+    ALLOC(x0,n_par,DOUBLE);
+    ALLOC(D,n_par*n_par,DOUBLE);
+    ALLOC(ft,n_par,DOUBLE);
+    ALLOC(fr,n_par,DOUBLE);
+    ann_cg_copy(kernel,x0,FALSE);
+    f0=ann_splx_eval(kernel,is_snn,x0,n,in,out,ws_vec[0]);
+    n_ev++;
+    if(f_init!=NULL) *f_init=f0;
+    for(start=0;start<ANN_SPLX_START;start++){
+        f_start=f0;
+        /*new simplex*/
+        memset(D,0,n_par*n_par*sizeof(DOUBLE));
+        for(idx=0;idx<n_par;idx++) D[_2D_IDX(n_par,idx,idx)]=ANN_SPLX_STEP;
+        ann_splx_trial(kernel,is_snn,n_par,x0,D,1.0,n,in,out,ws_x,ws_vec,ft);
+        n_ev+=n_par;
+        f0=ann_splx_accept(n_par,x0,D,1.0,ft,f0);
+        size=ANN_SPLX_STEP;
+        while((size>delta)&&(iter<MAX_SPLX_ITER)){
+            iter++;
+            /*reflection*/
+            ann_splx_trial(kernel,is_snn,n_par,x0,D,-1.0,n,in,out,
+                ws_x,ws_vec,fr);
+            n_ev+=n_par;
+            f_min=fr[0];
+            for(idx=1;idx<n_par;idx++) if(fr[idx]<f_min) f_min=fr[idx];
+            if(f_min<f0){
+                /*expansion*/
+                ann_splx_trial(kernel,is_snn,n_par,x0,D,-2.0,n,in,out,
+                    ws_x,ws_vec,ft);
+                n_ev+=n_par;
+                for(idx=0;(idx<n_par)&&(ft[idx]>=f_min);idx++);
+                if(idx<n_par) f0=ann_splx_accept(n_par,x0,D,-2.0,ft,f0);
+                else f0=ann_splx_accept(n_par,x0,D,-1.0,fr,f0);
+            }else{
+                /*contraction*/
+                ann_splx_trial(kernel,is_snn,n_par,x0,D,0.5,n,in,out,
+                    ws_x,ws_vec,ft);
+                n_ev+=n_par;
+                f0=ann_splx_accept(n_par,x0,D,0.5,ft,f0);
+            }
+            /*longest edge*/
+            size=0.;
+            for(idx=0;idx<n_par;idx++){
+                len=0.;
+                for(jdx=0;jdx<n_par;jdx++)
+                    len+=D[_2D_IDX(n_par,idx,jdx)]*D[_2D_IDX(n_par,idx,jdx)];
+                if(len>size) size=len;
+            }
+            size=sqrt(size);
+        }
+        if((f0>=f_start)||(iter>=MAX_SPLX_ITER)) break;
+    }
+    ann_cg_copy(kernel,x0,TRUE);
+    for(tdx=0;tdx<n_ws;tdx++) FREE(ws_x[tdx]);
+    FREE(ws_x);
+    ann_private_free(kernel,ws_vec,n_ws);
+    FREE(x0);
+    FREE(D);
+    FREE(ft);
+    FREE(fr);
+    if(n_iter!=NULL) *n_iter=iter;
+    if(n_eval!=NULL) *n_eval=n_ev;
+    return f0;
+}
+/*^^^ train the kernel with SPLX on n samples (n=1: one sample)*/
+DOUBLE ann_train_SPLX(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                      DOUBLE **train_out,DOUBLE delta){
+    DOUBLE res,f_init;
+    UINT n_iter,n_eval;
+    res=ann_splx_minimize(kernel,FALSE,n,train_in,train_out,delta,
+        &f_init,&n_iter,&n_eval);
+    NN_COUT(stdout," init=%15.10f",f_init);
+    NN_COUT(stdout," N_ITER=%8i N_EVAL=%8i",n_iter,n_eval);
+    NN_COUT(stdout," final=%15.10f\n",res);
+    fflush(stdout);
+    return res;
+}
+/*----------------------------------------*/
+/*+++ lock-free parallel SGD (hogwild) +++*/
+/*----------------------------------------*/
+/* Each OpenMP thread trains its own samples (as ann_train_BP does, until
+ * convergence) with a private forward pass and private deltas, and adds its
+ * updates to the shared weights and biases without any lock.  Concurrent
+ * updates can then be lost or read half-applied, which SGD tolerates when
+ * the updates are small and mostly touch different weights (Hogwild!).
+ * This parallelizes over samples rather than inside each (narrow) layer.*/
+/*^^^ private: derivative of the activation act, from the output y*/
+static DOUBLE ann_dact_private(ann_act_type act,DOUBLE y){
+    switch(act){
+    case ANN_ACT_RELU:
+        return (y>0.)?1.:0.;
+    case ANN_ACT_LRELU:
+        return (y>0.)?1.:ANN_LRELU_SLOPE;
+    case ANN_ACT_HTANH:
+        return ((y<1.)&&(y>-1.))?1.:0.;
+    case ANN_ACT_SIGMOID:
+    default:
+        return ann_dact(y);
+    }
+}
+/*^^^ private: forward pass of in with the weights W[layer] and biases
+ * B[layer], into the private layer outputs vec.  Returns the error
+ * against out.*/
+static DOUBLE ann_sgd_run(kernel_ann *kernel,BOOL is_snn,DOUBLE **W,DOUBLE **B,
+                          const DOUBLE *in,const DOUBLE *out,DOUBLE **vec){
+    layer_ann *lay;
+    const DOUBLE *v_in=in;
+    DOUBLE Ep=0.;
+    UINT idx;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        ann_layer_private(lay,W[idx],B[idx],
+            is_snn&&(idx==KERN.n_hiddens),v_in,vec[idx]);
+        v_in=vec[idx];
+    }
+    /*same errors as ann_kernel_train_error / snn_kernel_train_error*/
+    for(idx=0;idx<KERN.n_outputs;idx++){
+        if(is_snn){
+            if(v_in[idx]>0.) Ep+=out[idx]*log(v_in[idx]+TINY);
+        }else Ep+=(out[idx]-v_in[idx])*(out[idx]-v_in[idx]);
+    }
+    if(is_snn) return -Ep/KERN.n_outputs;
+    return 0.5*Ep;
+}
+/*^^^ private: train one sample until convergence (see ann_train_BP) with
+ * private vec and dl (deltas), updating the weights W and biases B: the
+ * shared kernel ones (hogwild) or those of a replica (local SGD).  Returns
+ * the last error decrease, is_ok tells if the answer was right.*/
+static DOUBLE ann_sgd_sample(kernel_ann *kernel,BOOL is_snn,DOUBLE rate,
+                             DOUBLE **W,DOUBLE **B,
+                             const DOUBLE *in,const DOUBLE *out,
+                             DOUBLE delta,DOUBLE **vec,DOUBLE **dl,
+                             UINT *n_iter,BOOL *is_ok){
+    layer_ann *lay;
+    const DOUBLE *v_in;
+    DOUBLE *res;
+    DOUBLE Ep,Epr,dEp,dv,probe;
+    UINT idx,jdx,kdx,N,M,iter=0,max_p,p_trg;
+    BOOL ok;
+    Ep=ann_sgd_run(kernel,is_snn,W,B,in,out,vec);
+    res=vec[KERN.n_hiddens];
+    do{
+        iter++;
+        /*deltas: output*/
+        N=KERN.n_outputs;
+        for(jdx=0;jdx<N;jdx++){
+            dl[KERN.n_hiddens][jdx]=out[jdx]-res[jdx];
+            if(!is_snn) dl[KERN.n_hiddens][jdx]*=
+                ann_dact_private(KERN.output.act,res[jdx]);
+        }
+        /*deltas: hiddens (with the weights before update)*/
+        for(idx=KERN.n_hiddens;idx>0;idx--){
+            lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+            N=lay->n_neurons;
+            M=lay->n_inputs;
+            for(kdx=0;kdx<M;kdx++){
+                dv=0.;
+                for(jdx=0;jdx<N;jdx++)
+                    dv+=W[idx][_2D_IDX(M,jdx,kdx)]*dl[idx][jdx];
+                dl[idx-1][kdx]=dv*ann_dact_private(KERN.hiddens[idx-1].act,
+                    vec[idx-1][kdx]);
+            }
+        }
+        /*update (no lock, even for shared weights)*/
+        for(idx=0;idx<=KERN.n_hiddens;idx++){
+            lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+            N=lay->n_neurons;
+            M=lay->n_inputs;
+            v_in=(idx==0)?in:vec[idx-1];
+            for(jdx=0;jdx<N;jdx++){
+                dv=rate*dl[idx][jdx];
+                for(kdx=0;kdx<M;kdx++) W[idx][_2D_IDX(M,jdx,kdx)]+=dv*v_in[kdx];
+                if(B[idx]!=NULL) B[idx][jdx]+=dv;
+            }
+        }
+        Epr=ann_sgd_run(kernel,is_snn,W,B,in,out,vec);
+        dEp=Ep-Epr;
+        Ep=Epr;
+        /*same convergence test as ann_train_BP*/
+        probe=-1.0;max_p=0;p_trg=0;
+        for(idx=0;idx<KERN.n_outputs;idx++){
+            if(probe<res[idx]){
+                probe=res[idx];
+                max_p=idx;
+            }
+            if(out[idx]>out[p_trg]) p_trg=idx;
+        }
+        ok=(max_p==p_trg);
+        if(iter>MAX_BP_ITER) break;
+        ok&=(iter>MIN_BP_ITER);
+    }while((dEp>delta)||(!ok));
+    *n_iter=iter;
+    *is_ok=ok;
+    return dEp;
+}
+/*^^^ train n samples in parallel with hogwild, at learning rate rate
+ * (is_snn: softmax output and cross-entropy error).  Returns the sum of
+ * the final error decreases, and the number of iterations (n_iter) and
+ * of samples that converged (n_ok) if not NULL.*/
+DOUBLE ann_hogwild_train(kernel_ann *kernel,BOOL is_snn,DOUBLE rate,UINT n,
+                         DOUBLE **in,DOUBLE **out,DOUBLE delta,
+                         UINT *n_iter,UINT *n_ok){
+    DOUBLE ***ws_vec;
+    DOUBLE ***ws_dl;
+    DOUBLE **W;
+    DOUBLE **B;
+    DOUBLE res=0.;
+    UINT idx,sdx,tid=0,n_ws=1;
+    UINT iter,it_sum=0,ok_sum=0;
+    BOOL is_ok;
+    if(delta<=0.) delta=DELTA_BP;
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+#ifdef _OMP
+    n_ws=_NN(return,omp_threads)();
+    if(n_ws<1) n_ws=1;
+#endif /*_OMP*/
+    /*one private workspace per thread, all sharing the kernel weights*/
+    ws_vec=ann_private_alloc(kernel,n_ws);
+    ws_dl=ann_private_alloc(kernel,n_ws);
+    ALLOC(W,KERN.n_hiddens+1,DOUBLE *);
+    ALLOC(B,KERN.n_hiddens+1,DOUBLE *);
+    for(idx=0;idx<KERN.n_hiddens;idx++){
+        W[idx]=KERN.hiddens[idx].weights;
+        B[idx]=KERN.hiddens[idx].bias;
+    }
+    W[KERN.n_hiddens]=KERN.output.weights;
+    B[KERN.n_hiddens]=KERN.output.bias;
+#pragma omp parallel for private(sdx,tid,iter,is_ok) reduction(+:res,it_sum,ok_sum) schedule(dynamic) _NT
+    for(sdx=0;sdx<n;sdx++){
+#ifdef _OMP
+        tid=omp_get_thread_num();
+#endif /*_OMP*/
+        res+=ann_sgd_sample(kernel,is_snn,rate,W,B,in[sdx],out[sdx],delta,
+            ws_vec[tid],ws_dl[tid],&iter,&is_ok);
+        it_sum+=iter;
+        if(is_ok) ok_sum++;
+    }
+    ann_private_free(kernel,ws_vec,n_ws);
+    ann_private_free(kernel,ws_dl,n_ws);
+    FREE(W);
+    FREE(B);
+    if(n_iter!=NULL) *n_iter=it_sum;
+    if(n_ok!=NULL) *n_ok=ok_sum;
+    return res;
+}
+/*^^^ train the kernel with BP on n samples, in parallel (hogwild)*/
+DOUBLE ann_train_hogwild(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                         DOUBLE **train_out,DOUBLE delta){
+    DOUBLE res;
+    UINT n_iter,n_ok;
+    res=ann_hogwild_train(kernel,FALSE,BP_LEARN_RATE,n,train_in,train_out,
+        delta,&n_iter,&n_ok);
+    NN_COUT(stdout," N_OK=%5i/%5i N_ITER=%10i",n_ok,n,n_iter);
+    NN_COUT(stdout," final=%15.10f\n",res/(DOUBLE)n);
+    fflush(stdout);
+    return res;
+}
+/*--------------------------------------------*/
+/*+++ local SGD (periodic model averaging) +++*/
+/*--------------------------------------------*/
+/* Each worker (OpenMP thread of each MPI task) trains its own replica of
+ * the parameters (flattened, CG layout) on its own k samples, then all
+ * replicas are replaced by their average: replicas are summed within the
+ * task, and over tasks by a single MPI_Allreduce.  Tasks thus communicate
+ * once every k samples per worker, instead of several times per sample
+ * and per layer with the layer split.  With adapt, k is doubled (up to
+ * ANN_LOCAL_KMAX) while the replicas stay close to their average, ie. a
+ * relative spread below ANN_LOCAL_DIV_LO, and halved when it goes over
+ * ANN_LOCAL_DIV_HI.*/
+/*^^^ private: W and B point to the layers of the flattened parameters x*/
+static void ann_local_ptr(kernel_ann *kernel,DOUBLE *x,DOUBLE **W,DOUBLE **B){
+    layer_ann *lay;
+    UINT idx;
+    for(idx=0;idx<=KERN.n_hiddens;idx++){
+        lay=(idx<KERN.n_hiddens)?&(KERN.hiddens[idx]):&(KERN.output);
+        W[idx]=x;
+        x+=(UINT64)lay->n_neurons*lay->n_inputs;
+        B[idx]=NULL;
+        if(lay->bias!=NULL){
+            B[idx]=x;
+            x+=lay->n_neurons;
+        }
+    }
+}
+/*^^^ train n samples with local SGD at learning rate rate (is_snn: softmax
+ * output and cross-entropy error), averaging every *k samples per worker.
+ * With adapt, *k is updated for the next call.  Returns the error of the
+ * averaged model summed over the n samples, and the number of iterations
+ * (n_iter), of samples that converged (n_ok) and of averages (n_avg), over
+ * all tasks, if not NULL.  The kernel is not run: vec is left as it was.*/
+DOUBLE ann_local_train(kernel_ann *kernel,BOOL is_snn,DOUBLE rate,UINT n,
+                       DOUBLE **in,DOUBLE **out,DOUBLE delta,UINT *k,
+                       BOOL adapt,UINT *n_iter,UINT *n_ok,UINT *n_avg){
+    DOUBLE ***ws_vec;
+    DOUBLE ***ws_dl;
+    DOUBLE ***W;
+    DOUBLE ***B;
+    DOUBLE **xs;
+    DOUBLE *avg;
+    DOUBLE stat[3];
+    DOUBLE res=0.,spread,norm,dv;
+    UINT64 n_par,jdx;
+    UINT *cnt;
+    UINT idx,tdx,sdx,s0,s1,s2,s_next,kk,n_work;
+    UINT iter,it_sum=0,ok_sum=0,av_sum=0;
+    UINT n_ws=1,n_tasks=1,task=0;
+    BOOL is_ok;
+    if(n==0) return 0.;
+    if(delta<=0.) delta=DELTA_BP;
+    kk=*k;
+    if(kk<1) kk=1;
+    n_par=ann_cg_size(kernel);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+#ifdef _OMP
+    n_ws=_NN(return,omp_threads)();
+    if(n_ws<1) n_ws=1;
+#endif /*_OMP*/
+#ifdef _MPI
+    _NN(get,mpi_tasks)(&n_tasks);
+    _NN(get,curr_mpi_task)(&task);
+#endif /*_MPI*/
+    n_work=n_ws*n_tasks;
+    /*one replica and private workspace per thread*/
+    ws_vec=ann_private_alloc(kernel,n_ws);
+    ws_dl=ann_private_alloc(kernel,n_ws);
+    ALLOC(xs,n_ws,DOUBLE *);
+    ALLOC(W,n_ws,DOUBLE **);
+    ALLOC(B,n_ws,DOUBLE **);
+    ALLOC(cnt,n_ws,UINT);
+    for(tdx=0;tdx<n_ws;tdx++){
+        ALLOC(xs[tdx],n_par,DOUBLE);
+        ALLOC(W[tdx],KERN.n_hiddens+1,DOUBLE *);
+        ALLOC(B[tdx],KERN.n_hiddens+1,DOUBLE *);
+        ann_local_ptr(kernel,xs[tdx],W[tdx],B[tdx]);
+    }
+    /*+1: number of samples that went into the average*/
+    ALLOC(avg,n_par+1,DOUBLE);
+    ann_cg_copy(kernel,avg,FALSE);
+    for(s0=0;s0<n;s0=s_next){
+        /*kk can change below*/
+        s_next=s0+kk*n_work;
+        /*every worker starts from the average, on its own k samples*/
+#pragma omp parallel for private(tdx,sdx,s1,s2,iter,is_ok) reduction(+:res,it_sum,ok_sum) _NT
+        for(tdx=0;tdx<n_ws;tdx++){
+            memcpy(xs[tdx],avg,n_par*sizeof(DOUBLE));
+            s1=s0+(task*n_ws+tdx)*kk;
+            s2=s1+kk;
+            if(s1>n) s1=n;
+            if(s2>n) s2=n;
+            cnt[tdx]=s2-s1;
+            for(sdx=s1;sdx<s2;sdx++){
+                res+=ann_sgd_sample(kernel,is_snn,rate,W[tdx],B[tdx],
+                    in[sdx],out[sdx],delta,ws_vec[tdx],ws_dl[tdx],
+                    &iter,&is_ok);
+                it_sum+=iter;
+                if(is_ok) ok_sum++;
+            }
+        }
+        /*average, weighted by the number of samples of each replica*/
+        memset(avg,0,(n_par+1)*sizeof(DOUBLE));
+        for(tdx=0;tdx<n_ws;tdx++){
+            if(cnt[tdx]==0) continue;
+            for(jdx=0;jdx<n_par;jdx++) avg[jdx]+=cnt[tdx]*xs[tdx][jdx];
+            avg[n_par]+=cnt[tdx];
+        }
+#ifdef _MPI
+        MPI_Allreduce(MPI_IN_PLACE,avg,(int)(n_par+1),MPI_DOUBLE,MPI_SUM,
+            MPI_COMM_WORLD);
+#endif /*_MPI*/
+        for(jdx=0;jdx<n_par;jdx++) avg[jdx]/=avg[n_par];
+        av_sum++;
+        if(!adapt) continue;
+        /*relative spread of the replicas around their average*/
+        stat[0]=0.;
+        for(tdx=0;tdx<n_ws;tdx++){
+            if(cnt[tdx]==0) continue;
+            for(jdx=0;jdx<n_par;jdx++){
+                dv=xs[tdx][jdx]-avg[jdx];
+                stat[0]+=cnt[tdx]*dv*dv;
+            }
+        }
+#ifdef _MPI
+        MPI_Allreduce(MPI_IN_PLACE,stat,1,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif /*_MPI*/
+        norm=0.;
+        for(jdx=0;jdx<n_par;jdx++) norm+=avg[jdx]*avg[jdx];
+        spread=sqrt(stat[0]/(avg[n_par]*(norm+TINY)));
+        if((spread<ANN_LOCAL_DIV_LO)&&(kk<ANN_LOCAL_KMAX)) kk*=2;
+        else if((spread>ANN_LOCAL_DIV_HI)&&(kk>1)) kk/=2;
+    }
+    ann_cg_copy(kernel,avg,TRUE);
+    /*the result is the error of the averaged model, not of the replicas:
+     *each task evaluates its share of the samples*/
+    for(idx=0;idx<KERN.n_hiddens;idx++){
+        W[0][idx]=KERN.hiddens[idx].weights;
+        B[0][idx]=KERN.hiddens[idx].bias;
+    }
+    W[0][KERN.n_hiddens]=KERN.output.weights;
+    B[0][KERN.n_hiddens]=KERN.output.bias;
+    res=0.;
+#pragma omp parallel for private(sdx,tdx) reduction(+:res) _NT
+    for(sdx=task;sdx<n;sdx+=n_tasks){
+        tdx=0;
+#ifdef _OMP
+        tdx=omp_get_thread_num();
+#endif /*_OMP*/
+        res+=ann_sgd_run(kernel,is_snn,W[0],B[0],in[sdx],out[sdx],ws_vec[tdx]);
+    }
+    /*statistics over all tasks*/
+    stat[0]=res;
+    stat[1]=(DOUBLE)it_sum;
+    stat[2]=(DOUBLE)ok_sum;
+#ifdef _MPI
+    MPI_Allreduce(MPI_IN_PLACE,stat,3,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif /*_MPI*/
+    ann_private_free(kernel,ws_vec,n_ws);
+    ann_private_free(kernel,ws_dl,n_ws);
+    for(tdx=0;tdx<n_ws;tdx++){
+        FREE(xs[tdx]);
+        FREE(W[tdx]);
+        FREE(B[tdx]);
+    }
+    FREE(xs);
+    FREE(W);
+    FREE(B);
+    FREE(cnt);
+    FREE(avg);
+    *k=kk;
+    if(n_iter!=NULL) *n_iter=(UINT)stat[1];
+    if(n_ok!=NULL) *n_ok=(UINT)stat[2];
+    if(n_avg!=NULL) *n_avg=av_sum;
+    return stat[0];
+}
+/*^^^ train the kernel with BP on n samples, with local SGD*/
+DOUBLE ann_train_local(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                       DOUBLE **train_out,DOUBLE delta,UINT *k,BOOL adapt){
+    DOUBLE res;
+    UINT n_iter,n_ok,n_avg;
+    res=ann_local_train(kernel,FALSE,BP_LEARN_RATE,n,train_in,train_out,
+        delta,k,adapt,&n_iter,&n_ok,&n_avg);
+    /*vec follows the averaged weights (on the last sample)*/
+    if(n>0) ARRAY_CP(train_in[n-1],KERN.in,KERN.n_inputs);
+    ann_kernel_run(kernel);
+    NN_COUT(stdout," N_AVG=%5i K=%4i",n_avg,*k);
+    NN_COUT(stdout," N_OK=%5i/%5i N_ITER=%10i",n_ok,n,n_iter);
+    NN_COUT(stdout," final=%15.10f\n",res/(DOUBLE)n);
+    fflush(stdout);
+    return res;
+}
+#endif /*_CUDA*/
 #undef KERN
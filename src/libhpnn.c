@@ -23,7 +23,9 @@
 #include <stdarg.h>
 #include <inttypes.h>
 #include <math.h>
+#include <limits.h>
 #include <time.h>
+#include <sys/stat.h>
 /* Artificial Neuron Network abstract layer, interfaces with the HPNN library */
 /* -------------------------------------------- Hubert Okadome Valencia, 2019 */
 /*^^^ MPI specific*/
@@ -51,6 +53,10 @@
 #ifdef _OMP
 #include <omp.h>
 #endif
+/*^^^ PTHREAD specific*/
+#ifdef _PTHREAD
+#include <pthread.h>
+#endif /*_PTHREAD*/
 /*^^^main header*/
 #include <libhpnn.h>
 #include <libhpnn/ann.h>
@@ -553,6 +559,40 @@ void _NN(init,conf)(nn_def *conf){
     _CONF.train=NN_TRAIN_UKN;
     _CONF.samples=NULL;
     _CONF.tests=NULL;
+    _CONF.samples_ds=NULL;
+    _CONF.tests_ds=NULL;
+    _CONF.pc.n_in=0;
+    _CONF.pc.n_out=0;
+    _CONF.pc.in=NULL;
+    _CONF.pc.out=NULL;
+    _CONF.pc.n_samples=0;
+    _CONF.pc.max_samples=0;
+    _CONF.pc.q_in=NULL;
+    _CONF.pc.q_out=NULL;
+    _CONF.f_chkpt=NULL;
+    _CONF.n_chkpt=0;
+    _CONF.t_chkpt=0;
+    _CONF.n_loaders=NN_LOADERS;
+    _CONF.n_prefetch=NN_PREFETCH;
+    _CONF.order=NN_ORDER_SHUFFLE;
+    _CONF.epoch=0;
+    _CONF.f_teacher=NULL;
+    _CONF.t_temp=1.;
+    _CONF.t_out=NULL;
+    _CONF.t_n=0;
+    _CONF.n_batch=0;
+    _CONF.par=NN_PAR_LAYER;
+    _CONF.n_local=0;
+    _CONF.k_local=0;
+    _CONF.comp=NN_COMP_NONE;
+    _CONF.comp_ratio=NN_COMP_RATIO;
+    _CONF.conv.max_iter=0;
+    _CONF.conv.max_time=0.;
+    _CONF.conv.patience=0;
+    _CONF.conv.min_rel=NN_CONV_MIN_REL;
+    _CONF.conv.defer=FALSE;
+    _CONF.conv.n_check=0;
+    memset(&(_CONF.conv_stats),0,sizeof(nn_conv_stats));
 }
 void _NN(deinit,conf)(nn_def *conf){
     if(_CONF.kernel!=NULL) _NN(free,kernel)(conf);
@@ -566,6 +606,42 @@ void _NN(deinit,conf)(nn_def *conf){
     _CONF.train=NN_TRAIN_UKN;
     FREE(_CONF.samples);
     FREE(_CONF.tests);
+    _NN(close,dataset)(_CONF.samples_ds);
+    _CONF.samples_ds=NULL;
+    _NN(close,dataset)(_CONF.tests_ds);
+    _CONF.tests_ds=NULL;
+    _NN(flush,queue)(conf);
+    FREE(_CONF.pc.q_in);
+    FREE(_CONF.pc.q_out);
+    _CONF.pc.max_samples=0;
+    FREE(_CONF.pc.in);
+    FREE(_CONF.pc.out);
+    _CONF.pc.n_in=0;
+    _CONF.pc.n_out=0;
+    FREE(_CONF.f_chkpt);
+    _CONF.n_chkpt=0;
+    _CONF.t_chkpt=0;
+    _CONF.n_loaders=0;
+    _CONF.n_prefetch=0;
+    _CONF.order=NN_ORDER_SHUFFLE;
+    _CONF.epoch=0;
+    FREE(_CONF.f_teacher);
+    _CONF.t_temp=1.;
+    FREE(_CONF.t_out);
+    _CONF.t_n=0;
+    _CONF.n_batch=0;
+    _CONF.par=NN_PAR_LAYER;
+    _CONF.n_local=0;
+    _CONF.k_local=0;
+    _CONF.comp=NN_COMP_NONE;
+    _CONF.comp_ratio=NN_COMP_RATIO;
+    _CONF.conv.max_iter=0;
+    _CONF.conv.max_time=0.;
+    _CONF.conv.patience=0;
+    _CONF.conv.min_rel=NN_CONV_MIN_REL;
+    _CONF.conv.defer=FALSE;
+    _CONF.conv.n_check=0;
+    memset(&(_CONF.conv_stats),0,sizeof(nn_conv_stats));
 }
 void _NN(set,name)(nn_def *conf,const CHAR *name){
     FREE(_CONF.name);
@@ -655,6 +731,112 @@ void _NN(get,tests_directory)(nn_def *conf,CHAR **tests){
 char *_NN(return,tests_directory)(nn_def *conf){
     return _CONF.tests;
 }
+/*^^^ a dataset replaces the corresponding directory, conf owns it*/
+void _NN(set,samples_dataset)(nn_def *conf,nn_dataset *ds){
+    if(_CONF.samples_ds!=ds) _NN(close,dataset)(_CONF.samples_ds);
+    _CONF.samples_ds=ds;
+}
+void _NN(set,tests_dataset)(nn_def *conf,nn_dataset *ds){
+    if(_CONF.tests_ds!=ds) _NN(close,dataset)(_CONF.tests_ds);
+    _CONF.tests_ds=ds;
+}
+void _NN(set,checkpoint)(nn_def *conf,const CHAR *f_chkpt,
+                         UINT n_samples,UINT n_seconds){
+    /*f_chkpt=NULL disable checkpoints*/
+    FREE(_CONF.f_chkpt);
+    if(f_chkpt!=NULL) STRDUP(f_chkpt,_CONF.f_chkpt);
+    _CONF.n_chkpt=n_samples;
+    _CONF.t_chkpt=n_seconds;
+}
+void _NN(get,checkpoint)(nn_def *conf,CHAR **f_chkpt,
+                         UINT *n_samples,UINT *n_seconds){
+    CHAR *tmp=NULL;
+    /*will initialize and return f_chkpt*/
+    /*USER need to free f_chkpt! --OVHPA*/
+    if(_CONF.f_chkpt!=NULL) STRDUP(_CONF.f_chkpt,tmp);
+    *f_chkpt=tmp;
+    *n_samples=_CONF.n_chkpt;
+    *n_seconds=_CONF.t_chkpt;
+}
+void _NN(set,loader)(nn_def *conf,UINT n_loaders,UINT n_prefetch){
+    /*n_loaders=0 disable prefetch*/
+    _CONF.n_loaders=n_loaders;
+    _CONF.n_prefetch=(n_prefetch>0)?n_prefetch:1;
+}
+void _NN(get,loader)(nn_def *conf,UINT *n_loaders,UINT *n_prefetch){
+    *n_loaders=_CONF.n_loaders;
+    *n_prefetch=_CONF.n_prefetch;
+}
+void _NN(set,order)(nn_def *conf,nn_order order){
+    _CONF.order=order;
+}
+void _NN(get,order)(nn_def *conf,nn_order *order){
+    *order=_CONF.order;
+}
+void _NN(set,epoch)(nn_def *conf,UINT epoch){
+    _CONF.epoch=epoch;
+}
+void _NN(get,epoch)(nn_def *conf,UINT *epoch){
+    *epoch=_CONF.epoch;
+}
+void _NN(set,batch)(nn_def *conf,UINT n_batch){
+    /*n_batch=0 or 1: one sample at a time*/
+    _CONF.n_batch=n_batch;
+}
+void _NN(get,batch)(nn_def *conf,UINT *n_batch){
+    *n_batch=_CONF.n_batch;
+}
+void _NN(set,parallel)(nn_def *conf,nn_par par){
+    _CONF.par=par;
+}
+void _NN(get,parallel)(nn_def *conf,nn_par *par){
+    *par=_CONF.par;
+}
+void _NN(set,local)(nn_def *conf,UINT n_local){
+    /*n_local=0: adaptive period*/
+    _CONF.n_local=n_local;
+    _CONF.k_local=n_local;
+}
+void _NN(get,local)(nn_def *conf,UINT *n_local){
+    *n_local=_CONF.n_local;
+}
+void _NN(set,compress)(nn_def *conf,nn_comp comp,DOUBLE ratio){
+    /*ratio: fraction of updates sent by NN_COMP_TOPK*/
+    _CONF.comp=comp;
+    _CONF.comp_ratio=((ratio>0.)&&(ratio<=1.))?ratio:NN_COMP_RATIO;
+}
+void _NN(get,compress)(nn_def *conf,nn_comp *comp,DOUBLE *ratio){
+    *comp=_CONF.comp;
+    *ratio=_CONF.comp_ratio;
+}
+void _NN(set,conv)(nn_def *conf,const nn_conv *conv){
+    /*all zero: original behavior (MAX_BP(M)_ITER only)*/
+    _CONF.conv=*conv;
+    if((_CONF.conv.min_rel<0.)||(_CONF.conv.min_rel>=1.))
+        _CONF.conv.min_rel=NN_CONV_MIN_REL;
+}
+void _NN(get,conv)(nn_def *conf,nn_conv *conv){
+    *conv=_CONF.conv;
+}
+void _NN(get,conv_stats)(nn_def *conf,nn_conv_stats *stats){
+    *stats=_CONF.conv_stats;
+}
+void _NN(set,teacher)(nn_def *conf,const CHAR *f_teacher,DOUBLE temperature){
+    /*f_teacher=NULL disable distillation*/
+    FREE(_CONF.f_teacher);
+    if(f_teacher!=NULL) STRDUP(f_teacher,_CONF.f_teacher);
+    _CONF.t_temp=(temperature>0.)?temperature:1.;
+    /*teacher outputs will be cached again*/
+    FREE(_CONF.t_out);
+    _CONF.t_n=0;
+}
+void _NN(get,teacher)(nn_def *conf,CHAR **f_teacher,DOUBLE *temperature){
+    CHAR *tmp=NULL;
+    /*USER need to free f_teacher! --OVHPA*/
+    if(_CONF.f_teacher!=NULL) STRDUP(_CONF.f_teacher,tmp);
+    *f_teacher=tmp;
+    *temperature=_CONF.t_temp;
+}
 nn_def *_NN(load,conf)(const CHAR *filename){
 #define FAIL read_conf_fail
     PREP_READLINE();
@@ -664,12 +846,18 @@ nn_def *_NN(load,conf)(const CHAR *filename){
     UINT *n_hiddens;
     UINT64 allocate;
     nn_def  *conf;
+    nn_dataset *ds;
+    CHAR  *f_in;
+    CHAR  *f_act;
+    BOOL is_bias;
     BOOL is_ok;
     UINT   idx;
     FILE   *fp;
     /*init*/
     allocate=0;
     n_hiddens=NULL;
+    f_act=NULL;
+    is_bias=FALSE;
     ALLOC_REPORT(conf,1,nn_def,allocate);
     _NN(init,conf)(conf);
     ALLOC(parameter,3,UINT);
@@ -790,6 +978,12 @@ NN_OUT(stdout,"loading kernel!\n");
             /*get the training type {"BP","BPM","CG" ...}*/
             ptr+=7;SKIP_BLANK(ptr);
             switch (*ptr){
+                case 'A':
+                    _CONF.train=NN_TRAIN_ADAM;
+                    break;
+                case 'R':
+                    _CONF.train=NN_TRAIN_RMSPROP;
+                    break;
                 case 'B':
                     if(*(ptr+2)=='M') _CONF.train=NN_TRAIN_BPM;
                     else _CONF.train=NN_TRAIN_BP;
@@ -797,6 +991,9 @@ NN_OUT(stdout,"loading kernel!\n");
                 case 'C':
                     _CONF.train=NN_TRAIN_CG;
                     break;
+                case 'L':
+                    _CONF.train=NN_TRAIN_LM;
+                    break;
                 case 'S':
                     _CONF.train=NN_TRAIN_SPLX;
                     break;
@@ -818,6 +1015,234 @@ NN_OUT(stdout,"loading kernel!\n");
             STR_CLEAN(ptr);
             STRDUP_REPORT(ptr,_CONF.tests,allocate);
         }
+        ptr=STRFIND("[sample_idx",line);
+        if(ptr==NULL) ptr=STRFIND("[test_idx",line);
+        if(ptr!=NULL){
+            /*get IDX dataset {"images" "labels"}*/
+            is_ok=(ptr[1]=='s');
+            ptr=STRFIND("]",ptr)+1;SKIP_BLANK(ptr);
+            ptr2=ptr;
+            while(ISGRAPH(*ptr2)&&(*ptr2!='#')) ptr2++;
+            f_in=NULL;
+            if(ptr2!=ptr){
+                ALLOC(f_in,(ptr2-ptr)+1,CHAR);
+                memcpy(f_in,ptr,(ptr2-ptr)*sizeof(CHAR));
+            }
+            ptr=ptr2;SKIP_BLANK(ptr);
+            STR_CLEAN(ptr);
+            ds=_NN(open,idx)(f_in,ptr,0,0.);
+            FREE(f_in);
+            if(ds==NULL){
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[%s_idx] can't read dataset!\n",
+                    is_ok ? "sample" : "test");
+                goto FAIL;
+            }
+            if(is_ok) _NN(set,samples_dataset)(conf,ds);
+            else _NN(set,tests_dataset)(conf,ds);
+        }
+        ptr=STRFIND("[checkpoint",line);
+        if(ptr!=NULL){
+            /*get checkpoint {"file" n_samples n_seconds}*/
+            ptr+=12;SKIP_BLANK(ptr);
+            ptr2=ptr;
+            while(ISGRAPH(*ptr2)&&(*ptr2!='#')) ptr2++;
+            if(ptr2==ptr){
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[checkpoint] missing filename...\n");
+                goto FAIL;
+            }
+            FREE(_CONF.f_chkpt);
+            ALLOC_REPORT(_CONF.f_chkpt,(ptr2-ptr)+1,CHAR,allocate);
+            memcpy(_CONF.f_chkpt,ptr,(ptr2-ptr)*sizeof(CHAR));
+            ptr=ptr2;SKIP_BLANK(ptr);
+            if(ISDIGIT(*ptr)) {
+                GET_UINT(_CONF.n_chkpt,ptr,ptr2);
+                ptr=ptr2;SKIP_BLANK(ptr);
+                if(ISDIGIT(*ptr)) GET_UINT(_CONF.t_chkpt,ptr,ptr2);
+            }
+            if((_CONF.n_chkpt==0)&&(_CONF.t_chkpt==0)){
+                NN_WARN(stderr,"[checkpoint] no interval, final only!\n");
+            }
+        }
+        ptr=STRFIND("[loader",line);
+        if(ptr!=NULL){
+            /*get sample loaders {n_loaders n_prefetch}*/
+            ptr+=8;SKIP_BLANK(ptr);
+            if(!ISDIGIT(*ptr)) {
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[loader] value: %s\n",ptr);
+                goto FAIL;
+            }
+            GET_UINT(_CONF.n_loaders,ptr,ptr2);
+            ptr=ptr2;SKIP_BLANK(ptr);
+            if(ISDIGIT(*ptr)) GET_UINT(_CONF.n_prefetch,ptr,ptr2);
+            if(_CONF.n_prefetch==0) _CONF.n_prefetch=1;
+        }
+        ptr=STRFIND("[order",line);
+        if(ptr!=NULL){
+            /*get sample order {"shuffle","inode"}*/
+            ptr+=7;SKIP_BLANK(ptr);
+            switch (*ptr){
+                case 'I':
+                case 'i':
+                    _CONF.order=NN_ORDER_INODE;
+                    break;
+                case 'S':
+                case 's':
+                default:
+                    _CONF.order=NN_ORDER_SHUFFLE;
+            }
+        }
+        ptr=STRFIND("[teacher",line);
+        if(ptr!=NULL){
+            /*get teacher kernel {"file" temperature}*/
+            ptr+=9;SKIP_BLANK(ptr);
+            ptr2=ptr;
+            while(ISGRAPH(*ptr2)&&(*ptr2!='#')) ptr2++;
+            if(ptr2==ptr){
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[teacher] missing filename...\n");
+                goto FAIL;
+            }
+            FREE(_CONF.f_teacher);
+            ALLOC_REPORT(_CONF.f_teacher,(ptr2-ptr)+1,CHAR,allocate);
+            memcpy(_CONF.f_teacher,ptr,(ptr2-ptr)*sizeof(CHAR));
+            ptr=ptr2;SKIP_BLANK(ptr);
+            if(ISDIGIT(*ptr)||(*ptr=='.')) {
+                GET_DOUBLE(_CONF.t_temp,ptr,ptr2);
+                if(_CONF.t_temp<=0.) _CONF.t_temp=1.;
+            }
+        }
+        ptr=STRFIND("[batch",line);
+        if(ptr!=NULL){
+            /*get CG/LM batch size {integer}*/
+            ptr+=7;SKIP_BLANK(ptr);
+            if(!ISDIGIT(*ptr)) {
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[batch] value: %s\n",ptr);
+                goto FAIL;
+            }
+            GET_UINT(_CONF.n_batch,ptr,ptr2);
+        }
+        ptr=STRFIND("[parallel",line);
+        if(ptr!=NULL){
+            /*get training parallelization {"layer","hogwild","local" K}*/
+            ptr+=10;SKIP_BLANK(ptr);
+            switch (*ptr){
+                case 'H':
+                case 'h':
+                    _CONF.par=NN_PAR_HOGWILD;
+                    break;
+                case 'L':
+                case 'l':
+                    if((*(ptr+1)=='O')||(*(ptr+1)=='o')){
+                        _CONF.par=NN_PAR_LOCAL;
+                        /*optional period (default 0: adaptive)*/
+                        while(ISGRAPH(*ptr)) ptr++;
+                        SKIP_BLANK(ptr);
+                        _CONF.n_local=0;
+                        if(ISDIGIT(*ptr)) GET_UINT(_CONF.n_local,ptr,ptr2);
+                        _CONF.k_local=_CONF.n_local;
+                        break;
+                    }
+                    /*fallthrough*/
+                default:
+                    _CONF.par=NN_PAR_LAYER;
+            }
+        }
+        ptr=STRFIND("[compress",line);
+        if(ptr!=NULL){
+            /*get MPI weight sync compression {"none","fp32","fp16","topk" R}*/
+            ptr+=10;SKIP_BLANK(ptr);
+            switch (*ptr){
+                case 'F':
+                case 'f':
+                    if(*(ptr+2)=='1') _CONF.comp=NN_COMP_FP16;
+                    else _CONF.comp=NN_COMP_FP32;
+                    break;
+                case 'T':
+                case 't':
+                    _CONF.comp=NN_COMP_TOPK;
+                    /*optional ratio (default NN_COMP_RATIO)*/
+                    while(ISGRAPH(*ptr)) ptr++;
+                    SKIP_BLANK(ptr);
+                    _CONF.comp_ratio=NN_COMP_RATIO;
+                    if(ISDIGIT(*ptr)||(*ptr=='.')){
+                        GET_DOUBLE(_CONF.comp_ratio,ptr,ptr2);
+                        if((_CONF.comp_ratio<=0.)||(_CONF.comp_ratio>1.))
+                            _CONF.comp_ratio=NN_COMP_RATIO;
+                    }
+                    break;
+                default:
+                    _CONF.comp=NN_COMP_NONE;
+            }
+        }
+        ptr=STRFIND("[converge",line);
+        if(ptr!=NULL){
+            /*get per-sample policy {max_iter max_time patience min_rel "defer"}*/
+            ptr+=10;SKIP_BLANK(ptr);
+            if(ISDIGIT(*ptr)){
+                GET_UINT(_CONF.conv.max_iter,ptr,ptr2);
+                ptr=ptr2;SKIP_BLANK(ptr);
+            }
+            if(ISDIGIT(*ptr)||(*ptr=='.')){
+                GET_DOUBLE(_CONF.conv.max_time,ptr,ptr2);
+                ptr=ptr2;SKIP_BLANK(ptr);
+            }
+            if(ISDIGIT(*ptr)){
+                GET_UINT(_CONF.conv.patience,ptr,ptr2);
+                ptr=ptr2;SKIP_BLANK(ptr);
+            }
+            if(ISDIGIT(*ptr)||(*ptr=='.')){
+                GET_DOUBLE(_CONF.conv.min_rel,ptr,ptr2);
+                ptr=ptr2;SKIP_BLANK(ptr);
+                if((_CONF.conv.min_rel<0.)||(_CONF.conv.min_rel>=1.))
+                    _CONF.conv.min_rel=NN_CONV_MIN_REL;
+            }
+            _CONF.conv.defer=FALSE;
+            if(ISGRAPH(*ptr)&&(*ptr!='#')){
+                if((STRFIND("defer",ptr)!=ptr)||(ISGRAPH(ptr[5])&&(ptr[5]!='#'))){
+                    NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                    NN_ERROR(stderr,"[converge] unknown keyword: %s\n",ptr);
+                    goto FAIL;
+                }
+                _CONF.conv.defer=TRUE;
+            }
+        }
+        ptr=STRFIND("[check]",line);
+        if(ptr!=NULL){
+            /*get convergence check interval {n_check}*/
+            ptr+=7;SKIP_BLANK(ptr);
+            if(!ISDIGIT(*ptr)) {
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[check] value: %s\n",ptr);
+                goto FAIL;
+            }
+            GET_UINT(_CONF.conv.n_check,ptr,ptr2);
+        }
+        ptr=STRFIND("[activation",line);
+        if(ptr!=NULL){
+            /*get layer activations {"name" x n_layers}*/
+            ptr+=12;SKIP_BLANK(ptr);
+            FREE(f_act);
+            STRDUP(ptr,f_act);
+        }
+        ptr=STRFIND("[bias]",line);
+        if(ptr!=NULL){
+            /*get biases {"yes","no"}*/
+            ptr+=6;SKIP_BLANK(ptr);
+            switch (*ptr){
+                case 'N':
+                case 'n':
+                    is_bias=FALSE;
+                    break;
+                case 'Y':
+                case 'y':
+                default:
+                    is_bias=TRUE;
+            }
+        }
         READLINE(fp,line);
     }while(!feof(fp));
     fclose(fp);
@@ -856,6 +1281,25 @@ NN_OUT(stdout,"loading kernel!\n");
             NN_ERROR(stderr,"[type] unsupported...\n");
             goto FAIL;
         }
+        /*one activation per hidden layer, the last one being repeated,
+         *then optionally the output (a loaded kernel has its own)*/
+        ptr=f_act;idx=0;
+        while((ptr!=NULL)&&ISGRAPH(*ptr)&&(*ptr!='#')&&(idx<=parameter[1])){
+            if(!_NN(set,activation)(conf,idx,ptr)){
+                NN_ERROR(stderr,"Malformed NN configuration file!\n");
+                NN_ERROR(stderr,"[activation] unknown value: %s\n",ptr);
+                goto FAIL;
+            }
+            while(ISGRAPH(*ptr)) ptr++;
+            SKIP_BLANK(ptr);
+            idx++;
+            if((idx<parameter[1])&&(!ISGRAPH(*ptr)||(*ptr=='#'))){
+                /*repeat the last one on remaining hidden layers*/
+                for(;idx<parameter[1];idx++)
+                    _NN(set,activation)(conf,idx,
+                        _NN(get,activation)(conf,idx-1));
+            }
+        }
     }else{
         is_ok=_NN(load,kernel)(conf);
         if(!is_ok){
@@ -867,8 +1311,15 @@ NN_OUT(stdout,"loading kernel!\n");
         NN_ERROR(stderr,"Initialization or load of NN kernel FAILED!\n");
         goto FAIL;
     }
+    /*a loaded kernel keeps its own biases, [bias] can only add some*/
+    if(is_bias&&(!_NN(set,bias)(conf,TRUE))){
+        NN_ERROR(stderr,"Malformed NN configuration file!\n");
+        NN_ERROR(stderr,"[bias] unsupported...\n");
+        goto FAIL;
+    }
     FREE(parameter);
     FREE(n_hiddens);
+    FREE(f_act);
 NN_OUT(stdout,"NN definition allocation: %lu (bytes)\n",allocate);
     return conf;
 read_conf_fail:
@@ -876,13 +1327,19 @@ read_conf_fail:
     FREE(_CONF.f_kernel);
     FREE(_CONF.samples);
     FREE(_CONF.tests);
+    FREE(_CONF.f_chkpt);
+    FREE(_CONF.f_teacher);
+    _NN(close,dataset)(_CONF.samples_ds);
+    _NN(close,dataset)(_CONF.tests_ds);
     FREE(conf);
     FREE(parameter);
     FREE(n_hiddens);
+    FREE(f_act);
     return NULL;
 #undef FAIL
 }
 void _NN(dump,conf)(nn_def *conf,FILE *fp){
+    kernel_ann *kernel;
     UINT n_hiddens;
     UINT idx;
     if(fp==NULL) return;
@@ -926,14 +1383,64 @@ void _NN(dump,conf)(nn_def *conf,FILE *fp){
         case NN_TRAIN_SPLX:
             NN_WRITE(fp,"[train] SPLX\n");
             break;
+        case NN_TRAIN_ADAM:
+            NN_WRITE(fp,"[train] ADAM\n");
+            break;
+        case NN_TRAIN_RMSPROP:
+            NN_WRITE(fp,"[train] RMSPROP\n");
+            break;
+        case NN_TRAIN_LM:
+            NN_WRITE(fp,"[train] LM\n");
+            break;
         default:
             NN_WRITE(fp,"[train] none\n");
     }
 
-    if(_CONF.samples!=NULL) NN_WRITE(fp,"[sample_dir] %s\n",_CONF.samples);
+    if((_CONF.samples_ds!=NULL)&&(_CONF.samples_ds->f_in!=NULL))
+        NN_WRITE(fp,"[sample_idx] %s %s\n",
+            _CONF.samples_ds->f_in,_CONF.samples_ds->f_out);
+    else if(_CONF.samples!=NULL)
+        NN_WRITE(fp,"[sample_dir] %s\n",_CONF.samples);
     else NN_WRITE(fp,"[sample_dir] INVALID <- this should trigger an error\n");
-    if(_CONF.tests!=NULL) NN_WRITE(fp,"[test_dir] %s\n",_CONF.tests);
+    if((_CONF.tests_ds!=NULL)&&(_CONF.tests_ds->f_in!=NULL))
+        NN_WRITE(fp,"[test_idx] %s %s\n",
+            _CONF.tests_ds->f_in,_CONF.tests_ds->f_out);
+    else if(_CONF.tests!=NULL) NN_WRITE(fp,"[test_dir] %s\n",_CONF.tests);
     else NN_WRITE(fp,"[test_dir] INVALID <- this should trigger an error\n");
+    if(_CONF.f_chkpt!=NULL) NN_WRITE(fp,"[checkpoint] %s %i %i\n",
+        _CONF.f_chkpt,_CONF.n_chkpt,_CONF.t_chkpt);
+    if((_CONF.n_loaders!=NN_LOADERS)||(_CONF.n_prefetch!=NN_PREFETCH))
+        NN_WRITE(fp,"[loader] %i %i\n",_CONF.n_loaders,_CONF.n_prefetch);
+    if(_CONF.order==NN_ORDER_INODE) NN_WRITE(fp,"[order] inode\n");
+    if(_CONF.f_teacher!=NULL) NN_WRITE(fp,"[teacher] %s %f\n",
+        _CONF.f_teacher,_CONF.t_temp);
+    if(_CONF.n_batch>1) NN_WRITE(fp,"[batch] %i\n",_CONF.n_batch);
+    if(_CONF.par==NN_PAR_HOGWILD) NN_WRITE(fp,"[parallel] hogwild\n");
+    if(_CONF.par==NN_PAR_LOCAL)
+        NN_WRITE(fp,"[parallel] local %i\n",_CONF.n_local);
+    if(_CONF.comp==NN_COMP_FP32) NN_WRITE(fp,"[compress] fp32\n");
+    if(_CONF.comp==NN_COMP_FP16) NN_WRITE(fp,"[compress] fp16\n");
+    if(_CONF.comp==NN_COMP_TOPK)
+        NN_WRITE(fp,"[compress] topk %f\n",_CONF.comp_ratio);
+    if((_CONF.conv.max_iter>0)||(_CONF.conv.max_time>0.)
+        ||(_CONF.conv.patience>0)||(_CONF.conv.defer))
+        NN_WRITE(fp,"[converge] %i %f %i %f%s\n",_CONF.conv.max_iter,
+            _CONF.conv.max_time,_CONF.conv.patience,_CONF.conv.min_rel,
+            (_CONF.conv.defer)?" defer":"");
+    if(_CONF.conv.n_check>1) NN_WRITE(fp,"[check] %i\n",_CONF.conv.n_check);
+    if(_NN(get,bias)(conf)) NN_WRITE(fp,"[bias] yes\n");
+    /*only when some layer is not the default sigmoid*/
+    kernel=(kernel_ann *)_CONF.kernel;
+    if((kernel!=NULL)&&((_CONF.type==NN_TYPE_ANN)||(_CONF.type==NN_TYPE_SNN))){
+        for(idx=0;idx<kernel->n_hiddens;idx++)
+            if(kernel->hiddens[idx].act!=ANN_ACT_SIGMOID) break;
+        if((idx<kernel->n_hiddens)||(kernel->output.act!=ANN_ACT_SIGMOID)){
+            NN_WRITE(fp,"[activation]");
+            for(idx=0;idx<=n_hiddens;idx++)
+                NN_WRITE(fp," %s",_NN(get,activation)(conf,idx));
+            NN_WRITE(fp,"\n");
+        }
+    }
 }
 /*----------------------------*/
 /*+++ manipulate NN kernel +++*/
@@ -1011,7 +1518,7 @@ void _NN(dump,kernel)(nn_def *conf, FILE *output){
 /*+++ Access NN parameters +++*/
 /*----------------------------*/
 UINT _NN(get,n_inputs)(nn_def *conf){
-    if(_CONF.f_kernel==NULL) return FALSE;
+    if(_CONF.kernel==NULL) return FALSE;
     switch (_CONF.type){
     case NN_TYPE_SNN:
         /*fallthrough*/
@@ -1024,7 +1531,7 @@ UINT _NN(get,n_inputs)(nn_def *conf){
     }
 }
 UINT _NN(get,n_hiddens)(nn_def *conf){
-    if(_CONF.f_kernel==NULL) return FALSE;
+    if(_CONF.kernel==NULL) return FALSE;
     switch (_CONF.type){
     case NN_TYPE_SNN:
         /*fallthrough*/
@@ -1037,7 +1544,7 @@ UINT _NN(get,n_hiddens)(nn_def *conf){
     }
 }
 UINT _NN(get,n_outputs)(nn_def *conf){
-    if(_CONF.f_kernel==NULL) return FALSE;
+    if(_CONF.kernel==NULL) return FALSE;
     switch (_CONF.type){
     case NN_TYPE_SNN:
         /*fallthrough*/
@@ -1050,12 +1557,12 @@ UINT _NN(get,n_outputs)(nn_def *conf){
     }
 }
 UINT _NN(get,h_neurons)(nn_def *conf,UINT layer){
-    if(_CONF.f_kernel==NULL) return FALSE;
+    if(_CONF.kernel==NULL) return FALSE;
     switch (_CONF.type){
     case NN_TYPE_SNN:
         /*fallthrough*/
     case NN_TYPE_ANN:
-        if(layer > ((kernel_ann *)_CONF.kernel)->n_hiddens) return FALSE;
+        if(layer >= ((kernel_ann *)_CONF.kernel)->n_hiddens) return FALSE;
         if(((kernel_ann *)_CONF.kernel)->hiddens==NULL) return FALSE;
         return ((kernel_ann *)_CONF.kernel)->hiddens[layer].n_neurons;
     case NN_TYPE_LNN:
@@ -1064,16 +1571,140 @@ UINT _NN(get,h_neurons)(nn_def *conf,UINT layer){
         return 0;
     }
 }
+/*^^^ set the activation of a layer (layer=n_hiddens is the output, which
+ * is ignored by SNN softmax), name is one of sigmoid, relu, lrelu, htanh.*/
+BOOL _NN(set,activation)(nn_def *conf,UINT layer,const CHAR *name){
+    kernel_ann *kernel=(kernel_ann *)_CONF.kernel;
+    ann_act_type act;
+    if(kernel==NULL) return FALSE;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        if(layer>kernel->n_hiddens) return FALSE;
+        act=ann_act_parse(name);
+        if(act==ANN_ACT_UKN) return FALSE;
+#ifdef _CUDA
+        if(act!=ANN_ACT_SIGMOID){
+            NN_ERROR(stderr,"%s activation unsupported on GPU!\n",
+                ann_act_name(act));
+            return FALSE;
+        }
+#endif /*_CUDA*/
+        if(layer<kernel->n_hiddens) kernel->hiddens[layer].act=act;
+        else kernel->output.act=act;
+        return TRUE;
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return FALSE;
+    }
+}
+const CHAR *_NN(get,activation)(nn_def *conf,UINT layer){
+    kernel_ann *kernel=(kernel_ann *)_CONF.kernel;
+    if(kernel==NULL) return NULL;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        if(layer>kernel->n_hiddens) return NULL;
+        if(layer<kernel->n_hiddens)
+            return ann_act_name(kernel->hiddens[layer].act);
+        return ann_act_name(kernel->output.act);
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return NULL;
+    }
+}
+/*^^^ add zero biases to all layers (is_bias=TRUE) or remove them all.*/
+BOOL _NN(set,bias)(nn_def *conf,BOOL is_bias){
+    kernel_ann *kernel=(kernel_ann *)_CONF.kernel;
+    if(kernel==NULL) return FALSE;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+#ifdef _CUDA
+        if(is_bias){
+            NN_ERROR(stderr,"biases unsupported on GPU!\n");
+            return FALSE;
+        }
+#endif /*_CUDA*/
+        if(is_bias) ann_bias_alloc(kernel);
+        else ann_bias_free(kernel);
+        return TRUE;
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return FALSE;
+    }
+}
+/*^^^ TRUE if any layer has biases*/
+BOOL _NN(get,bias)(nn_def *conf){
+    kernel_ann *kernel=(kernel_ann *)_CONF.kernel;
+    UINT idx;
+    if(kernel==NULL) return FALSE;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        for(idx=0;idx<kernel->n_hiddens;idx++)
+            if(kernel->hiddens[idx].bias!=NULL) return TRUE;
+        return (kernel->output.bias!=NULL);
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return FALSE;
+    }
+}
 /*------------------*/
 /*+++ sample I/O +++*/
 /*------------------*/
+/*^^^ fast, locale independent, string to double conversion. The fixed point
+ * notation used by libhpnn and its tutorials (ie. %17.15f or %7.5f) gives at
+ * most 2^53 as an integer mantissa m and 10^n (n<23) as a divisor, which are
+ * both exact in double precision, making m/10^n correctly rounded ie. equal
+ * to the strtod result. Anything else (exponent, too many digits, inf, nan,
+ * hexadecimal, etc.) falls back to STR2D.*/
+DOUBLE _NN(parse,double)(const CHAR *in,CHAR **out){
+    static const DOUBLE p10[23]={
+        1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+        1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    const CHAR *ptr=in;
+    UINT64 mant=0;
+    UINT n_dig=0,n_frac=0;
+    UINT digit;
+    BOOL is_neg=FALSE;
+    if(*ptr=='-') {is_neg=TRUE;ptr++;}
+    else if(*ptr=='+') ptr++;
+    /*integer part*/
+    while((digit=(UINT)(*ptr-'0'))<10){
+        mant=mant*10+digit;
+        n_dig++;ptr++;
+    }
+    /*fractional part*/
+    if(*ptr=='.'){
+        ptr++;
+        while((digit=(UINT)(*ptr-'0'))<10){
+            mant=mant*10+digit;
+            n_dig++;n_frac++;ptr++;
+        }
+    }
+    if((n_dig==0)||(n_dig>19)||(n_frac>22)||(mant>(1ULL<<53))
+        ||(*ptr=='e')||(*ptr=='E')||(*ptr=='x')||(*ptr=='X'))
+        return (DOUBLE)STR2D(in,out);
+    if(out!=NULL) *out=(CHAR *)ptr;
+    if(is_neg) return -((DOUBLE)mant/p10[n_frac]);
+    return (DOUBLE)mant/p10[n_frac];
+}
 BOOL _NN(read,sample)(CHAR *filename,DOUBLE **in,DOUBLE **out){
 #define FAIL nn_sample_read_fail
     PREP_READLINE();
     CHAR *line=NULL;
     CHAR *ptr,*ptr2;
-    UINT n_in,n_out;
-    UINT idx;
+    UINT n_in,n_out,n_nz;
+    UINT idx,jdx;
     FILE *fp;
     /**/
     if(filename==NULL) return FALSE;
@@ -1086,6 +1717,40 @@ BOOL _NN(read,sample)(CHAR *filename,DOUBLE **in,DOUBLE **out){
         return FALSE;
     }
     do{
+        ptr=STRFIND("[sparse_input",line);
+        if(ptr!=NULL){
+            /*read sparse inputs: N K then K idx:value pairs*/
+            ptr+=14;SKIP_BLANK(ptr);
+            if(!ISDIGIT(*ptr)) {
+                NN_ERROR(stderr,"sample %s input read failed!\n",filename);
+                goto FAIL;
+            }
+            GET_UINT(n_in,ptr,ptr2);
+            ptr=ptr2;SKIP_BLANK(ptr);
+            if((n_in==0)||(!ISDIGIT(*ptr))){
+                NN_ERROR(stderr,"sample %s input read failed!\n",filename);
+                goto FAIL;
+            }
+            GET_UINT(n_nz,ptr,ptr2);
+            READLINE(fp,line);/*line immediately after should contain pairs*/
+            ALLOC(*in,n_in,DOUBLE);/*zeroed*/
+            ptr=&(line[0]);SKIP_BLANK(ptr);
+            for(idx=0;idx<n_nz;idx++){
+                if(!ISDIGIT(*ptr)) {
+                    NN_ERROR(stderr,"sample %s input read failed!\n",filename);
+                    goto FAIL;
+                }
+                GET_UINT(jdx,ptr,ptr2);
+                if((jdx>=n_in)||(*ptr2!=':')){
+                    NN_ERROR(stderr,"sample %s bad sparse pair #%i!\n",
+                        filename,idx+1);
+                    goto FAIL;
+                }
+                ptr=ptr2+1;
+                NN_GET_DOUBLE((*in)[jdx],ptr,ptr2);ASSERT_GOTO(ptr2,FAIL);
+                ptr=ptr2;SKIP_BLANK(ptr);
+            }
+        }
         ptr=STRFIND("[input",line);
         if(ptr!=NULL){
             /*read inputs*/
@@ -1103,11 +1768,11 @@ BOOL _NN(read,sample)(CHAR *filename,DOUBLE **in,DOUBLE **out){
             ALLOC(*in,n_in,DOUBLE);
             ptr=&(line[0]);SKIP_BLANK(ptr);
             for(idx=0;idx<(n_in-1);idx++){
-                GET_DOUBLE((*in)[idx],ptr,ptr2);ASSERT_GOTO(ptr2,FAIL);
+                NN_GET_DOUBLE((*in)[idx],ptr,ptr2);ASSERT_GOTO(ptr2,FAIL);
                 ptr=ptr2+1;SKIP_BLANK(ptr);
             }
             /*get the last one*/
-            GET_DOUBLE((*in)[n_in-1],ptr,ptr2);/*no assert here*/
+            NN_GET_DOUBLE((*in)[n_in-1],ptr,ptr2);/*no assert here*/
         }
         ptr=STRFIND("[output",line);
         if(ptr!=NULL){
@@ -1126,11 +1791,11 @@ BOOL _NN(read,sample)(CHAR *filename,DOUBLE **in,DOUBLE **out){
             ALLOC(*out,n_out,DOUBLE);
             ptr=&(line[0]);SKIP_BLANK(ptr);
             for(idx=0;idx<(n_out-1);idx++){
-                GET_DOUBLE((*out)[idx],ptr,ptr2);ASSERT_GOTO(ptr2,FAIL);
+                NN_GET_DOUBLE((*out)[idx],ptr,ptr2);ASSERT_GOTO(ptr2,FAIL);
                 ptr=ptr2+1;SKIP_BLANK(ptr);
             }
             /*get the last one*/
-            GET_DOUBLE((*out)[n_out-1],ptr,ptr2);/*no assert here*/
+            NN_GET_DOUBLE((*out)[n_out-1],ptr,ptr2);/*no assert here*/
         }
         READLINE(fp,line);
     }while(!feof(fp));
@@ -1143,232 +1808,1261 @@ nn_sample_read_fail:
     return FALSE;
 #undef FAIL
 }
-/*---------------------*/
-/*+++ execute NN OP +++*/
-/*---------------------*/
-BOOL _NN(train,kernel)(nn_def *conf){
-    DIR_S *directory;
-    CHAR  *curr_file;
-    CHAR   *curr_dir;
-    DOUBLE    *tr_in;
-    DOUBLE   *tr_out;
-    UINT file_number;
-    CHAR     **flist;
-    CHAR  *tmp,**ptr;
-    UINT is_ok;
-    UINT   idx;
-    UINT   jdx;
-    DOUBLE res;
-    /**/
-    curr_file=NULL;
-    curr_dir =NULL;
-    flist = NULL;
-    /**/
-    if(_CONF.kernel==NULL) return FALSE;
-    if(_CONF.samples==NULL) return FALSE;
-    if(_CONF.type==NN_TYPE_UKN) return FALSE;
-    /*initialize momentum*/
-    switch (_CONF.type){
-    case NN_TYPE_SNN:
-        /*fallthrough*/
-    case NN_TYPE_ANN:
-        if(_CONF.train==NN_TRAIN_BPM)
-            ann_momentum_init((kernel_ann *)_CONF.kernel);
-        break;
-    case NN_TYPE_LNN:
-    case NN_TYPE_UKN:
+/*^^^ private: element size of a binary dataset type*/
+static UINT _NN(data,size)(nn_data_type type){
+    switch(type){
+    case NN_DATA_F32:
+        return sizeof(float);
+    case NN_DATA_F64:
+        return sizeof(double);
+    case NN_DATA_U8:
     default:
-        NN_ERROR(stdout,"unimplemented NN type!\n");
+        return sizeof(UCHAR);
     }
-    /*process sample files*/
-    OPEN_DIR(directory,_CONF.samples);
-    if(directory==NULL){
-        NN_ERROR(stderr,"can't open sample directory: %s\n",
-            _CONF.samples);
+}
+/*^^^ private: swap bytes of n elements of size sz (endianness)*/
+static void _NN(data,swap)(void *data,UINT64 n,UINT sz){
+    UCHAR *ptr=(UCHAR *)data;
+    UCHAR c;
+    UINT64 idx;
+    UINT jdx;
+    if(sz<2) return;
+    for(idx=0;idx<n;idx++){
+        for(jdx=0;jdx<sz/2;jdx++){
+            c=ptr[jdx];
+            ptr[jdx]=ptr[sz-1-jdx];
+            ptr[sz-1-jdx]=c;
+        }
+        ptr+=sz;
+    }
+}
+static BOOL _NN(data,is_le)(){
+    UINT one=1;
+    return (*((UCHAR *)&one)==1);
+}
+/*^^^ private: get element pos of matrix m as a DOUBLE*/
+static DOUBLE _NN(data,get)(nn_matrix *m,UINT64 pos){
+    switch(m->type){
+    case NN_DATA_F32:
+        return (DOUBLE)((float *)m->data)[pos];
+    case NN_DATA_F64:
+        return (DOUBLE)((double *)m->data)[pos];
+    case NN_DATA_U8:
+    default:
+        return (DOUBLE)((UCHAR *)m->data)[pos];
+    }
+}
+/*--------------------------------*/
+/*+++ read an IDX (MNIST) file +++*/
+/*--------------------------------*/
+/*^^^ IDX is big endian: 2 zero bytes, a type byte, a number of dimension
+ * byte, then one 32 bit size per dimension followed by the data.  The first
+ * dimension is the number of samples, the others are flattened.*/
+BOOL _NN(read,idx)(const CHAR *filename,nn_matrix *m){
+#define FAIL nn_idx_read_fail
+    UCHAR head[4];
+    UINT64 n_elem;
+    UINT64 n_cols;
+    UINT64 f_data;
+    long f_size;
+    UINT n_dims;
+    UINT dim;
+    UINT idx;
+    UINT sz;
+    FILE *fp;
+    /**/
+    m->type=NN_DATA_U8;
+    m->n_rows=0;
+    m->n_cols=0;
+    m->data=NULL;
+    if(filename==NULL) return FALSE;
+    fp=fopen(filename,"rb");
+    if(fp==NULL){
+        NN_ERROR(stderr,"can't open IDX file %s\n",filename);
         return FALSE;
     }
-    STRCAT(curr_dir,_CONF.samples,"/");
-    /*count the number of file in directory*/
-    FILE_FROM_DIR(directory,curr_file);
-    file_number=0;
-    while(curr_file!=NULL){
-        if(curr_file[0]=='.') {
-            FREE(curr_file);
-            FILE_FROM_DIR(directory,curr_file);/*NEXT*/
-            continue;
+    if(fread(head,sizeof(UCHAR),4,fp)!=4) goto FAIL;
+    if((head[0]!=0)||(head[1]!=0)) goto FAIL;
+    switch(head[2]){
+    case 0x08:
+        m->type=NN_DATA_U8;
+        break;
+    case 0x0D:
+        m->type=NN_DATA_F32;
+        break;
+    case 0x0E:
+        m->type=NN_DATA_F64;
+        break;
+    default:
+        NN_ERROR(stderr,"IDX file %s: unsupported type %X\n",filename,head[2]);
+        goto FAIL;
+    }
+    n_dims=head[3];
+    if(n_dims==0) goto FAIL;
+    n_cols=1;
+    for(idx=0;idx<n_dims;idx++){
+        if(fread(head,sizeof(UCHAR),4,fp)!=4) goto FAIL;
+        dim=((UINT)head[0]<<24)|((UINT)head[1]<<16)
+           |((UINT)head[2]<<8)|((UINT)head[3]);
+        if(idx==0) m->n_rows=dim;
+        else n_cols*=dim;/*can't overflow: both are < 2^32*/
+        if(n_cols>UINT_MAX){
+            NN_ERROR(stderr,"IDX file %s: sample too large!\n",filename);
+            goto FAIL;
         }
-        /*POSIX says char d_name[] has no fixed size*/
-        STRDUP(curr_file,tmp);
-        file_number++;
-        ALLOC(ptr,file_number,CHAR *);
-        for(idx=0;idx<(file_number-1);idx++){
-            ptr[idx]=flist[idx];
-        }
-        ptr[file_number-1]=tmp;
-        FREE(flist);
-        flist=ptr;
-        tmp=NULL;ptr=NULL;
-        FREE(curr_file);
-        FILE_FROM_DIR(directory,curr_file);/*NEXT*/
     }
-    CLOSE_DIR(directory,is_ok);
-    if(is_ok){
-        NN_ERROR(stderr,"trying to close %s directory. IGNORED\n",curr_dir);
+    m->n_cols=(UINT)n_cols;
+    sz=_NN(data,size)(m->type);
+    n_elem=(UINT64)m->n_rows*n_cols;
+    if(n_elem==0) goto FAIL;
+    /*the header must describe the file exactly*/
+    if(fseek(fp,0L,SEEK_END)!=0) goto FAIL;
+    f_size=ftell(fp);
+    if(f_size<(long)(4*(n_dims+1))) goto FAIL;
+    f_data=(UINT64)f_size-4*(n_dims+1);
+    if(((f_data%sz)!=0)||((f_data/sz)!=n_elem)){
+        NN_ERROR(stderr,"IDX file %s: size does not match header!\n",filename);
+        goto FAIL;
     }
-    if(_CONF.seed==0) _CONF.seed=time(NULL);
-    srandom(_CONF.seed);
-    jdx=0;
-    while(jdx<file_number){
-        /*get a random number between 0 and file_number-1*/
-        idx=(UINT) ((DOUBLE) random()*file_number / RAND_MAX);
-        while(flist[idx]==NULL){
-            /*no good, get another random number*/
-            idx=(UINT) ((DOUBLE) random()*file_number / RAND_MAX);
-        }
-        STRDUP(flist[idx],curr_file);
-        FREE(flist[idx]);flist[idx]=NULL;jdx++;
-        NN_OUT(stdout,"TRAINING FILE: %16.16s\t",curr_file);
-        /*this should never happen (but static analysis choked)*/
-        if(curr_file==NULL) continue;
-        STRCAT(tmp,curr_dir,curr_file);
-        _NN(read,sample)(tmp,&tr_in,&tr_out);
-        FREE(tmp);
-        if((tr_in==NULL)||(tr_out==NULL)){
-            /*something went wrong, skipping*/
-            FREE(curr_file);
-            FREE(tr_in);
-            FREE(tr_out);
-            continue;
-        }
-        switch (_CONF.type){
-        case NN_TYPE_ANN:
-            /*check training*/
-            switch (_CONF.train){
-            case NN_TRAIN_BPM:
-              res=ann_train_BPM((kernel_ann *)_CONF.kernel,tr_in,tr_out,.2,-1.);
-              break;
-            case NN_TRAIN_BP:
-              res=ann_train_BP((kernel_ann *)_CONF.kernel,tr_in,tr_out,-1.);
-              break;
-            case NN_TRAIN_SPLX:
-            case NN_TRAIN_CG:
-            default:
-              res=0.;
-              break;
-            }
-            break;
-        case NN_TYPE_LNN:
-        case NN_TYPE_SNN:
-            /*check training*/
-            switch (_CONF.train){
-            case NN_TRAIN_BPM:
-              res=snn_train_BPM((kernel_ann *)_CONF.kernel,tr_in,tr_out,.2,-1.);
-              break;
-            case NN_TRAIN_BP:
-              res=snn_train_BP((kernel_ann *)_CONF.kernel,tr_in,tr_out,-1.);
-              break;
-            case NN_TRAIN_SPLX:
-            case NN_TRAIN_CG:
-            default:
-              res=0.;
-              break;
+    if(fseek(fp,(long)(4*(n_dims+1)),SEEK_SET)!=0) goto FAIL;
+    ALLOC(m->data,n_elem*sz,UCHAR);
+    if(fread(m->data,sz,n_elem,fp)!=n_elem) goto FAIL;
+    fclose(fp);
+    if(_NN(data,is_le)()) _NN(data,swap)(m->data,n_elem,sz);
+    return TRUE;
+nn_idx_read_fail:
+    NN_ERROR(stderr,"IDX file %s read failed!\n",filename);
+    fclose(fp);
+    _NN(free,matrix)(m);
+    return FALSE;
+#undef FAIL
+}
+/*-----------------------------------------*/
+/*+++ read a raw (little endian) matrix +++*/
+/*-----------------------------------------*/
+/*^^^ the number of samples is deduced from the file size.*/
+BOOL _NN(read,raw)(const CHAR *filename,nn_data_type type,UINT n_cols,
+                   nn_matrix *m){
+#define FAIL nn_raw_read_fail
+    UINT64 n_elem;
+    long f_size;
+    UINT sz;
+    FILE *fp;
+    /**/
+    m->type=type;
+    m->n_rows=0;
+    m->n_cols=n_cols;
+    m->data=NULL;
+    if((filename==NULL)||(n_cols==0)) return FALSE;
+    fp=fopen(filename,"rb");
+    if(fp==NULL){
+        NN_ERROR(stderr,"can't open raw file %s\n",filename);
+        return FALSE;
+    }
+    sz=_NN(data,size)(type);
+    if(fseek(fp,0L,SEEK_END)!=0) goto FAIL;
+    f_size=ftell(fp);
+    if(f_size<=0) goto FAIL;
+    rewind(fp);
+    m->n_rows=(UINT)((UINT64)f_size/((UINT64)n_cols*sz));
+    n_elem=(UINT64)m->n_rows*n_cols;
+    if(n_elem==0) goto FAIL;
+    if((n_elem*sz)!=(UINT64)f_size)
+        NN_WARN(stderr,"raw file %s: trailing data ignored!\n",filename);
+    ALLOC(m->data,n_elem*sz,UCHAR);
+    if(fread(m->data,sz,n_elem,fp)!=n_elem) goto FAIL;
+    fclose(fp);
+    if(!_NN(data,is_le)()) _NN(data,swap)(m->data,n_elem,sz);
+    return TRUE;
+nn_raw_read_fail:
+    NN_ERROR(stderr,"raw file %s read failed!\n",filename);
+    fclose(fp);
+    _NN(free,matrix)(m);
+    return FALSE;
+#undef FAIL
+}
+void _NN(free,matrix)(nn_matrix *m){
+    if(m==NULL) return;
+    FREE(m->data);
+    m->n_rows=0;
+    m->n_cols=0;
+}
+/*----------------------*/
+/*+++ binary dataset +++*/
+/*----------------------*/
+/*^^^ private: validate a dataset. Outputs are class labels (one per sample)
+ * when n_classes>0, or when they are a single unsigned char column (such as
+ * IDX labels) in which case n_classes is max(label)+1.  A scale<=0 means 1/255
+ * for unsigned char inputs (ie. pixels) and 1 otherwise.*/
+static BOOL _NN(dataset,check)(nn_dataset *ds,UINT n_classes,DOUBLE scale){
+    UINT64 idx;
+    UINT label;
+    if(ds->in.n_rows!=ds->out.n_rows){
+        NN_ERROR(stderr,"dataset: %u inputs but %u outputs!\n",
+            ds->in.n_rows,ds->out.n_rows);
+        return FALSE;
+    }
+    if((n_classes==0)&&(ds->out.n_cols==1)&&(ds->out.type==NN_DATA_U8)){
+        for(idx=0;idx<ds->out.n_rows;idx++){
+            label=((UCHAR *)ds->out.data)[idx];
+            if(label>=n_classes) n_classes=label+1;
+        }
+    }
+    if(n_classes>0){
+        if(ds->out.n_cols!=1){
+            NN_ERROR(stderr,"dataset: labels should be a single column!\n");
+            return FALSE;
+        }
+        for(idx=0;idx<ds->out.n_rows;idx++){
+            label=(UINT)_NN(data,get)(&(ds->out),idx);
+            if(label>=n_classes){
+                NN_ERROR(stderr,"dataset: label %u out of boundaries!\n",label);
+                return FALSE;
             }
-            break;
-        case NN_TYPE_UKN:
-            res=0.;/*not ready yet*/
-            break;
-        default:
-            /*can't happen*/
-            res=0.;
         }
-        if(res>0.1) NN_DBG(stdout,"bad optimization!\n");
+    }
+    ds->n_classes=n_classes;
+    if(scale>0.) ds->scale=scale;
+    else if(ds->in.type==NN_DATA_U8) ds->scale=1./255.;
+    else ds->scale=1.;
+    return TRUE;
+}
+nn_dataset *_NN(open,idx)(const CHAR *f_in,const CHAR *f_out,
+                          UINT n_classes,DOUBLE scale){
+    nn_dataset *ds;
+    ALLOC(ds,1,nn_dataset);
+    if(!_NN(read,idx)(f_in,&(ds->in))) goto idx_open_fail;
+    if(!_NN(read,idx)(f_out,&(ds->out))) goto idx_open_fail;
+    if(!_NN(dataset,check)(ds,n_classes,scale)) goto idx_open_fail;
+    STRDUP(f_in,ds->f_in);
+    STRDUP(f_out,ds->f_out);
+    return ds;
+idx_open_fail:
+    _NN(close,dataset)(ds);
+    return NULL;
+}
+nn_dataset *_NN(open,raw)(const CHAR *f_in,nn_data_type t_in,UINT n_in,
+                          const CHAR *f_out,nn_data_type t_out,UINT n_out,
+                          UINT n_classes,DOUBLE scale){
+    nn_dataset *ds;
+    if(n_classes>0) n_out=1;/*one label per sample*/
+    ALLOC(ds,1,nn_dataset);
+    if(!_NN(read,raw)(f_in,t_in,n_in,&(ds->in))) goto raw_open_fail;
+    if(!_NN(read,raw)(f_out,t_out,n_out,&(ds->out))) goto raw_open_fail;
+    if(!_NN(dataset,check)(ds,n_classes,scale)) goto raw_open_fail;
+    /*raw datasets are not kept in configuration*/
+    return ds;
+raw_open_fail:
+    _NN(close,dataset)(ds);
+    return NULL;
+}
+void _NN(close,dataset)(nn_dataset *ds){
+    if(ds==NULL) return;
+    _NN(free,matrix)(&(ds->in));
+    _NN(free,matrix)(&(ds->out));
+    FREE(ds->f_in);
+    FREE(ds->f_out);
+    FREE(ds);
+}
+UINT _NN(get,dataset_size)(nn_dataset *ds){
+    if(ds==NULL) return 0;
+    return ds->in.n_rows;
+}
+/*^^^ decode sample index into in (normalized) and out (one-hot encoded with
+ * the usual +1/-1 convention when labels are used), both should be allocated
+ * by caller to the input and output (or n_classes) size. Thread safe.*/
+BOOL _NN(get,dataset_sample)(nn_dataset *ds,UINT index,DOUBLE *in,DOUBLE *out){
+    UINT64 pos;
+    UINT idx,n;
+    UINT label;
+    if((ds==NULL)||(index>=ds->in.n_rows)) return FALSE;
+    n=ds->in.n_cols;
+    pos=(UINT64)index*n;
+    switch(ds->in.type){
+    case NN_DATA_F32:
+        for(idx=0;idx<n;idx++)
+            in[idx]=ds->scale*(DOUBLE)((float *)ds->in.data)[pos+idx];
+        break;
+    case NN_DATA_F64:
+        for(idx=0;idx<n;idx++)
+            in[idx]=ds->scale*((double *)ds->in.data)[pos+idx];
+        break;
+    case NN_DATA_U8:
+    default:
+        for(idx=0;idx<n;idx++)
+            in[idx]=ds->scale*(DOUBLE)((UCHAR *)ds->in.data)[pos+idx];
+    }
+    if(ds->n_classes>0){
+        label=(UINT)_NN(data,get)(&(ds->out),index);
+        for(idx=0;idx<ds->n_classes;idx++) out[idx]=(idx==label)?1.0:-1.0;
+    }else{
+        n=ds->out.n_cols;
+        pos=(UINT64)index*n;
+        for(idx=0;idx<n;idx++) out[idx]=_NN(data,get)(&(ds->out),pos+idx);
+    }
+    return TRUE;
+}
+/*------------------------------------*/
+/*+++ checkpoint (during training) +++*/
+/*------------------------------------*/
+/*^^^ private: the kernel is staged (copied) on the training thread, then
+ * written by a background thread, so that training never waits for disk.
+ * A checkpoint which is due while the previous one is still being written
+ * is simply skipped.*/
+typedef struct {
+    CHAR        *file;  /*checkpoint filename*/
+    kernel_ann *stage;  /*CPU copy of the kernel being written*/
+    UINT       n_last;  /*samples since last checkpoint*/
+    time_t     t_last;  /*time of last checkpoint*/
+    BOOL      is_busy;  /*a write is in progress*/
+    BOOL        is_ok;  /*status of last write*/
+#ifdef _PTHREAD
+    BOOL   has_thread;  /*thread need to be joined*/
+    pthread_t  thread;
+    pthread_mutex_t lock;
+#endif /*_PTHREAD*/
+} nn_chkpt;
+static BOOL _NN(chkpt,init)(nn_def *conf,nn_chkpt *chk){
+    UINT task=0;
+    chk->file=NULL;
+    chk->stage=NULL;
+    chk->n_last=0;
+    chk->t_last=time(NULL);
+    chk->is_busy=FALSE;
+    chk->is_ok=TRUE;
+    if(_CONF.f_chkpt==NULL) return FALSE;
+    if((_CONF.type!=NN_TYPE_ANN)&&(_CONF.type!=NN_TYPE_SNN)) return FALSE;
+    /*only master writes (all kernels are identical)*/
+    _NN(get,curr_mpi_task)(&task);
+    if(task!=0) return FALSE;
+    chk->file=_CONF.f_chkpt;
+#ifdef _PTHREAD
+    chk->has_thread=FALSE;
+    pthread_mutex_init(&(chk->lock),NULL);
+#endif /*_PTHREAD*/
+    return TRUE;
+}
+#ifdef _PTHREAD
+static void *_NN(chkpt,thread)(void *arg){
+    nn_chkpt *chk=(nn_chkpt *)arg;
+    BOOL is_ok;
+    is_ok=ann_dump_file(chk->stage,chk->file);
+    pthread_mutex_lock(&(chk->lock));
+    chk->is_ok=is_ok;
+    chk->is_busy=FALSE;
+    pthread_mutex_unlock(&(chk->lock));
+    return NULL;
+}
+#endif /*_PTHREAD*/
+static void _NN(chkpt,write)(nn_def *conf,nn_chkpt *chk,BOOL wait){
+#ifdef _PTHREAD
+    BOOL is_busy;
+    pthread_mutex_lock(&(chk->lock));
+    is_busy=chk->is_busy;
+    pthread_mutex_unlock(&(chk->lock));
+    if(is_busy&&(!wait)){
+        NN_DBG(stdout,"checkpoint still in progress, skipped!\n");
+        return;
+    }
+    if(chk->has_thread){
+        pthread_join(chk->thread,NULL);
+        chk->has_thread=FALSE;
+        if(!chk->is_ok) NN_WARN(stderr,"checkpoint %s FAILED!\n",chk->file);
+    }
+#endif /*_PTHREAD*/
+    chk->stage=ann_kernel_stage((kernel_ann *)_CONF.kernel,chk->stage);
+    if(chk->stage==NULL) return;
+#ifdef _PTHREAD
+    if(!wait){
+        chk->is_busy=TRUE;
+        if(pthread_create(&(chk->thread),NULL,
+            _NN(chkpt,thread),(void *)chk)==0){
+            chk->has_thread=TRUE;
+            return;
+        }
+        /*no thread, write synchronously*/
+        chk->is_busy=FALSE;
+    }
+#endif /*_PTHREAD*/
+    chk->is_ok=ann_dump_file(chk->stage,chk->file);
+    if(!chk->is_ok) NN_WARN(stderr,"checkpoint %s FAILED!\n",chk->file);
+}
+static void _NN(chkpt,check)(nn_def *conf,nn_chkpt *chk){
+    BOOL is_due=FALSE;
+    time_t now;
+    if(chk->file==NULL) return;
+    chk->n_last++;
+    if((_CONF.n_chkpt>0)&&(chk->n_last>=_CONF.n_chkpt)) is_due=TRUE;
+    if(_CONF.t_chkpt>0){
+        now=time(NULL);
+        if((now-chk->t_last)>=(time_t)_CONF.t_chkpt) is_due=TRUE;
+    }
+    if(!is_due) return;
+    _NN(chkpt,write)(conf,chk,FALSE);
+    chk->n_last=0;
+    chk->t_last=time(NULL);
+}
+static void _NN(chkpt,deinit)(nn_def *conf,nn_chkpt *chk){
+    if(chk->file==NULL) return;
+    /*final checkpoint: always written (and waited for)*/
+    _NN(chkpt,write)(conf,chk,TRUE);
+#ifdef _PTHREAD
+    pthread_mutex_destroy(&(chk->lock));
+#endif /*_PTHREAD*/
+    ann_stage_free(chk->stage);
+    chk->stage=NULL;
+    chk->file=NULL;
+}
+/*--------------------*/
+/*+++ sample index +++*/
+/*--------------------*/
+/*^^^ private: list all (non hidden) files of dir into a growable vector.*/
+static BOOL _NN(index,list)(const CHAR *dir,CHAR ***flist,UINT *n_list){
+    DIR_S *directory;
+    CHAR  *curr_file;
+    CHAR  *tmp,**ptr;
+    UINT n_files;
+    UINT max_files;
+    UINT is_ok;
+    UINT idx;
+    /**/
+    curr_file=NULL;
+    *flist=NULL;
+    *n_list=0;
+    n_files=0;
+    max_files=0;
+    OPEN_DIR(directory,dir);
+    if(directory==NULL) return FALSE;
+    FILE_FROM_DIR(directory,curr_file);
+    while(curr_file!=NULL){
+        if(curr_file[0]=='.') {
+            FREE(curr_file);
+            FILE_FROM_DIR(directory,curr_file);/*NEXT*/
+            continue;
+        }
+        if(n_files>=max_files){
+            /*grow (double) the list*/
+            max_files=(max_files==0)?64:2*max_files;
+            ALLOC(ptr,max_files,CHAR *);
+            for(idx=0;idx<n_files;idx++) ptr[idx]=(*flist)[idx];
+            FREE(*flist);
+            *flist=ptr;
+        }
+        /*POSIX says char d_name[] has no fixed size*/
+        STRDUP(curr_file,tmp);
+        (*flist)[n_files]=tmp;
+        n_files++;
         FREE(curr_file);
+        FILE_FROM_DIR(directory,curr_file);/*NEXT*/
+    }
+    CLOSE_DIR(directory,is_ok);
+    if(is_ok){
+        NN_ERROR(stderr,"trying to close %s directory. IGNORED\n",dir);
+    }
+    *n_list=n_files;
+    return TRUE;
+}
+/*^^^ splitmix64: small, reproducible generator for the shuffle*/
+static UINT64 _NN(index,rand)(UINT64 *state){
+    UINT64 z;
+    *state+=0x9E3779B97F4A7C15ULL;
+    z=*state;
+    z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+    z=(z^(z>>27))*0x94D049BB133111EBULL;
+    return z^(z>>31);
+}
+/*^^^ Fisher-Yates shuffle, the order only depends on (seed,epoch)*/
+static void _NN(index,shuffle)(UINT *order,UINT n,UINT seed,UINT epoch){
+    UINT64 state;
+    UINT idx,jdx,tmp;
+    state=((UINT64)seed<<32)^(UINT64)epoch;
+    for(idx=n;idx>1;idx--){
+        jdx=(UINT)(_NN(index,rand)(&state)%idx);
+        tmp=order[idx-1];
+        order[idx-1]=order[jdx];
+        order[jdx]=tmp;
+    }
+}
+typedef struct {
+    UINT64 ino;
+    UINT   idx;
+} nn_inode;
+static int _NN(index,cmp_inode)(const void *a,const void *b){
+    const nn_inode *ia=(const nn_inode *)a;
+    const nn_inode *ib=(const nn_inode *)b;
+    if(ia->ino<ib->ino) return -1;
+    return (ia->ino>ib->ino);
+}
+/*^^^ sort files by inode number, which usually follows on-disk placement*/
+static void _NN(index,sort_inode)(const CHAR *dir,CHAR **flist,
+                                  UINT *order,UINT n){
+    struct stat st;
+    nn_inode *list;
+    CHAR *tmp=NULL;
+    UINT idx;
+    if(n<2) return;
+    ALLOC(list,n,nn_inode);
+    for(idx=0;idx<n;idx++){
+        STRCAT(tmp,dir,flist[order[idx]]);
+        if(stat(tmp,&st)==0) list[idx].ino=(UINT64)st.st_ino;
+        else list[idx].ino=0;
+        FREE(tmp);
+        list[idx].idx=order[idx];
+    }
+    qsort(list,n,sizeof(nn_inode),_NN(index,cmp_inode));
+    for(idx=0;idx<n;idx++) order[idx]=list[idx].idx;
+    FREE(list);
+}
+/*-----------------------------------*/
+/*+++ sample loader (prefetching) +++*/
+/*-----------------------------------*/
+/*^^^ private: samples (files of a directory, or rows of a dataset) are
+ * indexed and ordered once, then read (in that order) by n_loaders threads
+ * into a ring of n_prefetch slots, while the kernel is trained (or run) on
+ * the previous ones. File I/O and computation are thus overlapped. Without
+ * pthread (or n_loaders=0) samples are simply read when needed.*/
+typedef struct {
+    DOUBLE     *in;     /*sample input*/
+    DOUBLE    *out;     /*sample output*/
+    BOOL  is_ready;     /*slot is filled*/
+} nn_slot;
+typedef struct {
+    CHAR      *dir;     /*sample directory (including trailing '/')*/
+    CHAR   **flist;     /*sample files*/
+    nn_dataset *ds;     /*sample dataset (instead of directory)*/
+    UINT    *order;     /*order in which samples are processed*/
+    UINT   n_files;     /*number of samples*/
+    UINT      curr;     /*next sample to consume*/
+    CHAR  name[24];     /*name of current (dataset) sample*/
+#ifdef _PTHREAD
+    UINT      next;     /*next sample to load*/
+    UINT   n_slots;     /*number of slots in ring*/
+    nn_slot *slots;     /*ring of prefetched samples*/
+    BOOL   is_done;     /*loaders should stop*/
+    UINT n_threads;     /*number of running loaders*/
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;  /*a slot was filled*/
+    pthread_cond_t emptied; /*a slot was consumed*/
+#endif /*_PTHREAD*/
+} nn_loader;
+/*^^^ read sample number idx (in order), thread safe*/
+static void _NN(loader,read)(nn_loader *ld,UINT idx,DOUBLE **in,DOUBLE **out){
+    nn_dataset *ds=ld->ds;
+    CHAR *tmp=NULL;
+    *in=NULL;
+    *out=NULL;
+    if(ds!=NULL){
+        ALLOC(*in,ds->in.n_cols,DOUBLE);
+        if(ds->n_classes>0) ALLOC(*out,ds->n_classes,DOUBLE);
+        else ALLOC(*out,ds->out.n_cols,DOUBLE);
+        _NN(get,dataset_sample)(ds,ld->order[idx],*in,*out);
+        return;
+    }
+    STRCAT(tmp,ld->dir,ld->flist[ld->order[idx]]);
+    _NN(read,sample)(tmp,in,out);
+    FREE(tmp);
+}
+#ifdef _PTHREAD
+static void *_NN(loader,thread)(void *arg){
+    nn_loader *ld=(nn_loader *)arg;
+    DOUBLE *in,*out;
+    nn_slot *slot;
+    UINT idx;
+    pthread_mutex_lock(&(ld->lock));
+    while(TRUE){
+        /*wait for a free slot*/
+        while((!ld->is_done)&&(ld->next<ld->n_files)
+            &&(ld->next>=(ld->curr+ld->n_slots)))
+            pthread_cond_wait(&(ld->emptied),&(ld->lock));
+        if((ld->is_done)||(ld->next>=ld->n_files)) break;
+        idx=ld->next;
+        ld->next++;
+        pthread_mutex_unlock(&(ld->lock));
+        /*read outside of lock*/
+        _NN(loader,read)(ld,idx,&in,&out);
+        pthread_mutex_lock(&(ld->lock));
+        slot=&(ld->slots[idx % ld->n_slots]);
+        slot->in=in;
+        slot->out=out;
+        slot->is_ready=TRUE;
+        pthread_cond_broadcast(&(ld->filled));
+    }
+    pthread_mutex_unlock(&(ld->lock));
+    return NULL;
+}
+#endif /*_PTHREAD*/
+static BOOL _NN(loader,open)(nn_def *conf,nn_loader *ld,
+                             const CHAR *dir,nn_dataset *ds){
+    UINT idx;
+    /**/
+    ld->dir=NULL;
+    ld->flist=NULL;
+    ld->ds=ds;
+    ld->order=NULL;
+    ld->n_files=0;
+    ld->curr=0;
+    ld->name[0]='\0';
+#ifdef _PTHREAD
+    ld->next=0;
+    ld->n_slots=0;
+    ld->slots=NULL;
+    ld->is_done=FALSE;
+    ld->n_threads=0;
+    ld->threads=NULL;
+#endif /*_PTHREAD*/
+    if(ds!=NULL){
+        ld->n_files=_NN(get,dataset_size)(ds);
+    }else{
+        if(!_NN(index,list)(dir,&(ld->flist),&(ld->n_files))){
+            NN_ERROR(stderr,"can't open sample directory: %s\n",dir);
+            return FALSE;
+        }
+        STRCAT(ld->dir,dir,"/");
+    }
+    if(ld->n_files==0) return TRUE;
+    /*order*/
+    ALLOC(ld->order,ld->n_files,UINT);
+    for(idx=0;idx<ld->n_files;idx++) ld->order[idx]=idx;
+    if(_CONF.seed==0) _CONF.seed=time(NULL);
+    switch(_CONF.order){
+    case NN_ORDER_INODE:
+        /*a dataset is already contiguous*/
+        if(ds==NULL)
+            _NN(index,sort_inode)(ld->dir,ld->flist,ld->order,ld->n_files);
+        break;
+    case NN_ORDER_SHUFFLE:
+    default:
+        _NN(index,shuffle)(ld->order,ld->n_files,_CONF.seed,_CONF.epoch);
+    }
+#ifdef _PTHREAD
+    if(_CONF.n_loaders==0) return TRUE;
+    ld->n_slots=(_CONF.n_prefetch>0)?_CONF.n_prefetch:1;
+    ALLOC(ld->slots,ld->n_slots,nn_slot);
+    ALLOC(ld->threads,_CONF.n_loaders,pthread_t);
+    pthread_mutex_init(&(ld->lock),NULL);
+    pthread_cond_init(&(ld->filled),NULL);
+    pthread_cond_init(&(ld->emptied),NULL);
+    for(idx=0;idx<_CONF.n_loaders;idx++){
+        if(pthread_create(&(ld->threads[idx]),NULL,
+            _NN(loader,thread),(void *)ld)!=0) break;
+        ld->n_threads++;
+    }
+    if(ld->n_threads==0){
+        /*no thread, read synchronously*/
+        NN_WARN(stderr,"can't start sample loader, prefetch disabled!\n");
+        pthread_cond_destroy(&(ld->emptied));
+        pthread_cond_destroy(&(ld->filled));
+        pthread_mutex_destroy(&(ld->lock));
+        FREE(ld->threads);
+        FREE(ld->slots);
+    }
+#endif /*_PTHREAD*/
+    return TRUE;
+}
+/*^^^ get next sample: name is owned by the loader, in and out are then owned
+ * by the caller (which should free them).  in and/or out are NULL when the
+ * sample could not be read. Return FALSE when all samples were consumed.*/
+static BOOL _NN(loader,next)(nn_loader *ld,CHAR **name,
+                             DOUBLE **in,DOUBLE **out){
+#ifdef _PTHREAD
+    nn_slot *slot;
+#endif /*_PTHREAD*/
+    *in=NULL;
+    *out=NULL;
+    if(ld->curr>=ld->n_files) return FALSE;
+    if(ld->ds!=NULL){
+        sprintf(ld->name,"#%u",ld->order[ld->curr]);
+        *name=ld->name;
+    }else *name=ld->flist[ld->order[ld->curr]];
+#ifdef _PTHREAD
+    if(ld->n_threads>0){
+        slot=&(ld->slots[ld->curr % ld->n_slots]);
+        pthread_mutex_lock(&(ld->lock));
+        while(!slot->is_ready) pthread_cond_wait(&(ld->filled),&(ld->lock));
+        *in=slot->in;
+        *out=slot->out;
+        slot->in=NULL;
+        slot->out=NULL;
+        slot->is_ready=FALSE;
+        ld->curr++;
+        pthread_cond_broadcast(&(ld->emptied));
+        pthread_mutex_unlock(&(ld->lock));
+        return TRUE;
+    }
+#endif /*_PTHREAD*/
+    _NN(loader,read)(ld,ld->curr,in,out);
+    ld->curr++;
+    return TRUE;
+}
+static void _NN(loader,close)(nn_loader *ld){
+    UINT idx;
+#ifdef _PTHREAD
+    if(ld->n_threads>0){
+        pthread_mutex_lock(&(ld->lock));
+        ld->is_done=TRUE;
+        pthread_cond_broadcast(&(ld->emptied));
+        pthread_mutex_unlock(&(ld->lock));
+        for(idx=0;idx<ld->n_threads;idx++) pthread_join(ld->threads[idx],NULL);
+        /*remaining (unconsumed) samples*/
+        for(idx=0;idx<ld->n_slots;idx++){
+            FREE(ld->slots[idx].in);
+            FREE(ld->slots[idx].out);
+        }
+        pthread_cond_destroy(&(ld->emptied));
+        pthread_cond_destroy(&(ld->filled));
+        pthread_mutex_destroy(&(ld->lock));
+        ld->n_threads=0;
+    }
+    FREE(ld->threads);
+    FREE(ld->slots);
+#endif /*_PTHREAD*/
+    if(ld->flist!=NULL)
+        for(idx=0;idx<ld->n_files;idx++) FREE(ld->flist[idx]);
+    FREE(ld->flist);
+    FREE(ld->order);
+    FREE(ld->dir);
+    ld->ds=NULL;
+    ld->n_files=0;
+}
+#define _K ((kernel_ann *)(_CONF.kernel))
+/*------------------------------*/
+/*+++ distillation (teacher) +++*/
+/*------------------------------*/
+/*^^^ private: run a teacher kernel on in, and copy its output to out*/
+static void _NN(teacher,run)(nn_type type,kernel_ann *teacher,
+                             const DOUBLE *in,DOUBLE *out){
+#ifdef   _CUDA
+    cudastreams *cudas=_NN(return,cudas)();
+    CUDA_SET_DEV(*cudas,0);
+    if(cudas->mem_model!=CUDA_MEM_CMM){
+        CUDA_C2G_CP((DOUBLE *)in,teacher->in,teacher->n_inputs,DOUBLE);
+        if((cudas->mem_model==CUDA_MEM_EXP)&&(cudas->n_gpu>1)){
+            kernel_ann *kx;
+            /*distribute input to other GPUs*/
+            for(int gpu=1;gpu<cudas->n_gpu;gpu++){
+                kx=(kernel_ann *)teacher->kerns[gpu];
+                CUDA_G2G_CP(teacher->in,kx->in,teacher->n_inputs,DOUBLE);
+            }
+        }
+    }else{
+        CUDA_SYNC();
+        ARRAY_CP(in,teacher->in,teacher->n_inputs);
+        cudaMemPrefetchAsync(teacher->in,
+            teacher->n_inputs*sizeof(DOUBLE),0,NULL);
+        CUDA_SYNC();
+    }
+#else  /*_CUDA*/
+    ARRAY_CP(in,teacher->in,teacher->n_inputs);
+#endif /*_CUDA*/
+    if(type==NN_TYPE_SNN) snn_kernel_run(teacher);
+    else ann_kernel_run(teacher);
+#ifdef   _CUDA
+    if(cudas->mem_model!=CUDA_MEM_CMM){
+        CUDA_G2C_CP(out,teacher->output.vec,teacher->n_outputs,DOUBLE);
+        return;
+    }
+    CUDA_SYNC();
+#endif /*_CUDA*/
+    ARRAY_CP(teacher->output.vec,out,teacher->n_outputs);
+}
+/*^^^ private: the teacher kernel is run once over all samples and its
+ * outputs are kept in t_out (in sample index order), they replace sample
+ * outputs during training.  For SNN, the teacher probabilities p are
+ * softened by the temperature T: p^(1/T) (normalized).  The teacher kernel
+ * is freed as soon as the cache is complete.*/
+static BOOL _NN(teacher,cache)(nn_def *conf){
+    nn_loader ld;
+    kernel_ann *teacher;
+    CHAR  *curr_file;
+    DOUBLE    *tr_in;
+    DOUBLE   *tr_out;
+    DOUBLE *t_out,sum;
+    UINT n_outputs;
+    UINT idx;
+    if(_CONF.f_teacher==NULL) return FALSE;
+    if((_CONF.type!=NN_TYPE_ANN)&&(_CONF.type!=NN_TYPE_SNN)) return FALSE;
+    teacher=ann_load(_CONF.f_teacher);
+    if(teacher==NULL){
+        NN_ERROR(stderr,"FAILED to load teacher kernel: %s\n",
+            _CONF.f_teacher);
+        return FALSE;
+    }
+    if((teacher->n_inputs!=_K->n_inputs)
+        ||(teacher->n_outputs!=_K->n_outputs)){
+        NN_ERROR(stderr,"teacher kernel %s has %i inputs, %i outputs!\n",
+            _CONF.f_teacher,teacher->n_inputs,teacher->n_outputs);
+        ann_kernel_free(teacher);
+        FREE(teacher);
+        return FALSE;
+    }
+    n_outputs=_K->n_outputs;
+    if(!_NN(loader,open)(conf,&ld,_CONF.samples,_CONF.samples_ds)){
+        ann_kernel_free(teacher);
+        FREE(teacher);
+        return FALSE;
+    }
+    FREE(_CONF.t_out);
+    _CONF.t_n=ld.n_files;
+    if(_CONF.t_n>0) ALLOC(_CONF.t_out,_CONF.t_n*n_outputs,DOUBLE);
+    while(_NN(loader,next)(&ld,&curr_file,&tr_in,&tr_out)){
+        if(tr_in==NULL){
+            /*will be skipped during training*/
+            FREE(tr_out);
+            continue;
+        }
+        t_out=_CONF.t_out+ld.order[ld.curr-1]*n_outputs;
+        _NN(teacher,run)(_CONF.type,teacher,tr_in,t_out);
+        if((_CONF.type==NN_TYPE_SNN)&&(_CONF.t_temp!=1.)){
+            sum=0.;
+            for(idx=0;idx<n_outputs;idx++){
+                t_out[idx]=pow(t_out[idx],1./_CONF.t_temp);
+                sum+=t_out[idx];
+            }
+            if(sum>0.) for(idx=0;idx<n_outputs;idx++) t_out[idx]/=sum;
+        }
         FREE(tr_in);
         FREE(tr_out);
     }
-    FREE(curr_dir);
-    FREE(flist);
-    /*free momentum - if any*/
+    _NN(loader,close)(&ld);
+    ann_kernel_free(teacher);
+    FREE(teacher);
+    NN_OUT(stdout,"teacher outputs cached: %i samples\n",_CONF.t_n);
+    return TRUE;
+}
+#undef _K
+/*---------------------*/
+/*+++ execute NN OP +++*/
+/*---------------------*/
+/*^^^ TRUE if samples are trained in parallel with hogwild: BP only, on
+ * CPU, with a single MPI task (replicas would diverge otherwise).*/
+static BOOL _NN(hogwild,active)(nn_def *conf){
+#ifdef _CUDA
+    return FALSE;
+#else /*_CUDA*/
+    UINT n_tasks;
+    if(_CONF.par!=NN_PAR_HOGWILD) return FALSE;
+    if(_CONF.train!=NN_TRAIN_BP) return FALSE;
+    _NN(get,mpi_tasks)(&n_tasks);
+    return (n_tasks==1);
+#endif /*_CUDA*/
+}
+/*^^^ TRUE if samples are trained with local SGD: BP only, on CPU.*/
+static BOOL _NN(local,active)(nn_def *conf){
+#ifdef _CUDA
+    return FALSE;
+#else /*_CUDA*/
+    return (_CONF.par==NN_PAR_LOCAL)&&(_CONF.train==NN_TRAIN_BP);
+#endif /*_CUDA*/
+}
+/*^^^ TRUE if samples stopped by the convergence policy are retrained at
+ * the end of the pass: the policy is only applied by BP and BPM, one sample
+ * at a time (not with hogwild or local SGD).*/
+static BOOL _NN(defer,active)(nn_def *conf){
+    if(!_CONF.conv.defer) return FALSE;
+    if((_CONF.train!=NN_TRAIN_BP)&&(_CONF.train!=NN_TRAIN_BPM)) return FALSE;
+    return !(_NN(hogwild,active)(conf)||_NN(local,active)(conf));
+}
+/*^^^ allocate / free what the training method needs*/
+static void _NN(prepare,train)(nn_def *conf){
+    if((_CONF.par==NN_PAR_HOGWILD)&&(!_NN(hogwild,active)(conf)))
+        NN_WARN(stdout,"hogwild needs BP on CPU with 1 MPI task: ignored!\n");
+    if((_CONF.par==NN_PAR_LOCAL)&&(!_NN(local,active)(conf)))
+        NN_WARN(stdout,"local SGD needs BP on CPU: ignored!\n");
+    if((_CONF.conv.defer)&&(!_NN(defer,active)(conf)))
+        NN_WARN(stdout,"defer needs BP/BPM one sample at a time: ignored!\n");
+    /*compression of the MPI weight sync (BP, BPM)*/
+    ann_comp_set(_CONF.comp,_CONF.comp_ratio);
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        if(_CONF.train==NN_TRAIN_BPM)
+            ann_momentum_init((kernel_ann *)_CONF.kernel);
+        if((_CONF.train==NN_TRAIN_ADAM)||(_CONF.train==NN_TRAIN_RMSPROP))
+#ifndef _CUDA
+            ann_adapt_init((kernel_ann *)_CONF.kernel);
+#else  /*_CUDA*/
+            NN_ERROR(stderr,"ADAM/RMSPROP training unsupported on GPU!\n");
+#endif /*_CUDA*/
+#ifdef _CUDA
+        if((_CONF.train==NN_TRAIN_CG)||(_CONF.train==NN_TRAIN_LM)
+            ||(_CONF.train==NN_TRAIN_SPLX))
+            NN_ERROR(stderr,"CG/LM/SPLX training unsupported on GPU!\n");
+#endif /*_CUDA*/
+        break;
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        NN_ERROR(stdout,"unimplemented NN type!\n");
+    }
+}
+static void _NN(cleanup,train)(nn_def *conf){
+    UINT64 sent,raw;
+    ann_comp_stats(&sent,&raw);
+    if(raw>0) NN_OUT(stdout,"MPI weight sync: %.1f kB sent (%.1f kB raw)\n",
+        sent/1024.,raw/1024.);
+    ann_comp_set(NN_COMP_NONE,0.);
     switch (_CONF.type){
     case NN_TYPE_SNN:
         /*fallthrough*/
     case NN_TYPE_ANN:
         if(_CONF.train==NN_TRAIN_BPM)
             ann_momentum_free((kernel_ann *)_CONF.kernel);
+#ifndef _CUDA
+        if((_CONF.train==NN_TRAIN_ADAM)||(_CONF.train==NN_TRAIN_RMSPROP))
+            ann_adapt_free((kernel_ann *)_CONF.kernel);
+#endif /*_CUDA*/
         break;
     case NN_TYPE_LNN:
     case NN_TYPE_UKN:
     default:
         NN_ERROR(stdout,"unimplemented NN type!\n");
     }
+}
+/*^^^ train a single sample, according to type and training*/
+static DOUBLE _NN(train,sample)(nn_def *conf,DOUBLE *tr_in,DOUBLE *tr_out){
+    DOUBLE res;
+    switch (_CONF.type){
+    case NN_TYPE_ANN:
+        /*check training*/
+        switch (_CONF.train){
+        case NN_TRAIN_BPM:
+          res=ann_train_BPM((kernel_ann *)_CONF.kernel,tr_in,tr_out,.2,-1.,
+              &(_CONF.conv),&(_CONF.conv_stats));
+          break;
+        case NN_TRAIN_BP:
+          res=ann_train_BP((kernel_ann *)_CONF.kernel,tr_in,tr_out,-1.,
+              &(_CONF.conv),&(_CONF.conv_stats));
+          break;
+#ifndef _CUDA
+        case NN_TRAIN_ADAM:
+        case NN_TRAIN_RMSPROP:
+          res=ann_train_adapt((kernel_ann *)_CONF.kernel,tr_in,tr_out,
+              _CONF.train,-1.);
+          break;
+        case NN_TRAIN_CG:
+          res=ann_train_CG((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+        case NN_TRAIN_LM:
+          res=ann_train_LM((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+        case NN_TRAIN_SPLX:
+          res=ann_train_SPLX((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+#endif /*_CUDA*/
+        default:
+          res=0.;
+          break;
+        }
+        break;
+    case NN_TYPE_LNN:
+    case NN_TYPE_SNN:
+        /*check training*/
+        switch (_CONF.train){
+        case NN_TRAIN_BPM:
+          res=snn_train_BPM((kernel_ann *)_CONF.kernel,tr_in,tr_out,.2,-1.,
+              &(_CONF.conv),&(_CONF.conv_stats));
+          break;
+        case NN_TRAIN_BP:
+          res=snn_train_BP((kernel_ann *)_CONF.kernel,tr_in,tr_out,-1.,
+              &(_CONF.conv),&(_CONF.conv_stats));
+          break;
+#ifndef _CUDA
+        case NN_TRAIN_ADAM:
+        case NN_TRAIN_RMSPROP:
+          res=snn_train_adapt((kernel_ann *)_CONF.kernel,tr_in,tr_out,
+              _CONF.train,-1.);
+          break;
+        case NN_TRAIN_CG:
+          res=snn_train_CG((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+        case NN_TRAIN_LM:
+          res=snn_train_LM((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+        case NN_TRAIN_SPLX:
+          res=snn_train_SPLX((kernel_ann *)_CONF.kernel,1,&tr_in,&tr_out,-1.);
+          break;
+#endif /*_CUDA*/
+        default:
+          res=0.;
+          break;
+        }
+        break;
+    case NN_TYPE_UKN:
+        res=0.;/*not ready yet*/
+        break;
+    default:
+        /*can't happen*/
+        res=0.;
+    }
+    return res;
+}
+/*^^^ train n samples: CG and LM minimize the error summed over all of
+ * them at once (SPLX the number of failed samples), hogwild and local SGD
+ * train them concurrently, other methods train each sample in turn.
+ * Return the averaged training result.*/
+static DOUBLE _NN(train,batch)(nn_def *conf,UINT n,
+                               DOUBLE **tr_in,DOUBLE **tr_out){
+    DOUBLE res=0.;
+    UINT idx;
+    if(n==0) return 0.;
+#ifndef _CUDA
+    if(_NN(hogwild,active)(conf)){
+        switch (_CONF.type){
+        case NN_TYPE_ANN:
+            res=ann_train_hogwild((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_LNN:
+        case NN_TYPE_SNN:
+            res=snn_train_hogwild((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_UKN:
+        default:
+            res=0.;
+        }
+        return res/(DOUBLE)n;
+    }
+    if(_NN(local,active)(conf)){
+        switch (_CONF.type){
+        case NN_TYPE_ANN:
+            res=ann_train_local((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.,
+                &(_CONF.k_local),(_CONF.n_local==0));
+            break;
+        case NN_TYPE_LNN:
+        case NN_TYPE_SNN:
+            res=snn_train_local((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.,
+                &(_CONF.k_local),(_CONF.n_local==0));
+            break;
+        case NN_TYPE_UKN:
+        default:
+            res=0.;
+        }
+        return res/(DOUBLE)n;
+    }
+    if(_CONF.train==NN_TRAIN_CG){
+        switch (_CONF.type){
+        case NN_TYPE_ANN:
+            res=ann_train_CG((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_LNN:
+        case NN_TYPE_SNN:
+            res=snn_train_CG((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_UKN:
+        default:
+            res=0.;
+        }
+        return res/(DOUBLE)n;
+    }
+    if(_CONF.train==NN_TRAIN_LM){
+        switch (_CONF.type){
+        case NN_TYPE_ANN:
+            res=ann_train_LM((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_LNN:
+        case NN_TYPE_SNN:
+            res=snn_train_LM((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_UKN:
+        default:
+            res=0.;
+        }
+        return res/(DOUBLE)n;
+    }
+    if(_CONF.train==NN_TRAIN_SPLX){
+        switch (_CONF.type){
+        case NN_TYPE_ANN:
+            res=ann_train_SPLX((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_LNN:
+        case NN_TYPE_SNN:
+            res=snn_train_SPLX((kernel_ann *)_CONF.kernel,n,tr_in,tr_out,-1.);
+            break;
+        case NN_TYPE_UKN:
+        default:
+            res=0.;
+        }
+        return res/(DOUBLE)n;
+    }
+#endif /*_CUDA*/
+    for(idx=0;idx<n;idx++)
+        res+=_NN(train,sample)(conf,tr_in[idx],tr_out[idx]);
+    return res/(DOUBLE)n;
+}
+BOOL _NN(train,kernel)(nn_def *conf){
+    nn_loader ld;
+    CHAR  *curr_file;
+    DOUBLE    *tr_in;
+    DOUBLE   *tr_out;
+    DOUBLE   *target;
+    DOUBLE  **b_in;
+    DOUBLE  **b_out;
+    DOUBLE  **b_free;
+    DOUBLE  **d_in=NULL;
+    DOUBLE  **d_out=NULL;
+    DOUBLE  **d_free=NULL;
+    DOUBLE res;
+    UINT idx,n_batch,n_b=0,n_d=0;
+    UINT n_tasks;
+    nn_chkpt chk;
+    nn_conv_stats *st=&(_CONF.conv_stats);
+    nn_conv_stats st_pass;
+    /**/
+    if(_CONF.kernel==NULL) return FALSE;
+    if((_CONF.samples==NULL)&&(_CONF.samples_ds==NULL)) return FALSE;
+    if(_CONF.type==NN_TYPE_UKN) return FALSE;
+    /*distillation: teacher outputs are computed once*/
+    if((_CONF.f_teacher!=NULL)&&(_CONF.t_out==NULL))
+        if(!_NN(teacher,cache)(conf)) return FALSE;
+    /*process sample files*/
+    if(!_NN(loader,open)(conf,&ld,_CONF.samples,_CONF.samples_ds))
+        return FALSE;
+    if((_CONF.f_teacher!=NULL)&&(ld.n_files!=_CONF.t_n)){
+        NN_ERROR(stderr,"samples changed since teacher outputs were cached!\n");
+        _NN(loader,close)(&ld);
+        return FALSE;
+    }
+    /*CG and LM can minimize over several samples at once*/
+    n_batch=1;
+    if(((_CONF.train==NN_TRAIN_CG)||(_CONF.train==NN_TRAIN_LM))
+        &&(_CONF.n_batch>1)) n_batch=_CONF.n_batch;
+    /*SPLX does, by default over the whole pass (accuracy is its objective)*/
+    if(_CONF.train==NN_TRAIN_SPLX){
+        if(_CONF.n_batch>1) n_batch=_CONF.n_batch;
+        else n_batch=ld.n_files;
+        if(n_batch<1) n_batch=1;
+    }
+    /*hogwild needs several samples per thread*/
+    if(_NN(hogwild,active)(conf)){
+        if(_CONF.n_batch>1) n_batch=_CONF.n_batch;
+        else n_batch=NN_HOGWILD_BATCH*_NN(return,omp_threads)();
+    }
+    /*local SGD: (max) period times number of workers*/
+    if(_NN(local,active)(conf)){
+        _NN(get,mpi_tasks)(&n_tasks);
+        if(_CONF.n_batch>1) n_batch=_CONF.n_batch;
+        else n_batch=((_CONF.n_local>0)?_CONF.n_local:ANN_LOCAL_KMAX)
+            *_NN(return,omp_threads)()*n_tasks;
+    }
+    ALLOC(b_in,n_batch,DOUBLE *);
+    ALLOC(b_out,n_batch,DOUBLE *);
+    ALLOC(b_free,n_batch,DOUBLE *);
+    /*samples stopped by the convergence policy are kept for later*/
+    if((_NN(defer,active)(conf))&&(n_batch==1)&&(ld.n_files>0)){
+        ALLOC(d_in,ld.n_files,DOUBLE *);
+        ALLOC(d_out,ld.n_files,DOUBLE *);
+        ALLOC(d_free,ld.n_files,DOUBLE *);
+    }
+    memset(st,0,sizeof(nn_conv_stats));
+    /*initialize momentum*/
+    _NN(prepare,train)(conf);
+    _NN(chkpt,init)(conf,&chk);
+    while(_NN(loader,next)(&ld,&curr_file,&tr_in,&tr_out)){
+        if(n_batch==1) NN_OUT(stdout,"TRAINING FILE: %16.16s\t",curr_file);
+        if((tr_in==NULL)||(tr_out==NULL)){
+            /*something went wrong, skipping*/
+            FREE(tr_in);
+            FREE(tr_out);
+            continue;
+        }
+        /*distillation: train against the teacher outputs instead*/
+        if(_CONF.f_teacher!=NULL) target=_CONF.t_out
+            +ld.order[ld.curr-1]*((kernel_ann *)_CONF.kernel)->n_outputs;
+        else target=tr_out;
+        b_in[n_b]=tr_in;
+        b_out[n_b]=target;
+        b_free[n_b]=tr_out;
+        n_b++;
+        if(n_b<n_batch) continue;
+        if(n_batch>1) NN_OUT(stdout,"TRAINING BATCH: %5i samples\t",n_b);
+        st->last=NN_STOP_NONE;
+        res=_NN(train,batch)(conf,n_b,b_in,b_out);
+        if(res>0.1) NN_DBG(stdout,"bad optimization!\n");
+        if((d_in!=NULL)&&(st->last!=NN_STOP_NONE)){
+            /*defer: retrain at the end of the pass*/
+            d_in[n_d]=b_in[0];
+            d_out[n_d]=b_out[0];
+            d_free[n_d]=b_free[0];
+            n_d++;
+            b_in[0]=NULL;
+            b_free[0]=NULL;
+        }
+        for(idx=0;idx<n_b;idx++){
+            FREE(b_in[idx]);
+            FREE(b_free[idx]);
+            _NN(chkpt,check)(conf,&chk);
+        }
+        n_b=0;
+    }
+    if(n_b>0){
+        /*last (partial) batch*/
+        NN_OUT(stdout,"TRAINING BATCH: %5i samples\t",n_b);
+        res=_NN(train,batch)(conf,n_b,b_in,b_out);
+        if(res>0.1) NN_DBG(stdout,"bad optimization!\n");
+        for(idx=0;idx<n_b;idx++){
+            FREE(b_in[idx]);
+            FREE(b_free[idx]);
+            _NN(chkpt,check)(conf,&chk);
+        }
+    }
+    /*deferred samples: one more try, with the network trained on the rest*/
+    st->n_deferred=n_d;
+    for(idx=0;idx<n_d;idx++){
+        NN_OUT(stdout,"DEFERRED SAMPLE: %5i/%5i\t",idx+1,n_d);
+        /*a retry is not a new sample: only its time and outcome count*/
+        st_pass=*st;
+        st->last=NN_STOP_NONE;
+        _NN(train,batch)(conf,1,&(d_in[idx]),&(d_out[idx]));
+        st_pass.t_train=st->t_train;
+        if(st->last==NN_STOP_NONE) st_pass.n_recovered++;
+        *st=st_pass;
+        FREE(d_in[idx]);
+        FREE(d_free[idx]);
+    }
+    FREE(d_in);
+    FREE(d_out);
+    FREE(d_free);
+    if(st->n_samples>0){
+        NN_OUT(stdout,"CONVERGENCE: %i samples, %"PRIu64" iterations, %.3fs\n",
+            st->n_samples,st->n_iter,st->t_train);
+        NN_OUT(stdout,"CONVERGENCE: stopped by iter=%i time=%i stall=%i"
+            " (%.3fs), deferred=%i recovered=%i\n",st->n_stop[NN_STOP_ITER],
+            st->n_stop[NN_STOP_TIME],st->n_stop[NN_STOP_STALL],st->t_stop,
+            st->n_deferred,st->n_recovered);
+    }
+    FREE(b_in);
+    FREE(b_out);
+    FREE(b_free);
+    _NN(chkpt,deinit)(conf,&chk);
+    _NN(loader,close)(&ld);
+    /*next pass will use another order*/
+    _CONF.epoch++;
+    /*free momentum - if any*/
+    _NN(cleanup,train)(conf);
     return TRUE;
 }
 void _NN(run,kernel)(nn_def *conf){
-    DIR_S *directory;
+    nn_loader ld;
     CHAR  *curr_file;
-    CHAR   *curr_dir;
     DOUBLE    *tr_in;
     DOUBLE   *tr_out;
     DOUBLE     probe;
-    UINT file_number;
-    CHAR     **flist;
-    CHAR  *tmp,**ptr;
     DOUBLE res, *out;
     UINT is_ok;
     UINT guess;
     UINT   idx;
-    UINT   jdx;
 #ifdef   _CUDA
     cudastreams *cudas=_NN(return,cudas)();
     CUDA_SET_DEV(*cudas,0);/*useful?*/
 #endif /*_CUDA*/
-    /**/
-    curr_file=NULL;
-    curr_dir =NULL;
-    flist = NULL;
     /**/
     if(_CONF.kernel==NULL) return;
-    if(_CONF.tests==NULL) return;
+    if((_CONF.tests==NULL)&&(_CONF.tests_ds==NULL)) return;
     if(_CONF.type==NN_TYPE_UKN) return;
     /*process sample files*/
-    OPEN_DIR(directory,_CONF.tests);
-    if(directory==NULL){
-        NN_ERROR(stderr,"can't open test directory: %s\n",
-            _CONF.tests);
-        return;
-    }
-    STRCAT(curr_dir,_CONF.tests,"/");
-    /*count the number of file in directory*/
-    FILE_FROM_DIR(directory,curr_file);
-    file_number=0;
-    while(curr_file!=NULL){
-        if(curr_file[0]=='.') {
-            FREE(curr_file);
-            FILE_FROM_DIR(directory,curr_file);/*NEXT*/
-            continue;
-        }
-        /*POSIX says char d_name[] has no fixed size*/
-        STRDUP(curr_file,tmp);
-        file_number++;
-        ALLOC(ptr,file_number,CHAR *);
-        for(idx=0;idx<(file_number-1);idx++){
-            ptr[idx]=flist[idx];
-        }
-        ptr[file_number-1]=tmp;
-        FREE(flist);
-        flist=ptr;
-        tmp=NULL;ptr=NULL;
-        FREE(curr_file);
-        FILE_FROM_DIR(directory,curr_file);/*NEXT*/
-    }
-        CLOSE_DIR(directory,is_ok);
-    if(is_ok){
-        NN_ERROR(stderr,"trying to close %s directory. IGNORED\n",curr_dir);
-    }
-    if(_CONF.seed==0) _CONF.seed=time(NULL);
-    srandom(_CONF.seed);
-    jdx=0;
-    while(jdx<file_number){
+    if(!_NN(loader,open)(conf,&ld,_CONF.tests,_CONF.tests_ds)) return;
+    while(_NN(loader,next)(&ld,&curr_file,&tr_in,&tr_out)){
 #define _K ((kernel_ann *)(_CONF.kernel))
 #ifdef   _CUDA
         if(cudas->mem_model==CUDA_MEM_CMM){
@@ -1377,22 +3071,8 @@ void _NN(run,kernel)(nn_def *conf){
                 _K->n_inputs*sizeof(DOUBLE),cudaCpuDeviceId,NULL);
         }
 #endif /*_CUDA*/
-        /*get a random number between 0 and file_number-1*/
-        idx=(UINT) ((DOUBLE) random()*file_number / RAND_MAX);
-        while(flist[idx]==NULL){
-            /*no good, get another random number*/
-            idx=(UINT) ((DOUBLE) random()*file_number / RAND_MAX);
-        }
-        STRDUP(flist[idx],curr_file);
-        FREE(flist[idx]);flist[idx]=NULL;jdx++;
         NN_OUT(stdout,"TESTING FILE: %16.16s\t",curr_file);
-        /*this should never happen (but static analysis choked)*/
-        if(curr_file==NULL) continue;
-        STRCAT(tmp,curr_dir,curr_file);
-        _NN(read,sample)(tmp,&tr_in,&tr_out);
-        FREE(tmp);
         if((tr_in==NULL)||(tr_out==NULL)){
-            FREE(curr_file);
             FREE(tr_in);
             FREE(tr_out);
             continue;
@@ -1518,7 +3198,6 @@ void _NN(run,kernel)(nn_def *conf){
         default:
             break;
         }
-        FREE(curr_file);
         FREE(tr_in);
         FREE(tr_out);
 #ifdef   _CUDA
@@ -1530,9 +3209,318 @@ void _NN(run,kernel)(nn_def *conf){
         }
 #endif /*_CUDA*/
     }
-    FREE(curr_dir);
-    FREE(flist);
+    _NN(loader,close)(&ld);
+#undef _K
+}
+/*^^^ read all tests (directory or dataset) in memory, with the same loader
+ * as _NN(run,kernel): in is n x n_inputs and out is n x n_outputs, both are
+ * to be freed by the caller. Unreadable samples are skipped.  Return n, the
+ * number of tests (0, with in and out set to NULL, on failure).*/
+UINT _NN(read,tests)(nn_def *conf,DOUBLE **in,DOUBLE **out){
+    nn_loader ld;
+    CHAR  *curr_file;
+    DOUBLE    *tr_in;
+    DOUBLE   *tr_out;
+    DOUBLE *p_in,*p_out;
+    UINT n_in,n_out,n_tests=0;
+    /**/
+    *in=NULL;
+    *out=NULL;
+    if(_CONF.kernel==NULL) return 0;
+    if((_CONF.tests==NULL)&&(_CONF.tests_ds==NULL)) return 0;
+    n_in=_NN(get,n_inputs)(conf);
+    n_out=_NN(get,n_outputs)(conf);
+    if(!_NN(loader,open)(conf,&ld,_CONF.tests,_CONF.tests_ds)) return 0;
+    if(ld.n_files>0){
+        ALLOC(*in,(UINT64)ld.n_files*n_in,DOUBLE);
+        ALLOC(*out,(UINT64)ld.n_files*n_out,DOUBLE);
+    }
+    while(_NN(loader,next)(&ld,&curr_file,&tr_in,&tr_out)){
+        if((tr_in!=NULL)&&(tr_out!=NULL)){
+            p_in=&((*in)[(UINT64)n_tests*n_in]);
+            p_out=&((*out)[(UINT64)n_tests*n_out]);
+            ARRAY_CP(tr_in,p_in,n_in);
+            ARRAY_CP(tr_out,p_out,n_out);
+            n_tests++;
+        }
+        FREE(tr_in);
+        FREE(tr_out);
+    }
+    _NN(loader,close)(&ld);
+    if(n_tests==0){
+        FREE(*in);
+        FREE(*out);
+    }
+    return n_tests;
+}
+/*------------------------*/
+/*+++ structured prune +++*/
+/*------------------------*/
+#define _K ((kernel_ann *)(_CONF.kernel))
+/*^^^ private: activation variance of each neuron of hidden layer 'layer'
+ * over the training samples (CPU only).*/
+static BOOL _NN(prune,variance)(nn_def *conf,UINT layer,DOUBLE *score){
+#ifndef  _CUDA
+    nn_loader ld;
+    CHAR  *curr_file;
+    DOUBLE    *tr_in;
+    DOUBLE   *tr_out;
+    DOUBLE *sum;
+    DOUBLE v;
+    UINT idx,N,n_samples=0;
+    /**/
+    if((_CONF.samples==NULL)&&(_CONF.samples_ds==NULL)) return FALSE;
+    if(!_NN(loader,open)(conf,&ld,_CONF.samples,_CONF.samples_ds))
+        return FALSE;
+    N=_K->hiddens[layer].n_neurons;
+    ALLOC(sum,N,DOUBLE);
+    for(idx=0;idx<N;idx++) score[idx]=0.;
+    while(_NN(loader,next)(&ld,&curr_file,&tr_in,&tr_out)){
+        if((tr_in==NULL)||(tr_out==NULL)){
+            FREE(tr_in);
+            FREE(tr_out);
+            continue;
+        }
+        ARRAY_CP(tr_in,_K->in,_K->n_inputs);
+        ann_kernel_run(_K);
+        for(idx=0;idx<N;idx++){
+            v=_K->hiddens[layer].vec[idx];
+            sum[idx]+=v;
+            score[idx]+=v*v;
+        }
+        n_samples++;
+        FREE(tr_in);
+        FREE(tr_out);
+    }
+    _NN(loader,close)(&ld);
+    if(n_samples==0){
+        FREE(sum);
+        return FALSE;
+    }
+    for(idx=0;idx<N;idx++){
+        v=sum[idx]/n_samples;
+        score[idx]=score[idx]/n_samples-v*v;
+    }
+    FREE(sum);
+    return TRUE;
+#else  /*_CUDA*/
+    /*hidden activations are on GPU*/
+    return FALSE;
+#endif /*_CUDA*/
+}
+/*^^^ remove the n_remove least important neurons of hidden layer 'layer',
+ * ranked by criterion, and replace the kernel by the smaller one.*/
+BOOL _NN(prune,kernel)(nn_def *conf,nn_prune criterion,
+                       UINT layer,UINT n_remove){
+    kernel_ann *pruned;
+    DOUBLE *score;
+    /**/
+    if(_CONF.kernel==NULL) return FALSE;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        break;
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return FALSE;
+    }
+    if(layer>=_K->n_hiddens) return FALSE;
+    if(n_remove==0) return TRUE;
+    ALLOC(score,_K->hiddens[layer].n_neurons,DOUBLE);
+    if(criterion==NN_PRUNE_VARIANCE){
+        if(!_NN(prune,variance)(conf,layer,score)){
+            NN_WARN(stderr,"no activation variance, using weight norm!\n");
+            criterion=NN_PRUNE_NORM;
+        }
+    }
+    if(criterion==NN_PRUNE_NORM) ann_neuron_norm(_K,layer,score);
+    pruned=ann_prune(_K,layer,n_remove,score);
+    FREE(score);
+    if(pruned==NULL) return FALSE;
+    ann_kernel_free(_K);
+    FREE(_CONF.kernel);
+    _CONF.kernel=pruned;
+    return TRUE;
+}
+/*^^^ factorize layer (n_hiddens for output) weights into U.V, keeping a
+ * fraction energy of the squared singular values, within max_rank (if not
+ * 0).  Returns the rank, or 0 when the layer is kept dense.*/
+UINT _NN(lowrank,kernel)(nn_def *conf,UINT layer,DOUBLE energy,
+                         UINT max_rank,DOUBLE *kept){
+    if(kept!=NULL) *kept=1.;
+    if(_CONF.kernel==NULL) return 0;
+    switch (_CONF.type){
+    case NN_TYPE_SNN:
+        /*softmax output is always dense*/
+        if(layer>=_K->n_hiddens) return 0;
+        /*fallthrough*/
+    case NN_TYPE_ANN:
+        break;
+    case NN_TYPE_LNN:
+    case NN_TYPE_UKN:
+    default:
+        return 0;
+    }
+    if(layer>_K->n_hiddens) return 0;
+    return ann_lowrank(_K,layer,energy,max_rank,kept);
+}
 #undef _K
+/*-----------------------------*/
+/*+++ predictor / corrector +++*/
+/*-----------------------------*/
+/*^^^ A host program can use the NN as a predictor for its own (usually
+ * iterative) calculation. _NN(predict,kernel) runs the NN and returns a
+ * confidence, which the host can use to decide how much of its calculation
+ * is still needed. Once the host has its final result, _NN(correct,kernel)
+ * compares it to the prediction, and queue it for training only when the
+ * prediction was not good enough. The training itself is deferred to a
+ * call to _NN(train,queue), when the host see fit.            -- OVHPA*/
+#define _K ((kernel_ann *)(_CONF.kernel))
+DOUBLE _NN(predict,kernel)(nn_def *conf,const DOUBLE *in,DOUBLE *out){
+    DOUBLE first,second;
+    UINT idx,best;
+#ifdef   _CUDA
+    cudastreams *cudas=_NN(return,cudas)();
+#endif /*_CUDA*/
+    if(_CONF.kernel==NULL) return -1.;
+    if(in==NULL) return -1.;
+    if((_CONF.type!=NN_TYPE_ANN)&&(_CONF.type!=NN_TYPE_SNN)) return -1.;
+    if(_CONF.pc.in==NULL){
+        _CONF.pc.n_in=_K->n_inputs;
+        _CONF.pc.n_out=_K->n_outputs;
+        ALLOC(_CONF.pc.in,_CONF.pc.n_in,DOUBLE);
+        ALLOC(_CONF.pc.out,_CONF.pc.n_out,DOUBLE);
+    }
+    ARRAY_CP(in,_CONF.pc.in,_CONF.pc.n_in);
+#ifndef  _CUDA
+    /*only the changed inputs are accounted for (see ann_kernel_run_inc)*/
+    ARRAY_CP(in,_K->in,_K->n_inputs);
+    if(_CONF.type==NN_TYPE_SNN) snn_kernel_run_inc(_K,0,NULL);
+    else ann_kernel_run_inc(_K,0,NULL);
+    ARRAY_CP(_K->output.vec,_CONF.pc.out,_CONF.pc.n_out);
+#else  /*_CUDA*/
+    CUDA_SET_DEV(*cudas,0);
+    if(cudas->mem_model!=CUDA_MEM_CMM){
+        CUDA_C2G_CP(_CONF.pc.in,_K->in,_K->n_inputs,DOUBLE);
+        if((cudas->mem_model==CUDA_MEM_EXP)&&(cudas->n_gpu>1)){
+            kernel_ann *kx;
+            /*distribute input to other GPUs*/
+            for(int gpu=1;gpu<cudas->n_gpu;gpu++){
+                kx=(kernel_ann *)_K->kerns[gpu];
+                CUDA_G2G_CP(_K->in,kx->in,_K->n_inputs,DOUBLE);
+            }
+        }
+    }else{
+        CUDA_SYNC();
+        ARRAY_CP(_CONF.pc.in,_K->in,_K->n_inputs);
+        cudaMemPrefetchAsync(_K->in,_K->n_inputs*sizeof(DOUBLE),0,NULL);
+        CUDA_SYNC();
+    }
+    if(_CONF.type==NN_TYPE_SNN) snn_kernel_run(_K);
+    else ann_kernel_run(_K);
+    if(cudas->mem_model!=CUDA_MEM_CMM){
+        CUDA_G2C_CP(_CONF.pc.out,_K->output.vec,_K->n_outputs,DOUBLE);
+    }else{
+        CUDA_SYNC();
+        ARRAY_CP(_K->output.vec,_CONF.pc.out,_CONF.pc.n_out);
+    }
+#endif /*_CUDA*/
+    if(out!=NULL) ARRAY_CP(_CONF.pc.out,out,_CONF.pc.n_out);
+    /*confidence: best output and runner-up (best of the others)*/
+    best=0;
+    for(idx=1;idx<_CONF.pc.n_out;idx++)
+        if(_CONF.pc.out[idx]>_CONF.pc.out[best]) best=idx;
+    first=_CONF.pc.out[best];
+    second=(best==0)?_CONF.pc.out[1%_CONF.pc.n_out]:_CONF.pc.out[0];
+    for(idx=0;idx<_CONF.pc.n_out;idx++)
+        if((idx!=best)&&(_CONF.pc.out[idx]>second)) second=_CONF.pc.out[idx];
+    /*SNN: best class probability*/
+    if(_CONF.type==NN_TYPE_SNN) return first;
+    /*ANN: sigmoid and hard-tanh outputs are in [-1,1], the margin is scaled
+     * to [0,1]. ReLU and leaky ReLU outputs are unbounded: the margin is then
+     * returned raw, and its threshold has to follow the output scale.*/
+    switch(_K->output.act){
+    case ANN_ACT_RELU:
+    case ANN_ACT_LRELU:
+        if(_CONF.pc.n_out==1) return first;
+        return first-second;
+    case ANN_ACT_SIGMOID:
+    case ANN_ACT_HTANH:
+    default:
+        if(_CONF.pc.n_out==1) return fabs(first);
+        return 0.5*(first-second);
+    }
 }
+/*^^^ result is the host (converged) answer to the last prediction, which is
+ * queued for training when the prediction error is above threshold.  The
+ * error is the same as the one used in training, ie. 1/2 sum of squared
+ * differences for ANN, and cross-entropy for SNN. Return the error or -1 in
+ * case no prediction was made.*/
+DOUBLE _NN(correct,kernel)(nn_def *conf,const DOUBLE *result,DOUBLE threshold){
+    DOUBLE **q_in,**q_out;
+    DOUBLE Ep=0.;
+    UINT idx;
+    if(_CONF.pc.in==NULL) return -1.;
+    if(result==NULL) return -1.;
+    if(_CONF.type==NN_TYPE_SNN){
+        for(idx=0;idx<_CONF.pc.n_out;idx++)
+            Ep-=result[idx]*log(_CONF.pc.out[idx]+TINY);
+    }else{
+        for(idx=0;idx<_CONF.pc.n_out;idx++)
+            Ep+=(result[idx]-_CONF.pc.out[idx])*(result[idx]-_CONF.pc.out[idx]);
+        Ep*=0.5;
+    }
+    if(Ep<=threshold) return Ep;
+    /*prediction is not good enough: queue for training*/
+    if(_CONF.pc.n_samples>=_CONF.pc.max_samples){
+        if(_CONF.pc.max_samples==0) _CONF.pc.max_samples=16;
+        else _CONF.pc.max_samples*=2;
+        ALLOC(q_in,_CONF.pc.max_samples,DOUBLE *);
+        ALLOC(q_out,_CONF.pc.max_samples,DOUBLE *);
+        for(idx=0;idx<_CONF.pc.n_samples;idx++){
+            q_in[idx]=_CONF.pc.q_in[idx];
+            q_out[idx]=_CONF.pc.q_out[idx];
+        }
+        FREE(_CONF.pc.q_in);
+        FREE(_CONF.pc.q_out);
+        _CONF.pc.q_in=q_in;
+        _CONF.pc.q_out=q_out;
+    }
+    idx=_CONF.pc.n_samples;
+    ALLOC(_CONF.pc.q_in[idx],_CONF.pc.n_in,DOUBLE);
+    ALLOC(_CONF.pc.q_out[idx],_CONF.pc.n_out,DOUBLE);
+    ARRAY_CP(_CONF.pc.in,_CONF.pc.q_in[idx],_CONF.pc.n_in);
+    ARRAY_CP(result,_CONF.pc.q_out[idx],_CONF.pc.n_out);
+    _CONF.pc.n_samples++;
+    return Ep;
+}
+UINT _NN(get,n_queued)(nn_def *conf){
+    return _CONF.pc.n_samples;
+}
+/*^^^ train all queued samples (in order) then empty the queue.
+ * Return the averaged training result.*/
+DOUBLE _NN(train,queue)(nn_def *conf){
+    DOUBLE res=0.;
+    if(_CONF.kernel==NULL) return -1.;
+    if(_CONF.pc.n_samples==0) return 0.;
+    _NN(prepare,train)(conf);
+    /*CG, LM: the whole queue is a single batch*/
+    res=_NN(train,batch)(conf,_CONF.pc.n_samples,
+        _CONF.pc.q_in,_CONF.pc.q_out);
+    _NN(cleanup,train)(conf);
+    _NN(flush,queue)(conf);
+    return res;
+}
+void _NN(flush,queue)(nn_def *conf){
+    UINT idx;
+    for(idx=0;idx<_CONF.pc.n_samples;idx++){
+        FREE(_CONF.pc.q_in[idx]);
+        FREE(_CONF.pc.q_out[idx]);
+    }
+    _CONF.pc.n_samples=0;
+}
+#undef _K
 
 #undef _CONF
@@ -73,16 +73,13 @@
 #endif
 /*make life easier*/
 #define KERN (*kernel)
-/*------------------------*/
-/*+++ feed-forward run +++*/
-/*------------------------*/
-void snn_kernel_run(kernel_ann *kernel){
-#ifdef   _CUDA
-    /*the _NN(run,kernel) is now in charge of transfer(s)*/
-    scuda_snn_forward(kernel,_NN(return,cudas)());
-#else  /*_CUDA*/
-    /*simple, one pass kernel*/
-    UINT idx,jdx,M,N;
+#ifndef _CUDA
+/*-------------------------------*/
+/*+++ feed-forward output(s) +++*/
+/*-------------------------------*/
+/* run the softmax output layer, last hidden layer has to be done already.*/
+void snn_kernel_run_output(kernel_ann *kernel){
+    UINT jdx,M,N;
     DOUBLE dv;
 #if !defined (PBLAS) && !defined (SBLAS)
     UINT kdx;
@@ -93,190 +90,6 @@ void snn_kernel_run(kernel_ann *kernel){
     _NN(get,mpi_tasks)(&n_streams);
     _NN(get,curr_mpi_task)(&stream);
 #endif /*_MPI*/
-    /*simple, one pass kernel*/
-/*+++ I - input +++*/
-    N=KERN.hiddens[0].n_neurons;
-    M=KERN.hiddens[0].n_inputs;
-#ifdef _MPI
-    red=N/n_streams;
-    rem=N%n_streams;
-#endif /*_MPI*/
-#ifdef PBLAS
-#ifdef _MPI
-    cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
-        1.0,KERN.hiddens[0].weights+stream*M*red,M,KERN.in,1,0.,KERN.hiddens[0].vec+stream*red,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix+stream*red]=ann_act(KERN.hiddens[0].vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-    /*do the remaining ops without MPI*/
-    if(rem>0){
-        cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
-            1.0,KERN.hiddens[0].weights+n_streams*M*red,M,KERN.in,1,0.,KERN.hiddens[0].vec+n_streams*red,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix+n_streams*red]=ann_act(KERN.hiddens[0].vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-    }
-#else /*_MPI*/
-    cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,1.0,KERN.hiddens[0].weights,M,KERN.in,1,0.,KERN.hiddens[0].vec,1);
-#define OP_ACT(ix) KERN.hiddens[0].vec[ix]=ann_act(KERN.hiddens[0].vec[ix])
-    UNROLL_OMP_FOR(0,N,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-#endif /*_MPI*/
-#elif defined(SBLAS)
-    /*move the parallel mv into a series of vv*/
-#ifdef _MPI
-#pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<red;jdx++){
-_HT;
-        KERN.hiddens[0].vec[jdx+stream*red]=cblas_ddot(
-        M,&(KERN.hiddens[0].weights[M*(jdx+stream*red)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx+stream*red]=ann_act(KERN.hiddens[0].vec[jdx+stream*red]);
-    }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-if(rem>0){
-#pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<rem;jdx++){
-_HT;
-        KERN.hiddens[0].vec[jdx+n_streams*red]=cblas_ddot(
-        M,&(KERN.hiddens[0].weights[M*(jdx+n_streams*red)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx+n_streams*red]=ann_act(KERN.hiddens[0].vec[jdx+n_streams*red]);
-    }
-}
-#else /*_MPI*/
-#pragma omp parallel for private(jdx) _NT
-    for(jdx=0;jdx<N;jdx++){
-_HT;
-        KERN.hiddens[0].vec[jdx]=cblas_ddot(
-        M,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]),1,KERN.in,1);
-        KERN.hiddens[0].vec[jdx]=ann_act(KERN.hiddens[0].vec[jdx]);
-    }
-#endif /*_MPI*/
-#else /*no PBLAS no SBLAS*/
-#ifdef _MPI
-#pragma omp parallel for private(jdx,kdx) _NT
-    for(jdx=0;jdx<red;jdx++){
-        KERN.hiddens[0].vec[jdx+stream*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx+stream*red]+=KERN.hiddens[0].weights[M*(jdx+stream*red)+ix]*KERN.in[ix]
-        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-        KERN.hiddens[0].vec[jdx+stream*red]=ann_act(KERN.hiddens[0].vec[jdx+stream*red]);
-    }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-    if(rem>0){
-#pragma omp parallel for private(jdx,kdx) _NT
-        for(jdx=0;jdx<rem;jdx++){
-            KERN.hiddens[0].vec[jdx+n_streams*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx+n_streams*red]+=KERN.hiddens[0].weights[M*(jdx+n_streams*red)+ix]*KERN.in[ix]
-            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-            KERN.hiddens[0].vec[jdx+n_streams*red]=ann_act(KERN.hiddens[0].vec[jdx+n_streams*red]);
-        }
-    }
-#else /*_MPI*/
-#pragma omp parallel for private(jdx,kdx) _NT
-    for(jdx=0;jdx<N;jdx++){
-        KERN.hiddens[0].vec[jdx]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[0].vec[jdx]+=KERN.hiddens[0].weights[_2D_IDX(M,jdx,ix)]*KERN.in[ix]
-        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-        KERN.hiddens[0].vec[jdx]=ann_act(KERN.hiddens[0].vec[jdx]);
-    }
-#endif /*_MPI*/
-#endif /*PBLAS*/
-/*+++ II - hiddens +++*/
-    for(idx=1;idx<KERN.n_hiddens;idx++){
-        N=KERN.hiddens[idx].n_neurons;
-        M=KERN.hiddens[idx].n_inputs;
-#ifdef _MPI
-        red=N/n_streams;
-        rem=N%n_streams;
-#endif /*_MPI*/
-#ifdef PBLAS
-#ifdef _MPI
-        cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
-        1.0,KERN.hiddens[idx].weights+stream*M*red,M,KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec+stream*red,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix+stream*red]=ann_act(KERN.hiddens[idx].vec[ix+stream*red])
-        UNROLL_OMP_FOR(0,red,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-        if(rem>0){
-            cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
-            1.0,KERN.hiddens[idx].weights+n_streams*M*red,M,KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec+n_streams*red,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix+n_streams*red]=ann_act(KERN.hiddens[idx].vec[ix+n_streams*red])
-            UNROLL_OMP_FOR(0,rem,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-        }
-#else /*_MPI*/
-        cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
-            1.0,KERN.hiddens[idx].weights,M,KERN.hiddens[idx-1].vec,1,0.,KERN.hiddens[idx].vec,1);
-#define OP_ACT(ix) KERN.hiddens[idx].vec[ix]=ann_act(KERN.hiddens[idx].vec[ix])
-        UNROLL_OMP_FOR(0,N,ANN_UNROLL,ACT,jdx);
-#undef OP_ACT
-#endif /*_MPI*/
-#elif defined(SBLAS)
-        /*move the parallel mv into a series of vv*/
-#ifdef _MPI
-#pragma omp parallel for private(jdx) _NT
-        for(jdx=0;jdx<red;jdx++){
-_HT;
-            KERN.hiddens[idx].vec[jdx+stream*red]=cblas_ddot(
-            M,&(KERN.hiddens[idx].weights[M*(jdx+stream*red)]),1,KERN.hiddens[idx-1].vec,1);
-            KERN.hiddens[idx].vec[jdx+stream*red]=ann_act(KERN.hiddens[idx].vec[jdx+stream*red]);
-        }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-        if(rem>0){
-#pragma omp parallel for private(jdx) _NT
-            for(jdx=0;jdx<rem;jdx++){
-_HT;
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=cblas_ddot(
-                M,&(KERN.hiddens[idx].weights[M*(jdx+n_streams*red)]),1,KERN.hiddens[idx-1].vec,1);
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=ann_act(KERN.hiddens[idx].vec[jdx+n_streams*red]);
-            }
-        }
-#else /*_MPI*/
-#pragma omp parallel for private(jdx) _NT
-        for(jdx=0;jdx<N;jdx++){
-_HT;
-            KERN.hiddens[idx].vec[jdx]=cblas_ddot(
-            M,&(KERN.hiddens[idx].weights[_2D_IDX(M,jdx,0)]),1,KERN.hiddens[idx-1].vec,1);
-            KERN.hiddens[idx].vec[jdx]=ann_act(KERN.hiddens[idx].vec[jdx]);
-        }
-#endif /*_MPI*/
-#else /*no PBLAS no SBLAS*/
-#ifdef _MPI
-        #pragma omp parallel for private(jdx,kdx) _NT
-        for(jdx=0;jdx<red;jdx++){
-            KERN.hiddens[idx].vec[jdx+stream*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[idx].vec[jdx+stream*red]+=KERN.hiddens[idx].weights[M*(jdx+stream*red)+ix]*KERN.hiddens[idx-1].vec[ix]
-            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-            KERN.hiddens[idx].vec[jdx+stream*red]=ann_act(KERN.hiddens[idx].vec[jdx+stream*red]);
-        }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
-        if(rem>0){
-#pragma omp parallel for private(jdx) _NT
-            for(jdx=0;jdx<rem;jdx++){
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[idx].vec[jdx+n_streams*red]+=KERN.hiddens[idx].weights[M*(jdx+n_streams*red)+ix]*KERN.hiddens[idx-1].vec[ix]
-                UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-                KERN.hiddens[idx].vec[jdx+n_streams*red]=ann_act(KERN.hiddens[idx].vec[jdx+n_streams*red]);
-            }
-        }
-#else /*_MPI*/
-#pragma omp parallel for private(jdx,kdx) _NT
-        for(jdx=0;jdx<N;jdx++){
-            KERN.hiddens[idx].vec[jdx]=0.;/*TRAP*/
-#define OP_WI(ix) KERN.hiddens[idx].vec[jdx]+=KERN.hiddens[idx].weights[_2D_IDX(M,jdx,ix)]*KERN.hiddens[idx-1].vec[ix]
-            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
-#undef OP_WI
-            KERN.hiddens[idx].vec[jdx]=ann_act(KERN.hiddens[idx].vec[jdx]);
-        }
-#endif /*_MPI*/
-#endif /*PBLAS*/
-    }
-/*+++ III - output +++*/
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
     dv=TINY;
@@ -287,11 +100,15 @@ _HT;
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
-    1.0,KERN.output.weights+stream*M*red,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,0.,KERN.output.vec+stream*red,1);
+    1.0,KERN.output.weights+stream*M*red,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,
+    ann_bias_load(&(KERN.output),KERN.output.vec,stream*red,red),
+    KERN.output.vec+stream*red,1);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
         cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
-        1.0,KERN.output.weights+n_streams*M*red,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,0.,KERN.output.vec+n_streams*red,1);
+        1.0,KERN.output.weights+n_streams*M*red,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,
+        ann_bias_load(&(KERN.output),KERN.output.vec,n_streams*red,rem),
+        KERN.output.vec+n_streams*red,1);
     }
     /*SOFTMAX: calculate dv*/
     /* This should be equivalent to BLAS lvl. 1 dasum*/
@@ -321,7 +138,9 @@ _HT;
 #else /*_MPI*/
     /*serial dgemv (no thread support here)*/
     cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,
-        1.0,KERN.output.weights,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,0.,KERN.output.vec,1);
+        1.0,KERN.output.weights,M,KERN.hiddens[KERN.n_hiddens-1].vec,1,
+        ann_bias_load(&(KERN.output),KERN.output.vec,0,N),
+        KERN.output.vec,1);
     /*SOFTMAX: calculate dv*/
 #pragma omp parallel for private(jdx) reduction(+:dv) _NT
     for(jdx=0;jdx<N;jdx++){
@@ -339,7 +158,7 @@ _HT;
 #pragma omp parallel for private(jdx) reduction(+:dv) _NT
     for(jdx=0;jdx<red;jdx++){
 _HT;
-        KERN.output.vec[jdx+stream*red]=cblas_ddot(
+        KERN.output.vec[jdx+stream*red]=ANN_BIAS(&(KERN.output),jdx+stream*red)+cblas_ddot(
         M,&(KERN.output.weights[M*(jdx+stream*red)]),1,KERN.hiddens[KERN.n_hiddens-1].vec,1);
         /*SOFTMAX: calculate dv*/
         KERN.output.vec[jdx+stream*red]=exp(KERN.output.vec[jdx+stream*red]-1.0);
@@ -351,7 +170,7 @@ _HT;
 #pragma omp parallel for private(jdx) reduction(+:dv) _NT
         for(jdx=0;jdx<rem;jdx++){
 _HT;
-            KERN.output.vec[jdx+n_streams*red]=cblas_ddot(
+            KERN.output.vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.output),jdx+n_streams*red)+cblas_ddot(
             M,&(KERN.output.weights[M*(jdx+n_streams*red)]),1,KERN.hiddens[KERN.n_hiddens-1].vec,1);
             /*SOFTMAX: calculate dv*/
             KERN.output.vec[jdx+n_streams*red]=exp(KERN.output.vec[jdx+n_streams*red]-1.0);
@@ -367,11 +186,12 @@ _HT;
 #define OP_SX(ix) KERN.output.vec[ix+n_streams*red]/=dv;
         UNROLL_OMP_FOR(0,rem,ANN_UNROLL,SX,jdx);
 #undef OP_SX
+    }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) reduction(+:dv) _NT
     for(jdx=0;jdx<N;jdx++){
 _HT;
-        KERN.output.vec[jdx]=cblas_ddot(
+        KERN.output.vec[jdx]=ANN_BIAS(&(KERN.output),jdx)+cblas_ddot(
         M,&(KERN.output.weights[_2D_IDX(M,jdx,0)]),1,KERN.hiddens[KERN.n_hiddens-1].vec,1);
         /*SOFTMAX: calculate dv*/
         KERN.output.vec[jdx]=exp(KERN.output.vec[jdx]-1.0);
@@ -386,7 +206,7 @@ _HT;
 #ifdef _MPI
 #pragma omp parallel for private(jdx,kdx) reduction(+:dv) _NT
     for(jdx=0;jdx<red;jdx++){
-        KERN.output.vec[jdx+stream*red]=0.;/*TRAP*/
+        KERN.output.vec[jdx+stream*red]=ANN_BIAS(&(KERN.output),jdx+stream*red);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx+stream*red]+=KERN.output.weights[M*(jdx+stream*red)+ix]*KERN.hiddens[KERN.n_hiddens-1].vec[ix]
         UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
@@ -399,7 +219,7 @@ _HT;
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) reduction(+:dv) _NT
         for(jdx=0;jdx<rem;jdx++){
-            KERN.output.vec[jdx+n_streams*red]=0.;/*TRAP*/
+            KERN.output.vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.output),jdx+n_streams*red);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx+n_streams*red]+=KERN.output.weights[M*(jdx+n_streams*red)+ix]*KERN.hiddens[KERN.n_hiddens-1].vec[ix]
             UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
@@ -421,7 +241,7 @@ _HT;
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) reduction(+:dv) _NT
     for(jdx=0;jdx<N;jdx++){
-        KERN.output.vec[jdx]=0.;/*TRAP*/
+        KERN.output.vec[jdx]=ANN_BIAS(&(KERN.output),jdx);/*TRAP*/
 #define OP_WI(ix) KERN.output.vec[jdx]+=KERN.output.weights[_2D_IDX(M,jdx,ix)]*KERN.hiddens[KERN.n_hiddens-1].vec[ix]
         UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
 #undef OP_WI
@@ -435,12 +255,152 @@ _HT;
 #undef OP_SX
 #endif /*_MPI*/
 #endif /*PBLAS*/
+}
+/*--------------------------*/
+/*+++ feed-forward input +++*/
+/*--------------------------*/
+static void snn_kernel_run_input(kernel_ann *kernel){
+    UINT M,N;
+#ifndef PBLAS
+    UINT jdx;
+#endif /*PBLAS*/
+#if !defined (PBLAS) && !defined (SBLAS)
+    UINT kdx;
+#endif
+#ifdef _MPI
+    UINT n_streams,stream;
+    UINT red,rem;
+    _NN(get,mpi_tasks)(&n_streams);
+    _NN(get,curr_mpi_task)(&stream);
+#endif /*_MPI*/
+    N=KERN.hiddens[0].n_neurons;
+    M=KERN.hiddens[0].n_inputs;
+#ifdef _MPI
+    red=N/n_streams;
+    rem=N%n_streams;
+#endif /*_MPI*/
+#ifdef PBLAS
+#ifdef _MPI
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,red,M,
+        1.0,KERN.hiddens[0].weights+stream*M*red,M,KERN.in,1,
+        ann_bias_load(&(KERN.hiddens[0]),KERN.hiddens[0].vec,stream*red,red),
+        KERN.hiddens[0].vec+stream*red,1);
+    ann_act_range(&(KERN.hiddens[0]),stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
+    /*do the remaining ops without MPI*/
+    if(rem>0){
+        cblas_dgemv(CblasRowMajor,CblasNoTrans,rem,M,
+            1.0,KERN.hiddens[0].weights+n_streams*M*red,M,KERN.in,1,
+            ann_bias_load(&(KERN.hiddens[0]),KERN.hiddens[0].vec,n_streams*red,rem),
+            KERN.hiddens[0].vec+n_streams*red,1);
+        ann_act_range(&(KERN.hiddens[0]),n_streams*red,rem);
+    }
+#else /*_MPI*/
+    cblas_dgemv(CblasRowMajor,CblasNoTrans,N,M,1.0,KERN.hiddens[0].weights,M,KERN.in,1,
+        ann_bias_load(&(KERN.hiddens[0]),KERN.hiddens[0].vec,0,N),
+        KERN.hiddens[0].vec,1);
+    ann_act_range(&(KERN.hiddens[0]),0,N);
+#endif /*_MPI*/
+#elif defined(SBLAS)
+    /*move the parallel mv into a series of vv*/
+#ifdef _MPI
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<red;jdx++){
+_HT;
+        KERN.hiddens[0].vec[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+stream*red)+cblas_ddot(
+        M,&(KERN.hiddens[0].weights[M*(jdx+stream*red)]),1,KERN.in,1);
+    }
+    ann_act_range(&(KERN.hiddens[0]),stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
+if(rem>0){
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<rem;jdx++){
+_HT;
+        KERN.hiddens[0].vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+n_streams*red)+cblas_ddot(
+        M,&(KERN.hiddens[0].weights[M*(jdx+n_streams*red)]),1,KERN.in,1);
+    }
+    ann_act_range(&(KERN.hiddens[0]),n_streams*red,rem);
+}
+#else /*_MPI*/
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<N;jdx++){
+_HT;
+        KERN.hiddens[0].vec[jdx]=ANN_BIAS(&(KERN.hiddens[0]),jdx)+cblas_ddot(
+        M,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx,0)]),1,KERN.in,1);
+    }
+    ann_act_range(&(KERN.hiddens[0]),0,N);
+#endif /*_MPI*/
+#else /*no PBLAS no SBLAS*/
+#ifdef _MPI
+#pragma omp parallel for private(jdx,kdx) _NT
+    for(jdx=0;jdx<red;jdx++){
+        KERN.hiddens[0].vec[jdx+stream*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+stream*red);/*TRAP*/
+#define OP_WI(ix) KERN.hiddens[0].vec[jdx+stream*red]+=KERN.hiddens[0].weights[M*(jdx+stream*red)+ix]*KERN.in[ix]
+        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
+    }
+    ann_act_range(&(KERN.hiddens[0]),stream*red,red);
+    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].vec,red,MPI_DOUBLE,MPI_COMM_WORLD);
+    if(rem>0){
+#pragma omp parallel for private(jdx,kdx) _NT
+        for(jdx=0;jdx<rem;jdx++){
+            KERN.hiddens[0].vec[jdx+n_streams*red]=ANN_BIAS(&(KERN.hiddens[0]),jdx+n_streams*red);/*TRAP*/
+#define OP_WI(ix) KERN.hiddens[0].vec[jdx+n_streams*red]+=KERN.hiddens[0].weights[M*(jdx+n_streams*red)+ix]*KERN.in[ix]
+            UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
+        }
+        ann_act_range(&(KERN.hiddens[0]),n_streams*red,rem);
+    }
+#else /*_MPI*/
+#pragma omp parallel for private(jdx,kdx) _NT
+    for(jdx=0;jdx<N;jdx++){
+        KERN.hiddens[0].vec[jdx]=ANN_BIAS(&(KERN.hiddens[0]),jdx);/*TRAP*/
+#define OP_WI(ix) KERN.hiddens[0].vec[jdx]+=KERN.hiddens[0].weights[_2D_IDX(M,jdx,ix)]*KERN.in[ix]
+        UNROLL_FOR(0,M,ANN_UNROLL,WI,kdx);
+#undef OP_WI
+    }
+    ann_act_range(&(KERN.hiddens[0]),0,N);
+#endif /*_MPI*/
+#endif /*PBLAS*/
+}
+#endif /*_CUDA*/
+/*------------------------*/
+/*+++ feed-forward run +++*/
+/*------------------------*/
+void snn_kernel_run(kernel_ann *kernel){
+#ifdef   _CUDA
+    /*the _NN(run,kernel) is now in charge of transfer(s)*/
+    scuda_snn_forward(kernel,_NN(return,cudas)());
+#else  /*_CUDA*/
+    /*simple, one pass kernel*/
+    /*incremental run data are not kept here*/
+    ann_kernel_inc_reset(kernel);
+/*+++ I - input +++*/
+    if(KERN.hiddens[0].rank>0) ann_lowrank_run(&(KERN.hiddens[0]),KERN.in);
+    else snn_kernel_run_input(kernel);
+/*+++ II - hiddens +++*/
+    ann_kernel_run_hiddens(kernel);
+/*+++ III - output +++*/
+    snn_kernel_run_output(kernel);
 #ifdef _MPI
 //  MPI_Barrier(MPI_COMM_WORLD);//WAIT FOR ALL TASKS BEFORE LEAVING
 #endif
     /*done*/
 #endif /*_CUDA*/
 }
+/*------------------------------------*/
+/*+++ incremental feed-forward run +++*/
+/*------------------------------------*/
+/* same as ann_kernel_run_inc, with a softmax output layer.*/
+void snn_kernel_run_inc(kernel_ann *kernel,UINT n_changed,const UINT *changed){
+#ifdef   _CUDA
+    snn_kernel_run(kernel);
+#else  /*_CUDA*/
+    if(!ann_kernel_inc_input(kernel,n_changed,changed)) return;
+    ann_kernel_run_hiddens(kernel);
+    snn_kernel_run_output(kernel);
+#endif /*_CUDA*/
+}
 /*-------------------------------*/
 /*+++ Train Error Calculation +++*/
 /*-------------------------------*/
@@ -483,7 +443,10 @@ void snn_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train, DOUBLE **del
         UINT kdx;
 #endif
     UINT N,M;
-        UINT idx, jdx;
+        UINT idx;
+#ifndef PBLAS
+        UINT jdx;
+#endif /*PBLAS*/
 #ifdef _MPI
     UINT red, rem;
     UINT n_streams,stream;
@@ -522,23 +485,17 @@ void snn_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train, DOUBLE **del
 #ifdef _MPI
     cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
         1.0,KERN.output.weights+stream*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix+stream*red])
-    UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
         cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
             1.0,KERN.output.weights+n_streams*red,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix+n_streams*red])
-        UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
     }
 #else /*_MPI*/
     /*! transposed*/
     cblas_dgemv(CblasRowMajor,CblasTrans,N,M,1.0,KERN.output.weights,M,delta_ptr[KERN.n_hiddens],1,0.,delta_ptr[KERN.n_hiddens-1],1);
-#define OP_DACT(ix) delta_ptr[KERN.n_hiddens-1][ix]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[ix])
-    UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
 #endif /*_MPI*/
 #elif defined(SBLAS)
     /*move the mv into a series of vv*/
@@ -548,8 +505,8 @@ void snn_kernel_train_delta(kernel_ann *kernel,const DOUBLE *train, DOUBLE **del
 _HT;
         delta_ptr[KERN.n_hiddens-1][jdx+stream*red]=cblas_ddot(
             N,&(KERN.output.weights[jdx+stream*red]),M,delta_ptr[KERN.n_hiddens],1);
-        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+stream*red]);
     }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
@@ -557,8 +514,8 @@ _HT;
 _HT;
             delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]=cblas_ddot(
                 N,&(KERN.output.weights[jdx+n_streams*red]),M,delta_ptr[KERN.n_hiddens],1);
-            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+n_streams*red]);
         }
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
@@ -567,8 +524,8 @@ _HT;
         /*since the matrix is transposed incX is the matrix stride!*/
         delta_ptr[KERN.n_hiddens-1][jdx]=cblas_ddot(
         N,&(KERN.output.weights[jdx]),M,&(delta_ptr[KERN.n_hiddens][0]),1);
-        delta_ptr[KERN.n_hiddens-1][jdx]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx]);
     }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
@@ -578,8 +535,8 @@ _HT;
     KERN.output.weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[KERN.n_hiddens][ix]
         UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-        delta_ptr[KERN.n_hiddens-1][jdx+stream*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+stream*red]);
     }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],stream*red,red);
     MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[KERN.n_hiddens-1],red,MPI_DOUBLE,MPI_COMM_WORLD);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -588,8 +545,8 @@ _HT;
     KERN.output.weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[KERN.n_hiddens][ix]
             UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-            delta_ptr[KERN.n_hiddens-1][jdx+n_streams*red]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx+n_streams*red]);
         }
+        ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],n_streams*red,rem);
     }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -597,8 +554,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[KERN.n_hiddens-1][jdx]+=KERN.output.weights[_2D_IDX(M,ix,jdx)]*delta_ptr[KERN.n_hiddens][ix]
         UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-        delta_ptr[KERN.n_hiddens-1][jdx]*=ann_dact(KERN.hiddens[KERN.n_hiddens-1].vec[jdx]);
     }
+    ann_dact_range(&(KERN.hiddens[KERN.n_hiddens-1]),delta_ptr[KERN.n_hiddens-1],0,M);
 #endif /*_MPI*/
 #endif /*PBLAS*/
 #ifdef _MPI
@@ -616,23 +573,17 @@ _HT;
 #ifdef _MPI
             cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
                  1.0,KERN.hiddens[idx+1].weights+stream*red,M,delta_ptr[idx+1],1,0.,delta_ptr[idx]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[idx][ix+stream*red]*=ann_dact(KERN.hiddens[idx].vec[ix+stream*red])
-            UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
                 cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
                     1.0,KERN.hiddens[idx+1].weights+n_streams*red,M,delta_ptr[idx+1],1,0.,delta_ptr[idx]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[idx][ix+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[ix+n_streams*red])
-                UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
             /*! transposed*/
             cblas_dgemv(CblasRowMajor,CblasTrans,N,M,1.0,KERN.hiddens[idx+1].weights,M,delta_ptr[idx+1],1,0.,delta_ptr[idx],1);
-#define OP_DACT(ix) delta_ptr[idx][ix]*=ann_dact(KERN.hiddens[idx].vec[ix])
-            UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #elif defined(SBLAS)
             /*move the mv into a series of vv*/
@@ -643,8 +594,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[idx][jdx+stream*red]=cblas_ddot(
                 N,&(KERN.hiddens[idx+1].weights[jdx+stream*red]),M,delta_ptr[idx+1],1);
-                delta_ptr[idx][jdx+stream*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+stream*red]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
 #pragma omp parallel for private(jdx) _NT
@@ -653,8 +604,8 @@ _HT;
                     /*since the matrix is transposed incX is the matrix stride!*/
                     delta_ptr[idx][jdx+n_streams*red]=cblas_ddot(
                     N,&(KERN.hiddens[idx+1].weights[jdx+n_streams*red]),M,delta_ptr[idx+1],1);
-                    delta_ptr[idx][jdx+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+n_streams*red]);
                 }
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
@@ -663,8 +614,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[idx][jdx]=cblas_ddot(
                 N,&(KERN.hiddens[idx+1].weights[_2D_IDX(M,0,jdx)]),M,delta_ptr[idx+1],1);
-                delta_ptr[idx][jdx]*=ann_dact(KERN.hiddens[idx].vec[jdx]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
@@ -673,8 +624,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx+stream*red]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[idx+1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[idx][jdx+stream*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+stream*red]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],stream*red,red);
             MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[idx],red,MPI_DOUBLE,MPI_COMM_WORLD);
             if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -682,8 +633,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx+n_streams*red]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[idx+1][ix]
                     UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                    delta_ptr[idx][jdx+n_streams*red]*=ann_dact(KERN.hiddens[idx].vec[jdx+n_streams*red]);
                 }
+                ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],n_streams*red,rem);
             }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -691,8 +642,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[idx][jdx]+=KERN.hiddens[idx+1].weights[_2D_IDX(M,ix,jdx)]*delta_ptr[idx+1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[idx][jdx]*=ann_dact(KERN.hiddens[idx].vec[jdx]);
             }
+            ann_dact_range(&(KERN.hiddens[idx]),delta_ptr[idx],0,M);
 #endif /*_MPI*/
 #endif /*PBLAS*/
 #ifdef _MPI
@@ -710,23 +661,17 @@ _HT;
 #ifdef _MPI
         cblas_dgemv(CblasRowMajor,CblasTrans,N,red,
             1.0,KERN.hiddens[1].weights+stream*red,M,delta_ptr[1],1,0.,delta_ptr[0]+stream*red,1);
-#define OP_DACT(ix) delta_ptr[0][ix+stream*red]*=ann_dact(KERN.hiddens[0].vec[ix+stream*red])
-        UNROLL_OMP_FOR(0,red,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
             cblas_dgemv(CblasRowMajor,CblasTrans,N,rem,
             1.0,KERN.hiddens[1].weights+n_streams*red,M,delta_ptr[1],1,0.,delta_ptr[0]+n_streams*red,1);
-#define OP_DACT(ix) delta_ptr[0][ix+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[ix+n_streams*red])
-            UNROLL_OMP_FOR(0,rem,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
         cblas_dgemv(CblasRowMajor,CblasTrans,N,M,
         1.0,KERN.hiddens[1].weights,M,delta_ptr[1],1,0.,delta_ptr[0],1);
-#define OP_DACT(ix) delta_ptr[0][ix]*=ann_dact(KERN.hiddens[0].vec[ix])
-        UNROLL_OMP_FOR(0,M,ANN_UNROLL,DACT,jdx);
-#undef OP_DACT
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #elif defined(SBLAS)
 #ifdef _MPI
@@ -736,8 +681,8 @@ _HT;
             /*since the matrix is transposed incX is the matrix stride!*/
             delta_ptr[0][jdx+stream*red]=cblas_ddot(
             N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx+stream*red)]),N,&(delta_ptr[1][0]),1);
-            delta_ptr[0][jdx+stream*red]*=ann_dact(KERN.hiddens[0].vec[jdx+stream*red]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
@@ -746,8 +691,8 @@ _HT;
                 /*since the matrix is transposed incX is the matrix stride!*/
                 delta_ptr[0][jdx+n_streams*red]=cblas_ddot(
                 N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx+n_streams*red)]),N,&(delta_ptr[1][0]),1);
-                delta_ptr[0][jdx+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[jdx+n_streams*red]);
             }
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx) _NT
@@ -756,8 +701,8 @@ _HT;
             /*since the matrix is transposed incX is the matrix stride!*/
             delta_ptr[0][jdx]=cblas_ddot(
             N,&(KERN.hiddens[1].weights[_2D_IDX(M,0,jdx)]),M,&(delta_ptr[1][0]),1);
-            delta_ptr[0][jdx]*=ann_dact(KERN.hiddens[0].vec[jdx]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #else /*no PBLAS no SBLAS*/
 #ifdef _MPI
@@ -766,8 +711,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx+stream*red]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx+stream*red)]*delta_ptr[1][ix]
             UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-            delta_ptr[0][jdx+stream*red]*=ann_dact(KERN.hiddens[0].vec[jdx+stream*red]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],stream*red,red);
         MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,delta_ptr[0],red,MPI_DOUBLE,MPI_COMM_WORLD);
         if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -775,8 +720,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx+n_streams*red]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx+n_streams*red)]*delta_ptr[1][ix]
                 UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-                delta_ptr[0][jdx+n_streams*red]*=ann_dact(KERN.hiddens[0].vec[jdx+n_streams*red]);
             }
+            ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],n_streams*red,rem);
         }
 #else /*_MPI*/
 #pragma omp parallel for private(jdx,kdx) _NT
@@ -784,8 +729,8 @@ _HT;
 #define OP_WD(ix) delta_ptr[0][jdx]+=KERN.hiddens[1].weights[_2D_IDX(M,ix,jdx)]*delta_ptr[1][ix]
             UNROLL_FOR(0,N,ANN_UNROLL,WD,kdx);
 #undef OP_WD
-            delta_ptr[0][jdx]*=ann_dact(KERN.hiddens[0].vec[jdx]);
         }
+        ann_dact_range(&(KERN.hiddens[0]),delta_ptr[0],0,M);
 #endif /*_MPI*/
 #endif /*PBLAS*/
 #ifdef _MPI
@@ -795,7 +740,7 @@ _HT;
 /*------------------------*/
 /*+++ back-propagation +++*/
 /*------------------------*/
-DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train){
+DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train,DOUBLE *err){
 #define LEARN_RATE 0.01
 #if !defined (PBLAS) && !defined (SBLAS)
     UINT kdx;
@@ -820,8 +765,15 @@ DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train){
     ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
     for(idx=0;idx<KERN.n_hiddens;idx++)
         ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
 /*+++ I - forward is _supposed_ to be done already +++*/
-    Ep=snn_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        /*the error is usually known from the previous step*/
+        if(*err<0.) Ep=snn_kernel_train_error(kernel,train);
+        else Ep=*err;
+    }
 //  NN_DBG(stdout,"TRAINING INITIAL ERROR: %.15f\n",Ep);
 /*+++ II - calculate deltas +++*/
     snn_kernel_train_delta(kernel,train,delta_ptr);
@@ -829,15 +781,18 @@ DOUBLE snn_kernel_train(kernel_ann *kernel,const DOUBLE *train){
 /*^^^ output*/
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
+    /*bias: the ger column of a constant input 1*/
+    ann_bias_train(&(KERN.output),delta_ptr[KERN.n_hiddens],LEARN_RATE);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,KERN.n_hiddens,KERN.output.weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,LEARN_RATE,delta_ptr[KERN.n_hiddens]+stream*red,
     1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.output.weights+stream*M*red,M);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,LEARN_RATE,delta_ptr[KERN.n_hiddens]+n_streams*red,
         1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.output.weights+n_streams*M*red,M);
@@ -855,7 +810,7 @@ _HT;
         M,delta_ptr[KERN.n_hiddens][idx+stream*red]*LEARN_RATE,
         &(KERN.hiddens[KERN.n_hiddens-1].vec[0]),1,&(KERN.output.weights[_2D_IDX(M,idx+stream*red,0)]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx) _NT
         for(idx=0;idx<rem;idx++){
@@ -885,7 +840,7 @@ _HT;
         UNROLL_FOR(0,M,ANN_UNROLL,DH,jdx);
 #undef OP_DH
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx,jdx) _NT
         for(idx=0;idx<rem;idx++){
@@ -912,9 +867,11 @@ _HT;
     for(idx=(KERN.n_hiddens-1);idx>0;idx--){
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
+        ann_bias_train(&(KERN.hiddens[idx]),delta_ptr[idx],LEARN_RATE);
 #ifdef _MPI
         red=N/n_streams;
         rem=N%n_streams;
+        ann_comp_save(kernel,idx,KERN.hiddens[idx].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
@@ -922,7 +879,7 @@ _HT;
         delta_ptr[idx]+stream*red,1,
         KERN.hiddens[idx-1].vec,1,
         KERN.hiddens[idx].weights+stream*M*red,M);
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
             cblas_dger(CblasRowMajor,rem,M,LEARN_RATE,
                 delta_ptr[idx]+n_streams*red,1,
@@ -940,7 +897,7 @@ _HT;
             cblas_daxpy(M,delta_ptr[idx][jdx+stream*red]*LEARN_RATE,
                 &(KERN.hiddens[idx-1].vec[0]),1,&(KERN.hiddens[idx].weights[_2D_IDX(M,jdx+stream*red,0)]),1);
         }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
 #pragma omp parallel for private(jdx) _NT
             for(jdx=0;jdx<rem;jdx++){
@@ -967,7 +924,7 @@ _HT;
             UNROLL_FOR(0,M,ANN_UNROLL,DH,kdx);
 #undef OP_DH
         }
-        MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+        ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
         if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
             for(jdx=0;jdx<rem;jdx++){
@@ -994,14 +951,16 @@ _HT;
     /*add zero*/
     N=KERN.hiddens[0].n_neurons;
     M=KERN.hiddens[0].n_inputs;
+    ann_bias_train(&(KERN.hiddens[0]),delta_ptr[0],LEARN_RATE);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,0,KERN.hiddens[0].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,LEARN_RATE,delta_ptr[0]+stream*red,1,KERN.in,1,KERN.hiddens[0].weights+stream*M*red,M);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,
             LEARN_RATE,delta_ptr[0]+n_streams*red,1,
@@ -1018,7 +977,7 @@ _HT;
     for(jdx=0;jdx<red;jdx++){
         cblas_daxpy(M,LEARN_RATE*delta_ptr[0][jdx+stream*red],KERN.in,1,&(KERN.hiddens[0].weights[_2D_IDX(M,jdx+stream*red,0)]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         for(jdx=0;jdx<rem;jdx++){
             cblas_daxpy(M,LEARN_RATE*delta_ptr[0][jdx+n_streams*red],
@@ -1039,7 +998,7 @@ _HT;
         UNROLL_FOR(0,M,ANN_UNROLL,DI,kdx);
 #undef OP_DI
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -1060,9 +1019,15 @@ _HT;
 #ifdef _MPI
 //  MPI_Barrier(MPI_COMM_WORLD);//WAIT FOR ALL TASKS
 #endif /*_MPI*/
+#ifdef _MPI
+    ann_comp_wait();/*weights are needed again*/
+#endif /*_MPI*/
 /*+++ IV - update error +++*/
     snn_kernel_run(kernel);
-    Epr=snn_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        Epr=snn_kernel_train_error(kernel,train);
+        *err=Epr;
+    }
 //  NN_DBG(stdout,"TRAINING UPDATED ERROR: %.15f\n",Epr);
 /*+++ V - cleanup +++*/
     for(idx=0;idx<(KERN.n_hiddens+1);idx++){
@@ -1075,7 +1040,7 @@ _HT;
 /*---------------------------------*/
 /*+++ momentum back-propagation +++*/
 /*---------------------------------*/
-DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE alpha){
+DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE alpha,DOUBLE *err){
     UINT idx,N,M;
 #ifdef _MPI
     UINT red, rem;
@@ -1099,8 +1064,15 @@ DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
     ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
     for(idx=0;idx<KERN.n_hiddens;idx++)
         ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
 /*+++ I - forward is _supposed_ to be done already +++*/
-    Ep=snn_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        /*the error is usually known from the previous step*/
+        if(*err<0.) Ep=snn_kernel_train_error(kernel,train);
+        else Ep=*err;
+    }
 //  NN_DBG(stdout,"TRAINING INITIAL ERROR: %.15f\n",Ep);
 /*+++ II - calculate deltas +++*/
     snn_kernel_train_delta(kernel,train,delta_ptr);
@@ -1108,9 +1080,12 @@ DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
 /*^^^ output*/
     N=KERN.output.n_neurons;
     M=KERN.output.n_inputs;
+    /*bias: the ger column of a constant input 1*/
+    ann_bias_momentum(&(KERN.output),delta_ptr[KERN.n_hiddens],LEARN_RATE,alpha);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,KERN.n_hiddens,KERN.output.weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
@@ -1118,8 +1093,7 @@ DOUBLE snn_kernel_train_momentum(kernel_ann *kernel,const DOUBLE *train,DOUBLE a
     1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.dw[KERN.n_hiddens]+stream*M*red,M);
     cblas_daxpy(red*M,1.0,KERN.dw[KERN.n_hiddens]+stream*M*red,1,KERN.output.weights+stream*M*red,1);
     cblas_dscal(red*M,alpha,KERN.dw[KERN.n_hiddens]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,LEARN_RATE,delta_ptr[KERN.n_hiddens]+n_streams*red,
         1,KERN.hiddens[KERN.n_hiddens-1].vec,1,KERN.dw[KERN.n_hiddens]+n_streams*M*red,M);
@@ -1147,8 +1121,7 @@ _HT;
         &(KERN.output.weights[_2D_IDX(M,idx+stream*red,0)]),1);
         cblas_dscal(M,alpha,&(KERN.dw[KERN.n_hiddens][(idx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx) _NT
         for(idx=0;idx<rem;idx++){
@@ -1189,8 +1162,7 @@ _HT;
             KERN.dw[KERN.n_hiddens][(idx+stream*red)*M+jdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.output.weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[KERN.n_hiddens],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,KERN.n_hiddens,KERN.output.weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(idx,jdx) _NT
         for(idx=0;idx<rem;idx++){
@@ -1217,23 +1189,24 @@ _HT;
     for(idx=(KERN.n_hiddens-1);idx>0;idx--){
         N=KERN.hiddens[idx].n_neurons;
         M=KERN.hiddens[idx].n_inputs;
+        ann_bias_momentum(&(KERN.hiddens[idx]),delta_ptr[idx],LEARN_RATE,alpha);
 #ifdef _MPI
         red=N/n_streams;
         rem=N%n_streams;
+        ann_comp_save(kernel,idx,KERN.hiddens[idx].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,LEARN_RATE,
         delta_ptr[idx]+stream*red,1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx]+stream*M*red,M);
-    cblas_daxpy(N*M,1.0,KERN.dw[idx]+stream*M*red,1,KERN.hiddens[idx].weights+stream*M*red,1);
-    cblas_dscal(N*M,alpha,KERN.dw[idx]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    cblas_daxpy(red*M,1.0,KERN.dw[idx]+stream*M*red,1,KERN.hiddens[idx].weights+stream*M*red,1);
+    cblas_dscal(red*M,alpha,KERN.dw[idx]+stream*M*red,1);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
-        cblas_dger(CblasRowMajor,red,M,LEARN_RATE,
+        cblas_dger(CblasRowMajor,rem,M,LEARN_RATE,
             delta_ptr[idx]+n_streams*red,1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx]+n_streams*M*red,M);
-        cblas_daxpy(N*M,1.0,KERN.dw[idx]+n_streams*M*red,1,KERN.hiddens[idx].weights+n_streams*M*red,1);
-        cblas_dscal(N*M,alpha,KERN.dw[idx]+n_streams*M*red,1);
+        cblas_daxpy(rem*M,1.0,KERN.dw[idx]+n_streams*M*red,1,KERN.hiddens[idx].weights+n_streams*M*red,1);
+        cblas_dscal(rem*M,alpha,KERN.dw[idx]+n_streams*M*red,1);
     }
 #else /*_MPI*/
     cblas_dger(CblasRowMajor,N,M,LEARN_RATE,delta_ptr[idx],1,KERN.hiddens[idx-1].vec,1,KERN.dw[idx],M);
@@ -1250,8 +1223,7 @@ _HT;
         cblas_daxpy(M,1.0,&(KERN.dw[idx][(jdx+stream*red)*M]),1,&(KERN.hiddens[idx].weights[(jdx+stream*red)*M]),1);
         cblas_dscal(M,alpha,&(KERN.dw[idx][(jdx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -1285,8 +1257,7 @@ _HT;
             KERN.dw[idx][(jdx+stream*red)*M+kdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[idx].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[idx],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,idx,KERN.hiddens[idx].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx,kdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -1313,17 +1284,18 @@ _HT;
     /*add zero*/
     N=KERN.hiddens[0].n_neurons;
     M=KERN.hiddens[0].n_inputs;
+    ann_bias_momentum(&(KERN.hiddens[0]),delta_ptr[0],LEARN_RATE,alpha);
 #ifdef _MPI
     red=N/n_streams;
     rem=N%n_streams;
+    ann_comp_save(kernel,0,KERN.hiddens[0].weights+stream*M*red,M*red);
 #endif /*_MPI*/
 #ifdef PBLAS
 #ifdef _MPI
     cblas_dger(CblasRowMajor,red,M,LEARN_RATE,delta_ptr[0]+stream*red,1,KERN.in,1,KERN.dw[0]+stream*M*red,M);
     cblas_daxpy(red*M,1.0,KERN.dw[0]+stream*M*red,1,KERN.hiddens[0].weights+stream*M*red,1);
     cblas_dscal(red*M,alpha,KERN.dw[0]+stream*M*red,1);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         cblas_dger(CblasRowMajor,rem,M,LEARN_RATE,delta_ptr[0]+n_streams*red,1,KERN.in,1,KERN.dw[0]+n_streams*M*red,M);
         cblas_daxpy(rem*M,1.0,KERN.dw[0]+n_streams*M*red,1,KERN.hiddens[0].weights+n_streams*M*red,1);
@@ -1343,8 +1315,7 @@ _HT;
         cblas_daxpy(M,1.0,&(KERN.dw[0][(jdx+stream*red)*M]),1,&(KERN.hiddens[0].weights[(jdx+stream*red)*M]),1);
         cblas_dscal(M,alpha,&(KERN.dw[0][(jdx+stream*red)*M]),1);
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
         for(jdx=0;jdx<rem;jdx++){
 _HT;
@@ -1375,8 +1346,7 @@ _HT;
             KERN.dw[0][(jdx+stream*red)*M+kdx]*=alpha;
         }
     }
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.hiddens[0].weights,M*red,MPI_DOUBLE,MPI_COMM_WORLD);
-    MPI_Allgather(MPI_IN_PLACE,0,MPI_DATATYPE_NULL,KERN.dw[0],M*red,MPI_DOUBLE,MPI_COMM_WORLD);
+    ann_comp_sync(kernel,0,KERN.hiddens[0].weights,M*red);
     if(rem>0){
 #pragma omp parallel for private(jdx) _NT
         for(jdx=0;jdx<rem;jdx++){
@@ -1398,9 +1368,15 @@ _HT;
     }
 #endif /*_MPI*/
 #endif /*PBLAS*/
+#ifdef _MPI
+    ann_comp_wait();/*weights are needed again*/
+#endif /*_MPI*/
 /*+++ IV - update error +++*/
     snn_kernel_run(kernel);
-    Epr=snn_kernel_train_error(kernel,train);
+    if(err!=NULL){
+        Epr=snn_kernel_train_error(kernel,train);
+        *err=Epr;
+    }
 //  NN_DBG(stdout,"TRAINING UPDATED ERROR: %.15f\n",Epr);
 /*+++ IV - cleanup +++*/
     for(idx=0;idx<(KERN.n_hiddens+1);idx++){
@@ -1414,16 +1390,22 @@ _HT;
 /*--------------------------*/
 /* train SNN sample with BP */
 /*--------------------------*/
-DOUBLE snn_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,DOUBLE delta){
+DOUBLE snn_train_BP(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                    DOUBLE delta,const nn_conv *conv,nn_conv_stats *stats){
 /*typical values delta=0.000001*/
     BOOL is_ok;
     UINT   idx;
     UINT  iter;
     UINT max_p;
     UINT p_trg;
+    DOUBLE  Ep;
     DOUBLE dEp;
     DOUBLE *ptr;
     DOUBLE probe;
+    BOOL is_lazy;
+    UINT n_check;
+    nn_stop stop;
+    ann_conv cv;
 #ifdef _CUDA
     cudastreams *cudas=_NN(return,cudas)();
     DOUBLE *train_gpu;
@@ -1453,12 +1435,21 @@ if(cudas->mem_model==CUDA_MEM_CMM){
     dEp=snn_kernel_train_error(kernel,train_out);
 #endif /*_CUDA*/
     NN_COUT(stdout," init=%15.10f",dEp);
+    Ep=dEp;
+    ann_conv_init(&cv,Ep);
+    stop=NN_STOP_NONE;
+    n_check=((conv!=NULL)&&(conv->n_check>1))?conv->n_check:1;
+    is_ok=FALSE;
     iter=0;
     if(delta <= 0.) delta = DELTA_BP;/*default*/
     do{
         iter++;
+        /*error and answer are only checked every n_check iterations*/
+        is_lazy=(iter>1)&&((iter%n_check)!=0);
 #ifdef _CUDA
         dEp=(DOUBLE)scuda_snn_train(kernel,train_gpu,_NN(return,cudas)());
+        Ep-=dEp;/*dEp is the error decrease of this iteration*/
+        if(is_lazy) continue;/*no output copy*/
 if(cudas->mem_model!=CUDA_MEM_CMM){
         /*we have to sync output.cuda_v -> out*/
         CUDA_SET_DEV(*cudas,0);/*make sure transfer happen from GPU[0]*/
@@ -1471,7 +1462,12 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
         ptr=kernel->output.vec;
 }
 #else /*_CUDA*/
-        dEp=snn_kernel_train(kernel,train_out);
+        if(is_lazy){
+            snn_kernel_train(kernel,train_out,NULL);
+            Ep=-1.;/*unknown*/
+            continue;
+        }
+        dEp=snn_kernel_train(kernel,train_out,&Ep);
         ptr=kernel->output.vec;
 #endif /*_CUDA*/
         /*determine if we get a good answer at first try*/
@@ -1482,7 +1478,7 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
                 probe=ptr[idx];
                 max_p=idx;
             }
-            if(train_out[idx]==1.0) p_trg=idx;
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
         }
         /*2- match*/
         is_ok=(max_p==p_trg);
@@ -1490,9 +1486,13 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
             if(is_ok==TRUE) NN_COUT(stdout," OK");
             else NN_COUT(stdout," NO");
         }
-        if(iter>MAX_BP_ITER) break;/*do at most MAX iterations*/
+        /*3- budgets (only while not converged)*/
+        if((dEp>DELTA_BP)||(is_ok!=TRUE)||(iter<=MIN_BP_ITER))
+            stop=ann_conv_stop(conv,&cv,iter,MAX_BP_ITER,Ep);
+        if(stop!=NN_STOP_NONE) break;/*budget exhausted*/
         is_ok&=(iter>MIN_BP_ITER);/*do at least MIN iterations*/
     }while((dEp > DELTA_BP)||(!(is_ok==TRUE)));
+    ann_conv_done(stats,&cv,iter,stop);
     NN_COUT(stdout," N_ITER=%8i",iter);
     NN_COUT(stdout," final=%15.10f\n",dEp);
     fflush(stdout);
@@ -1504,16 +1504,23 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
 /*---------------------------*/
 /* train SNN sample with BPM */
 /*---------------------------*/
-DOUBLE snn_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,DOUBLE alpha,DOUBLE delta){
+DOUBLE snn_train_BPM(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                     DOUBLE alpha,DOUBLE delta,const nn_conv *conv,
+                     nn_conv_stats *stats){
 /*typical values alpha=0.2 delta=0.00001*/
     BOOL is_ok;
     UINT   idx;
     UINT  iter;
     UINT max_p;
     UINT p_trg;
+    DOUBLE  Ep;
     DOUBLE dEp;
     DOUBLE *ptr;
     DOUBLE probe;
+    BOOL is_lazy;
+    UINT n_check;
+    nn_stop stop;
+    ann_conv cv;
     ann_raz_momentum(kernel);
 #ifdef _CUDA
     cudastreams *cudas=_NN(return,cudas)();
@@ -1544,12 +1551,21 @@ if(cudas->mem_model==CUDA_MEM_CMM){
     dEp=snn_kernel_train_error(kernel,train_out);
 #endif /*_CUDA*/
     NN_COUT(stdout," init=%15.10f",dEp);
+    Ep=dEp;
+    ann_conv_init(&cv,Ep);
+    stop=NN_STOP_NONE;
+    n_check=((conv!=NULL)&&(conv->n_check>1))?conv->n_check:1;
+    is_ok=FALSE;
     iter=0;
     if(delta <= 0.) delta = DELTA_BPM;/*default*/
     do{
         iter++;
+        /*error and answer are only checked every n_check iterations*/
+        is_lazy=(iter>1)&&((iter%n_check)!=0);
 #ifdef _CUDA
         dEp=(DOUBLE)scuda_snn_train_momentum(kernel,train_gpu,alpha,_NN(return,cudas)());
+        Ep-=dEp;/*dEp is the error decrease of this iteration*/
+        if(is_lazy) continue;/*no output copy*/
 if(cudas->mem_model!=CUDA_MEM_CMM){
         /*we have to sync output.cuda_v -> out*/
         CUDA_SET_DEV(*cudas,0);/*make sure transfer happen from GPU[0]*/
@@ -1561,7 +1577,12 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
         ptr=kernel->output.vec;
 }
 #else /*_CUDA*/
-        dEp=snn_kernel_train_momentum(kernel,train_out,alpha);
+        if(is_lazy){
+            snn_kernel_train_momentum(kernel,train_out,alpha,NULL);
+            Ep=-1.;/*unknown*/
+            continue;
+        }
+        dEp=snn_kernel_train_momentum(kernel,train_out,alpha,&Ep);
         ptr=kernel->output.vec;
 #endif /*_CUDA*/
         /*1- determine max_p, p_trg*/
@@ -1571,7 +1592,7 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
                 probe = ptr[idx];
                 max_p = idx;
             }
-            if(train_out[idx]==1.0) p_trg = idx;
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
         }
         /*2- match*/
         is_ok=(max_p == p_trg);
@@ -1580,9 +1601,13 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
             if(is_ok==TRUE) NN_COUT(stdout," OK");
             else NN_COUT(stdout," NO");
         }
-        if(iter>MAX_BPM_ITER) break;/*do at most MAX iterations*/
+        /*3- budgets (only while not converged)*/
+        if((dEp>delta)||(is_ok!=TRUE)||(iter<=MIN_BPM_ITER))
+            stop=ann_conv_stop(conv,&cv,iter,MAX_BPM_ITER,Ep);
+        if(stop!=NN_STOP_NONE) break;/*budget exhausted*/
         is_ok&=(iter>MIN_BPM_ITER);/*do at least MIN iterations*/
     }while((dEp > delta)||(!(is_ok==TRUE)));
+    ann_conv_done(stats,&cv,iter,stop);
     NN_COUT(stdout," N_ITER=%8i",iter);
     NN_COUT(stdout," final=%15.10f",dEp);
     if(is_ok==TRUE) NN_COUT(stdout," SUCCESS!\n");
@@ -1593,5 +1618,173 @@ if(cudas->mem_model!=CUDA_MEM_CMM){
 #endif /*_CUDA*/
     return dEp;
 }
+#ifndef _CUDA
+/*-------------------------------*/
+/*+++ ADAM / RMSPROP training +++*/
+/*-------------------------------*/
+/*^^^ same as ann_kernel_train_adapt, with the SNN error and deltas*/
+DOUBLE snn_kernel_train_adapt(kernel_ann *kernel,const DOUBLE *train,
+                              nn_train rule){
+    DOUBLE **delta_ptr;
+    DOUBLE Ep,Epr;
+    UINT idx;
+    UINT64 allocate=0.;
+    ALLOC_REPORT(delta_ptr,KERN.n_hiddens+1,DOUBLE *,allocate);/*+1 for OUTPUT*/
+    ALLOC_REPORT(delta_ptr[KERN.n_hiddens],KERN.n_outputs,DOUBLE,allocate);
+    for(idx=0;idx<KERN.n_hiddens;idx++)
+        ALLOC_REPORT(delta_ptr[idx],KERN.hiddens[idx].n_neurons,DOUBLE,allocate);
+    /*weights are going to change*/
+    ann_kernel_inc_reset(kernel);
+    ann_lowrank_drop(kernel);
+/*+++ I - forward is _supposed_ to be done already +++*/
+    Ep=snn_kernel_train_error(kernel,train);
+/*+++ II - calculate deltas +++*/
+    snn_kernel_train_delta(kernel,train,delta_ptr);
+/*+++ III - fused update +++*/
+    ann_adapt_update(kernel,delta_ptr,rule);
+/*+++ IV - update error +++*/
+    snn_kernel_run(kernel);
+    Epr=snn_kernel_train_error(kernel,train);
+/*+++ V - cleanup +++*/
+    for(idx=0;idx<(KERN.n_hiddens+1);idx++) FREE(delta_ptr[idx]);
+    FREE(delta_ptr);
+    return Ep-Epr;
+}
+/*---------------------------------------*/
+/* train SNN sample with ADAM or RMSPROP */
+/*---------------------------------------*/
+DOUBLE snn_train_adapt(kernel_ann *kernel,DOUBLE *train_in,DOUBLE *train_out,
+                       nn_train rule,DOUBLE delta){
+    BOOL is_ok;
+    UINT   idx;
+    UINT  iter;
+    UINT max_p;
+    UINT p_trg;
+    DOUBLE dEp;
+    DOUBLE probe;
+    /*copy input*/
+    ARRAY_CP(train_in,KERN.in,KERN.n_inputs);
+    snn_kernel_run(kernel);/*also FILL vec*/
+    dEp=snn_kernel_train_error(kernel,train_out);
+    NN_COUT(stdout," init=%15.10f",dEp);
+    iter=0;
+    if(delta <= 0.) delta = DELTA_ADAPT;/*default*/
+    do{
+        iter++;
+        dEp=snn_kernel_train_adapt(kernel,train_out,rule);
+        /*1- determine max_p, p_trg*/
+        probe=-1.0;max_p=0;p_trg=0;
+        for(idx=0;idx<KERN.n_outputs;idx++){
+            if(probe < KERN.output.vec[idx]){
+                probe = KERN.output.vec[idx];
+                max_p = idx;
+            }
+            if(train_out[idx]>train_out[p_trg]) p_trg=idx;
+        }
+        /*2- match*/
+        is_ok=(max_p == p_trg);
+        if(iter==1){
+            /*determine if we get a good answer at first try*/
+            if(is_ok==TRUE) NN_COUT(stdout," OK");
+            else NN_COUT(stdout," NO");
+        }
+        if(iter>MAX_ADAPT_ITER) break;/*do at most MAX iterations*/
+        is_ok&=(iter>MIN_ADAPT_ITER);/*do at least MIN iterations*/
+    }while((dEp > delta)||(!(is_ok==TRUE)));
+    NN_COUT(stdout," N_ITER=%8i",iter);
+    NN_COUT(stdout," final=%15.10f",dEp);
+    if(is_ok==TRUE) NN_COUT(stdout," SUCCESS!\n");
+    else NN_COUT(stdout," FAIL!\n");
+    fflush(stdout);
+    return dEp;
+}
+/*^^^ train the kernel with CG on n samples (n=1: one sample)*/
+DOUBLE snn_train_CG(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta){
+    ann_cg_ops ops;
+    DOUBLE dEp=0.;
+    UINT n_iter,n_grad,idx;
+    ops.run=snn_kernel_run;
+    ops.error=snn_kernel_train_error;
+    ops.delta=snn_kernel_train_delta;
+    for(idx=0;idx<n;idx++){
+        ARRAY_CP(train_in[idx],KERN.in,KERN.n_inputs);
+        snn_kernel_run(kernel);
+        dEp+=snn_kernel_train_error(kernel,train_out[idx]);
+    }
+    NN_COUT(stdout," init=%15.10f",dEp);
+    dEp=ann_cg_minimize(kernel,&ops,n,train_in,train_out,delta,
+        &n_iter,&n_grad);
+    NN_COUT(stdout," N_ITER=%8i N_GRAD=%8i",n_iter,n_grad);
+    NN_COUT(stdout," final=%15.10f\n",dEp);
+    fflush(stdout);
+    return dEp;
+}
+/*^^^ train the kernel with LM on n samples (n=1: one sample)*/
+DOUBLE snn_train_LM(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                    DOUBLE **train_out,DOUBLE delta){
+    ann_cg_ops ops;
+    DOUBLE dEp=0.;
+    UINT n_iter,n_jac,idx;
+    ops.run=snn_kernel_run;
+    ops.error=snn_kernel_train_error;
+    ops.delta=snn_kernel_train_delta;
+    for(idx=0;idx<n;idx++){
+        ARRAY_CP(train_in[idx],KERN.in,KERN.n_inputs);
+        snn_kernel_run(kernel);
+        dEp+=snn_kernel_train_error(kernel,train_out[idx]);
+    }
+    NN_COUT(stdout," init=%15.10f",dEp);
+    dEp=ann_lm_minimize(kernel,&ops,n,train_in,train_out,delta,
+        &n_iter,&n_jac);
+    NN_COUT(stdout," N_ITER=%8i N_JAC=%8i",n_iter,n_jac);
+    NN_COUT(stdout," final=%15.10f\n",dEp);
+    fflush(stdout);
+    return dEp;
+}
+/*^^^ train the kernel with SPLX on n samples (n=1: one sample)*/
+DOUBLE snn_train_SPLX(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                      DOUBLE **train_out,DOUBLE delta){
+    DOUBLE res,f_init;
+    UINT n_iter,n_eval;
+    res=ann_splx_minimize(kernel,TRUE,n,train_in,train_out,delta,
+        &f_init,&n_iter,&n_eval);
+    NN_COUT(stdout," init=%15.10f",f_init);
+    NN_COUT(stdout," N_ITER=%8i N_EVAL=%8i",n_iter,n_eval);
+    NN_COUT(stdout," final=%15.10f\n",res);
+    fflush(stdout);
+    return res;
+}
+/*^^^ train the kernel with BP on n samples, in parallel (hogwild)*/
+DOUBLE snn_train_hogwild(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                         DOUBLE **train_out,DOUBLE delta){
+    DOUBLE res;
+    UINT n_iter,n_ok;
+    /*same rate as snn_kernel_train*/
+    res=ann_hogwild_train(kernel,TRUE,LEARN_RATE,n,train_in,train_out,
+        delta,&n_iter,&n_ok);
+    NN_COUT(stdout," N_OK=%5i/%5i N_ITER=%10i",n_ok,n,n_iter);
+    NN_COUT(stdout," final=%15.10f\n",res/(DOUBLE)n);
+    fflush(stdout);
+    return res;
+}
+/*^^^ train the kernel with BP on n samples, with local SGD*/
+DOUBLE snn_train_local(kernel_ann *kernel,UINT n,DOUBLE **train_in,
+                       DOUBLE **train_out,DOUBLE delta,UINT *k,BOOL adapt){
+    DOUBLE res;
+    UINT n_iter,n_ok,n_avg;
+    /*same rate as snn_kernel_train*/
+    res=ann_local_train(kernel,TRUE,LEARN_RATE,n,train_in,train_out,
+        delta,k,adapt,&n_iter,&n_ok,&n_avg);
+    /*vec follows the averaged weights (on the last sample)*/
+    if(n>0) ARRAY_CP(train_in[n-1],KERN.in,KERN.n_inputs);
+    snn_kernel_run(kernel);
+    NN_COUT(stdout," N_AVG=%5i K=%4i",n_avg,*k);
+    NN_COUT(stdout," N_OK=%5i/%5i N_ITER=%10i",n_ok,n,n_iter);
+    NN_COUT(stdout," final=%15.10f\n",res/(DOUBLE)n);
+    fflush(stdout);
+    return res;
+}
+#endif /*_CUDA*/
 
 #undef KERN
@@ -0,0 +1,400 @@
+/*
++++ libhpnn - High Performance Neural Network library - file: sparse.c +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This file is part of libhpnn.
+
+    libhpnn is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libhpnn is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+/*^^^ OMP specific*/
+#ifdef _OMP
+#include <omp.h>
+#endif
+/*link to the main library*/
+#include <libhpnn.h>
+#include <libhpnn/ann.h>
+#include <libhpnn/sparse.h>
+/*----------------------*/
+/*+++ useful defines +++*/
+/*----------------------*/
+/*^^^ OMP specific*/
+#ifdef _OMP
+#define _NT num_threads(_NN(return,omp_threads)())
+#else
+#define _NT
+#endif
+/*make life easier*/
+#define SPRS (*sparse)
+#define SPARSE_PAD(n,b) ((((n)+(b)-1)/(b))*(b))
+/* Sparse kernels are meant for inference of pruned kernels, they are not
+ * trained.  Each MPI task runs the whole kernel: the rows of a pruned layer
+ * are usually too cheap to be worth an Allgather.*/
+/*------------------------------*/
+/*+++ dense to sparse kernel +++*/
+/*------------------------------*/
+/*^^^ private: is any weight of w[col..col+block[ above threshold*/
+static BOOL sparse_keep(const DOUBLE *w,UINT col,UINT M,
+                        UINT block,DOUBLE threshold){
+    UINT idx;
+    for(idx=col;(idx<col+block)&&(idx<M);idx++)
+        if(fabs(w[idx])>threshold) return TRUE;
+    return FALSE;
+}
+/*^^^ private: convert a dense N x M layer, weights below threshold are
+ * dropped (and zeroed inside a kept block), biases are kept as is.*/
+static void sparse_layer_convert(layer_sparse *ls,const layer_ann *lay,
+    DOUBLE threshold,UINT block){
+    UINT N=lay->n_neurons,M=lay->n_inputs;
+    const DOUBLE *w=lay->weights;
+    UINT idx,jdx,kdx,n_blk;
+    ls->n_neurons=N;
+    ls->n_inputs=M;
+    ls->act=lay->act;
+    if(lay->bias!=NULL){
+        ALLOC(ls->bias,N,DOUBLE);
+        memcpy(ls->bias,lay->bias,N*sizeof(DOUBLE));
+    }
+    ALLOC(ls->row_ptr,N+1,UINT);
+    /*1st pass: count blocks*/
+    n_blk=0;
+    for(idx=0;idx<N;idx++){
+        ls->row_ptr[idx]=n_blk;
+        for(jdx=0;jdx<M;jdx+=block)
+            if(sparse_keep(&(w[_2D_IDX(M,idx,0)]),jdx,M,block,threshold))
+                n_blk++;
+    }
+    ls->row_ptr[N]=n_blk;
+    ls->n_blk=n_blk;
+    ALLOC(ls->vec,SPARSE_PAD(N,block),DOUBLE);
+    if(n_blk==0) return;/*fully pruned layer*/
+    /*2nd pass: fill*/
+    ALLOC(ls->col_idx,n_blk,UINT);
+    ALLOC(ls->val,n_blk*block,DOUBLE);
+    n_blk=0;
+    for(idx=0;idx<N;idx++){
+        for(jdx=0;jdx<M;jdx+=block){
+            if(!sparse_keep(&(w[_2D_IDX(M,idx,0)]),jdx,M,block,threshold))
+                continue;
+            ls->col_idx[n_blk]=jdx;
+            for(kdx=jdx;(kdx<jdx+block)&&(kdx<M);kdx++)
+                if(fabs(w[_2D_IDX(M,idx,kdx)])>threshold)
+                    ls->val[n_blk*block+kdx-jdx]=w[_2D_IDX(M,idx,kdx)];
+            n_blk++;
+        }
+    }
+}
+/*^^^ convert a dense kernel into a sparse one (block=1 for CSR), keeping
+ * only weights w with |w| > threshold.*/
+kernel_sparse *sparse_convert(kernel_ann *kernel,DOUBLE threshold,UINT block){
+    kernel_sparse *sparse;
+    kernel_ann *cpu;
+    UINT idx;
+    if((kernel==NULL)||(block==0)) return NULL;
+#ifdef _CUDA
+    /*weights may only be available on GPU*/
+    cpu=ann_kernel_stage(kernel,NULL);
+    if(cpu==NULL) return NULL;
+#else  /*_CUDA*/
+    cpu=kernel;
+#endif /*_CUDA*/
+    ALLOC(sparse,1,kernel_sparse);
+    if(cpu->name!=NULL) STRDUP(cpu->name,SPRS.name);
+    SPRS.block=block;
+    SPRS.n_inputs=cpu->n_inputs;
+    SPRS.n_hiddens=cpu->n_hiddens;
+    SPRS.n_outputs=cpu->n_outputs;
+    ALLOC(SPRS.in,SPARSE_PAD(SPRS.n_inputs,block),DOUBLE);
+    ALLOC(SPRS.hiddens,SPRS.n_hiddens,layer_sparse);
+    for(idx=0;idx<SPRS.n_hiddens;idx++)
+        sparse_layer_convert(&(SPRS.hiddens[idx]),&(cpu->hiddens[idx]),
+            threshold,block);
+    sparse_layer_convert(&(SPRS.output),&(cpu->output),threshold,block);
+#ifdef _CUDA
+    ann_stage_free(cpu);
+#endif /*_CUDA*/
+    return sparse;
+}
+static void sparse_layer_free(layer_sparse *ls){
+    FREE(ls->row_ptr);
+    FREE(ls->col_idx);
+    FREE(ls->val);
+    FREE(ls->vec);
+    FREE(ls->bias);
+    ls->n_blk=0;
+}
+void sparse_free(kernel_sparse *sparse){
+    UINT idx;
+    if(sparse==NULL) return;
+    FREE(SPRS.name);
+    FREE(SPRS.in);
+    if(SPRS.hiddens!=NULL){
+        for(idx=0;idx<SPRS.n_hiddens;idx++)
+            sparse_layer_free(&(SPRS.hiddens[idx]));
+        FREE(SPRS.hiddens);
+    }
+    sparse_layer_free(&(SPRS.output));
+    FREE(sparse);
+}
+/*^^^ fraction of the dense weights that are stored*/
+DOUBLE sparse_density(kernel_sparse *sparse){
+    UINT64 n_dense=0,n_stored=0;
+    UINT idx;
+    if(sparse==NULL) return 0.;
+    for(idx=0;idx<SPRS.n_hiddens;idx++){
+        n_dense+=(UINT64)SPRS.hiddens[idx].n_neurons*SPRS.hiddens[idx].n_inputs;
+        n_stored+=(UINT64)SPRS.hiddens[idx].n_blk*SPRS.block;
+    }
+    n_dense+=(UINT64)SPRS.output.n_neurons*SPRS.output.n_inputs;
+    n_stored+=(UINT64)SPRS.output.n_blk*SPRS.block;
+    if(n_dense==0) return 0.;
+    return (DOUBLE)n_stored/(DOUBLE)n_dense;
+}
+/*--------------------------*/
+/*+++ binary sparse file +++*/
+/*--------------------------*/
+/* file: SPARSE_MAGIC, then UINT endian,block,n_inputs,n_hiddens,n_outputs,
+ * name length, followed by the name; then for each layer (hiddens, output)
+ * UINT n_neurons,n_inputs,n_blk,act,has_bias, the n_neurons biases (if any),
+ * row_ptr, col_idx and val arrays.  Data is written in native byte order,
+ * which SPARSE_ENDIAN allows to check.*/
+static BOOL sparse_layer_write(FILE *out,layer_sparse *ls,UINT block){
+    UINT dim[5];
+    dim[0]=ls->n_neurons;
+    dim[1]=ls->n_inputs;
+    dim[2]=ls->n_blk;
+    dim[3]=(UINT)ls->act;
+    dim[4]=(ls->bias!=NULL);
+    if(fwrite(dim,sizeof(UINT),5,out)!=5) return FALSE;
+    if(dim[4]&&(fwrite(ls->bias,sizeof(DOUBLE),dim[0],out)!=dim[0]))
+        return FALSE;
+    if(fwrite(ls->row_ptr,sizeof(UINT),dim[0]+1,out)!=dim[0]+1) return FALSE;
+    if(dim[2]==0) return TRUE;
+    if(fwrite(ls->col_idx,sizeof(UINT),dim[2],out)!=dim[2]) return FALSE;
+    if(fwrite(ls->val,sizeof(DOUBLE),(size_t)dim[2]*block,out)
+        !=(size_t)dim[2]*block) return FALSE;
+    return TRUE;
+}
+BOOL sparse_dump(kernel_sparse *sparse,const CHAR *filename){
+#define FAIL sparse_dump_fail
+    FILE *out;
+    UINT head[6];
+    UINT idx;
+    if((sparse==NULL)||(filename==NULL)) return FALSE;
+    out=fopen(filename,"wb");
+    if(out==NULL){
+        NN_ERROR(stderr,"can't open %s for writing!\n",filename);
+        return FALSE;
+    }
+    head[0]=SPARSE_ENDIAN;
+    head[1]=SPRS.block;
+    head[2]=SPRS.n_inputs;
+    head[3]=SPRS.n_hiddens;
+    head[4]=SPRS.n_outputs;
+    head[5]=(SPRS.name==NULL)?0:strlen(SPRS.name);
+    if(fwrite(SPARSE_MAGIC,sizeof(CHAR),8,out)!=8) goto FAIL;
+    if(fwrite(head,sizeof(UINT),6,out)!=6) goto FAIL;
+    if((head[5]>0)&&(fwrite(SPRS.name,sizeof(CHAR),head[5],out)!=head[5]))
+        goto FAIL;
+    for(idx=0;idx<SPRS.n_hiddens;idx++)
+        if(!sparse_layer_write(out,&(SPRS.hiddens[idx]),SPRS.block))
+            goto FAIL;
+    if(!sparse_layer_write(out,&(SPRS.output),SPRS.block)) goto FAIL;
+    if(fclose(out)!=0){
+        NN_ERROR(stderr,"write error on %s!\n",filename);
+        return FALSE;
+    }
+    return TRUE;
+sparse_dump_fail:
+    NN_ERROR(stderr,"write error on %s!\n",filename);
+    fclose(out);
+    return FALSE;
+#undef FAIL
+}
+/*^^^ private: read a layer of N x M weights and check its structure.*/
+static BOOL sparse_layer_read(FILE *fp,layer_sparse *ls,
+                              UINT N,UINT M,UINT block){
+    UINT dim[5];
+    UINT idx;
+    if(fread(dim,sizeof(UINT),5,fp)!=5) return FALSE;
+    if((dim[0]!=N)||(dim[1]!=M)) return FALSE;
+    if(dim[3]>(UINT)ANN_ACT_HTANH) return FALSE;
+    if(dim[4]>1) return FALSE;
+    ls->n_neurons=N;
+    ls->n_inputs=M;
+    ls->n_blk=dim[2];
+    ls->act=(ann_act_type)dim[3];
+    if(dim[4]){
+        ALLOC(ls->bias,N,DOUBLE);
+        if(fread(ls->bias,sizeof(DOUBLE),N,fp)!=N) return FALSE;
+    }
+    ALLOC(ls->row_ptr,N+1,UINT);
+    ALLOC(ls->vec,SPARSE_PAD(N,block),DOUBLE);
+    if(fread(ls->row_ptr,sizeof(UINT),N+1,fp)!=N+1) return FALSE;
+    if((ls->row_ptr[0]!=0)||(ls->row_ptr[N]!=ls->n_blk)) return FALSE;
+    for(idx=0;idx<N;idx++)
+        if(ls->row_ptr[idx]>ls->row_ptr[idx+1]) return FALSE;
+    if(ls->n_blk==0) return TRUE;
+    ALLOC(ls->col_idx,ls->n_blk,UINT);
+    ALLOC(ls->val,(size_t)ls->n_blk*block,DOUBLE);
+    if(fread(ls->col_idx,sizeof(UINT),ls->n_blk,fp)!=ls->n_blk) return FALSE;
+    for(idx=0;idx<ls->n_blk;idx++)
+        if((ls->col_idx[idx]>=M)||(ls->col_idx[idx]%block)) return FALSE;
+    if(fread(ls->val,sizeof(DOUBLE),(size_t)ls->n_blk*block,fp)
+        !=(size_t)ls->n_blk*block) return FALSE;
+    return TRUE;
+}
+kernel_sparse *sparse_load(const CHAR *filename){
+#define FAIL sparse_load_fail
+    kernel_sparse *sparse=NULL;
+    CHAR magic[8];
+    UINT head[6];
+    UINT idx,M;
+    FILE *fp;
+    if(filename==NULL) return NULL;
+    fp=fopen(filename,"rb");
+    if(fp==NULL){
+        NN_ERROR(stderr,"can't open %s for reading!\n",filename);
+        return NULL;
+    }
+    if(fread(magic,sizeof(CHAR),8,fp)!=8) goto FAIL;
+    if(memcmp(magic,SPARSE_MAGIC,8)!=0) goto FAIL;
+    if(fread(head,sizeof(UINT),6,fp)!=6) goto FAIL;
+    if(head[0]!=SPARSE_ENDIAN){
+        NN_ERROR(stderr,"sparse kernel %s: wrong endianness!\n",filename);
+        fclose(fp);
+        return NULL;
+    }
+    if((head[1]==0)||(head[2]==0)||(head[3]==0)||(head[4]==0)) goto FAIL;
+    ALLOC(sparse,1,kernel_sparse);
+    SPRS.block=head[1];
+    SPRS.n_inputs=head[2];
+    SPRS.n_hiddens=head[3];
+    SPRS.n_outputs=head[4];
+    if(head[5]>0){
+        ALLOC(SPRS.name,head[5]+1,CHAR);
+        if(fread(SPRS.name,sizeof(CHAR),head[5],fp)!=head[5]) goto FAIL;
+    }
+    ALLOC(SPRS.in,SPARSE_PAD(SPRS.n_inputs,SPRS.block),DOUBLE);
+    ALLOC(SPRS.hiddens,SPRS.n_hiddens,layer_sparse);
+    M=SPRS.n_inputs;
+    for(idx=0;idx<SPRS.n_hiddens;idx++){
+        /*hidden layer size is only known from the file*/
+        if(fread(head,sizeof(UINT),1,fp)!=1) goto FAIL;
+        if(fseek(fp,-(long)sizeof(UINT),SEEK_CUR)!=0) goto FAIL;
+        if(head[0]==0) goto FAIL;
+        if(!sparse_layer_read(fp,&(SPRS.hiddens[idx]),head[0],M,
+            SPRS.block)) goto FAIL;
+        M=head[0];
+    }
+    if(!sparse_layer_read(fp,&(SPRS.output),SPRS.n_outputs,M,
+        SPRS.block)) goto FAIL;
+    fclose(fp);
+    return sparse;
+sparse_load_fail:
+    NN_ERROR(stderr,"sparse kernel %s: read failed!\n",filename);
+    fclose(fp);
+    sparse_free(sparse);
+    return NULL;
+#undef FAIL
+}
+/*------------------------*/
+/*+++ feed-forward run +++*/
+/*------------------------*/
+/*^^^ private: one row of a layer, x being its (padded) input*/
+static DOUBLE sparse_row(const layer_sparse *ls,UINT block,
+                         UINT row,const DOUBLE *x){
+    const DOUBLE *v;
+    const DOUBLE *xx;
+    DOUBLE acc=0.;
+    DOUBLE lane[8]={0.,0.,0.,0.,0.,0.,0.,0.};
+    UINT kdx,bdx;
+    switch(block){
+    case 1:
+        for(kdx=ls->row_ptr[row];kdx<ls->row_ptr[row+1];kdx++)
+            acc+=ls->val[kdx]*x[ls->col_idx[kdx]];
+        break;
+    case 4:
+        /*fixed size blocks: one partial sum per lane (vectorized)*/
+        for(kdx=ls->row_ptr[row];kdx<ls->row_ptr[row+1];kdx++){
+            v=&(ls->val[kdx*4]);
+            xx=&(x[ls->col_idx[kdx]]);
+            for(bdx=0;bdx<4;bdx++) lane[bdx]+=v[bdx]*xx[bdx];
+        }
+        acc=(lane[0]+lane[1])+(lane[2]+lane[3]);
+        break;
+    case 8:
+        for(kdx=ls->row_ptr[row];kdx<ls->row_ptr[row+1];kdx++){
+            v=&(ls->val[kdx*8]);
+            xx=&(x[ls->col_idx[kdx]]);
+            for(bdx=0;bdx<8;bdx++) lane[bdx]+=v[bdx]*xx[bdx];
+        }
+        acc=((lane[0]+lane[1])+(lane[2]+lane[3]))
+           +((lane[4]+lane[5])+(lane[6]+lane[7]));
+        break;
+    default:
+        for(kdx=ls->row_ptr[row];kdx<ls->row_ptr[row+1];kdx++){
+            v=&(ls->val[kdx*block]);
+            xx=&(x[ls->col_idx[kdx]]);
+            for(bdx=0;bdx<block;bdx++) acc+=v[bdx]*xx[bdx];
+        }
+    }
+    return acc;
+}
+static void sparse_layer_run(layer_sparse *ls,UINT block,const DOUBLE *x){
+    UINT jdx;
+#pragma omp parallel for private(jdx) _NT
+    for(jdx=0;jdx<ls->n_neurons;jdx++)
+        ls->vec[jdx]=ANN_BIAS(ls,jdx)+sparse_row(ls,block,jdx,x);
+    ann_act_vec(ls->act,ls->vec,ls->n_neurons);
+}
+static void sparse_run_hiddens(kernel_sparse *sparse){
+    UINT idx;
+    sparse_layer_run(&(SPRS.hiddens[0]),SPRS.block,SPRS.in);
+    for(idx=1;idx<SPRS.n_hiddens;idx++)
+        sparse_layer_run(&(SPRS.hiddens[idx]),SPRS.block,
+            SPRS.hiddens[idx-1].vec);
+}
+/*^^^ same as ann_kernel_run*/
+void sparse_ann_run(kernel_sparse *sparse){
+    if(sparse==NULL) return;
+    sparse_run_hiddens(sparse);
+    sparse_layer_run(&(SPRS.output),SPRS.block,
+        SPRS.hiddens[SPRS.n_hiddens-1].vec);
+}
+/*^^^ same as snn_kernel_run (softmax output)*/
+void sparse_snn_run(kernel_sparse *sparse){
+    DOUBLE *x;
+    DOUBLE dv;
+    UINT jdx,N;
+    if(sparse==NULL) return;
+    sparse_run_hiddens(sparse);
+    N=SPRS.output.n_neurons;
+    x=SPRS.hiddens[SPRS.n_hiddens-1].vec;
+    dv=TINY;
+#pragma omp parallel for private(jdx) reduction(+:dv) _NT
+    for(jdx=0;jdx<N;jdx++){
+        SPRS.output.vec[jdx]=exp(ANN_BIAS(&(SPRS.output),jdx)+
+            sparse_row(&(SPRS.output),SPRS.block,jdx,x)-1.0);
+        dv+=SPRS.output.vec[jdx];
+    }
+#define OP_SX(ix) SPRS.output.vec[ix]/=dv
+    UNROLL_OMP_FOR(0,N,ANN_UNROLL,SX,jdx);
+#undef OP_SX
+}
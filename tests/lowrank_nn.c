@@ -0,0 +1,266 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - lowrank_nn test application +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Artificial Neuron Network low-rank layers.     */
+/* --------------- Hubert Okadome Valencia, 2019 */
+
+#include "nn_tools.h"
+
+void dump_help(){
+    _OUT(stdout,"*************************************\n");
+    _OUT(stdout,"usage:  lowrank_nn [-options] [input]\n");
+    _OUT(stdout,"*************************************\n");
+    _OUT(stdout,"options:\n");
+    _OUT(stdout,"-h \tdisplay this help;\n");
+    _OUT(stdout,"-v \tincrease verbosity;\n");
+    _OUT(stdout,"-l \tlayer to factorize (all);\n");
+    _OUT(stdout,"-e \tenergy to keep (0.99);\n");
+    _OUT(stdout,"-r \tmaximum rank (none);\n");
+    _OUT(stdout,"-t \ttimed passes over tests (10).\n");
+#ifdef _OMP
+    _OUT(stdout,"-O \tnumber of openMP threads.\n");
+    _OUT(stdout,"-B \tnumber of BLAS threads (MKL).\n");
+#endif
+    _OUT(stdout,"*************************************\n");
+    _OUT(stdout,"input:       neural network .def file\n");
+    _OUT(stdout,"contains the network definition and\n");
+    _OUT(stdout,"the (trained) kernel to factorize.\n");
+    _OUT(stdout,"Each layer weights W are replaced by\n");
+    _OUT(stdout,"a truncated SVD U.V which keeps the\n");
+    _OUT(stdout,"energy fraction of |W|^2. Layer -l\n");
+    _OUT(stdout,"is 0 for the 1st hidden layer, and\n");
+    _OUT(stdout,"the number of hidden layers for the\n");
+    _OUT(stdout,"output. Result is in kernel.lowrank\n");
+    _OUT(stdout,"The tests are run -t times through\n");
+    _OUT(stdout,"the original and factorized kernels\n");
+    _OUT(stdout,"to compare their accuracy and time.\n");
+    _OUT(stdout,"*************************************\n");
+    _OUT(stdout,"Code released 'as is' within GPLv3.\n");
+    _OUT(stdout,"here: https://github.com/ovhpa/hpnn\n");
+    _OUT(stdout,"- project started 2019~   -- OVHPA.\n");
+    _OUT(stdout,"*************************************\n");
+}
+int main (int argc, char *argv[]){
+    int    idx;
+    UINT   jdx;
+    FILE   *output;
+    BOOL have_filename=FALSE;
+    BOOL have_layer=FALSE;
+    UINT layer=0,max_rank=0;
+    DOUBLE energy=0.99,kept;
+    UINT kdx,n_hiddens,N,M,rank;
+    UINT64 dense_ops=0,lowrank_ops=0;
+    UINT n_loop=10;
+#ifndef _CUDA
+    UINT n_tests=0,n_out,p_dense=0,p_lowrank;
+    DOUBLE t_dense=0.,t_lowrank,diff;
+#endif /*_CUDA*/
+    DOUBLE *t_in=NULL,*t_out=NULL,*r_dense=NULL,*r_lowrank=NULL;
+#ifdef _OMP
+    UINT  n_o, n_b;
+#endif /*_OMP*/
+    CHAR *nn_filename = NULL;
+    nn_def    *neural = NULL;
+    /*init all*/
+    _NN(init,all)(1);
+/*parse arguments*/
+    idx=1;
+    while(idx<argc){
+        if(argv[idx][0]=='-'){
+            /*switch detected*/
+            jdx=1;
+            while(ISGRAPH(argv[idx][jdx])){
+                switch (argv[idx][jdx]){
+                case 'h':
+                    dump_help();
+                    _NN(deinit,all)();
+                    FREE(nn_filename);
+                    return 0;
+                case 'v':
+                    _NN(inc,verbose)();
+                    jdx++;
+                    break;
+                case 'l':
+                    if(!get_switch_uint(argc,argv,&idx,jdx,&layer)){
+                        _OUT(stderr,"syntax error: bad -l parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    have_layer=TRUE;
+                    goto next_arg;/*no combination is allowed*/
+                case 'e':
+                    if((!get_switch_double(argc,argv,&idx,jdx,&energy))
+                        ||(energy<=0.)||(energy>1.)){
+                        _OUT(stderr,"syntax error: bad -e parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                case 'r':
+                    if(!get_switch_uint(argc,argv,&idx,jdx,&max_rank)){
+                        _OUT(stderr,"syntax error: bad -r parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                case 't':
+                    if(!get_switch_uint(argc,argv,&idx,jdx,&n_loop)){
+                        _OUT(stderr,"syntax error: bad -t parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+#ifdef _OMP
+                case 'O':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_o))
+                        ||(n_o==0)){
+                        _OUT(stderr,"syntax error: bad -O parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_threads)(n_o);
+                    goto next_arg;
+                case 'B':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_b))
+                        ||(n_b==0)){
+                        _OUT(stderr,"syntax error: bad -B parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_blas)(n_b);
+                    goto next_arg;
+#endif /*_OMP*/
+                default:
+                    _OUT(stderr,"syntax error: unrecognized option!\n");
+                    dump_help();
+                    goto FAIL;
+                }
+            }
+        }else{
+            /*not a switch, then must be a file name!*/
+            if(have_filename) goto FAIL;
+            STRDUP(argv[idx],nn_filename);
+            have_filename=TRUE;/*only 1 allowed*/
+        }
+next_arg:
+        idx++;
+    }
+    if(nn_filename==NULL) STRDUP("./nn.conf",nn_filename);
+    /*load configuration file*/
+    neural=_NN(load,conf)(nn_filename);
+    FREE(nn_filename);
+    if(neural==NULL) {
+        _OUT(stderr,"FAILED to read NN configuration file! (ABORTING)\n");
+        goto FAIL;
+    }
+    n_hiddens=_NN(get,n_hiddens)(neural);
+    if(have_layer&&(layer>n_hiddens)){
+        _OUT(stderr,"bad -l parameter: kernel has %i hidden layer(s)!\n",
+            n_hiddens);
+        goto FAIL;
+    }
+#ifndef _CUDA
+    /*run the tests through the original kernel*/
+    n_out=_NN(get,n_outputs)(neural);
+    if(n_loop>0) n_tests=_NN(read,tests)(neural,&t_in,&t_out);
+    if(n_tests>0){
+        ALLOC(r_dense,(UINT64)n_tests*n_out,DOUBLE);
+        ALLOC(r_lowrank,(UINT64)n_tests*n_out,DOUBLE);
+        t_dense=run_tests(neural,NULL,n_tests,t_in,n_loop,r_dense);
+        p_dense=count_pass(n_tests,n_out,t_out,r_dense);
+    }
+#endif /*_CUDA*/
+    /*factorize, kdx==n_hiddens is the output*/
+    M=_NN(get,n_inputs)(neural);
+    for(kdx=0;kdx<=n_hiddens;kdx++){
+        if(kdx<n_hiddens) N=_NN(get,h_neurons)(neural,kdx);
+        else N=_NN(get,n_outputs)(neural);
+        dense_ops+=(UINT64)N*M;
+        if(have_layer&&(kdx!=layer)){
+            lowrank_ops+=(UINT64)N*M;
+            M=N;
+            continue;
+        }
+        rank=_NN(lowrank,kernel)(neural,kdx,energy,max_rank,&kept);
+        if(rank==0){
+            _OUT(stdout,"layer %i: %i x %i kept dense (%.2f%% energy)\n",
+                kdx,N,M,100.*kept);
+            lowrank_ops+=(UINT64)N*M;
+        }else{
+            _OUT(stdout,"layer %i: %i x %i -> rank %i (%.2f%% energy)",
+                kdx,N,M,rank,100.*kept);
+            _OUT(stdout," %" PRIu64 " -> %" PRIu64 " mult-add\n",
+                (UINT64)N*M,(UINT64)rank*(N+M));
+            lowrank_ops+=(UINT64)rank*(N+M);
+        }
+        M=N;
+    }
+    _OUT(stdout,"kernel: %" PRIu64 " -> %" PRIu64 " mult-add per run (x%.2f)\n",
+        dense_ops,lowrank_ops,(DOUBLE)dense_ops/(DOUBLE)lowrank_ops);
+#ifndef _CUDA
+    /*same tests through the factorized kernel*/
+    if(n_tests>0){
+        t_lowrank=run_tests(neural,NULL,n_tests,t_in,n_loop,r_lowrank);
+        p_lowrank=count_pass(n_tests,n_out,t_out,r_lowrank);
+        diff=0.;
+        for(idx=0;idx<(int)(n_tests*n_out);idx++)
+            if(fabs(r_lowrank[idx]-r_dense[idx])>diff)
+                diff=fabs(r_lowrank[idx]-r_dense[idx]);
+        _OUT(stdout,"original:   %i/%i PASS (%.2f%%) %.4f ms/run\n",
+            p_dense,n_tests,100.*p_dense/n_tests,1E3*t_dense);
+        _OUT(stdout,"factorized: %i/%i PASS (%.2f%%) %.4f ms/run\n",
+            p_lowrank,n_tests,100.*p_lowrank/n_tests,1E3*t_lowrank);
+        _OUT(stdout,"accuracy: %+.2f%%, max output change: %.3e,",
+            100.*((DOUBLE)p_lowrank-(DOUBLE)p_dense)/n_tests,diff);
+        _OUT(stdout," speedup: x%.2f\n",t_dense/t_lowrank);
+    }else if(n_loop>0) _OUT(stdout,"no test to run!\n");
+#endif /*_CUDA*/
+    /*save the factorized kernel*/
+    output=fopen("kernel.lowrank","w");
+    if(output==NULL){
+        _OUT(stderr,"FAILED to open kernel.lowrank for WRITE!\n");
+        goto FAIL;
+    }
+    _NN(dump,kernel)(neural,output);
+    fclose(output);
+    /*deinit*/
+    FREE(t_in);
+    FREE(t_out);
+    FREE(r_dense);
+    FREE(r_lowrank);
+    _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    return 0;
+FAIL:
+    FREE(t_in);
+    FREE(t_out);
+    FREE(r_dense);
+    FREE(r_lowrank);
+    if(neural!=NULL) _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    FREE(nn_filename);
+    return -1;
+}
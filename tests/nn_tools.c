@@ -0,0 +1,115 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - helpers shared by the test applications +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+/* Command line and test run helpers.             */
+/* --------------- Hubert Okadome Valencia, 2019 */
+
+#include "nn_tools.h"
+
+/*^^^ read the value of switch argv[*idx][jdx], either -XN or -X N*/
+BOOL get_switch_uint(int argc,char *argv[],int *idx,UINT jdx,UINT *value){
+    CHAR *tmp,*ptr;
+    tmp=&(argv[*idx][jdx]);
+    if(!ISGRAPH(*(tmp+1))){
+        /*we are having separated -X N*/
+        (*idx)++;
+        if(*idx>=argc) return FALSE;
+        tmp=&(argv[*idx][0]);
+        SKIP_BLANK(tmp);
+    }else{
+        /*we have -XN*/
+        tmp++;
+    }
+    if(!ISDIGIT(*tmp)) return FALSE;
+    GET_UINT(*value,tmp,ptr);
+    return TRUE;
+}
+/*^^^ same for a DOUBLE value*/
+BOOL get_switch_double(int argc,char *argv[],int *idx,UINT jdx,DOUBLE *value){
+    CHAR *tmp,*ptr;
+    tmp=&(argv[*idx][jdx]);
+    if(!ISGRAPH(*(tmp+1))){
+        (*idx)++;
+        if(*idx>=argc) return FALSE;
+        tmp=&(argv[*idx][0]);
+        SKIP_BLANK(tmp);
+    }else{
+        tmp++;
+    }
+    GET_DOUBLE(*value,tmp,ptr);
+    return (ptr!=tmp);
+}
+/*^^^ number of the n results res for which the highest output is the
+ * expected (ie. the highest) one of out.*/
+UINT count_pass(UINT n,UINT n_out,const DOUBLE *out,const DOUBLE *res){
+    UINT idx,jdx,guess,is_ok,n_pass=0;
+    for(idx=0;idx<n;idx++){
+        guess=0;
+        is_ok=0;
+        for(jdx=1;jdx<n_out;jdx++){
+            if(res[(UINT64)idx*n_out+jdx]>res[(UINT64)idx*n_out+guess])
+                guess=jdx;
+            if(out[(UINT64)idx*n_out+jdx]>out[(UINT64)idx*n_out+is_ok])
+                is_ok=jdx;
+        }
+        if(guess==is_ok) n_pass++;
+    }
+    return n_pass;
+}
+/*^^^ run the n inputs n_loop times through the kernel of neural (sparse==NULL)
+ * or through the sparse one. The outputs of the last pass are put in res
+ * (n x n_outputs). Return the time of one run.*/
+DOUBLE run_tests(nn_def *neural,kernel_sparse *sparse,UINT n,const DOUBLE *in,
+                 UINT n_loop,DOUBLE *res){
+    kernel_ann *kernel=(kernel_ann *)(neural->kernel);
+    BOOL is_ann=(_NN(return,type)(neural)==NN_TYPE_ANN);
+    UINT n_in=kernel->n_inputs,n_out=kernel->n_outputs;
+    UINT idx,loop;
+    const DOUBLE *p_in;
+    DOUBLE t0,*p_res,*k_in,*k_out;
+    if(sparse==NULL){
+        k_in=kernel->in;
+        k_out=kernel->output.vec;
+    }else{
+        k_in=sparse->in;
+        k_out=sparse->output.vec;
+    }
+    t0=ann_wtime();
+    for(loop=0;loop<n_loop;loop++){
+        for(idx=0;idx<n;idx++){
+            p_in=&(in[(UINT64)idx*n_in]);
+            ARRAY_CP(p_in,k_in,n_in);
+            if(sparse==NULL){
+                if(is_ann) ann_kernel_run(kernel);
+                else snn_kernel_run(kernel);
+            }else{
+                if(is_ann) sparse_ann_run(sparse);
+                else sparse_snn_run(sparse);
+            }
+            if(loop+1<n_loop) continue;
+            p_res=&(res[(UINT64)idx*n_out]);
+            ARRAY_CP(k_out,p_res,n_out);
+        }
+    }
+    return (ann_wtime()-t0)/((DOUBLE)n_loop*(DOUBLE)n);
+}
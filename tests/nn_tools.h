@@ -0,0 +1,33 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - helpers shared by the test applications +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#ifndef NN_TOOLS_H
+#define NN_TOOLS_H
+
+#include <libhpnn.h>
+#include <libhpnn/ann.h>
+#include <libhpnn/snn.h>
+#include <libhpnn/sparse.h>
+
+BOOL get_switch_uint(int argc,char *argv[],int *idx,UINT jdx,UINT *value);
+BOOL get_switch_double(int argc,char *argv[],int *idx,UINT jdx,DOUBLE *value);
+UINT count_pass(UINT n,UINT n_out,const DOUBLE *out,const DOUBLE *res);
+DOUBLE run_tests(nn_def *neural,kernel_sparse *sparse,UINT n,const DOUBLE *in,
+                 UINT n_loop,DOUBLE *res);
+
+#endif /*NN_TOOLS_H*/
@@ -0,0 +1,228 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - parse_nn test application +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Artificial Neuron Network number parsing.      */
+/* --------------- Hubert Okadome Valencia, 2019 */
+
+#include "nn_tools.h"
+
+void dump_help(){
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"usage:  parse_nn [-options] [input]\n");
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"options:\n");
+    _OUT(stdout,"-h \tdisplay this help;\n");
+    _OUT(stdout,"-v \tincrease verbosity;\n");
+    _OUT(stdout,"-n \tnumber of generated values\n");
+    _OUT(stdout,"   \t(1000000);\n");
+    _OUT(stdout,"-t \tnumber of timed passes (10).\n");
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"input: a sample or kernel file. If\n");
+    _OUT(stdout,"none is given, parse.bench is made\n");
+    _OUT(stdout,"with -n values in the kernel and in\n");
+    _OUT(stdout,"the sample notations. All numbers\n");
+    _OUT(stdout,"of the file are parsed by both the\n");
+    _OUT(stdout,"library parser and strtod, and the\n");
+    _OUT(stdout,"speed of each is reported in MB/s.\n");
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"Code released 'as is' within GPLv3.\n");
+    _OUT(stdout,"here: https://github.com/ovhpa/hpnn\n");
+    _OUT(stdout,"- project started 2019~   -- OVHPA.\n");
+    _OUT(stdout,"***********************************\n");
+}
+/*^^^ write n values in [-1,1], 30 per line, the lines being alternately in
+ * the kernel (%17.15f) and sample (%7.5f) notations.*/
+BOOL write_bench(const CHAR *filename,UINT n){
+    FILE *fp;
+    DOUBLE val;
+    UINT idx;
+    fp=fopen(filename,"w");
+    if(fp==NULL) return FALSE;
+    srand(10);
+    for(idx=0;idx<n;idx++){
+        val=2.*(DOUBLE)rand()/(DOUBLE)RAND_MAX-1.;
+        if((idx/30)%2) fprintf(fp,"%7.5f",val);
+        else fprintf(fp,"%17.15f",val);
+        if(((idx+1)%30==0)||(idx+1==n)) fprintf(fp,"\n");
+        else fprintf(fp," ");
+    }
+    fclose(fp);
+    return TRUE;
+}
+/*^^^ read the whole file in memory (NUL terminated), its size in *size*/
+CHAR *read_bench(const CHAR *filename,UINT64 *size){
+    FILE *fp;
+    CHAR *buf;
+    long len;
+    *size=0;
+    fp=fopen(filename,"r");
+    if(fp==NULL) return NULL;
+    fseek(fp,0L,SEEK_END);
+    len=ftell(fp);
+    rewind(fp);
+    if(len<=0){
+        fclose(fp);
+        return NULL;
+    }
+    ALLOC(buf,len+1,CHAR);
+    *size=(UINT64)fread(buf,sizeof(CHAR),len,fp);
+    buf[*size]='\0';
+    fclose(fp);
+    return buf;
+}
+/*^^^ parse all numbers in buf, with _NN(parse,double) when is_fast or with
+ * STR2D otherwise. The first max_val values are put in val (if not NULL).
+ * Return the number of values.*/
+UINT64 parse_bench(const CHAR *buf,BOOL is_fast,DOUBLE *val,UINT64 max_val){
+    CHAR *ptr,*end;
+    DOUBLE d;
+    UINT64 n=0;
+    ptr=(CHAR *)buf;
+    while(*ptr!='\0'){
+        while(ISSPACE(*ptr)) ptr++;
+        if(*ptr=='\0') break;
+        if(is_fast) NN_GET_DOUBLE(d,ptr,end);
+        else GET_DOUBLE(d,ptr,end);
+        if(end==ptr){
+            /*not a number (keyword, separator, etc.)*/
+            ptr++;
+            continue;
+        }
+        if((val!=NULL)&&(n<max_val)) val[n]=d;
+        n++;
+        ptr=end;
+    }
+    return n;
+}
+int main (int argc, char *argv[]){
+    int    idx;
+    UINT   jdx;
+    BOOL have_filename=FALSE;
+    UINT n_gen=1000000,n_loop=10,loop;
+    UINT64 size,n_val,n_fast=0,n_diff,kdx;
+    DOUBLE t0,t_std,t_fast;
+    DOUBLE *v_std=NULL,*v_fast=NULL;
+    CHAR *buf=NULL;
+    CHAR *nn_filename = NULL;
+    /*init all*/
+    _NN(init,all)(1);
+/*parse arguments*/
+    idx=1;
+    while(idx<argc){
+        if(argv[idx][0]=='-'){
+            /*switch detected*/
+            jdx=1;
+            while(ISGRAPH(argv[idx][jdx])){
+                switch (argv[idx][jdx]){
+                case 'h':
+                    dump_help();
+                    _NN(deinit,all)();
+                    FREE(nn_filename);
+                    return 0;
+                case 'v':
+                    _NN(inc,verbose)();
+                    jdx++;
+                    break;
+                case 'n':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_gen))
+                        ||(n_gen==0)){
+                        _OUT(stderr,"syntax error: bad -n parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;/*no combination is allowed*/
+                case 't':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_loop))
+                        ||(n_loop==0)){
+                        _OUT(stderr,"syntax error: bad -t parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                default:
+                    _OUT(stderr,"syntax error: unrecognized option!\n");
+                    dump_help();
+                    goto FAIL;
+                }
+            }
+        }else{
+            /*not a switch, then must be a file name!*/
+            if(have_filename) goto FAIL;
+            STRDUP(argv[idx],nn_filename);
+            have_filename=TRUE;/*only 1 allowed*/
+        }
+next_arg:
+        idx++;
+    }
+    if(nn_filename==NULL){
+        STRDUP("./parse.bench",nn_filename);
+        if(!write_bench(nn_filename,n_gen)){
+            _OUT(stderr,"FAILED to write %s!\n",nn_filename);
+            goto FAIL;
+        }
+    }
+    buf=read_bench(nn_filename,&size);
+    if(buf==NULL){
+        _OUT(stderr,"FAILED to read %s!\n",nn_filename);
+        goto FAIL;
+    }
+    /*reference values*/
+    n_val=parse_bench(buf,FALSE,NULL,0);
+    _OUT(stdout,"file %s: %" PRIu64 " bytes, %" PRIu64 " values\n",
+        nn_filename,size,n_val);
+    if(n_val==0) goto FAIL;
+    ALLOC(v_std,n_val,DOUBLE);
+    ALLOC(v_fast,n_val,DOUBLE);
+    /*time both parsers*/
+    t0=ann_wtime();
+    for(loop=0;loop<n_loop;loop++) parse_bench(buf,FALSE,v_std,n_val);
+    t_std=(ann_wtime()-t0)/(DOUBLE)n_loop;
+    t0=ann_wtime();
+    for(loop=0;loop<n_loop;loop++)
+        n_fast=parse_bench(buf,TRUE,v_fast,n_val);
+    t_fast=(ann_wtime()-t0)/(DOUBLE)n_loop;
+    n_diff=0;
+    for(kdx=0;kdx<n_val;kdx++) if(v_std[kdx]!=v_fast[kdx]) n_diff++;
+    _OUT(stdout,"strtod:           %10.2f MB/s\n",1E-6*size/t_std);
+    _OUT(stdout,"_NN(parse,double): %9.2f MB/s (x%.2f)\n",
+        1E-6*size/t_fast,t_std/t_fast);
+    if(n_fast!=n_val)
+        _OUT(stdout,"parsed %" PRIu64 " values instead of %" PRIu64 "!\n",
+            n_fast,n_val);
+    _OUT(stdout,"%" PRIu64 " value(s) differ from strtod\n",n_diff);
+    /*deinit*/
+    FREE(v_std);
+    FREE(v_fast);
+    FREE(buf);
+    FREE(nn_filename);
+    _NN(deinit,all)();
+    return 0;
+FAIL:
+    FREE(v_std);
+    FREE(v_fast);
+    FREE(buf);
+    _NN(deinit,all)();
+    FREE(nn_filename);
+    return -1;
+}
@@ -0,0 +1,240 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - prune_nn test application +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Artificial Neuron Network structured pruning. */
+/* --------------- Hubert Okadome Valencia, 2019 */
+
+#include "nn_tools.h"
+
+void dump_help(){
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"usage:  prune_nn [-options] [input]\n");
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"options:\n");
+    _OUT(stdout,"-h \tdisplay this help;\n");
+    _OUT(stdout,"-v \tincrease verbosity;\n");
+    _OUT(stdout,"-l \thidden layer to prune (all);\n");
+    _OUT(stdout,"-n \tneurons removed per step (1);\n");
+    _OUT(stdout,"-s \tnumber of pruning steps (1);\n");
+    _OUT(stdout,"-f \ttraining passes per step (0);\n");
+    _OUT(stdout,"-a \trank by activation variance.\n");
+#ifdef _OMP
+    _OUT(stdout,"-O \tnumber of openMP threads.\n");
+    _OUT(stdout,"-B \tnumber of BLAS threads (MKL).\n");
+#endif
+#ifdef _CUDA
+    _OUT(stdout,"-S \tnumber of CUDA streams.\n");
+#endif
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"input:     neural network .def file\n");
+    _OUT(stdout,"contains the network definition and\n");
+    _OUT(stdout,"the (trained) kernel to be pruned.\n");
+    _OUT(stdout,"Neurons are ranked by the norm of\n");
+    _OUT(stdout,"their outgoing weights, unless -a,\n");
+    _OUT(stdout,"the weakest are removed and result\n");
+    _OUT(stdout,"is written to kernel.prune\n");
+    _OUT(stdout,"***********************************\n");
+    _OUT(stdout,"Code released 'as is' within GPLv3.\n");
+    _OUT(stdout,"here: https://github.com/ovhpa/hpnn\n");
+    _OUT(stdout,"- project started 2019~   -- OVHPA.\n");
+    _OUT(stdout,"***********************************\n");
+}
+int main (int argc, char *argv[]){
+    int    idx;
+    UINT   jdx;
+    FILE   *output;
+    BOOL have_filename=FALSE;
+    BOOL have_layer=FALSE;
+    UINT layer=0,n_remove=1,n_steps=1,n_tune=0;
+    UINT step,kdx,n_hiddens,n_neurons;
+    nn_prune criterion=NN_PRUNE_NORM;
+#ifdef _OMP
+    UINT  n_o, n_b;
+#endif /*_OMP*/
+#ifdef _CUDA
+    UINT n_s=0;
+#endif /*_CUDA*/
+    CHAR *nn_filename = NULL;
+    nn_def    *neural = NULL;
+    /*init all*/
+    _NN(init,all)(1);
+/*parse arguments*/
+    idx=1;
+    while(idx<argc){
+        if(argv[idx][0]=='-'){
+            /*switch detected*/
+            jdx=1;
+            while(ISGRAPH(argv[idx][jdx])){
+                switch (argv[idx][jdx]){
+                case 'h':
+                    dump_help();
+                    _NN(deinit,all)();
+                    FREE(nn_filename);
+                    return 0;
+                case 'v':
+                    _NN(inc,verbose)();
+                    jdx++;
+                    break;
+                case 'a':
+                    criterion=NN_PRUNE_VARIANCE;
+                    jdx++;
+                    break;
+                case 'l':
+                    if(!get_switch_uint(argc,argv,&idx,jdx,&layer)){
+                        _OUT(stderr,"syntax error: bad -l parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    have_layer=TRUE;
+                    goto next_arg;/*no combination is allowed*/
+                case 'n':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_remove))
+                        ||(n_remove==0)){
+                        _OUT(stderr,"syntax error: bad -n parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                case 's':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_steps))
+                        ||(n_steps==0)){
+                        _OUT(stderr,"syntax error: bad -s parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                case 'f':
+                    if(!get_switch_uint(argc,argv,&idx,jdx,&n_tune)){
+                        _OUT(stderr,"syntax error: bad -f parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+#ifdef _OMP
+                case 'O':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_o))
+                        ||(n_o==0)){
+                        _OUT(stderr,"syntax error: bad -O parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_threads)(n_o);
+                    goto next_arg;
+                case 'B':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_b))
+                        ||(n_b==0)){
+                        _OUT(stderr,"syntax error: bad -B parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_blas)(n_b);
+                    goto next_arg;
+#endif /*_OMP*/
+#ifdef _CUDA
+                case 'S':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_s))
+                        ||(n_s==0)){
+                        _OUT(stderr,"syntax error: bad -S parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+#endif /*_CUDA*/
+                default:
+                    _OUT(stderr,"syntax error: unrecognized option!\n");
+                    dump_help();
+                    goto FAIL;
+                }
+            }
+        }else{
+            /*not a switch, then must be a file name!*/
+            if(have_filename) goto FAIL;
+            STRDUP(argv[idx],nn_filename);
+            have_filename=TRUE;/*only 1 allowed*/
+        }
+next_arg:
+        idx++;
+    }
+#ifdef _CUDA
+    if(n_s<1) n_s=1;
+    _NN(set,cuda_streams)(n_s);
+#endif
+    if(nn_filename==NULL) STRDUP("./nn.conf",nn_filename);
+    /*load configuration file*/
+    neural=_NN(load,conf)(nn_filename);
+    FREE(nn_filename);
+    if(neural==NULL) {
+        _OUT(stderr,"FAILED to read NN configuration file! (ABORTING)\n");
+        goto FAIL;
+    }
+    n_hiddens=_NN(get,n_hiddens)(neural);
+    if(have_layer&&(layer>=n_hiddens)){
+        _OUT(stderr,"bad -l parameter: kernel has %i hidden layer(s)!\n",
+            n_hiddens);
+        goto FAIL;
+    }
+    /*prune, then fine-tune*/
+    for(step=0;step<n_steps;step++){
+        for(kdx=0;kdx<n_hiddens;kdx++){
+            if(have_layer&&(kdx!=layer)) continue;
+            n_neurons=_NN(get,h_neurons)(neural,kdx);
+            if(n_remove>=n_neurons){
+                _OUT(stdout,"step %i: layer %i has only %i neurons left\n",
+                    step+1,kdx,n_neurons);
+                continue;
+            }
+            if(!_NN(prune,kernel)(neural,criterion,kdx,n_remove)){
+                _OUT(stderr,"FAILED to prune kernel!\n");
+                goto FAIL;
+            }
+            _OUT(stdout,"step %i: layer %i pruned to %i neurons\n",
+                step+1,kdx,_NN(get,h_neurons)(neural,kdx));
+        }
+        for(kdx=0;kdx<n_tune;kdx++){
+            if(!_NN(train,kernel)(neural)){
+                _OUT(stderr,"FAILED to train kernel!\n");
+                goto FAIL;
+            }
+        }
+    }
+    /*save the pruned kernel*/
+    output=fopen("kernel.prune","w");
+    if(output==NULL){
+        _OUT(stderr,"FAILED to open kernel.prune for WRITE!\n");
+        goto FAIL;
+    }
+    _NN(dump,kernel)(neural,output);
+    fclose(output);
+    /*deinit*/
+    _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    return 0;
+FAIL:
+    if(neural!=NULL) _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    FREE(nn_filename);
+    return -1;
+}
@@ -0,0 +1,300 @@
+/*
++++ libhpnn - High Performance Neural Network library
+            - sparse_nn test application +++
+    Copyright (C) 2019  Okadome Valencia Hubert
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+/* Artificial Neuron Network sparse kernels.      */
+/* --------------- Hubert Okadome Valencia, 2019 */
+
+#include "nn_tools.h"
+
+/*fraction of the weights dropped for each tested level (without -s)*/
+#define N_LEVELS 6
+static const DOUBLE levels[N_LEVELS]={0.,0.5,0.75,0.9,0.95,0.99};
+
+void dump_help(){
+    _OUT(stdout,"************************************\n");
+    _OUT(stdout,"usage:  sparse_nn [-options] [input]\n");
+    _OUT(stdout,"************************************\n");
+    _OUT(stdout,"options:\n");
+    _OUT(stdout,"-h \tdisplay this help;\n");
+    _OUT(stdout,"-v \tincrease verbosity;\n");
+    _OUT(stdout,"-s \tweight threshold (sweep);\n");
+    _OUT(stdout,"-b \tblock size (1);\n");
+    _OUT(stdout,"-t \ttimed passes over tests (10).\n");
+#ifdef _OMP
+    _OUT(stdout,"-O \tnumber of openMP threads.\n");
+    _OUT(stdout,"-B \tnumber of BLAS threads (MKL).\n");
+#endif
+    _OUT(stdout,"************************************\n");
+    _OUT(stdout,"input:      neural network .def file\n");
+    _OUT(stdout,"contains the network definition and\n");
+    _OUT(stdout,"the (trained) kernel to convert. The\n");
+    _OUT(stdout,"weights w with |w| > threshold are\n");
+    _OUT(stdout,"kept, by blocks of -b weights. With\n");
+    _OUT(stdout,"no -s, thresholds drop 0 to 99%% of\n");
+    _OUT(stdout,"the weights. Each sparse kernel is\n");
+    _OUT(stdout,"written to kernel.sparse, reloaded,\n");
+    _OUT(stdout,"and run on the tests (or on random\n");
+    _OUT(stdout,"inputs) against the dense kernel.\n");
+    _OUT(stdout,"************************************\n");
+    _OUT(stdout,"Code released 'as is' within GPLv3.\n");
+    _OUT(stdout,"here: https://github.com/ovhpa/hpnn\n");
+    _OUT(stdout,"- project started 2019~   -- OVHPA.\n");
+    _OUT(stdout,"************************************\n");
+}
+/*^^^ qsort comparison of two DOUBLE*/
+int cmp_double(const void *a,const void *b){
+    DOUBLE x=*(const DOUBLE *)a,y=*(const DOUBLE *)b;
+    return (x>y)-(x<y);
+}
+/*^^^ sorted |w| of all the weights of kernel, their number in *n_w*/
+DOUBLE *sort_weights(kernel_ann *kernel,UINT64 *n_w){
+    layer_ann *lay;
+    DOUBLE *w;
+    UINT64 idx,n=0,kdx;
+    UINT jdx;
+    *n_w=0;
+    for(jdx=0;jdx<=kernel->n_hiddens;jdx++){
+        if(jdx<kernel->n_hiddens) lay=&(kernel->hiddens[jdx]);
+        else lay=&(kernel->output);
+        n+=(UINT64)lay->n_neurons*lay->n_inputs;
+    }
+    ALLOC(w,n,DOUBLE);
+    kdx=0;
+    for(jdx=0;jdx<=kernel->n_hiddens;jdx++){
+        if(jdx<kernel->n_hiddens) lay=&(kernel->hiddens[jdx]);
+        else lay=&(kernel->output);
+        for(idx=0;idx<(UINT64)lay->n_neurons*lay->n_inputs;idx++)
+            w[kdx++]=fabs(lay->weights[idx]);
+    }
+    qsort(w,n,sizeof(DOUBLE),cmp_double);
+    *n_w=n;
+    return w;
+}
+int main (int argc, char *argv[]){
+    int    idx;
+    UINT   jdx;
+    BOOL have_filename=FALSE;
+    BOOL have_threshold=FALSE;
+    UINT block=1,n_loop=10,n_tests=0,n_in,n_out,n_levels,level;
+    UINT p_dense,p_sparse;
+    UINT64 n_w=0,kdx;
+    DOUBLE threshold=0.,t_dense,t_sparse,diff,reload;
+    DOUBLE *t_in=NULL,*t_out=NULL,*r_dense=NULL,*r_sparse=NULL,*w=NULL;
+    kernel_sparse *sparse=NULL,*loaded=NULL;
+#ifdef _OMP
+    UINT  n_o, n_b;
+#endif /*_OMP*/
+    CHAR *nn_filename = NULL;
+    nn_def    *neural = NULL;
+    /*init all*/
+    _NN(init,all)(1);
+/*parse arguments*/
+    idx=1;
+    while(idx<argc){
+        if(argv[idx][0]=='-'){
+            /*switch detected*/
+            jdx=1;
+            while(ISGRAPH(argv[idx][jdx])){
+                switch (argv[idx][jdx]){
+                case 'h':
+                    dump_help();
+                    _NN(deinit,all)();
+                    FREE(nn_filename);
+                    return 0;
+                case 'v':
+                    _NN(inc,verbose)();
+                    jdx++;
+                    break;
+                case 's':
+                    if((!get_switch_double(argc,argv,&idx,jdx,&threshold))
+                        ||(threshold<0.)){
+                        _OUT(stderr,"syntax error: bad -s parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    have_threshold=TRUE;
+                    goto next_arg;/*no combination is allowed*/
+                case 'b':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&block))
+                        ||(block==0)){
+                        _OUT(stderr,"syntax error: bad -b parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+                case 't':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_loop))
+                        ||(n_loop==0)){
+                        _OUT(stderr,"syntax error: bad -t parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    goto next_arg;
+#ifdef _OMP
+                case 'O':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_o))
+                        ||(n_o==0)){
+                        _OUT(stderr,"syntax error: bad -O parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_threads)(n_o);
+                    goto next_arg;
+                case 'B':
+                    if((!get_switch_uint(argc,argv,&idx,jdx,&n_b))
+                        ||(n_b==0)){
+                        _OUT(stderr,"syntax error: bad -B parameter!\n");
+                        dump_help();
+                        goto FAIL;
+                    }
+                    _NN(set,omp_blas)(n_b);
+                    goto next_arg;
+#endif /*_OMP*/
+                default:
+                    _OUT(stderr,"syntax error: unrecognized option!\n");
+                    dump_help();
+                    goto FAIL;
+                }
+            }
+        }else{
+            /*not a switch, then must be a file name!*/
+            if(have_filename) goto FAIL;
+            STRDUP(argv[idx],nn_filename);
+            have_filename=TRUE;/*only 1 allowed*/
+        }
+next_arg:
+        idx++;
+    }
+#ifdef _CUDA
+    _OUT(stderr,"sparse kernels are only available on CPU!\n");
+    goto FAIL;
+#endif /*_CUDA*/
+    if(nn_filename==NULL) STRDUP("./nn.conf",nn_filename);
+    /*load configuration file*/
+    neural=_NN(load,conf)(nn_filename);
+    FREE(nn_filename);
+    if(neural==NULL) {
+        _OUT(stderr,"FAILED to read NN configuration file! (ABORTING)\n");
+        goto FAIL;
+    }
+    n_in=_NN(get,n_inputs)(neural);
+    n_out=_NN(get,n_outputs)(neural);
+    /*tests, or random inputs checked against the dense kernel*/
+    n_tests=_NN(read,tests)(neural,&t_in,&t_out);
+    if(n_tests==0){
+        n_tests=100;
+        FREE(t_in);
+        FREE(t_out);
+        ALLOC(t_in,(UINT64)n_tests*n_in,DOUBLE);
+        srand(10);
+        for(kdx=0;kdx<(UINT64)n_tests*n_in;kdx++)
+            t_in[kdx]=2.*(DOUBLE)rand()/(DOUBLE)RAND_MAX-1.;
+        _OUT(stdout,"no test: %i random inputs, checked against dense\n",
+            n_tests);
+    }
+    ALLOC(r_dense,(UINT64)n_tests*n_out,DOUBLE);
+    ALLOC(r_sparse,(UINT64)n_tests*n_out,DOUBLE);
+    t_dense=run_tests(neural,NULL,n_tests,t_in,n_loop,r_dense);
+    if(t_out==NULL){
+        ALLOC(t_out,(UINT64)n_tests*n_out,DOUBLE);
+        ARRAY_CP(r_dense,t_out,(UINT64)n_tests*n_out);
+    }
+    p_dense=count_pass(n_tests,n_out,t_out,r_dense);
+    _OUT(stdout,"dense:  %i/%i PASS, %.4f ms/run\n",
+        p_dense,n_tests,1E3*t_dense);
+    /*thresholds*/
+    if(have_threshold) n_levels=1;
+    else {
+        n_levels=N_LEVELS;
+        w=sort_weights((kernel_ann *)(neural->kernel),&n_w);
+    }
+    _OUT(stdout," threshold  density   PASS     ms/run speedup max_diff\n");
+    for(level=0;level<n_levels;level++){
+        if(!have_threshold){
+            /*drop the levels[level] fraction of smallest weights*/
+            kdx=(UINT64)(levels[level]*(DOUBLE)n_w);
+            threshold=(kdx==0)?0.:w[kdx-1];
+        }
+        sparse=sparse_convert((kernel_ann *)(neural->kernel),threshold,block);
+        if(sparse==NULL){
+            _OUT(stderr,"FAILED to convert kernel!\n");
+            goto FAIL;
+        }
+        /*dump and reload*/
+        if(!sparse_dump(sparse,"kernel.sparse")){
+            _OUT(stderr,"FAILED to write kernel.sparse!\n");
+            goto FAIL;
+        }
+        loaded=sparse_load("kernel.sparse");
+        if(loaded==NULL){
+            _OUT(stderr,"FAILED to read kernel.sparse!\n");
+            goto FAIL;
+        }
+        run_tests(neural,sparse,n_tests,t_in,1,r_sparse);
+        t_sparse=run_tests(neural,loaded,n_tests,t_in,n_loop,r_dense);
+        reload=0.;
+        for(kdx=0;kdx<(UINT64)n_tests*n_out;kdx++)
+            if(fabs(r_dense[kdx]-r_sparse[kdx])>reload)
+                reload=fabs(r_dense[kdx]-r_sparse[kdx]);
+        if(reload>0.)
+            _OUT(stdout,"reloaded kernel differs by %.3e!\n",reload);
+        p_sparse=count_pass(n_tests,n_out,t_out,r_sparse);
+        /*dense outputs again, for the difference*/
+        run_tests(neural,NULL,n_tests,t_in,1,r_dense);
+        diff=0.;
+        for(kdx=0;kdx<(UINT64)n_tests*n_out;kdx++)
+            if(fabs(r_dense[kdx]-r_sparse[kdx])>diff)
+                diff=fabs(r_dense[kdx]-r_sparse[kdx]);
+        _OUT(stdout,"%10.3e %7.2f%% %4i/%-4i %9.4f %7.2f %.3e\n",
+            threshold,100.*sparse_density(loaded),p_sparse,n_tests,
+            1E3*t_sparse,t_dense/t_sparse,diff);
+        sparse_free(sparse);
+        sparse_free(loaded);
+        sparse=NULL;
+        loaded=NULL;
+    }
+    /*deinit*/
+    FREE(w);
+    FREE(t_in);
+    FREE(t_out);
+    FREE(r_dense);
+    FREE(r_sparse);
+    _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    return 0;
+FAIL:
+    if(sparse!=NULL) sparse_free(sparse);
+    if(loaded!=NULL) sparse_free(loaded);
+    FREE(w);
+    FREE(t_in);
+    FREE(t_out);
+    FREE(r_dense);
+    FREE(r_sparse);
+    if(neural!=NULL) _NN(deinit,conf)(neural);
+    FREE(neural);
+    _NN(deinit,all)();
+    FREE(nn_filename);
+    return -1;
+}